@@ -0,0 +1,145 @@
+#ifndef __LIBOAUTHCPP_ASYNC_VERIFY_BENCH_H__
+#define __LIBOAUTHCPP_ASYNC_VERIFY_BENCH_H__
+
+#include "benchutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace OAuthBench {
+
+/** Requests verified per second when every secret lookup takes a round
+ *  trip: one lookup per request with Verifier, or one per batch of 64 with
+ *  AsyncVerifier and a MemorySecretResolver. Requests come from 1000
+ *  consumers, so nothing is cached.
+ **/
+class AsyncVerifyBench {
+public:
+    static const int consumers = 1000;
+
+    /** A SecretStore that takes latency seconds to answer. */
+    class SlowSecretStore : public OAuth::SecretStore {
+    public:
+        SlowSecretStore(double latency) : mLatency(latency) {}
+        virtual bool consumerSecret(const std::string& consumerKey, std::string& secret) const {
+            wait(mLatency);
+            secret = "zzzzyyyyxxxxwwww";
+            return true;
+        }
+        virtual bool tokenSecret(const std::string& consumerKey, const std::string& token, std::string& secret) const {
+            return false;
+        }
+    private:
+        double mLatency;
+    };
+
+    class CountValid : public OAuth::VerificationCallback {
+    public:
+        CountValid() : valid(0) {}
+        virtual void verified(OAuth::Verification::Result result, const OAuth::VerificationBuffer& buffer) {
+            if (result == OAuth::Verification::Valid)
+                valid++;
+        }
+        int valid;
+    };
+
+    static void wait(double seconds) {
+        if (seconds <= 0)
+            return;
+#ifdef _WIN32
+        Sleep((DWORD)(seconds * 1000));
+#else
+        struct timespec ts;
+        ts.tv_sec = (time_t)seconds;
+        ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+#endif
+    }
+
+    static void run() {
+        OAuth::FixedClock clock(1390268986);
+        std::vector<std::string> headers;
+        for(int i = 0; i < consumers; i++) {
+            std::stringstream key;
+            key << "consumer" << i;
+            OAuth::Consumer consumer(key.str(), "zzzzyyyyxxxxwwww");
+            OAuth::Client oauth(&consumer);
+            OAuth::FixedNonceSource nonce(i);
+            oauth.setClock(&clock);
+            oauth.setNonceSource(&nonce);
+            headers.push_back(oauth.getHttpHeader(OAuth::Http::Get, url()));
+        }
+
+        const double latencies[] = { 0, 0.0001, 0.001, 0.005 };
+        for(std::size_t l = 0; l < sizeof(latencies) / sizeof(latencies[0]); l++) {
+            synchronous(latencies[l], clock, headers);
+            asynchronous(latencies[l], clock, headers);
+        }
+    }
+
+    static std::string url() {
+        return "http://api.example.com/1/statuses/home_timeline.json";
+    }
+
+    static std::string title(const std::string& name, double latency) {
+        std::stringstream s;
+        s << name << ", " << latency * 1000 << "ms lookups";
+        return s.str();
+    }
+
+    static void synchronous(double latency, const OAuth::FixedClock& clock, const std::vector<std::string>& headers) {
+        SlowSecretStore secrets(latency);
+        OAuth::Verifier verifier(&secrets);
+        verifier.setClock(&clock);
+        OAuth::VerificationBuffer buffer;
+        // About a quarter of a second at most
+        int iterations = latency > 0 ? (int)(0.25 / latency) : 20000;
+
+        double start = BenchUtil::now();
+        for(int it = 0; it < iterations; it++) {
+            if (verifier.verify(buffer, OAuth::Http::Get, url(), headers[it % headers.size()]) != OAuth::Verification::Valid) {
+                std::cerr << "Request did not verify" << std::endl;
+                std::exit(1);
+            }
+        }
+        double elapsed = BenchUtil::now() - start;
+        BenchUtil::report_ops(title("Verify", latency), iterations, elapsed);
+    }
+
+    static void asynchronous(double latency, const OAuth::FixedClock& clock, const std::vector<std::string>& headers) {
+        OAuth::MemorySecretResolver resolver(latency);
+        for(std::size_t i = 0; i < headers.size(); i++) {
+            std::stringstream key;
+            key << "consumer" << i;
+            resolver.addConsumer(key.str(), "zzzzyyyyxxxxwwww");
+        }
+        OAuth::Verifier verifier(NULL);
+        verifier.setClock(&clock);
+        CountValid counter;
+        const int iterations = 20000;
+
+        double start = BenchUtil::now();
+        {
+            OAuth::AsyncVerifier async(&verifier, &resolver, 64);
+            for(int it = 0; it < iterations; it++)
+                async.submit(OAuth::Http::Get, url(), headers[it % headers.size()], "", &counter);
+            async.drain();
+        }
+        double elapsed = BenchUtil::now() - start;
+        if (counter.valid != iterations) {
+            std::cerr << "Request did not verify" << std::endl;
+            std::exit(1);
+        }
+        BenchUtil::report_ops(title("AsyncVerifier, batches of 64", latency), iterations, elapsed);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef __LIBOAUTHCPP_BASE64_BENCH_H__
+#define __LIBOAUTHCPP_BASE64_BENCH_H__
+
+#include "benchutil.h"
+#include "../src/base64.h"
+
+namespace OAuthBench {
+
+/** Base64 throughput for signature sized digests and for large buffers.
+ **/
+class Base64Bench {
+public:
+    static void run() {
+        unsigned char digest[20];
+        for(int i = 0; i < 20; i++)
+            digest[i] = (unsigned char)(i * 37);
+
+        int iterations = 2000000;
+        double start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++) {
+            digest[0] = (unsigned char)i;
+            gSink += base64_encode(digest, 20)[3];
+        }
+        BenchUtil::report_ops("base64_encode 20B digest", iterations, BenchUtil::now() - start);
+
+        start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++) {
+            char encoded[BASE64_SHA1_DIGEST_LENGTH];
+            digest[0] = (unsigned char)i;
+            base64_encode_sha1_digest(digest, encoded);
+            gSink += encoded[3];
+        }
+        BenchUtil::report_ops("base64_encode_sha1_digest", iterations, BenchUtil::now() - start);
+
+        std::string data(1024 * 1024, '\0');
+        for(std::size_t i = 0; i < data.size(); i++)
+            data[i] = (char)(i * 131);
+        std::string encoded = base64_encode((const unsigned char*)data.data(), data.size());
+
+        iterations = 100;
+        start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++)
+            gSink += base64_encode((const unsigned char*)data.data(), data.size()).size();
+        BenchUtil::report_bytes("base64_encode 1MB", (double)data.size() * iterations, BenchUtil::now() - start);
+
+        start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++)
+            gSink += base64_decode(encoded).size();
+        BenchUtil::report_bytes("base64_decode 1MB", (double)encoded.size() * iterations, BenchUtil::now() - start);
+    }
+};
+
+}
+
+#endif
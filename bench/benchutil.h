@@ -0,0 +1,53 @@
+#ifndef __LIBOAUTHCPP_BENCHUTIL_H__
+#define __LIBOAUTHCPP_BENCHUTIL_H__
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <ctime>
+
+namespace OAuthBench {
+
+class BenchUtil {
+public:
+    /** Wall clock time in seconds, for measuring intervals. */
+    static double now() {
+#ifdef _WIN32
+        return (double)std::clock() / CLOCKS_PER_SEC;
+#else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    }
+
+    /** Report throughput of a benchmark that processed bytes in seconds. */
+    static void report_bytes(const std::string& name, double bytes, double seconds) {
+        std::cout << std::left << std::setw(48) << name << std::right
+                  << std::setw(12) << std::fixed << std::setprecision(1)
+                  << (bytes / seconds / (1024.0 * 1024.0)) << " MB/s" << std::endl;
+    }
+
+    /** Report the rate of a benchmark that performed ops operations in
+     *  seconds.
+     */
+    static void report_ops(const std::string& name, double ops, double seconds) {
+        std::cout << std::left << std::setw(48) << name << std::right
+                  << std::setw(12) << std::fixed << std::setprecision(0)
+                  << (ops / seconds) << " ops/s" << std::endl;
+    }
+
+    /** Report a measurement other than a rate, e.g. a size. */
+    static void report_value(const std::string& name, double value, const std::string& unit) {
+        std::cout << std::left << std::setw(48) << name << std::right
+                  << std::setw(12) << std::fixed << std::setprecision(1)
+                  << value << " " << unit << std::endl;
+    }
+};
+
+// Keeps the compiler from discarding a benchmarked result
+extern volatile unsigned int gSink;
+
+} // namespace OAuthBench
+
+#endif
@@ -0,0 +1,39 @@
+#include <iostream>
+#include "benchutil.h"
+#include "sha1_bench.h"
+#include "hmac_sha1_bench.h"
+#include "urlencode_bench.h"
+#include "parse_bench.h"
+#include "base64_bench.h"
+#include "sign_bench.h"
+#include "verify_bench.h"
+#include "async_verify_bench.h"
+#include "shared_credentials_bench.h"
+#include "replay_cache_bench.h"
+#ifndef _WIN32
+#include "shared_nonce_store_bench.h"
+#endif
+
+using namespace OAuthBench;
+
+namespace OAuthBench {
+volatile unsigned int gSink = 0;
+}
+
+int main(int argc, char** argv) {
+    SHA1Bench::run();
+    HMACSHA1Bench::run();
+    URLEncodeBench::run();
+    ParseBench::run();
+    Base64Bench::run();
+    SignBench::run();
+    VerifyBench::run();
+    AsyncVerifyBench::run();
+    SharedCredentialsBench::run();
+    ReplayCacheBench::run();
+#ifndef _WIN32
+    SharedNonceStoreBench::run();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef __LIBOAUTHCPP_PARSE_BENCH_H__
+#define __LIBOAUTHCPP_PARSE_BENCH_H__
+
+#include "benchutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+
+namespace OAuthBench {
+
+/** Parsing rates for a token response and an Authorization header, into a
+ *  KeyValuePairs map and in place with ParameterReader.
+ **/
+class ParseBench {
+public:
+    static void run() {
+        std::string response = "oauth_token=aaaabbbbccccdddd&oauth_token_secret=ddddccccbbbbaaaa"
+            "&oauth_callback_confirmed=true&user_id=1234567&screen_name=example";
+        std::string header = "OAuth realm=\"Example\", oauth_consumer_key=\"wwwwxxxxyyyyzzzz\", "
+            "oauth_nonce=\"7d8f3e4a\", oauth_signature=\"dL0PcWpqCbjKDRxMfxkHv1nDAjA%3D\", "
+            "oauth_signature_method=\"HMAC-SHA1\", oauth_timestamp=\"1390268986\", "
+            "oauth_token=\"aaaabbbbccccdddd\", oauth_version=\"1.0\"";
+        const int iterations = 200000;
+
+        double start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++)
+            gSink += OAuth::ParseKeyValuePairs(response).size();
+        BenchUtil::report_ops("ParseKeyValuePairs token response", iterations, BenchUtil::now() - start);
+
+        start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++)
+            gSink += read(response, OAuth::ParameterReader::UrlEncoded);
+        BenchUtil::report_ops("ParameterReader token response", iterations, BenchUtil::now() - start);
+
+        start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++)
+            gSink += OAuth::Token::extract(response).key().length();
+        BenchUtil::report_ops("Token::extract", iterations, BenchUtil::now() - start);
+
+        start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++)
+            gSink += read(header, OAuth::ParameterReader::AuthorizationHeader);
+        BenchUtil::report_ops("ParameterReader Authorization header", iterations, BenchUtil::now() - start);
+    }
+
+    static unsigned int read(const std::string& data, OAuth::ParameterReader::Format format) {
+        unsigned int total = 0;
+        OAuth::ParameterReader reader(data, format);
+        while (reader.next())
+            total += reader.valueLength();
+        return total;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef __LIBOAUTHCPP_REPLAY_CACHE_BENCH_H__
+#define __LIBOAUTHCPP_REPLAY_CACHE_BENCH_H__
+
+#include "benchutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <sstream>
+#include <vector>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace OAuthBench {
+
+/** Nonces recorded per second by a ReplayCache and a ReplayFilter, and the
+ *  memory each nonce takes once the window is full, at 50,000 requests per
+ *  (simulated) second.
+ **/
+class ReplayCacheBench {
+public:
+    static const int window = 30;
+    static const int rate = 50000;
+
+    struct Inserter {
+        OAuth::NonceStore* cache;
+        const std::vector<std::string>* nonces;
+        int thread;
+        int nthreads;
+        int seconds;
+    };
+
+    static void run() {
+        std::vector<std::string> nonces;
+        for(int i = 0; i < rate; i++) {
+            std::stringstream s;
+            s << "1390268986" << std::hex << (0x5deece66dULL * (i + 1));
+            nonces.push_back(s.str());
+        }
+
+        OAuth::ReplayCache cache(window);
+        insert("ReplayCache insert", &cache, 1, nonces);
+        BenchUtil::report_value("ReplayCache memory per nonce", (double)cache.memoryUsage() / cache.size(), "bytes");
+#ifndef _WIN32
+        OAuth::ReplayCache threadedCache(window);
+        insert("ReplayCache insert, 4 threads", &threadedCache, 4, nonces);
+#endif
+
+        filter("ReplayFilter", 0.01, nonces);
+        filter("ReplayFilter", 0.001, nonces);
+    }
+
+    static void filter(const std::string& name, double falsePositiveRate, const std::vector<std::string>& nonces) {
+        std::stringstream title;
+        title << name << " (" << falsePositiveRate * 100 << "% false positives)";
+        OAuth::ReplayFilter filter(window, rate, falsePositiveRate);
+        unsigned int before = gSink;
+        insert(title.str() + " insert", &filter, 1, nonces);
+
+        // Every nonce was new, so each one refused was a false positive. The
+        // filters fill up as they go, so the rate is lower than at the end.
+        double inserted = (double)(2 * window + 20) * nonces.size();
+        double held = (double)(2 * window + 1) * nonces.size();
+        BenchUtil::report_value(name + " memory per nonce", filter.memoryUsage() / held, "bytes");
+        BenchUtil::report_value(name + " false positives while filling", 100.0 * (inserted - (gSink - before)) / inserted, "%");
+        BenchUtil::report_value(name + " estimated false positives", 100.0 * filter.falsePositiveRate(), "%");
+    }
+
+    static void* insert_thread(void* arg) {
+        Inserter* inserter = (Inserter*)arg;
+        const std::vector<std::string>& nonces = *inserter->nonces;
+        for(int t = 0; t < inserter->seconds; t++) {
+            for(std::size_t i = inserter->thread; i < nonces.size(); i += inserter->nthreads)
+                gSink += inserter->cache->insert("wwwwxxxxyyyyzzzz", "aaaabbbbccccdddd", nonces[i], 1390268986 + t);
+        }
+        return NULL;
+    }
+
+    static void insert(const std::string& name, OAuth::NonceStore* cache, int nthreads, const std::vector<std::string>& nonces) {
+        // Long enough to fill the window and start reusing seconds
+        const int seconds = 2 * window + 20;
+        std::vector<Inserter> inserters(nthreads);
+        for(int t = 0; t < nthreads; t++) {
+            inserters[t].cache = cache;
+            inserters[t].nonces = &nonces;
+            inserters[t].thread = t;
+            inserters[t].nthreads = nthreads;
+            inserters[t].seconds = seconds;
+        }
+
+        double start = BenchUtil::now();
+#ifndef _WIN32
+        std::vector<pthread_t> ids(nthreads);
+        for(int t = 0; t < nthreads; t++)
+            pthread_create(&ids[t], NULL, insert_thread, &inserters[t]);
+        for(int t = 0; t < nthreads; t++)
+            pthread_join(ids[t], NULL);
+#else
+        insert_thread(&inserters[0]);
+#endif
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_ops(name, (double)seconds * nonces.size(), elapsed);
+    }
+};
+
+}
+
+#endif
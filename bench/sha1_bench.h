@@ -0,0 +1,53 @@
+#ifndef __LIBOAUTHCPP_SHA1_BENCH_H__
+#define __LIBOAUTHCPP_SHA1_BENCH_H__
+
+#include "benchutil.h"
+#include "../src/SHA1.h"
+
+namespace OAuthBench {
+
+/** Throughput of each SHA1 block transform supported by this CPU.
+ **/
+class SHA1Bench {
+public:
+    static void run() {
+        struct { int impl; const char* name; } impls[] = {
+            { CSHA1::TRANSFORM_SCALAR, "scalar" },
+            { CSHA1::TRANSFORM_SSSE3, "ssse3" },
+            { CSHA1::TRANSFORM_AVX2, "avx2" },
+            { CSHA1::TRANSFORM_SHANI, "sha-ni" }
+        };
+        int original = CSHA1::GetTransform();
+        for(std::size_t i = 0; i < sizeof(impls)/sizeof(impls[0]); i++) {
+            if (!CSHA1::SetTransform(impls[i].impl)) {
+                std::cout << "SHA1 " << impls[i].name << ": not supported" << std::endl;
+                continue;
+            }
+            throughput(std::string("SHA1 ") + impls[i].name + " 64B messages", 64, 200000);
+            throughput(std::string("SHA1 ") + impls[i].name + " 1KB messages", 1024, 50000);
+            throughput(std::string("SHA1 ") + impls[i].name + " 1MB messages", 1024 * 1024, 64);
+        }
+        CSHA1::SetTransform(original);
+    }
+
+    static void throughput(const std::string& name, std::size_t msg_size, int iterations) {
+        std::string msg(msg_size, 'x');
+        UINT_8 digest[20];
+
+        double start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++) {
+            CSHA1 sha;
+            sha.Update((const UINT_8*)msg.data(), msg.size());
+            sha.Final();
+            sha.GetHash(digest);
+            gSink += digest[0];
+        }
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_bytes(name, (double)msg_size * iterations, elapsed);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef __LIBOAUTHCPP_SHARED_CREDENTIALS_BENCH_H__
+#define __LIBOAUTHCPP_SHARED_CREDENTIALS_BENCH_H__
+
+#include "benchutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace OAuthBench {
+
+/** Requests signed per second with SharedCredentials, alone and on several
+ *  threads while other credentials are published as fast as they can be
+ *  built, and the time to publish a large set.
+ **/
+class SharedCredentialsBench {
+public:
+    static void run() {
+        sign("Sign GET, shared credentials", 1000);
+        publish("Publish 10000 tokens", 10000);
+#ifndef _WIN32
+        sign_threaded("Sign GET, shared, 4 threads", 4, false);
+        sign_threaded("Sign GET, shared, 4 threads, publishing", 4, true);
+#endif
+    }
+
+    static std::string url() {
+        return "http://api.example.com/1/statuses/home_timeline.json";
+    }
+
+    // The consumer, and tokens token0 to token<tokens - 1> with the secret
+    static OAuth::CredentialSet credentials(int tokens, const std::string& secret) {
+        OAuth::CredentialSet set;
+        set.addConsumer(OAuth::Consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww"));
+        for(int i = 0; i < tokens; i++) {
+            std::stringstream key;
+            key << "token" << i;
+            set.addToken("wwwwxxxxyyyyzzzz", OAuth::Token(key.str(), secret));
+        }
+        return set;
+    }
+
+    static void sign(const std::string& name, int tokens) {
+        OAuth::SharedCredentials shared(credentials(tokens, "ddddccccbbbbaaaa"));
+        OAuth::Client oauth(&shared, "wwwwxxxxyyyyzzzz", "token1");
+        oauth.setClock(&sClock);
+        oauth.setNonceSource(&sNonce);
+        OAuth::SigningBuffer buffer;
+        char out[1024];
+        const int iterations = 20000;
+
+        double start = BenchUtil::now();
+        for(int it = 0; it < iterations; it++)
+            gSink += oauth.getHttpHeader(buffer, out, sizeof(out), OAuth::Http::Get, url());
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_ops(name, iterations, elapsed);
+    }
+
+    static void publish(const std::string& name, int tokens) {
+        OAuth::CredentialSet set = credentials(tokens, "ddddccccbbbbaaaa");
+        OAuth::SharedCredentials shared;
+        const int iterations = 10;
+
+        double start = BenchUtil::now();
+        for(int it = 0; it < iterations; it++)
+            shared.publish(set);
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_value(name, elapsed / iterations * 1000, "ms");
+    }
+
+#ifndef _WIN32
+    struct Signer {
+        OAuth::Client* oauth;
+        // The header with each of the secrets that may be published
+        std::string expected[2];
+        int iterations;
+        int mismatches;
+        // Signers that have finished
+        volatile int* done;
+    };
+
+    static void* sign_thread(void* arg) {
+        Signer* signer = (Signer*)arg;
+        OAuth::SigningBuffer buffer;
+        char out[1024];
+        for(int it = 0; it < signer->iterations; it++) {
+            signer->oauth->getHttpHeader(buffer, out, sizeof(out), OAuth::Http::Get, url());
+            if (signer->expected[0] != out && signer->expected[1] != out)
+                signer->mismatches++;
+        }
+        __sync_fetch_and_add(signer->done, 1);
+        return NULL;
+    }
+
+    /** Signs on several threads at once, one Client per thread, checking
+     *  every header. With publishing, the main thread swaps between two
+     *  sets of secrets until the signers are done.
+     */
+    static void sign_threaded(const std::string& name, int nthreads, bool publishing) {
+        OAuth::CredentialSet sets[2] = {
+            credentials(1000, "ddddccccbbbbaaaa"),
+            credentials(1000, "aaaabbbbccccdddd")
+        };
+        OAuth::SharedCredentials shared(sets[0]);
+        std::vector<OAuth::FixedNonceSource*> nonces;
+        std::vector<OAuth::Client*> clients;
+        std::vector<Signer> signers(nthreads);
+        std::vector<pthread_t> ids(nthreads);
+        const int iterations = 20000;
+        volatile int done = 0;
+
+        for(int t = 0; t < nthreads; t++) {
+            nonces.push_back(new OAuth::FixedNonceSource(100 + t));
+            clients.push_back(new OAuth::Client(&shared, "wwwwxxxxyyyyzzzz", "token1"));
+            clients[t]->setClock(&sClock);
+            clients[t]->setNonceSource(nonces[t]);
+            signers[t].oauth = clients[t];
+            for(int s = 0; s < 2; s++) {
+                shared.publish(sets[s]);
+                signers[t].expected[s] = clients[t]->getHttpHeader(OAuth::Http::Get, url());
+            }
+            signers[t].iterations = iterations;
+            signers[t].mismatches = 0;
+            signers[t].done = &done;
+        }
+
+        std::size_t firstVersion = shared.version();
+        double start = BenchUtil::now();
+        for(int t = 0; t < nthreads; t++)
+            pthread_create(&ids[t], NULL, sign_thread, &signers[t]);
+        // Stop publishing once the first signer is done, so the rate is
+        // measured while it goes on
+        for(int i = 0; publishing && __sync_fetch_and_add(&done, 0) == 0; i++)
+            shared.publish(sets[i % 2]);
+        for(int t = 0; t < nthreads; t++)
+            pthread_join(ids[t], NULL);
+        double elapsed = BenchUtil::now() - start;
+
+        int mismatches = 0;
+        for(int t = 0; t < nthreads; t++) {
+            mismatches += signers[t].mismatches;
+            delete clients[t];
+            delete nonces[t];
+        }
+        if (mismatches) {
+            std::cerr << name << ": " << mismatches << " headers did not match" << std::endl;
+            std::exit(1);
+        }
+
+        BenchUtil::report_ops(name, (double)iterations * nthreads, elapsed);
+        if (publishing)
+            BenchUtil::report_value(name + ", swaps", (double)(shared.version() - firstVersion), "");
+    }
+#endif
+
+    static OAuth::FixedClock sClock;
+    static OAuth::FixedNonceSource sNonce;
+};
+
+OAuth::FixedClock SharedCredentialsBench::sClock(1390268986);
+OAuth::FixedNonceSource SharedCredentialsBench::sNonce(100);
+
+}
+
+#endif
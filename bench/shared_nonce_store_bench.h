@@ -0,0 +1,82 @@
+#ifndef __LIBOAUTHCPP_SHARED_NONCE_STORE_BENCH_H__
+#define __LIBOAUTHCPP_SHARED_NONCE_STORE_BENCH_H__
+
+#include "benchutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <sstream>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace OAuthBench {
+
+/** Nonces recorded per second by a SharedNonceStore, between all of 1 to 64
+ *  processes sharing it, at 50,000 requests per (simulated) second as in
+ *  ReplayCacheBench. Each process records its share of every second's
+ *  requests.
+ **/
+class SharedNonceStoreBench {
+public:
+    static const int window = 30;
+    static const int rate = 50000;
+
+    static void run() {
+        std::vector<std::string> nonces;
+        for(int i = 0; i < rate; i++) {
+            std::stringstream s;
+            s << "1390268986" << std::hex << (0x5deece66dULL * (i + 1));
+            nonces.push_back(s.str());
+        }
+
+        for(int nprocesses = 1; nprocesses <= 64; nprocesses *= 2)
+            insert(nprocesses, nonces);
+    }
+
+    static void insert(int nprocesses, const std::vector<std::string>& nonces) {
+        std::stringstream name;
+        name << "/liboauthcpp-bench-" << getpid();
+        OAuth::SharedNonceStore::remove(name.str());
+        OAuth::SharedNonceStore store(name.str(), window, rate);
+        OAuth::SharedNonceStore::remove(name.str());
+
+        // Long enough to fill the window and start reusing tables
+        const int seconds = 2 * window + 20;
+        // Processes start together when the pipe is closed
+        int start[2];
+        if (pipe(start) != 0)
+            return;
+        std::vector<pid_t> pids;
+        for(int p = 0; p < nprocesses; p++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                char c;
+                close(start[1]);
+                while (read(start[0], &c, 1) > 0) {}
+                unsigned int recorded = 0;
+                for(int t = 0; t < seconds; t++) {
+                    for(std::size_t i = p; i < nonces.size(); i += nprocesses)
+                        recorded += store.insert("wwwwxxxxyyyyzzzz", "aaaabbbbccccdddd", nonces[i], 1390268986 + t);
+                }
+                _exit(recorded == 0);
+            }
+            pids.push_back(pid);
+        }
+        close(start[0]);
+
+        double begin = BenchUtil::now();
+        close(start[1]);
+        for(std::size_t p = 0; p < pids.size(); p++)
+            waitpid(pids[p], NULL, 0);
+        double elapsed = BenchUtil::now() - begin;
+
+        std::stringstream title;
+        title << "SharedNonceStore insert, " << nprocesses << (nprocesses == 1 ? " process" : " processes");
+        BenchUtil::report_ops(title.str(), (double)seconds * nonces.size(), elapsed);
+        if (nprocesses == 1)
+            BenchUtil::report_value("SharedNonceStore memory per nonce", (double)store.memoryUsage() / store.size(), "bytes");
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef __LIBOAUTHCPP_SIGN_BENCH_H__
+#define __LIBOAUTHCPP_SIGN_BENCH_H__
+
+#include "benchutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <cstdlib>
+#include <vector>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace OAuthBench {
+
+/** Requests signed per second through the public Client API, for a small
+ *  request and one carrying a large form body. Each Client signs with a
+ *  fixed clock and nonce source, so runs are repeatable and the threaded
+ *  benchmark can check every result exactly.
+ **/
+class SignBench {
+public:
+    static void run() {
+        OAuth::Client::__resetInitialize();
+
+        std::string body;
+        for(int i = 0; i < 64; i++) {
+            if (i) body += "&";
+            body += "field" + std::string(1, (char)('a' + i % 26)) + "=some%20value%20with%20spaces";
+        }
+
+        sign("Sign GET no params", "http://api.example.com/1/statuses/home_timeline.json", "");
+        sign("Sign POST 64 params", "http://api.example.com/1/statuses/update.json", body);
+        sign_buffer("Sign GET no params, buffer", "http://api.example.com/1/statuses/home_timeline.json", "");
+        sign_buffer("Sign POST 64 params, buffer", "http://api.example.com/1/statuses/update.json", body);
+
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json?" + body;
+        sign("Sign GET 64+2 params", url + "&cursor=1234&page=2", "");
+        sign_prepared("Sign GET 64+2 params, prepared", url, "cursor=1234&page=2");
+#ifndef _WIN32
+        sign_threaded("Sign GET no params, 4 threads", 4, "http://api.example.com/1/statuses/home_timeline.json");
+#endif
+    }
+
+    static void sign(const std::string& name, const std::string& url, const std::string& data) {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        OAuth::Client oauth(&consumer, &token);
+        oauth.setClock(&sClock);
+        oauth.setNonceSource(&sNonce);
+        const int iterations = 20000;
+
+        double start = BenchUtil::now();
+        for(int it = 0; it < iterations; it++) {
+            std::string header = oauth.getHttpHeader(
+                data.empty() ? OAuth::Http::Get : OAuth::Http::Post, url, data);
+            gSink += header.length();
+        }
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_ops(name, iterations, elapsed);
+    }
+
+    static void sign_buffer(const std::string& name, const std::string& url, const std::string& data) {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        OAuth::Client oauth(&consumer, &token);
+        oauth.setClock(&sClock);
+        oauth.setNonceSource(&sNonce);
+        OAuth::SigningBuffer buffer;
+        char out[1024];
+        const int iterations = 20000;
+
+        double start = BenchUtil::now();
+        for(int it = 0; it < iterations; it++) {
+            gSink += oauth.getHttpHeader(buffer, out, sizeof(out),
+                data.empty() ? OAuth::Http::Get : OAuth::Http::Post, url, data);
+        }
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_ops(name, iterations, elapsed);
+    }
+
+    static void sign_prepared(const std::string& name, const std::string& url, const std::string& dynamicData) {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        OAuth::Client oauth(&consumer, &token);
+        oauth.setClock(&sClock);
+        oauth.setNonceSource(&sNonce);
+        OAuth::PreparedRequest request = oauth.prepare(OAuth::Http::Get, url);
+        const int iterations = 20000;
+
+        double start = BenchUtil::now();
+        for(int it = 0; it < iterations; it++) {
+            std::string header = oauth.getHttpHeader(request, dynamicData);
+            gSink += header.length();
+        }
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_ops(name, iterations, elapsed);
+    }
+
+#ifndef _WIN32
+    struct Signer {
+        OAuth::Client* oauth;
+        std::string url;
+        std::string expected;
+        int iterations;
+        int mismatches;
+    };
+
+    static void* sign_thread(void* arg) {
+        Signer* signer = (Signer*)arg;
+        OAuth::SigningBuffer buffer;
+        char out[1024];
+        for(int it = 0; it < signer->iterations; it++) {
+            signer->oauth->getHttpHeader(buffer, out, sizeof(out), OAuth::Http::Get, signer->url);
+            if (signer->expected != out)
+                signer->mismatches++;
+        }
+        return NULL;
+    }
+
+    /** Signs on several threads at once, one Client per thread with its own
+     *  fixed values, and checks every header against the one the Client
+     *  produced before the threads started.
+     */
+    static void sign_threaded(const std::string& name, int nthreads, const std::string& url) {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        std::vector<OAuth::FixedNonceSource*> nonces;
+        std::vector<OAuth::Client*> clients;
+        std::vector<Signer> signers(nthreads);
+        std::vector<pthread_t> ids(nthreads);
+        const int iterations = 20000;
+
+        for(int t = 0; t < nthreads; t++) {
+            nonces.push_back(new OAuth::FixedNonceSource(100 + t));
+            clients.push_back(new OAuth::Client(&consumer, &token));
+            clients[t]->setClock(&sClock);
+            clients[t]->setNonceSource(nonces[t]);
+            signers[t].oauth = clients[t];
+            signers[t].url = url;
+            signers[t].expected = clients[t]->getHttpHeader(OAuth::Http::Get, url);
+            signers[t].iterations = iterations;
+            signers[t].mismatches = 0;
+        }
+
+        double start = BenchUtil::now();
+        for(int t = 0; t < nthreads; t++)
+            pthread_create(&ids[t], NULL, sign_thread, &signers[t]);
+        for(int t = 0; t < nthreads; t++)
+            pthread_join(ids[t], NULL);
+        double elapsed = BenchUtil::now() - start;
+
+        int mismatches = 0;
+        for(int t = 0; t < nthreads; t++) {
+            mismatches += signers[t].mismatches;
+            delete clients[t];
+            delete nonces[t];
+        }
+        if (mismatches) {
+            std::cerr << name << ": " << mismatches << " headers did not match" << std::endl;
+            std::exit(1);
+        }
+
+        BenchUtil::report_ops(name, (double)iterations * nthreads, elapsed);
+    }
+#endif
+
+    static OAuth::FixedClock sClock;
+    static OAuth::FixedNonceSource sNonce;
+};
+
+OAuth::FixedClock SignBench::sClock(1390268986);
+OAuth::FixedNonceSource SignBench::sNonce(100);
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef __LIBOAUTHCPP_URLENCODE_BENCH_H__
+#define __LIBOAUTHCPP_URLENCODE_BENCH_H__
+
+#include "benchutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+
+namespace OAuthBench {
+
+/** Percent encoding and decoding throughput for typical parameter values:
+ *  mostly unreserved text, and text with a reserved character every few
+ *  bytes. Decoding is also measured on larger bodies, up to 1MB.
+ **/
+class URLEncodeBench {
+public:
+    static void run() {
+        std::string plain, mixed;
+        for(int i = 0; i < 1024; i++) {
+            plain += (char)('a' + i % 26);
+            mixed += (i % 8 == 7) ? ' ' : (char)('a' + i % 26);
+        }
+
+        throughput("PercentEncode 16B unreserved", plain.substr(0, 16), 2000000);
+        throughput("PercentEncode 1KB unreserved", plain, 200000);
+        throughput("PercentEncode 1KB 1/8 reserved", mixed, 200000);
+        throughput("HttpEncodePath 1KB 1/8 reserved", mixed, 200000, true);
+
+        std::string large, largeMixed;
+        for(int i = 0; i < 1024; i++) {
+            large += plain;
+            largeMixed += mixed;
+        }
+        std::string encoded = OAuth::PercentEncode(mixed);
+        std::string largeEncoded = OAuth::PercentEncode(largeMixed);
+        decode_throughput("PercentDecode 1KB unescaped", plain, 200000);
+        decode_throughput("PercentDecode 1KB 1/8 escaped", encoded, 200000);
+        decode_throughput("PercentDecode 64KB unescaped", large.substr(0, 65536), 4000);
+        decode_throughput("PercentDecode 1MB unescaped", large, 200);
+        decode_throughput("PercentDecode 1MB 1/8 escaped", largeEncoded, 200);
+        decode_throughput("PercentDecodeInPlace 1MB 1/8 escaped", largeEncoded, 200, true);
+    }
+
+    static void throughput(const std::string& name, const std::string& value, int iterations, bool path = false) {
+        double start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++) {
+            std::string encoded = path ? OAuth::HttpEncodePath(value) : OAuth::PercentEncode(value);
+            gSink += encoded.length();
+        }
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_bytes(name, (double)value.size() * iterations, elapsed);
+    }
+
+    /** In place, each iteration decodes a fresh copy, which is timed too. */
+    static void decode_throughput(const std::string& name, const std::string& value, int iterations,
+                                  bool inPlace = false) {
+        std::string copy;
+        double start = BenchUtil::now();
+        for(int i = 0; i < iterations; i++) {
+            if (inPlace) {
+                copy.assign(value);
+                gSink += OAuth::PercentDecodeInPlace(&copy[0], copy.length());
+            }
+            else {
+                gSink += OAuth::PercentDecode(value).length();
+            }
+        }
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_bytes(name, (double)value.size() * iterations, elapsed);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __LIBOAUTHCPP_VERIFY_BENCH_H__
+#define __LIBOAUTHCPP_VERIFY_BENCH_H__
+
+#include "benchutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <cstdlib>
+
+namespace OAuthBench {
+
+/** Requests verified per second, for requests signed by Client, building
+ *  the signing key each time or taking it from a CredentialCache.
+ */
+class VerifyBench {
+public:
+    class FixedSecretStore : public OAuth::SecretStore {
+    public:
+        virtual bool consumerSecret(const std::string& consumerKey, std::string& secret) const {
+            secret = "zzzzyyyyxxxxwwww";
+            return true;
+        }
+        virtual bool tokenSecret(const std::string& consumerKey, const std::string& token, std::string& secret) const {
+            secret = "ddddccccbbbbaaaa";
+            return true;
+        }
+    };
+
+    static void run() {
+        std::string body;
+        for(int i = 0; i < 64; i++) {
+            if (i) body += "&";
+            body += "field" + std::string(1, (char)('a' + i % 26)) + "=some%20value%20with%20spaces";
+        }
+
+        verify("Verify GET header, no params", OAuth::Http::Get, "http://api.example.com/1/statuses/home_timeline.json", "", false);
+        verify("Verify GET header, credential cache", OAuth::Http::Get, "http://api.example.com/1/statuses/home_timeline.json", "", true);
+        verify("Verify POST header, 64 params", OAuth::Http::Post, "http://api.example.com/1/statuses/update.json", body, false);
+    }
+
+    static void verify(const std::string& name, OAuth::Http::RequestType eType, const std::string& url, const std::string& data,
+                       bool cached) {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        OAuth::Client oauth(&consumer, &token);
+        OAuth::FixedClock clock(1390268986);
+        OAuth::FixedNonceSource nonce(100);
+        oauth.setClock(&clock);
+        oauth.setNonceSource(&nonce);
+        std::string header = oauth.getHttpHeader(eType, url, data);
+
+        FixedSecretStore secrets;
+        OAuth::Verifier verifier(&secrets);
+        verifier.setClock(&clock);
+        OAuth::CredentialCache cache(&secrets);
+        if (cached)
+            verifier.setCredentialCache(&cache);
+        OAuth::VerificationBuffer buffer;
+        const int iterations = 20000;
+
+        double start = BenchUtil::now();
+        for(int it = 0; it < iterations; it++) {
+            if (verifier.verify(buffer, eType, url, header, data) != OAuth::Verification::Valid) {
+                std::cerr << name << ": request did not verify" << std::endl;
+                std::exit(1);
+            }
+        }
+        double elapsed = BenchUtil::now() - start;
+
+        BenchUtil::report_ops(name, iterations, elapsed);
+    }
+};
+
+}
+
+#endif
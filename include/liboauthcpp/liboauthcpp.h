@@ -4,8 +4,10 @@
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 #include <stdexcept>
 #include <ctime>
+#include <cstddef>
 
 namespace OAuth {
 
@@ -67,6 +69,29 @@ std::string HttpEncodeQueryKey(const std::string& decoded);
  */
 std::string HttpEncodeQueryValue(const std::string& decoded);
 
+typedef enum _DecodeMode
+{
+    /** A '%' that isn't followed by two hex digits is an error */
+    DecodeStrict = 0,
+    /** A '%' that isn't followed by two hex digits is kept as it is */
+    DecodeLenient = 1
+} DecodeMode;
+
+/** Percent decode a string value, e.g. a value returned by
+ *  ParseKeyValuePairs or Token::extract. '+' is left alone, as it only
+ *  stands for a space in form encoded data.
+ *  \throws ParseError if mode is DecodeStrict and an escape is malformed
+ */
+std::string PercentDecode(const std::string& encoded, DecodeMode mode = DecodeStrict);
+
+/** Percent decode [data, data + length) in place. The decoded form is never
+ *  longer, so it is written over the start of data.
+ *  \returns the decoded length
+ *  \throws ParseError if mode is DecodeStrict and an escape is malformed.
+ *          data is then left partly decoded.
+ */
+std::size_t PercentDecodeInPlace(char* data, std::size_t length, DecodeMode mode = DecodeStrict);
+
 /** Parses key value pairs into a map.
  *  \param encoded the encoded key value pairs, i.e. the url encoded parameters
  *  \returns a map of string keys to string values
@@ -74,6 +99,66 @@ std::string HttpEncodeQueryValue(const std::string& decoded);
  */
 KeyValuePairs ParseKeyValuePairs(const std::string& encoded);
 
+/** Reads key value pairs in place, without copying them: url encoded data
+ *  (key=value&key=value...), or the parameters of an OAuth Authorization
+ *  header. Keys and values point into the data, which must stay valid while
+ *  they are used, and stay percent encoded unless decodeKey or decodeValue
+ *  is called.
+ */
+class ParameterReader {
+public:
+    enum Format {
+        /** url encoded data, e.g. a query string or form body */
+        UrlEncoded,
+        /** [Authorization:] OAuth key="value", key="value"... Values may be
+         *  quoted, and pairs are separated by commas and whitespace. The
+         *  realm is read like any other parameter.
+         */
+        AuthorizationHeader
+    };
+
+    /** \throws ParseError if format is AuthorizationHeader and the data
+     *          isn't an OAuth header
+     */
+    ParameterReader(const char* data, std::size_t length, Format format = UrlEncoded);
+    explicit ParameterReader(const char* data, Format format = UrlEncoded);
+    explicit ParameterReader(const std::string& data, Format format = UrlEncoded);
+
+    /** Move to the next pair.
+     *  \returns false when there are no more
+     *  \throws ParseError if the pair cannot be parsed
+     */
+    bool next();
+
+    const char* key() const { return mKey; }
+    std::size_t keyLength() const { return mKeyLength; }
+    const char* value() const { return mValue; }
+    std::size_t valueLength() const { return mValueLength; }
+
+    /** Whether the current key is key, compared as it is encoded. */
+    bool keyIs(const std::string& key) const;
+    /** Percent decode the current key or value, appending it to out.
+     *  \returns false if it has a malformed escape
+     */
+    bool decodeKey(std::string& out) const;
+    bool decodeValue(std::string& out) const;
+
+private:
+    void init(const char* data, std::size_t length, Format format);
+    void skipHeaderPrefix();
+    bool nextUrlEncoded();
+    bool nextHeaderParameter();
+
+    const char* mPos;
+    const char* mEnd;
+    Format mFormat;
+    bool mDone;
+    const char* mKey;
+    std::size_t mKeyLength;
+    const char* mValue;
+    std::size_t mValueLength;
+};
+
 class ParseError : public std::runtime_error {
 public:
     ParseError(const std::string msg)
@@ -150,17 +235,205 @@ private:
     std::string mPin;
 };
 
+/** A single request in a batch passed to Client::getHttpHeaders or
+ *  Client::getURLQueryStrings. The fields have the same meaning as the
+ *  arguments of the single request methods, e.g. Client::getHttpHeader.
+ */
+struct Request {
+    Request(const Http::RequestType eType_,
+            const std::string& rawUrl_,
+            const std::string& rawData_ = "",
+            const bool includeOAuthVerifierPin_ = false);
+
+    Http::RequestType eType;
+    std::string rawUrl;
+    std::string rawData;
+    bool includeOAuthVerifierPin;
+};
+typedef std::vector<Request> RequestList;
+
+class ParameterList;
+
+/** Computes the oauth_body_hash parameter of the OAuth Request Body Hash
+ *  extension, base64(SHA1(body)), for request bodies that are not form
+ *  encoded. The body is hashed as it is fed in, so it never needs to be held
+ *  in memory as a whole. Pass the result to Client::getHttpHeader.
+ */
+class BodyHash {
+public:
+    BodyHash();
+    ~BodyHash();
+
+    /** Hash the next chunk of the body. */
+    void update(const void* data, std::size_t len);
+    /** Hash the contents of a file. Regular files are memory mapped rather
+     *  than read into a buffer.
+     *
+     *  \returns false if the file could not be opened or read
+     */
+    bool updateFromFile(const std::string& path);
+    /** Hash everything that can be read from a file descriptor, from its
+     *  current position until end of file. Not available on Windows.
+     *
+     *  \returns false on a read error
+     */
+    bool updateFromFileDescriptor(int fd);
+
+    /** Get the base64 encoded hash. This finishes the hash: the body must
+     *  be complete before this is called, and no updates may follow.
+     */
+    std::string value() const;
+private:
+    BodyHash(const BodyHash&);
+    BodyHash& operator=(const BodyHash&);
+
+    struct State;
+    State* mState;
+};
+
+/** A request to an endpoint that is signed over and over with only a few
+ *  parameters changing, e.g. paging through results with a cursor. Made
+ *  once with Client::prepare: the url is percent encoded and the static
+ *  parameters are parsed, encoded and sorted up front, so each signature
+ *  only merges the nonce, timestamp and dynamic parameters into place.
+ *
+ *  A prepared request holds the consumer and token keys of the Client that
+ *  prepared it and must only be signed by that Client.
+ */
+class PreparedRequest {
+public:
+    PreparedRequest(const PreparedRequest& other);
+    PreparedRequest& operator=(const PreparedRequest& other);
+    ~PreparedRequest();
+private:
+    friend class Client;
+    PreparedRequest();
+
+    struct State;
+    State* mState;
+};
+
+/** Reusable scratch space for signing requests into caller supplied
+ *  buffers, see e.g. Client::getHttpHeader(SigningBuffer&, char*, ...).
+ *  Everything a signature is built in is kept here and reused, so once the
+ *  buffer has grown to fit the requests it signs, signing does not allocate.
+ *  Keep one per thread (or event loop) and use it for every request.
+ *
+ *  The buffer also holds the last result, until it is used again.
+ */
+class SigningBuffer {
+public:
+    SigningBuffer();
+    ~SigningBuffer();
+
+    /** The last result. Not NUL terminated. */
+    const char* data() const;
+    std::size_t length() const;
+
+    /** Copy the last result to out, NUL terminated, if it fits.
+     *
+     *  \returns the length of the result, excluding the NUL. If this is not
+     *           less than outSize, nothing is written.
+     */
+    std::size_t copy(char* out, std::size_t outSize) const;
+private:
+    friend class Client;
+    SigningBuffer(const SigningBuffer&);
+    SigningBuffer& operator=(const SigningBuffer&);
+
+    struct State;
+    State* mState;
+};
+
+/** Source of the time used for oauth_timestamp, see Client::setClock.
+ *  Implementations must be safe to call from every thread that signs with
+ *  a Client using them.
+ */
+class Clock {
+public:
+    virtual ~Clock() {}
+    /** The current time, in seconds since the epoch. */
+    virtual time_t now() const = 0;
+};
+
+/** A Clock that always reads the time it is set to, e.g. for tests. */
+class FixedClock : public Clock {
+public:
+    FixedClock(time_t t) : mTime(t) {}
+
+    void set(time_t t) { mTime = t; }
+    virtual time_t now() const { return mTime; }
+
+private:
+    time_t mTime;
+};
+
+/** Source of oauth_nonce values, see Client::setNonceSource. A nonce is
+ *  the timestamp followed by whatever the source appends, which must be
+ *  unique among the requests signed with the same credentials. Sources
+ *  must be safe to call from every thread that signs with a Client using
+ *  them.
+ */
+class NonceSource {
+public:
+    virtual ~NonceSource() {}
+    /** Append the unique part of a nonce, using only unreserved URL
+     *  characters.
+     */
+    virtual void append(std::string& nonce) const = 0;
+};
+
+/** A NonceSource that always appends the same value, in hex, e.g. for tests
+ *  and reproducible benchmarks. Together with a FixedClock, this makes a
+ *  Client's signatures deterministic, as Client::initialize(nonce,
+ *  timestamp) does for the whole process.
+ */
+class FixedNonceSource : public NonceSource {
+public:
+    FixedNonceSource(unsigned int value) : mValue(value) {}
+
+    void set(unsigned int value) { mValue = value; }
+    virtual void append(std::string& nonce) const;
+
+private:
+    unsigned int mValue;
+};
+
+/** Nonces that are unique across processes and hosts by construction, for
+ *  fleets of pre-forked workers or many hosts that share credentials. Each
+ *  nonce is a node id, a random 64 bit prefix drawn for each process (and
+ *  drawn again in a forked child), and a per-process counter, so it costs
+ *  one atomic increment and needs no coordination.
+ *
+ *  The default nonces are random, so collisions are only improbable; with
+ *  distinct node ids, nonces from different nodes can never collide.
+ */
+class DistributedNonceSource : public NonceSource {
+public:
+    /** \param nodeId identifies this host or worker group */
+    explicit DistributedNonceSource(unsigned long long nodeId);
+
+    virtual void append(std::string& nonce) const;
+
+private:
+    unsigned long long mNodeId;
+};
+
+class SharedCredentials;
+
 class Client {
 public:
-    /** Perform static initialization. This will be called automatically, but
-     *  you can call it explicitly to ensure thread safety. If you do not call
-     *  this explicitly before using the Client class, the same nonce may be
-     *  generated twice.
+    /** Perform static initialization. Nonces are generated from per-thread
+     *  operating system entropy and need no setup, so this is no longer
+     *  required; it remains for compatibility.
      */
     static void initialize();
     /** Alternative initialize method which lets you specify the seed and
      *  control the timestamp used in generating signatures. This only exists
-     *  for testing purposes and should not be used in practice.
+     *  for testing purposes and should not be used in practice. It applies
+     *  to every Client in the process; prefer setting a FixedClock and
+     *  FixedNonceSource on a Client, which this is equivalent to for the
+     *  Clients that have none of their own.
      */
     static void initialize(int nonce, time_t timestamp);
 
@@ -188,9 +461,59 @@ public:
      *         it remains valid during the lifetime of this object
      */
     Client(const Consumer* consumer, const Token* token);
+    /** Construct an OAuth Client that signs with credentials published in
+     *  a SharedCredentials. The consumer and token are looked up by key
+     *  for each request, without locking, so a request is signed with the
+     *  secrets most recently published when it starts. Signing throws
+     *  MissingKeyError if they aren't in that set.
+     *
+     *  \param credentials where to look the credentials up. The caller
+     *         must ensure it remains valid during the lifetime of this
+     *         object
+     *  \param consumerKey the key of the consumer to sign as
+     *  \param token the key of the access token to sign with, or empty to
+     *         sign without one
+     */
+    Client(const SharedCredentials* credentials, const std::string& consumerKey,
+           const std::string& token = "");
+
+    Client(const Client& other);
+    Client& operator=(const Client& other);
 
     ~Client();
 
+    /** Use a SigningBuffer as scratch space for every request this Client
+     *  signs through the std::string methods, so each request only
+     *  allocates the returned string. Without one, the scratch space is
+     *  allocated for each request.
+     *
+     *  The buffer is not thread safe: the Client must not be used from
+     *  several threads at once while it has one. It is not copied along
+     *  with the Client.
+     *
+     *  \param buffer the scratch space, which must outlive its use by this
+     *         Client, or NULL to stop using one
+     */
+    void setSigningBuffer(SigningBuffer* buffer);
+
+    /** Take oauth_timestamp from a different clock. By default it comes
+     *  from the system's coarse realtime clock, which is cheap to read and
+     *  accurate to well within a second.
+     *
+     *  \param clock the clock, which must outlive its use by this Client,
+     *         or NULL for the default
+     */
+    void setClock(const Clock* clock);
+
+    /** Generate oauth_nonce with a different strategy. By default the
+     *  nonce ends in 64 random bits, see DistributedNonceSource for an
+     *  alternative.
+     *
+     *  \param source the nonce source, which must outlive its use by this
+     *         Client, or NULL for the default
+     */
+    void setNonceSource(const NonceSource* source);
+
     /** Build an OAuth HTTP header for the given request. This version provides
      *  only the field value.
      *
@@ -230,6 +553,134 @@ public:
                          const std::string& rawUrl,
                          const std::string& rawData = "",
                          const bool includeOAuthVerifierPin = false) const;
+
+    /** Build an OAuth HTTP header for a request whose body is not form
+     *  encoded, e.g. JSON or binary uploads. Instead of the body itself, the
+     *  request is signed over its oauth_body_hash, which is included in the
+     *  header.
+     *
+     *  \param eType the HTTP request type, e.g. GET or POST
+     *  \param rawUrl the raw request URL (should include query parameters)
+     *  \param body hash of the complete request body
+     *  \param includeOAuthVerifierPin if true, adds oauth_verifier parameter
+     *  \returns a string containing the HTTP header
+     */
+    std::string getHttpHeader(const Http::RequestType eType,
+                         const std::string& rawUrl,
+                         const BodyHash& body,
+                         const bool includeOAuthVerifierPin = false) const;
+    /** Build an OAuth HTTP header for a request whose body is not form
+     *  encoded, including the header field name. See the BodyHash version
+     *  of getHttpHeader.
+     */
+    std::string getFormattedHttpHeader(const Http::RequestType eType,
+                         const std::string& rawUrl,
+                         const BodyHash& body,
+                         const bool includeOAuthVerifierPin = false) const;
+
+    /** Build OAuth HTTP headers for a batch of requests. This gives the same
+     *  results as calling getHttpHeader for each request, but computes the
+     *  signatures of several requests in parallel where the CPU allows, so
+     *  it is considerably faster for large batches.
+     *
+     *  \param requests the requests to sign
+     *  \returns the HTTP header for each request, in the same order
+     */
+    std::vector<std::string> getHttpHeaders(const RequestList& requests) const;
+    /** Build OAuth query strings for a batch of requests. This gives the same
+     *  results as calling getURLQueryString for each request; see
+     *  getHttpHeaders.
+     *
+     *  \param requests the requests to sign
+     *  \returns the query string for each request, in the same order
+     */
+    std::vector<std::string> getURLQueryStrings(const RequestList& requests) const;
+
+    /** Prepare a request that will be signed many times. The arguments are
+     *  the ones getHttpHeader takes; rawUrl and rawData should only hold
+     *  the parameters that are the same for every signature.
+     *
+     *  \param eType the HTTP request type, e.g. GET or POST
+     *  \param rawUrl the raw request URL, with its static query parameters
+     *  \param rawData the static part of the raw HTTP request data
+     *  \param includeOAuthVerifierPin if true, adds oauth_verifier parameter
+     *  \returns the prepared request
+     *  \throws ParseError if the parameters cannot be decoded
+     */
+    PreparedRequest prepare(const Http::RequestType eType,
+                         const std::string& rawUrl,
+                         const std::string& rawData = "",
+                         const bool includeOAuthVerifierPin = false) const;
+    /** Build an OAuth HTTP header for a prepared request. Gives the same
+     *  result as getHttpHeader with the dynamic data appended to the
+     *  request's static data.
+     *
+     *  \param request a request prepared by this Client
+     *  \param dynamicData url encoded parameters for this request only
+     *         (can be empty)
+     *  \returns a string containing the HTTP header
+     */
+    std::string getHttpHeader(const PreparedRequest& request,
+                         const std::string& dynamicData = "") const;
+    /** Build an OAuth HTTP header for a prepared request, including the
+     *  header field name. See the PreparedRequest version of getHttpHeader.
+     */
+    std::string getFormattedHttpHeader(const PreparedRequest& request,
+                         const std::string& dynamicData = "") const;
+    /** Build an OAuth query string for a prepared request. Gives the same
+     *  result as getURLQueryString with the dynamic data appended to the
+     *  request's static data.
+     *
+     *  \param request a request prepared by this Client
+     *  \param dynamicData url encoded parameters for this request only
+     *         (can be empty)
+     *  \returns a string containing the query string
+     */
+    std::string getURLQueryString(const PreparedRequest& request,
+                         const std::string& dynamicData = "") const;
+
+    /** Build an OAuth HTTP header for the given request into a caller
+     *  supplied buffer. Gives the same result as the std::string version,
+     *  but doesn't allocate once the SigningBuffer has grown to fit.
+     *
+     *  To query the size, pass a NULL out and outSize 0: the header is kept
+     *  in buffer, so it can be fetched with SigningBuffer::copy once there
+     *  is room, without signing again.
+     *
+     *  \param buffer scratch space, reused between calls
+     *  \param out where to write the NUL terminated header (can be NULL)
+     *  \param outSize the size of out
+     *  \param eType the HTTP request type, e.g. GET or POST
+     *  \param rawUrl the raw request URL (should include query parameters)
+     *  \param rawData the raw HTTP request data (can be empty)
+     *  \param includeOAuthVerifierPin if true, adds oauth_verifier parameter
+     *  \returns the length of the header, excluding the NUL. If this is not
+     *           less than outSize, nothing is written to out.
+     */
+    std::size_t getHttpHeader(SigningBuffer& buffer,
+                         char* out, std::size_t outSize,
+                         const Http::RequestType eType,
+                         const std::string& rawUrl,
+                         const std::string& rawData = "",
+                         const bool includeOAuthVerifierPin = false) const;
+    /** Build a fully formatted OAuth HTTP header into a caller supplied
+     *  buffer. See the SigningBuffer version of getHttpHeader.
+     */
+    std::size_t getFormattedHttpHeader(SigningBuffer& buffer,
+                         char* out, std::size_t outSize,
+                         const Http::RequestType eType,
+                         const std::string& rawUrl,
+                         const std::string& rawData = "",
+                         const bool includeOAuthVerifierPin = false) const;
+    /** Build an OAuth query string into a caller supplied buffer. See the
+     *  SigningBuffer version of getHttpHeader.
+     */
+    std::size_t getURLQueryString(SigningBuffer& buffer,
+                         char* out, std::size_t outSize,
+                         const Http::RequestType eType,
+                         const std::string& rawUrl,
+                         const std::string& rawData = "",
+                         const bool includeOAuthVerifierPin = false) const;
 private:
     /** Disable default constructur -- must provide consumer
      * information.
@@ -244,16 +695,39 @@ private:
     const Consumer* mConsumer;
     const Token* mToken;
 
+    /* HMAC-SHA1 state for the consumer_secret&token_secret signing key,
+     * computed once at construction. Both secrets are immutable, so it stays
+     * valid for the lifetime of the Client.
+     */
+    struct SigningKey;
+    SigningKey* mSigningKey;
+
+    /* Or, the keys of the credentials to look up for each request */
+    const SharedCredentials* mSharedCredentials;
+    std::string mConsumerKey;
+    std::string mTokenKey;
+
+    /* The consumer, token and signing key a request is signed with, either
+     * the ones above or those found in mSharedCredentials.
+     */
+    struct Credentials;
+
+    /* Scratch space for the std::string methods, optional */
+    SigningBuffer* mSigningBuffer;
+
+    /* Sources of timestamps and nonces, NULL for the defaults */
+    const Clock* mClock;
+    const NonceSource* mNonceSource;
+
     /* OAuth related utility methods */
-    bool buildOAuthTokenKeyValuePairs( const bool includeOAuthVerifierPin, /* in */
+    bool buildOAuthTokenKeyValuePairs( const Credentials& credentials, /* in */
+                                       const bool includeOAuthVerifierPin, /* in */
                                        const std::string& rawData, /* in */
-                                       const std::string& oauthSignature, /* in */
-                                       KeyValuePairs& keyValueMap /* out */,
-                                       const bool urlEncodeValues /* in */,
+                                       ParameterList& keyValueMap /* out */,
                                        const std::string& nonce /* in */,
                                        const std::string& timeStamp /* in */) const;
 
-    bool getStringFromOAuthKeyValuePairs( const KeyValuePairs& rawParamMap, /* in */
+    bool getStringFromOAuthKeyValuePairs( const ParameterList& rawParamMap, /* in */
                                           std::string& rawParams, /* out */
                                           const std::string& paramsSeperator /* in */ ) const;
 
@@ -264,22 +738,781 @@ private:
     // Utility for building OAuth HTTP header or query string. The string type
     // controls the separator and also filters parameters: for query strings,
     // all parameters are included. For HTTP headers, only auth parameters are
-    // included.
+    // included. A non-empty oauthBodyHash is signed and output along with
+    // the auth parameters. The result starts with prefix.
     std::string buildOAuthParameterString(
         ParameterStringType string_type,
+        const std::string& prefix,
         const Http::RequestType eType,
         const std::string& rawUrl,
         const std::string& rawData,
-        const bool includeOAuthVerifierPin) const;
+        const bool includeOAuthVerifierPin,
+        const std::string& oauthBodyHash = "") const;
+    // Does the work of buildOAuthParameterString in the scratch space,
+    // appending the result to scratch.output.
+    void buildOAuthParameterString(
+        ParameterStringType string_type,
+        const Http::RequestType eType,
+        const std::string& rawUrl,
+        const std::string& rawData,
+        const bool includeOAuthVerifierPin,
+        const std::string& oauthBodyHash,
+        SigningBuffer::State& scratch) const;
+    // Prepared request version of buildOAuthParameterString.
+    std::string buildOAuthParameterString(
+        ParameterStringType string_type,
+        const std::string& prefix,
+        const PreparedRequest& request,
+        const std::string& dynamicData) const;
+    // Batch version of buildOAuthParameterString.
+    void buildOAuthParameterStrings(
+        ParameterStringType string_type,
+        const RequestList& requests,
+        std::vector<std::string>& results) const;
+
+    // The two halves of buildOAuthParameterString, before and after the
+    // signature is computed.
+    void prepareOAuthParameters( const Credentials& credentials, /* in */
+                                 const Http::RequestType eType, /* in */
+                                 const std::string& rawUrl, /* in */
+                                 const std::string& rawData, /* in */
+                                 const bool includeOAuthVerifierPin, /* in */
+                                 ParameterList& rawKeyValuePairs, /* out */
+                                 std::string& pureUrl, /* out */
+                                 std::string& nonce, /* out */
+                                 std::string& timeStamp /* out */ ) const;
+    void finishOAuthParameterString( const Credentials& credentials, /* in */
+                                     ParameterStringType string_type, /* in */
+                                     const bool includeOAuthVerifierPin, /* in */
+                                     const std::string& oauthSignature, /* in */
+                                     const std::string& nonce, /* in */
+                                     const std::string& timeStamp, /* in */
+                                     ParameterList& rawKeyValuePairs, /* in/out */
+                                     std::string& rawParams /* out */ ) const;
+
+    bool getSignatureBaseString( const Http::RequestType eType, /* in */
+                                 const std::string& rawUrl, /* in */
+                                 const ParameterList& rawKeyValuePairs, /* in */
+                                 std::string& sigBase /* out */,
+                                 const bool rawUrlEncoded = false /* in */ ) const;
 
-    bool getSignature( const Http::RequestType eType, /* in */
+    bool getSignatureFromDigest( const unsigned char* digest, /* in */
+                                 std::string& oAuthSignature /* out */ ) const;
+
+    bool getSignature( const Credentials& credentials, /* in */
+                       const Http::RequestType eType, /* in */
                        const std::string& rawUrl, /* in */
-                       const KeyValuePairs& rawKeyValuePairs, /* in */
-                       std::string& oAuthSignature /* out */ ) const;
+                       const ParameterList& rawKeyValuePairs, /* in */
+                       std::string& oAuthSignature /* out */,
+                       const bool rawUrlEncoded = false /* in */ ) const;
 
     void generateNonceTimeStamp(std::string& nonce, std::string& timeStamp) const;
 };
 
+namespace Verification {
+typedef enum _Result
+{
+    Valid = 0,
+    /** The OAuth parameters couldn't be parsed, or one appeared twice */
+    Malformed,
+    /** A required OAuth parameter is missing */
+    MissingParameter,
+    /** The signature method isn't HMAC-SHA1, or the version isn't 1.0 */
+    Unsupported,
+    /** oauth_timestamp is too far from the Verifier's clock */
+    StaleTimestamp,
+    UnknownConsumer,
+    UnknownToken,
+    InvalidSignature,
+    /** The nonce was seen before, see Verifier::setNonceStore */
+    Replayed
+} Result;
+} // namespace Verification
+
+/** Where a Verifier looks up the secrets requests are signed with. It may be
+ *  called from several threads at once.
+ */
+class SecretStore {
+public:
+    virtual ~SecretStore() {}
+
+    /** Find the secret of a consumer.
+     *  \returns false if there is no such consumer
+     */
+    virtual bool consumerSecret(const std::string& consumerKey,
+                                std::string& secret) const = 0;
+    /** Find the secret of a token issued to a consumer.
+     *  \returns false if there is no such token for the consumer
+     */
+    virtual bool tokenSecret(const std::string& consumerKey,
+                             const std::string& token,
+                             std::string& secret) const = 0;
+};
+
+/** Keeps the signing keys of recently seen consumer and token pairs for a
+ *  Verifier, so that secrets are only looked up in the SecretStore the
+ *  first time. Each entry holds the percent encoded
+ *  consumer_secret&token_secret key, as Client builds it, with its
+ *  HMAC-SHA1 pad states already computed. Entries are split into
+ *  independently locked shards by a keyed hash, and a full shard evicts
+ *  with the CLOCK algorithm, an approximation of least recently used.
+ *
+ *  When several threads miss on the same pair at once, only one of them
+ *  asks the SecretStore and the others wait for its answer. Unknown
+ *  consumers and tokens aren't cached.
+ */
+class CredentialCache {
+public:
+    /** Counts since the cache was created. */
+    struct Stats {
+        Stats();
+
+        /** Requests whose key was in the cache */
+        std::size_t hits;
+        /** Requests whose key wasn't, including coalesced ones */
+        std::size_t misses;
+        /** Misses that waited for another thread's lookup of the same key */
+        std::size_t coalesced;
+        /** Lookups in the SecretStore */
+        std::size_t lookups;
+        std::size_t evictions;
+        std::size_t invalidations;
+        /** Total and longest time spent in SecretStore lookups */
+        double lookupSeconds;
+        double maxLookupSeconds;
+
+        /** Fraction of requests that hit, or 0 before the first. */
+        double hitRate() const;
+        /** Mean time of a SecretStore lookup, or 0 before the first. */
+        double averageLookupSeconds() const;
+    };
+
+    /** \param secrets where to look up secrets on a miss. It isn't copied
+     *         and must stay valid as long as the cache is used.
+     *  \param capacity the most consumer and token pairs to keep
+     *  \param shards the number of shards, rounded up to a power of 2 and
+     *         at most capacity
+     */
+    explicit CredentialCache(const SecretStore* secrets,
+                             std::size_t capacity = 10000,
+                             unsigned int shards = 16);
+    ~CredentialCache();
+
+    /** Forget the key of a consumer and token, e.g. when the token is
+     *  revoked. Pass an empty token for the consumer's own key, used for
+     *  requests without a token. A lookup in progress for it isn't cached.
+     */
+    void invalidate(const std::string& consumerKey, const std::string& token);
+    /** Forget every key of a consumer, e.g. when its secret changes. */
+    void invalidateConsumer(const std::string& consumerKey);
+    /** Forget every key. */
+    void clear();
+
+    /** The number of keys held. */
+    std::size_t size() const;
+    Stats stats() const;
+private:
+    friend class Verifier;
+    friend class AsyncVerifier;
+    CredentialCache(const CredentialCache&);
+    CredentialCache& operator=(const CredentialCache&);
+
+    /* Finds the signing key for a request, looking the secrets up on a
+     * miss. Returns Valid, UnknownConsumer or UnknownToken.
+     */
+    struct SigningKey;
+    Verification::Result signingKey(const std::string& consumerKey,
+                                    const std::string& token,
+                                    SigningKey& key);
+
+    struct Shard;
+    Shard** mShards;
+    unsigned int mShardBits;
+    const SecretStore* mSecrets;
+    unsigned long long mSeed;
+};
+
+/** Consumers and the tokens issued to them, to publish in a
+ *  SharedCredentials. Build a new set, or change a copy of the last one,
+ *  for each reload.
+ */
+class CredentialSet {
+public:
+    CredentialSet();
+    CredentialSet(const CredentialSet& other);
+    CredentialSet& operator=(const CredentialSet& other);
+    ~CredentialSet();
+
+    /** Add a consumer, or replace its secret. */
+    void addConsumer(const Consumer& consumer);
+    /** Add a token issued to a consumer, or replace its secret and pin.
+     *  Tokens of consumers that aren't in the set when it is published are
+     *  left out.
+     */
+    void addToken(const std::string& consumerKey, const Token& token);
+    /** Remove a consumer, along with its tokens. */
+    void removeConsumer(const std::string& consumerKey);
+    void removeToken(const std::string& consumerKey, const std::string& token);
+
+    /** The number of consumers and tokens. */
+    std::size_t size() const;
+private:
+    friend class SharedCredentials;
+    struct State;
+    State* mState;
+};
+
+/** Credentials that can be replaced while Clients sign and Verifiers verify
+ *  with them from any number of threads. Each publish builds an immutable
+ *  snapshot of a CredentialSet, with the signing key of every consumer and
+ *  token computed, and swaps it in atomically.
+ *
+ *  Readers take no lock: they count themselves in one of a number of
+ *  padded counters for the current epoch, and publish waits for the
+ *  previous epoch's readers to leave before freeing the snapshot it
+ *  replaced. Requests in progress finish with the secrets they started
+ *  with; later ones get the new secrets.
+ *
+ *  It is also a SecretStore, for use where only the secrets are needed.
+ */
+class SharedCredentials : public SecretStore {
+public:
+    /** Start with an empty set. */
+    SharedCredentials();
+    explicit SharedCredentials(const CredentialSet& credentials);
+    /** Readers must be done before it is destroyed. */
+    ~SharedCredentials();
+
+    /** Replace the credentials. The signing keys are computed in the
+     *  calling thread before the swap, so reload from a thread of your own
+     *  rather than one serving requests. Returns once no reader holds the
+     *  replaced credentials, so it blocks while long requests finish.
+     *  Publishes from several threads are done one at a time.
+     */
+    void publish(const CredentialSet& credentials);
+
+    /** How many sets it has held: 1 until the first publish. */
+    std::size_t version() const;
+
+    virtual bool consumerSecret(const std::string& consumerKey,
+                                std::string& secret) const;
+    virtual bool tokenSecret(const std::string& consumerKey,
+                             const std::string& token,
+                             std::string& secret) const;
+private:
+    friend class CredentialsReader;
+    SharedCredentials(const SharedCredentials&);
+    SharedCredentials& operator=(const SharedCredentials&);
+
+    struct State;
+    State* mState;
+};
+
+/** Where a Verifier records the nonces of the requests it accepts, to turn
+ *  replays away. Requests are identified by consumer key, token, nonce and
+ *  timestamp: the same nonce may be used again with another timestamp. It
+ *  may be called from several threads at once.
+ */
+class NonceStore {
+public:
+    virtual ~NonceStore() {}
+
+    /** Record a request.
+     *  \returns false if it was recorded before, i.e. it is a replay
+     */
+    virtual bool insert(const std::string& consumerKey,
+                        const std::string& token,
+                        const std::string& nonce,
+                        time_t timestamp) = 0;
+};
+
+/** An in-process NonceStore for one Verifier's window of accepted
+ *  timestamps. Nonces are kept as 64-bit hashes, keyed with a random seed,
+ *  in a ring of per-second hash tables indexed by oauth_timestamp: a second's
+ *  table is emptied for reuse once no timestamp in it can still be accepted,
+ *  so memory is bounded by the number of requests in the window. The tables
+ *  are split into independently locked shards by hash, so inserts from
+ *  different threads rarely wait for each other.
+ *
+ *  Two different requests with the same timestamp have a 2^-64 chance of
+ *  colliding, in which case the second is taken for a replay.
+ */
+class ReplayCache : public NonceStore {
+public:
+    /** \param window the Verifier's maximum clock skew, see
+     *         Verifier::setMaxClockSkew. Must be greater than 0.
+     *  \param shards the number of shards, rounded up to a power of 2
+     */
+    explicit ReplayCache(time_t window = 300, unsigned int shards = 64);
+    ~ReplayCache();
+
+    /** Record a request that passed the Verifier's timestamp check.
+     *  Timestamps that are older than the window of one already recorded
+     *  are refused too, as they can't have passed it.
+     *
+     *  \returns false for a replay
+     */
+    virtual bool insert(const std::string& consumerKey,
+                        const std::string& token,
+                        const std::string& nonce,
+                        time_t timestamp);
+
+    /** The number of nonces held, including ones whose second hasn't been
+     *  reused yet.
+     */
+    std::size_t size() const;
+    /** Bytes allocated for the nonces, for sizing. */
+    std::size_t memoryUsage() const;
+private:
+    ReplayCache(const ReplayCache&);
+    ReplayCache& operator=(const ReplayCache&);
+
+    struct Shard;
+    Shard** mShards;
+    unsigned int mShardBits;
+    time_t mWindow;
+    unsigned long long mSeed;
+};
+
+/** An exact record of the requests a service has accepted, e.g. its access
+ *  log or a database, that is too slow to consult for every request. A
+ *  ReplayFilter only asks it about the few requests the filter can't tell
+ *  from replays. It may be called from several threads at once.
+ */
+class NonceHistory {
+public:
+    virtual ~NonceHistory() {}
+
+    /** Whether a request with these parameters was accepted before. */
+    virtual bool seen(const std::string& consumerKey,
+                      const std::string& token,
+                      const std::string& nonce,
+                      time_t timestamp) const = 0;
+};
+
+/** A NonceStore that trades exactness for memory: each request only sets a
+ *  few bits in a Bloom filter, so a new request is occasionally taken for a
+ *  replay (a false positive), but a replay is never missed. Filters cover a
+ *  span of oauth_timestamp each and are rotated out as the window moves on,
+ *  as in ReplayCache, and they are split into independently locked shards.
+ *
+ *  Filters are sized for an expected request rate and false positive rate.
+ *  Going over the rate raises the false positive rate instead of using more
+ *  memory; see falsePositiveRate() for the current estimate. Suspected
+ *  replays are reported as replays, or checked with a NonceHistory if one
+ *  is given.
+ */
+class ReplayFilter : public NonceStore {
+public:
+    /** \param window the Verifier's maximum clock skew, see
+     *         Verifier::setMaxClockSkew. Must be greater than 0.
+     *  \param requestsPerSecond the expected request rate
+     *  \param falsePositiveRate the wanted chance of taking a new request
+     *         for a replay, at the expected rate
+     *  \param history exact record to check suspected replays with, or
+     *         NULL. It isn't copied and must outlive the filter.
+     *  \param shards the number of shards, rounded up to a power of 2
+     */
+    ReplayFilter(time_t window, std::size_t requestsPerSecond,
+                 double falsePositiveRate = 0.001,
+                 const NonceHistory* history = NULL,
+                 unsigned int shards = 64);
+    ~ReplayFilter();
+
+    /** Record a request that passed the Verifier's timestamp check, as
+     *  ReplayCache::insert.
+     *
+     *  \returns false for a replay or suspected replay
+     */
+    virtual bool insert(const std::string& consumerKey,
+                        const std::string& token,
+                        const std::string& nonce,
+                        time_t timestamp);
+
+    /** Estimated false positive rate of the filters as they are now filled,
+     *  averaged over the filters in use.
+     */
+    double falsePositiveRate() const;
+    /** Requests taken for replays by the filters, whether they were or not. */
+    std::size_t suspectedReplays() const;
+    /** Suspected replays the NonceHistory had not seen, and were let in. */
+    std::size_t falsePositives() const;
+    /** Bytes allocated for the filters, for sizing. */
+    std::size_t memoryUsage() const;
+private:
+    ReplayFilter(const ReplayFilter&);
+    ReplayFilter& operator=(const ReplayFilter&);
+
+    struct Shard;
+    Shard** mShards;
+    unsigned int mShardBits;
+    unsigned int mBitsPerRequest;
+    time_t mBucketSeconds;
+    const NonceHistory* mHistory;
+    unsigned long long mSeed;
+};
+
+#ifndef _WIN32
+class SharedMemoryError : public std::runtime_error {
+public:
+    SharedMemoryError(const std::string msg)
+     : std::runtime_error(msg)
+    {}
+};
+
+/** A NonceStore in a POSIX shared memory segment, for several processes on
+ *  one host that verify requests for the same service, e.g. pre-forked
+ *  workers. A replay is caught whichever process gets it.
+ *
+ *  The segment is a ring of hash tables, each holding the requests of a
+ *  span of oauth_timestamp, as the filters of ReplayFilter. Requests are
+ *  kept as 40-bit hashes tagged with their span's epoch number, with open
+ *  addressing, and each is claimed with a single compare-and-swap. A table
+ *  is emptied for a new span by moving its epoch on, after which the old
+ *  entries count as free places. There are no locks, so a process that
+ *  dies at any point leaves nothing held, and at most the entry it was
+ *  claiming.
+ *
+ *  Two different requests in the same span have about a 2^-40 chance of
+ *  colliding, in which case the second is taken for a replay. Entries left
+ *  in a table that sat unused for 2^23 spans may come back as
+ *  occupied; that is only a matter of months for short windows.
+ */
+class SharedNonceStore : public NonceStore {
+public:
+    /** Create the segment called name, or attach to it if another process
+     *  already has. Its tables are sized when it is created, and the
+     *  parameters are ignored when attaching. If the process creating it
+     *  died before setting it up, it is set up again after a few seconds.
+     *
+     *  Objects may also be inherited across fork(), which is the simplest
+     *  way to share one between pre-forked workers: create it in the parent
+     *  before forking.
+     *
+     *  \param name the segment name, for shm_open: a '/' followed by up to
+     *         254 characters that aren't '/'
+     *  \param window the Verifier's maximum clock skew, see
+     *         Verifier::setMaxClockSkew. Must be greater than 0.
+     *  \param requestsPerSecond the expected peak request rate, of all the
+     *         processes together. The tables are half full at this rate;
+     *         when a table fills up, its requests are refused.
+     *  \throws SharedMemoryError if the segment can't be created or
+     *          attached to
+     */
+    SharedNonceStore(const std::string& name, time_t window,
+                     std::size_t requestsPerSecond);
+    /** Detaches from the segment. The segment itself stays until remove()
+     *  is called, so other processes can keep using it.
+     */
+    ~SharedNonceStore();
+
+    /** Remove the segment called name. Processes still attached to it keep
+     *  using it, and a new one is created by the next SharedNonceStore of
+     *  that name.
+     */
+    static void remove(const std::string& name);
+
+    /** Record a request that passed the Verifier's timestamp check, as
+     *  ReplayCache::insert.
+     *
+     *  \returns false for a replay, or if the request's table is full
+     */
+    virtual bool insert(const std::string& consumerKey,
+                        const std::string& token,
+                        const std::string& nonce,
+                        time_t timestamp);
+
+    /** The number of requests held in the tables of current spans. */
+    std::size_t size() const;
+    /** Bytes of shared memory in the segment, for sizing. */
+    std::size_t memoryUsage() const;
+private:
+    SharedNonceStore(const SharedNonceStore&);
+    SharedNonceStore& operator=(const SharedNonceStore&);
+
+    struct Segment;
+    Segment* mSegment;
+    std::size_t mSegmentSize;
+};
+#endif
+
+/** Scratch space for Verifier::verify, and the OAuth parameters of the last
+ *  request it verified. Like SigningBuffer, it is reused between calls so
+ *  that verification doesn't allocate; keep one per thread.
+ */
+class VerificationBuffer {
+public:
+    VerificationBuffer();
+    ~VerificationBuffer();
+
+    /** The decoded parameters of the last request verified, whether or not
+     *  it was valid. Empty (0 for the timestamp) if a parameter was missing
+     *  or verification failed before getting to it.
+     */
+    const std::string& consumerKey() const;
+    const std::string& token() const;
+    const std::string& nonce() const;
+    time_t timestamp() const;
+private:
+    friend class Verifier;
+    VerificationBuffer(const VerificationBuffer&);
+    VerificationBuffer& operator=(const VerificationBuffer&);
+
+    struct State;
+    State* mState;
+};
+
+/** Checks the signatures of OAuth 1.0a requests, for the service provider
+ *  side. The base string is rebuilt the way Client builds it, and the
+ *  HMAC-SHA1 digest is compared with the one in the request in constant time.
+ *
+ *  Replays are only detected with a NonceStore, see setNonceStore. Otherwise
+ *  it is left to the caller: after a request is verified its nonce and
+ *  timestamp are in the VerificationBuffer.
+ */
+class Verifier {
+public:
+    /** \param secrets where to look up consumer and token secrets. It isn't
+     *         copied and must stay valid as long as the Verifier is used.
+     *         It may be NULL for a Verifier only used by an AsyncVerifier.
+     */
+    explicit Verifier(const SecretStore* secrets);
+
+    /** Use clock to check timestamps against, rather than the system clock.
+     *  The clock isn't copied and must stay valid while it is set. Pass
+     *  NULL to return to the system clock.
+     */
+    void setClock(const Clock* clock);
+    /** Reject requests whose timestamp is more than seconds away from the
+     *  clock. 0 turns the check off. The default is 300 (five minutes).
+     */
+    void setMaxClockSkew(time_t seconds);
+    /** Record the nonce of each request with a valid signature in store,
+     *  and reject the ones it has seen as Verification::Replayed. The store
+     *  isn't copied and must stay valid while it is set. Pass NULL to stop
+     *  checking.
+     */
+    void setNonceStore(NonceStore* store);
+    /** Look signing keys up in cache, rather than building them from the
+     *  SecretStore for every request. The cache has its own SecretStore,
+     *  normally the same one. It isn't copied and must stay valid while it
+     *  is set. Pass NULL to stop using it.
+     */
+    void setCredentialCache(CredentialCache* cache);
+    /** Use the signing keys of credentials, as last published, rather than
+     *  building them from the SecretStore for every request. This takes
+     *  the place of a CredentialCache. The credentials aren't copied and
+     *  must stay valid while they are set. Pass NULL to stop using them.
+     */
+    void setSharedCredentials(const SharedCredentials* credentials);
+
+    /** Verify a request. The OAuth parameters are taken from the
+     *  Authorization header if there is one, and from the query string and
+     *  body otherwise.
+     *
+     *  \param buffer scratch space, reused between calls
+     *  \param eType the HTTP request type, e.g. GET or POST
+     *  \param rawUrl the request URL as the client signed it, including the
+     *         query string. Nothing is normalized, so it must be in the
+     *         same form, e.g. the scheme and host are case sensitive.
+     *  \param authorizationHeader the Authorization header, with or without
+     *         the field name, or empty if the request has none
+     *  \param rawData the url encoded request body, or empty if it isn't a
+     *         form
+     *  \returns Verification::Valid, or why the request isn't
+     */
+    Verification::Result verify(VerificationBuffer& buffer,
+                         const Http::RequestType eType,
+                         const std::string& rawUrl,
+                         const std::string& authorizationHeader,
+                         const std::string& rawData = "") const;
+    /** Verify a request with temporary scratch space. See the
+     *  VerificationBuffer version.
+     */
+    Verification::Result verify(const Http::RequestType eType,
+                         const std::string& rawUrl,
+                         const std::string& authorizationHeader,
+                         const std::string& rawData = "") const;
+private:
+    friend class AsyncVerifier;
+    Verifier();
+
+    /* The checks that don't need the secrets, then the signature check with
+     * the signing key. Between the two the request is kept in the buffer.
+     */
+    Verification::Result prepareVerify(VerificationBuffer& buffer,
+                                       const Http::RequestType eType,
+                                       const std::string& rawUrl,
+                                       const std::string& authorizationHeader,
+                                       const std::string& rawData) const;
+    Verification::Result finishVerify(VerificationBuffer& buffer,
+                                      const CredentialCache::SigningKey& key) const;
+
+    const SecretStore* mSecrets;
+    const Clock* mClock;
+    time_t mMaxClockSkew;
+    NonceStore* mNonceStore;
+    CredentialCache* mCredentials;
+    const SharedCredentials* mSharedCredentials;
+};
+
+/** The secrets of a batch of requests verified by an AsyncVerifier, for a
+ *  BatchSecretResolver to look up. Each consumer and token pair appears
+ *  once, however many of the requests share it.
+ */
+class SecretBatch {
+public:
+    std::size_t size() const;
+    const std::string& consumerKey(std::size_t i) const;
+    /** The token, or empty for requests without one. */
+    const std::string& token(std::size_t i) const;
+
+    /** Give the secrets of pair i. Pairs left unset are unknown consumers.
+     *  \param tokenSecret the token secret, ignored without a token
+     */
+    void setSecrets(std::size_t i, const std::string& consumerSecret,
+                    const std::string& tokenSecret = "");
+    /** The consumer of pair i is known but its token isn't. */
+    void setUnknownToken(std::size_t i);
+
+    /** Signal that the secrets are all set. The requests' signatures are
+     *  checked and their callbacks called in this thread, before it
+     *  returns. Call exactly once, after which the batch mustn't be used.
+     */
+    void complete();
+private:
+    friend class AsyncVerifier;
+    SecretBatch();
+    ~SecretBatch();
+    SecretBatch(const SecretBatch&);
+    SecretBatch& operator=(const SecretBatch&);
+
+    struct State;
+    State* mState;
+};
+
+/** Looks up the secrets of a batch of requests at once, e.g. with one
+ *  multi-get from a remote key-value store. It may answer asynchronously:
+ *  several batches can be outstanding at once.
+ */
+class BatchSecretResolver {
+public:
+    virtual ~BatchSecretResolver() {}
+
+    /** Look up the secrets of batch, then call SecretBatch::complete(),
+     *  either before returning or later from any thread.
+     */
+    virtual void resolve(SecretBatch& batch) = 0;
+};
+
+/** A BatchSecretResolver answering from memory after a set delay, standing
+ *  in for a remote store in tests and benchmarks. Batches are completed in
+ *  the order they were sent, by a thread of the resolver's own, so that
+ *  many can wait out the delay at once.
+ */
+class MemorySecretResolver : public BatchSecretResolver {
+public:
+    /** \param latency seconds from a batch being sent to its secrets being
+     *         set, as a round trip to a remote store would take
+     *  \param perKeyLatency extra seconds for each pair in the batch
+     */
+    explicit MemorySecretResolver(double latency = 0, double perKeyLatency = 0);
+    /** Waits for the outstanding batches to complete. */
+    ~MemorySecretResolver();
+
+    /** Add or replace secrets. Safe while batches are outstanding. */
+    void addConsumer(const std::string& consumerKey, const std::string& secret);
+    void addToken(const std::string& consumerKey, const std::string& token,
+                  const std::string& secret);
+
+    virtual void resolve(SecretBatch& batch);
+
+    /** Batches and pairs looked up so far. */
+    std::size_t batches() const;
+    std::size_t lookups() const;
+private:
+    MemorySecretResolver(const MemorySecretResolver&);
+    MemorySecretResolver& operator=(const MemorySecretResolver&);
+
+    struct State;
+    State* mState;
+};
+
+/** Receives the result of a request verified by an AsyncVerifier. */
+class VerificationCallback {
+public:
+    virtual ~VerificationCallback() {}
+
+    /** \param buffer the request's decoded parameters, as from
+     *         Verifier::verify. It is only valid during the call.
+     */
+    virtual void verified(Verification::Result result,
+                          const VerificationBuffer& buffer) = 0;
+};
+
+/** Verifies requests with their secrets looked up in batches, for secret
+ *  stores that answer many lookups at once much faster than one at a time.
+ *
+ *  submit() makes the checks that don't need the secrets right away, in
+ *  the calling thread. A request that passes waits in the open batch until
+ *  the batch is full or flush() is called, and the batch is then sent to
+ *  the BatchSecretResolver. When the resolver completes it, the signatures
+ *  are checked and the callbacks called, in the thread that completed it.
+ *  Requests that fail the first checks get their callback before submit()
+ *  returns.
+ *
+ *  Everything else, the clock, the nonce store and so on, comes from a
+ *  Verifier. Its SecretStore and CredentialCache aren't used. Any thread
+ *  may submit and flush.
+ */
+class AsyncVerifier {
+public:
+    /** \param verifier the checks to make. It isn't copied and must stay
+     *         valid as long as the AsyncVerifier is used.
+     *  \param resolver where to look up secrets, likewise
+     *  \param maxBatch the most requests to put in a batch
+     */
+    AsyncVerifier(const Verifier* verifier, BatchSecretResolver* resolver,
+                  std::size_t maxBatch = 64);
+    /** Waits for every request to complete, see drain(). */
+    ~AsyncVerifier();
+
+    /** Verify a request, as Verifier::verify. The strings are only used
+     *  before submit returns. callback is called once with the result, and
+     *  must stay valid until then.
+     */
+    void submit(const Http::RequestType eType,
+                const std::string& rawUrl,
+                const std::string& authorizationHeader,
+                const std::string& rawData,
+                VerificationCallback* callback);
+
+    /** Send the open batch, if it has any requests, without waiting for it
+     *  to fill. Call this when there are no more requests to submit for
+     *  now, e.g. at the end of an event loop iteration.
+     */
+    void flush();
+    /** flush(), then wait until every submitted request has had its
+     *  callback.
+     */
+    void drain();
+
+    /** Requests submitted whose callbacks haven't been called yet. */
+    std::size_t outstanding() const;
+    /** Batches sent to the resolver so far. */
+    std::size_t batches() const;
+private:
+    friend class SecretBatch;
+    AsyncVerifier(const AsyncVerifier&);
+    AsyncVerifier& operator=(const AsyncVerifier&);
+
+    /* Checks the signatures of a resolved batch and calls the callbacks */
+    void complete(SecretBatch& batch);
+
+    struct State;
+    State* mState;
+};
+
 } // namespace OAuth
 
 #endif // __LIBOAUTHCPP_LIBOAUTHCPP_H__
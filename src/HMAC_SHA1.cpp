@@ -8,7 +8,7 @@
 #include <memory>
 
 
-void CHMAC_SHA1::HMAC_SHA1(BYTE *text, int text_len, BYTE *key, int key_len, BYTE *digest)
+void CHMAC_SHA1::PrepareKey(BYTE *key, int key_len, KEY_STATE *ks)
 {
 	memset(SHA1_Key, 0, SHA1_BLOCK_SIZE);
 
@@ -34,26 +34,64 @@ void CHMAC_SHA1::HMAC_SHA1(BYTE *text, int text_len, BYTE *key, int key_len, BYT
 		m_ipad[i] ^= SHA1_Key[i];
 	}
 
-	/* STEP 4 */
-	CSHA1::Reset();
-        CSHA1::Update((UINT_8 *)m_ipad, sizeof(m_ipad));
-        CSHA1::Update((UINT_8 *)text, text_len);
-	CSHA1::Final();
-
-        char szReport[SHA1_DIGEST_LENGTH];
-	CSHA1::GetHash((UINT_8 *)szReport);
-
 	/* STEP 5 */
 	for (int j=0; j<(int)sizeof(m_opad); j++)
 	{
 		m_opad[j] ^= SHA1_Key[j];
 	}
 
-	/*STEP 7 */
+	/* Absorb one block of each pad and keep the chaining values */
+	CSHA1::Reset();
+	CSHA1::Update((UINT_8 *)m_ipad, sizeof(m_ipad));
+	memcpy(ks->ipad_state, m_state, sizeof(ks->ipad_state));
+
+	CSHA1::Reset();
+	CSHA1::Update((UINT_8 *)m_opad, sizeof(m_opad));
+	memcpy(ks->opad_state, m_state, sizeof(ks->opad_state));
+
+#ifdef SHA1_WIPE_VARIABLES
+	memset(SHA1_Key, 0, SHA1_BLOCK_SIZE);
+	memset(m_ipad, 0, sizeof(m_ipad));
+	memset(m_opad, 0, sizeof(m_opad));
 	CSHA1::Reset();
-        CSHA1::Update((UINT_8 *)m_opad, sizeof(m_opad));
-        CSHA1::Update((UINT_8 *)szReport, SHA1_DIGEST_LENGTH);
+#endif
+}
+
+void CHMAC_SHA1::Begin(const KEY_STATE &ks)
+{
+	/* STEP 4, resuming after the ipad block */
+	memcpy(m_state, ks.ipad_state, sizeof(ks.ipad_state));
+	m_count[0] = SHA1_BLOCK_SIZE << 3;
+	m_count[1] = 0;
+}
+
+void CHMAC_SHA1::Finish(const KEY_STATE &ks, BYTE *digest)
+{
+	CSHA1::Final();
+
+	char szReport[SHA1_DIGEST_LENGTH];
+	CSHA1::GetHash((UINT_8 *)szReport);
+
+	/*STEP 7, resuming after the opad block */
+	memcpy(m_state, ks.opad_state, sizeof(ks.opad_state));
+	m_count[0] = SHA1_BLOCK_SIZE << 3;
+	m_count[1] = 0;
+	CSHA1::Update((UINT_8 *)szReport, SHA1_DIGEST_LENGTH);
 	CSHA1::Final();
 
 	CSHA1::GetHash((UINT_8 *)digest);
 }
+
+void CHMAC_SHA1::HMAC_SHA1(BYTE *text, int text_len, const KEY_STATE &ks, BYTE *digest)
+{
+	Begin(ks);
+	CSHA1::Update((UINT_8 *)text, text_len);
+	Finish(ks, digest);
+}
+
+void CHMAC_SHA1::HMAC_SHA1(BYTE *text, int text_len, BYTE *key, int key_len, BYTE *digest)
+{
+	KEY_STATE ks;
+	PrepareKey(key, key_len, &ks);
+	HMAC_SHA1(text, text_len, ks, digest);
+}
@@ -28,8 +28,27 @@ private:
     char SHA1_Key[SHA1_BLOCK_SIZE];
 
 public:
+    // Hash state left after absorbing the ipad and opad blocks for a key.
+    // Both pads are exactly one block long, so only the chaining values
+    // need to be kept; everything else is implied.
+    struct KEY_STATE
+    {
+        UINT_32 ipad_state[5];
+        UINT_32 opad_state[5];
+    };
+
     CHMAC_SHA1() {}
 
+    // Precompute the pad states for key so it can be reused for any number
+    // of messages.
+    void PrepareKey(BYTE *key, int key_len, KEY_STATE *ks);
+
+    // Incremental interface: Begin(), any number of CSHA1::Update() calls
+    // with the message, then Finish() to get the digest.
+    void Begin(const KEY_STATE &ks);
+    void Finish(const KEY_STATE &ks, BYTE *digest);
+
+    void HMAC_SHA1(BYTE *text, int text_len, const KEY_STATE &ks, BYTE *digest);
     void HMAC_SHA1(BYTE *text, int text_len, BYTE *key, int key_len, BYTE *digest);
 };
 
@@ -0,0 +1,360 @@
+//******************************************************************************
+//* HMAC_SHA1_mb.cpp : Multi-buffer HMAC SHA1
+//*
+//* Each SIMD lane carries one message through its inner hash and then its
+//* outer hash. Lanes are refilled with the next message as soon as they
+//* finish, so messages of different lengths keep all lanes busy. Message
+//* tails (the last partial block plus SHA-1 padding) are built per lane in a
+//* small buffer; idle lanes hash a dummy block whose result is ignored.
+//******************************************************************************
+#include "HMAC_SHA1_mb.h"
+#include "SHA1_x86.h"
+
+#define HMAC_SHA1_MB_MAX_LANES 8
+
+typedef void (*MB_COMPRESS_FN)(UINT_32 (*state)[HMAC_SHA1_MB_MAX_LANES], const UINT_8 *const *blocks);
+
+#ifdef SHA1_X86_SIMD
+#include <immintrin.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// 4 lanes, SSSE3
+
+#define MB_FUNC        Compress_SSSE3_X4
+#define MB_TARGET      __attribute__((target("ssse3")))
+#define MB_VEC         __m128i
+#define MB_LOAD(p)     _mm_loadu_si128((const __m128i *)(p))
+#define MB_STORE(p,v)  _mm_storeu_si128((__m128i *)(p), v)
+#define MB_SET1(x)     _mm_set1_epi32((int)(x))
+#define MB_ADD(a,b)    _mm_add_epi32(a,b)
+#define MB_XOR(a,b)    _mm_xor_si128(a,b)
+#define MB_AND(a,b)    _mm_and_si128(a,b)
+#define MB_OR(a,b)     _mm_or_si128(a,b)
+#define MB_SHL(v,n)    _mm_slli_epi32(v,n)
+#define MB_SHR(v,n)    _mm_srli_epi32(v,n)
+#define MB_LOAD_MSG(msg, blocks) \
+	{ \
+		const __m128i bswap = _mm_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3); \
+		for (int q = 0; q < 4; q++) \
+		{ \
+			__m128i r0 = _mm_loadu_si128((const __m128i *)(blocks[0] + 16*q)); \
+			__m128i r1 = _mm_loadu_si128((const __m128i *)(blocks[1] + 16*q)); \
+			__m128i r2 = _mm_loadu_si128((const __m128i *)(blocks[2] + 16*q)); \
+			__m128i r3 = _mm_loadu_si128((const __m128i *)(blocks[3] + 16*q)); \
+			__m128i t0 = _mm_unpacklo_epi32(r0, r1); \
+			__m128i t1 = _mm_unpacklo_epi32(r2, r3); \
+			__m128i t2 = _mm_unpackhi_epi32(r0, r1); \
+			__m128i t3 = _mm_unpackhi_epi32(r2, r3); \
+			msg[4*q+0] = _mm_shuffle_epi8(_mm_unpacklo_epi64(t0, t1), bswap); \
+			msg[4*q+1] = _mm_shuffle_epi8(_mm_unpackhi_epi64(t0, t1), bswap); \
+			msg[4*q+2] = _mm_shuffle_epi8(_mm_unpacklo_epi64(t2, t3), bswap); \
+			msg[4*q+3] = _mm_shuffle_epi8(_mm_unpackhi_epi64(t2, t3), bswap); \
+		} \
+	}
+
+#include "HMAC_SHA1_mb_kernel.inc"
+
+#undef MB_FUNC
+#undef MB_TARGET
+#undef MB_VEC
+#undef MB_LOAD
+#undef MB_STORE
+#undef MB_SET1
+#undef MB_ADD
+#undef MB_XOR
+#undef MB_AND
+#undef MB_OR
+#undef MB_SHL
+#undef MB_SHR
+#undef MB_LOAD_MSG
+
+/////////////////////////////////////////////////////////////////////////////
+// 8 lanes, AVX2
+
+#define MB_FUNC        Compress_AVX2_X8
+#define MB_TARGET      __attribute__((target("avx2")))
+#define MB_VEC         __m256i
+#define MB_LOAD(p)     _mm256_loadu_si256((const __m256i *)(p))
+#define MB_STORE(p,v)  _mm256_storeu_si256((__m256i *)(p), v)
+#define MB_SET1(x)     _mm256_set1_epi32((int)(x))
+#define MB_ADD(a,b)    _mm256_add_epi32(a,b)
+#define MB_XOR(a,b)    _mm256_xor_si256(a,b)
+#define MB_AND(a,b)    _mm256_and_si256(a,b)
+#define MB_OR(a,b)     _mm256_or_si256(a,b)
+#define MB_SHL(v,n)    _mm256_slli_epi32(v,n)
+#define MB_SHR(v,n)    _mm256_srli_epi32(v,n)
+#define MB_LOAD_MSG(msg, blocks) \
+	{ \
+		const __m256i bswap = _mm256_set_epi8( \
+			12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3, \
+			12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3); \
+		for (int h = 0; h < 2; h++) \
+		{ \
+			__m256i r0 = _mm256_loadu_si256((const __m256i *)(blocks[0] + 32*h)); \
+			__m256i r1 = _mm256_loadu_si256((const __m256i *)(blocks[1] + 32*h)); \
+			__m256i r2 = _mm256_loadu_si256((const __m256i *)(blocks[2] + 32*h)); \
+			__m256i r3 = _mm256_loadu_si256((const __m256i *)(blocks[3] + 32*h)); \
+			__m256i r4 = _mm256_loadu_si256((const __m256i *)(blocks[4] + 32*h)); \
+			__m256i r5 = _mm256_loadu_si256((const __m256i *)(blocks[5] + 32*h)); \
+			__m256i r6 = _mm256_loadu_si256((const __m256i *)(blocks[6] + 32*h)); \
+			__m256i r7 = _mm256_loadu_si256((const __m256i *)(blocks[7] + 32*h)); \
+			__m256i t0 = _mm256_unpacklo_epi32(r0, r1); \
+			__m256i t1 = _mm256_unpackhi_epi32(r0, r1); \
+			__m256i t2 = _mm256_unpacklo_epi32(r2, r3); \
+			__m256i t3 = _mm256_unpackhi_epi32(r2, r3); \
+			__m256i t4 = _mm256_unpacklo_epi32(r4, r5); \
+			__m256i t5 = _mm256_unpackhi_epi32(r4, r5); \
+			__m256i t6 = _mm256_unpacklo_epi32(r6, r7); \
+			__m256i t7 = _mm256_unpackhi_epi32(r6, r7); \
+			__m256i u0 = _mm256_unpacklo_epi64(t0, t2); \
+			__m256i u1 = _mm256_unpackhi_epi64(t0, t2); \
+			__m256i u2 = _mm256_unpacklo_epi64(t1, t3); \
+			__m256i u3 = _mm256_unpackhi_epi64(t1, t3); \
+			__m256i u4 = _mm256_unpacklo_epi64(t4, t6); \
+			__m256i u5 = _mm256_unpackhi_epi64(t4, t6); \
+			__m256i u6 = _mm256_unpacklo_epi64(t5, t7); \
+			__m256i u7 = _mm256_unpackhi_epi64(t5, t7); \
+			msg[8*h+0] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u0, u4, 0x20), bswap); \
+			msg[8*h+1] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u1, u5, 0x20), bswap); \
+			msg[8*h+2] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u2, u6, 0x20), bswap); \
+			msg[8*h+3] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u3, u7, 0x20), bswap); \
+			msg[8*h+4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u0, u4, 0x31), bswap); \
+			msg[8*h+5] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u1, u5, 0x31), bswap); \
+			msg[8*h+6] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u2, u6, 0x31), bswap); \
+			msg[8*h+7] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u3, u7, 0x31), bswap); \
+		} \
+	}
+
+#include "HMAC_SHA1_mb_kernel.inc"
+
+#undef MB_FUNC
+#undef MB_TARGET
+#undef MB_VEC
+#undef MB_LOAD
+#undef MB_STORE
+#undef MB_SET1
+#undef MB_ADD
+#undef MB_XOR
+#undef MB_AND
+#undef MB_OR
+#undef MB_SHL
+#undef MB_SHR
+#undef MB_LOAD_MSG
+
+#endif // SHA1_X86_SIMD
+
+/////////////////////////////////////////////////////////////////////////////
+// Lane scheduling
+
+namespace {
+
+struct MB_LANE
+{
+	bool busy;
+	bool outer;              // inner hash done, working on the outer hash
+	size_t job;              // index of the message in this lane
+	const UINT_8 *data;      // next full block of the message
+	size_t fullBlocks;       // full blocks left before the tail
+	UINT_8 tail[128];        // last partial block plus padding
+	int tailBlocks;
+	int tailPos;
+};
+
+// Appends the SHA-1 padding for a message of totalLen bytes whose last
+// partial block is already in lane.tail[0..partialLen).
+void PadTail(MB_LANE &lane, size_t partialLen, unsigned long long totalLen)
+{
+	lane.tailBlocks = (partialLen + 9 <= 64) ? 1 : 2;
+	size_t end = 64 * lane.tailBlocks;
+
+	lane.tail[partialLen] = 0x80;
+	memset(lane.tail + partialLen + 1, 0, end - partialLen - 1);
+
+	unsigned long long bits = totalLen << 3;
+	for (int i = 0; i < 8; i++)
+		lane.tail[end - 1 - i] = (UINT_8)(bits >> (8 * i));
+	lane.tailPos = 0;
+}
+
+void LoadState(UINT_32 (*state)[HMAC_SHA1_MB_MAX_LANES], int lane, const UINT_32 *src)
+{
+	for (int i = 0; i < 5; i++)
+		state[i][lane] = src[i];
+}
+
+void StartInner(MB_LANE &lane, UINT_32 (*state)[HMAC_SHA1_MB_MAX_LANES], int lanePos,
+                size_t job, const CHMAC_SHA1::KEY_STATE &ks, const BYTE *text, size_t len)
+{
+	lane.busy = true;
+	lane.outer = false;
+	lane.job = job;
+	lane.data = text;
+	lane.fullBlocks = len / 64;
+
+	size_t partial = len % 64;
+	memcpy(lane.tail, text + len - partial, partial);
+	// The ipad block was already absorbed into the key state
+	PadTail(lane, partial, (unsigned long long)len + CHMAC_SHA1::SHA1_BLOCK_SIZE);
+
+	LoadState(state, lanePos, ks.ipad_state);
+}
+
+void StartOuter(MB_LANE &lane, UINT_32 (*state)[HMAC_SHA1_MB_MAX_LANES], int lanePos,
+                const CHMAC_SHA1::KEY_STATE &ks)
+{
+	// Inner digest becomes the outer message
+	for (int i = 0; i < 5; i++)
+	{
+		UINT_32 v = state[i][lanePos];
+		lane.tail[4*i+0] = (UINT_8)(v >> 24);
+		lane.tail[4*i+1] = (UINT_8)(v >> 16);
+		lane.tail[4*i+2] = (UINT_8)(v >> 8);
+		lane.tail[4*i+3] = (UINT_8)(v);
+	}
+	lane.outer = true;
+	lane.fullBlocks = 0;
+	PadTail(lane, CHMAC_SHA1::SHA1_DIGEST_LENGTH,
+	        CHMAC_SHA1::SHA1_BLOCK_SIZE + CHMAC_SHA1::SHA1_DIGEST_LENGTH);
+
+	LoadState(state, lanePos, ks.opad_state);
+}
+
+void RunLanes(MB_COMPRESS_FN compress, int nLanes, size_t count,
+              const CHMAC_SHA1::KEY_STATE* const* keys,
+              const BYTE* const* texts, const size_t* text_lens, BYTE* digests)
+{
+	static const UINT_8 idleBlock[64] = { 0 };
+
+	UINT_32 state[5][HMAC_SHA1_MB_MAX_LANES];
+	MB_LANE lanes[HMAC_SHA1_MB_MAX_LANES];
+	const UINT_8 *blocks[HMAC_SHA1_MB_MAX_LANES];
+	size_t next = 0;
+	int busy = 0;
+
+	for (int l = 0; l < HMAC_SHA1_MB_MAX_LANES; l++)
+	{
+		lanes[l].busy = false;
+		blocks[l] = idleBlock;
+	}
+	for (int l = 0; l < nLanes && next < count; l++, next++, busy++)
+		StartInner(lanes[l], state, l, next, *keys[next], texts[next], text_lens[next]);
+
+	while (busy != 0)
+	{
+		for (int l = 0; l < nLanes; l++)
+		{
+			MB_LANE &lane = lanes[l];
+			if (!lane.busy)
+				blocks[l] = idleBlock;
+			else if (lane.fullBlocks != 0)
+			{
+				blocks[l] = lane.data;
+				lane.data += 64;
+				lane.fullBlocks--;
+			}
+			else
+				blocks[l] = lane.tail + 64 * lane.tailPos++;
+		}
+
+		compress(state, blocks);
+
+		for (int l = 0; l < nLanes; l++)
+		{
+			MB_LANE &lane = lanes[l];
+			if (!lane.busy || lane.fullBlocks != 0 || lane.tailPos != lane.tailBlocks)
+				continue;
+
+			if (!lane.outer)
+			{
+				StartOuter(lane, state, l, *keys[lane.job]);
+				continue;
+			}
+
+			BYTE *digest = digests + CHMAC_SHA1::SHA1_DIGEST_LENGTH * lane.job;
+			for (int i = 0; i < 20; i++)
+				digest[i] = (BYTE)(state[i >> 2][l] >> ((3 - (i & 3)) * 8));
+
+			if (next < count)
+			{
+				StartInner(lane, state, l, next, *keys[next], texts[next], text_lens[next]);
+				next++;
+			}
+			else
+			{
+				lane.busy = false;
+				busy--;
+			}
+		}
+	}
+
+#ifdef SHA1_WIPE_VARIABLES
+	memset(state, 0, sizeof(state));
+	for (int l = 0; l < HMAC_SHA1_MB_MAX_LANES; l++)
+		memset(lanes[l].tail, 0, sizeof(lanes[l].tail));
+#endif
+}
+
+}
+
+bool HMAC_SHA1_MB_IsSupported(int nImpl)
+{
+	switch (nImpl)
+	{
+	case HMAC_SHA1_MB_AUTO:
+	case HMAC_SHA1_MB_SCALAR:
+		return true;
+#ifdef SHA1_X86_SIMD
+	case HMAC_SHA1_MB_SSSE3_X4:
+		return SHA1_CPU_HasSSSE3();
+	case HMAC_SHA1_MB_AVX2_X8:
+		return SHA1_CPU_HasAVX2();
+#endif
+	default:
+		return false;
+	}
+}
+
+void HMAC_SHA1_MB(size_t count,
+                  const CHMAC_SHA1::KEY_STATE* const* keys,
+                  const BYTE* const* texts,
+                  const size_t* text_lens,
+                  BYTE* digests,
+                  int nImpl)
+{
+	if (nImpl == HMAC_SHA1_MB_AUTO)
+	{
+		// A single message can't use more than one lane. With two or more,
+		// even the 4 lane version outruns single stream SHA-NI on short
+		// messages.
+		if (count < 2)
+			nImpl = HMAC_SHA1_MB_SCALAR;
+		else if (HMAC_SHA1_MB_IsSupported(HMAC_SHA1_MB_AVX2_X8))
+			nImpl = HMAC_SHA1_MB_AVX2_X8;
+		else if (HMAC_SHA1_MB_IsSupported(HMAC_SHA1_MB_SSSE3_X4))
+			nImpl = HMAC_SHA1_MB_SSSE3_X4;
+		else
+			nImpl = HMAC_SHA1_MB_SCALAR;
+	}
+	if (!HMAC_SHA1_MB_IsSupported(nImpl))
+		nImpl = HMAC_SHA1_MB_SCALAR;
+
+	switch (nImpl)
+	{
+#ifdef SHA1_X86_SIMD
+	case HMAC_SHA1_MB_SSSE3_X4:
+		RunLanes(Compress_SSSE3_X4, 4, count, keys, texts, text_lens, digests);
+		return;
+	case HMAC_SHA1_MB_AVX2_X8:
+		RunLanes(Compress_AVX2_X8, 8, count, keys, texts, text_lens, digests);
+		return;
+#endif
+	default:
+		{
+			CHMAC_SHA1 objHMACSHA1;
+			for (size_t i = 0; i < count; i++)
+				objHMACSHA1.HMAC_SHA1((BYTE *)texts[i], (int)text_lens[i], *keys[i],
+				                      digests + CHMAC_SHA1::SHA1_DIGEST_LENGTH * i);
+		}
+		return;
+	}
+}
@@ -0,0 +1,32 @@
+/*
+	Multi-buffer HMAC-SHA1: signs many independent messages at once by
+	running one SHA-1 state per SIMD lane. SHA-1 is serial within a message,
+	so this is how batches of short messages (e.g. signature base strings)
+	get vector throughput.
+*/
+
+#ifndef __HMAC_SHA1_MB_H__
+#define __HMAC_SHA1_MB_H__
+
+#include "HMAC_SHA1.h"
+
+enum {
+	HMAC_SHA1_MB_AUTO = 0,
+	HMAC_SHA1_MB_SCALAR,   // one message at a time with CHMAC_SHA1
+	HMAC_SHA1_MB_SSSE3_X4, // 4 lanes in 128-bit registers
+	HMAC_SHA1_MB_AVX2_X8   // 8 lanes in 256-bit registers
+};
+
+bool HMAC_SHA1_MB_IsSupported(int nImpl);
+
+// Computes HMAC-SHA1 for count messages. keys[i] is the prepared key for
+// texts[i] (keys may repeat), and the 20 byte digest of message i is written
+// to digests + 20*i.
+void HMAC_SHA1_MB(size_t count,
+                  const CHMAC_SHA1::KEY_STATE* const* keys,
+                  const BYTE* const* texts,
+                  const size_t* text_lens,
+                  BYTE* digests,
+                  int nImpl = HMAC_SHA1_MB_AUTO);
+
+#endif /* __HMAC_SHA1_MB_H__ */
@@ -30,11 +30,25 @@
 */
 
 #include "SHA1.h"
+#include "SHA1_x86.h"
 #include <cassert>
 
 #ifdef SHA1_UTILITY_FUNCTIONS
-#define SHA1_MAX_FILE_BUFFER 8000
+// Read size for files that can't be mapped. A multiple of the block size, so
+// whole reads go straight to the transform without being buffered.
+#define SHA1_MAX_FILE_BUFFER (64 * 1024)
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 #endif
+#endif
+
+// Largest piece UpdateLarge() hands to Update(), which takes a 32-bit length
+#define SHA1_MAX_UPDATE (1UL << 30)
 
 // Rotate x bits to the left
 #ifndef ROL32
@@ -46,14 +60,14 @@
 #endif
 
 #ifdef SHA1_LITTLE_ENDIAN
-#define SHABLK0(i) (m_block->l[i] = \
-	(ROL32(m_block->l[i],24) & 0xFF00FF00) | (ROL32(m_block->l[i],8) & 0x00FF00FF))
+#define SHABLK0(i) (block.l[i] = \
+	(ROL32(block.l[i],24) & 0xFF00FF00) | (ROL32(block.l[i],8) & 0x00FF00FF))
 #else
-#define SHABLK0(i) (m_block->l[i])
+#define SHABLK0(i) (block.l[i])
 #endif
 
-#define SHABLK(i) (m_block->l[i&15] = ROL32(m_block->l[(i+13)&15] ^ m_block->l[(i+8)&15] \
-	^ m_block->l[(i+2)&15] ^ m_block->l[i&15],1))
+#define SHABLK(i) (block.l[i&15] = ROL32(block.l[(i+13)&15] ^ block.l[(i+8)&15] \
+	^ block.l[(i+2)&15] ^ block.l[i&15],1))
 
 // SHA-1 rounds
 #define _R0(v,w,x,y,z,i) { z+=((w&(x^y))^y)+SHABLK0(i)+0x5A827999+ROL32(v,5); w=ROL32(w,30); }
@@ -64,8 +78,6 @@
 
 CSHA1::CSHA1()
 {
-	m_block = (SHA1_WORKSPACE_BLOCK *)m_workspace;
-
 	Reset();
 }
 
@@ -87,12 +99,16 @@ void CSHA1::Reset()
 	m_count[1] = 0;
 }
 
-void CSHA1::Transform(UINT_32 *state, UINT_8 *buffer)
+void CSHA1::TransformScalar(UINT_32 *state, const UINT_8 *data, size_t nBlocks)
 {
+	SHA1_WORKSPACE_BLOCK block;
+
+	for(; nBlocks != 0; nBlocks--, data += 64)
+	{
 	// Copy state[] to working vars
 	UINT_32 a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
 
-	memcpy(m_block, buffer, 64);
+	memcpy(&block, data, 64);
 
 	// 4 rounds of 20 operations each. Loop unrolled.
 	_R0(a,b,c,d,e, 0); _R0(e,a,b,c,d, 1); _R0(d,e,a,b,c, 2); _R0(c,d,e,a,b, 3);
@@ -127,10 +143,83 @@ void CSHA1::Transform(UINT_32 *state, UINT_8 *buffer)
 #ifdef SHA1_WIPE_VARIABLES
 	a = b = c = d = e = 0;
 #endif
+	}
+
+#ifdef SHA1_WIPE_VARIABLES
+	memset(&block, 0, sizeof(block));
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Runtime selection of the block transform
+
+// The first call through m_transform detects the CPU features and replaces
+// itself with the best supported implementation. Threads hashing for the
+// first time at once all pick the same one, and each stores it atomically.
+void CSHA1::TransformAutoSelect(UINT_32 *state, const UINT_8 *data, size_t nBlocks)
+{
+	SetTransform(TRANSFORM_AUTO);
+	Transform(state, data, nBlocks);
+}
+
+SHA1_TRANSFORM_FN CSHA1::m_transform = TransformAutoSelect;
+int CSHA1::m_transformImpl = CSHA1::TRANSFORM_AUTO;
+
+bool CSHA1::IsTransformSupported(int nImpl)
+{
+	switch(nImpl)
+	{
+	case TRANSFORM_AUTO:
+	case TRANSFORM_SCALAR:
+		return true;
+#ifdef SHA1_X86_SIMD
+	case TRANSFORM_SSSE3:
+		return SHA1_CPU_HasSSSE3();
+	case TRANSFORM_AVX2:
+		return SHA1_CPU_HasAVX2();
+	case TRANSFORM_SHANI:
+		return SHA1_CPU_HasSHANI();
+#endif
+	default:
+		return false;
+	}
+}
+
+bool CSHA1::SetTransform(int nImpl)
+{
+	if(!IsTransformSupported(nImpl)) return false;
+
+	if(nImpl == TRANSFORM_AUTO)
+	{
+		if(IsTransformSupported(TRANSFORM_SHANI)) nImpl = TRANSFORM_SHANI;
+		else if(IsTransformSupported(TRANSFORM_AVX2)) nImpl = TRANSFORM_AVX2;
+		else if(IsTransformSupported(TRANSFORM_SSSE3)) nImpl = TRANSFORM_SSSE3;
+		else nImpl = TRANSFORM_SCALAR;
+	}
+
+	SHA1_TRANSFORM_FN transform;
+	switch(nImpl)
+	{
+#ifdef SHA1_X86_SIMD
+	case TRANSFORM_SSSE3: transform = SHA1_Transform_SSSE3; break;
+	case TRANSFORM_AVX2: transform = SHA1_Transform_AVX2; break;
+	case TRANSFORM_SHANI: transform = SHA1_Transform_SHANI; break;
+#endif
+	default: transform = TransformScalar; break;
+	}
+	OAuth::AtomicStore(&m_transform, transform);
+	OAuth::AtomicStore(&m_transformImpl, nImpl);
+	return true;
+}
+
+int CSHA1::GetTransform()
+{
+	if(OAuth::AtomicLoad(&m_transformImpl) == TRANSFORM_AUTO) SetTransform(TRANSFORM_AUTO);
+	return OAuth::AtomicLoad(&m_transformImpl);
 }
 
 // Use this function to hash in binary data and strings
-void CSHA1::Update(UINT_8 *data, UINT_32 len)
+void CSHA1::Update(const UINT_8 *data, UINT_32 len)
 {
 	UINT_32 i, j;
 
@@ -144,9 +233,16 @@ void CSHA1::Update(UINT_8 *data, UINT_32 len)
 	{
 		i = 64 - j;
 		memcpy(&m_buffer[j], data, i);
-		Transform(m_state, m_buffer);
+		Transform(m_state, m_buffer, 1);
 
-		for(; i + 63 < len; i += 64) Transform(m_state, &data[i]);
+		// Hand all remaining full blocks over at once so the SIMD
+		// transforms can work on more than one block at a time
+		UINT_32 nBlocks = (len - i) >> 6;
+		if(nBlocks != 0)
+		{
+			Transform(m_state, &data[i], nBlocks);
+			i += nBlocks << 6;
+		}
 
 		j = 0;
 	}
@@ -155,53 +251,86 @@ void CSHA1::Update(UINT_8 *data, UINT_32 len)
 	memcpy(&m_buffer[j], &data[i], len - i);
 }
 
+void CSHA1::UpdateLarge(const UINT_8 *data, size_t len)
+{
+	while(len > SHA1_MAX_UPDATE)
+	{
+		Update(data, (UINT_32)SHA1_MAX_UPDATE);
+		data += SHA1_MAX_UPDATE;
+		len -= SHA1_MAX_UPDATE;
+	}
+	Update(data, (UINT_32)len);
+}
+
 #ifdef SHA1_UTILITY_FUNCTIONS
 // Hash in file contents
-bool CSHA1::HashFile(char *szFileName)
+bool CSHA1::HashFile(const char *szFileName)
 {
-	unsigned long ulFileSize, ulRest, ulBlocks;
-	unsigned long i;
-	UINT_8 uData[SHA1_MAX_FILE_BUFFER];
-	FILE *fIn;
-
 	if(szFileName == NULL) return false;
 
-	fIn = fopen(szFileName, "rb");
+#ifndef _WIN32
+	int fd = open(szFileName, O_RDONLY);
+	if(fd < 0) return false;
+
+	bool bResult = HashFileDescriptor(fd);
+	close(fd);
+	return bResult;
+#else
+	FILE *fIn = fopen(szFileName, "rb");
 	if(fIn == NULL) return false;
 
-	fseek(fIn, 0, SEEK_END);
-	ulFileSize = (unsigned long)ftell(fIn);
-	fseek(fIn, 0, SEEK_SET);
+	UINT_8 *uData = new UINT_8[SHA1_MAX_FILE_BUFFER];
+	size_t nRead;
+	while((nRead = fread(uData, 1, SHA1_MAX_FILE_BUFFER, fIn)) != 0)
+		Update(uData, (UINT_32)nRead);
 
-	if(ulFileSize != 0)
-	{
-		ulBlocks = ulFileSize / SHA1_MAX_FILE_BUFFER;
-		ulRest = ulFileSize % SHA1_MAX_FILE_BUFFER;
-	}
-	else
-	{
-		ulBlocks = 0;
-		ulRest = 0;
-	}
+	bool bResult = (ferror(fIn) == 0);
+	fclose(fIn); fIn = NULL;
+	delete[] uData;
+	return bResult;
+#endif
+}
 
-	for(i = 0; i < ulBlocks; i++)
+#ifndef _WIN32
+bool CSHA1::HashFileDescriptor(int fd)
+{
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0) return false;
+
+	// Regular files are mapped and hashed in place. Nothing is copied, and
+	// the kernel reads ahead since the access is sequential. The size is
+	// only a hint: procfs and sysfs files report 0, and files still being
+	// written may grow, so whatever follows is read below.
+	if(S_ISREG(st.st_mode))
 	{
-		size_t nread = fread(uData, 1, SHA1_MAX_FILE_BUFFER, fIn);
-                assert(nread == SHA1_MAX_FILE_BUFFER);
-		Update((UINT_8 *)uData, SHA1_MAX_FILE_BUFFER);
+		off_t offset = lseek(fd, 0, SEEK_CUR);
+		void *pMap = (offset >= 0 && offset < st.st_size) ?
+			mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		if(pMap != MAP_FAILED)
+		{
+			madvise(pMap, (size_t)st.st_size, MADV_SEQUENTIAL);
+			UpdateLarge((const UINT_8 *)pMap + offset, (size_t)(st.st_size - offset));
+			munmap(pMap, (size_t)st.st_size);
+			lseek(fd, st.st_size, SEEK_SET);
+		}
 	}
 
-	if(ulRest != 0)
+	// Pipes, sockets, anything that can't be mapped and the rest of regular
+	// files, until EOF
+	UINT_8 *uData = new UINT_8[SHA1_MAX_FILE_BUFFER];
+	bool bResult = true;
+	for(;;)
 	{
-		size_t nread = fread(uData, 1, ulRest, fIn);
-                assert(nread == ulRest);
-		Update((UINT_8 *)uData, ulRest);
+		ssize_t nRead = read(fd, uData, SHA1_MAX_FILE_BUFFER);
+		if(nRead > 0) Update(uData, (UINT_32)nRead);
+		else if(nRead == 0) break;
+		else if(errno != EINTR) { bResult = false; break; }
 	}
-
-	fclose(fIn); fIn = NULL;
-	return true;
+	delete[] uData;
+	return bResult;
 }
 #endif
+#endif
 
 void CSHA1::Final()
 {
@@ -231,7 +360,6 @@ void CSHA1::Final()
 	memset(m_state, 0, 20);
 	memset(m_count, 0, 8);
 	memset(finalcount, 0, 8);
-	Transform(m_state, m_buffer);
 #endif
 }
 
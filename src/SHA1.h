@@ -37,6 +37,8 @@
 #endif
 
 #include <memory.h> // Needed for memset and memcpy
+#include <stddef.h> // Needed for size_t
+#include "atomic.h" // Needed for publishing the selected transform
 
 #ifdef SHA1_UTILITY_FUNCTIONS
 #include <stdio.h>  // Needed for file access and sprintf
@@ -96,6 +98,9 @@ typedef union
 	UINT_32 l[16];
 } SHA1_WORKSPACE_BLOCK;
 
+// Block transform: compresses nBlocks consecutive 64-byte blocks into state
+typedef void (*SHA1_TRANSFORM_FN)(UINT_32 *state, const UINT_8 *data, size_t nBlocks);
+
 class CSHA1
 {
 public:
@@ -108,6 +113,24 @@ public:
 	};
 #endif
 
+	// Block transform implementations. TRANSFORM_AUTO picks the fastest one
+	// the running CPU supports; the others force a specific code path, which
+	// is mainly useful for testing and benchmarking.
+	enum
+	{
+		TRANSFORM_AUTO = 0,
+		TRANSFORM_SCALAR,
+		TRANSFORM_SSSE3,  // SSSE3 message schedule, scalar rounds
+		TRANSFORM_AVX2,   // AVX2 message schedule for two blocks at a time
+		TRANSFORM_SHANI   // x86 SHA extensions
+	};
+
+	static bool IsTransformSupported(int nImpl);
+	// The selection is published atomically, so it may change while other
+	// threads hash; each block uses whichever transform was selected last
+	static bool SetTransform(int nImpl);
+	static int GetTransform();
+
 	// Constructor and Destructor
 	CSHA1();
 	~CSHA1();
@@ -122,9 +145,15 @@ public:
 	void Reset();
 
 	// Update the hash value
-	void Update(UINT_8 *data, UINT_32 len);
+	void Update(const UINT_8 *data, UINT_32 len);
+	// Same as Update(), for buffers of any size (e.g. a mapped file)
+	void UpdateLarge(const UINT_8 *data, size_t len);
 #ifdef SHA1_UTILITY_FUNCTIONS
-	bool HashFile(char *szFileName);
+	bool HashFile(const char *szFileName);
+#ifndef _WIN32
+	// Hash everything that can be read from fd, from its current position
+	bool HashFileDescriptor(int fd);
+#endif
 #endif
 
 	// Finalize hash and report
@@ -136,13 +165,21 @@ public:
 #endif
 	void GetHash(UINT_8 *puDest);
 
+	// Portable SHA-1 transformation, always available
+	static void TransformScalar(UINT_32 *state, const UINT_8 *data, size_t nBlocks);
+
 private:
-	// Private SHA-1 transformation
-	void Transform(UINT_32 *state, UINT_8 *buffer);
+	// Dispatches to the selected block transform
+	static void Transform(UINT_32 *state, const UINT_8 *data, size_t nBlocks)
+	{
+		SHA1_TRANSFORM_FN transform = OAuth::AtomicLoad(&m_transform);
+		transform(state, data, nBlocks);
+	}
+
+	static void TransformAutoSelect(UINT_32 *state, const UINT_8 *data, size_t nBlocks);
 
-	// Member variables
-	UINT_8 m_workspace[64];
-	SHA1_WORKSPACE_BLOCK *m_block; // SHA1 pointer to the byte array above
+	static SHA1_TRANSFORM_FN m_transform;
+	static int m_transformImpl;
 };
 
 #endif
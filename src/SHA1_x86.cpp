@@ -0,0 +1,351 @@
+/*
+	x86 SIMD block transforms for CSHA1.
+
+	- SSSE3: the message schedule is computed four words at a time. Words
+	  16-31 need a fix-up for the dependency of W[i+3] on W[i]; from word 32
+	  on the equivalent recurrence
+	      W[i] = (W[i-6] ^ W[i-16] ^ W[i-28] ^ W[i-32]) rol 2
+	  has no dependencies within a vector. The rounds stay scalar but consume
+	  the precomputed W[i]+K values.
+	- AVX2: the same schedule, but each 128-bit lane works on a different
+	  block so two blocks are scheduled per pass.
+	- SHA-NI: the SHA extensions do both the schedule and the rounds.
+*/
+
+#include "SHA1_x86.h"
+
+#ifdef SHA1_X86_SIMD
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// CPU feature detection
+
+namespace {
+
+struct SHA1_CPU_FEATURES
+{
+	bool ssse3;
+	bool sse41;
+	bool avx2;
+	bool sha;
+};
+
+SHA1_CPU_FEATURES DetectCPU()
+{
+	SHA1_CPU_FEATURES f = { false, false, false, false };
+	unsigned int eax, ebx, ecx, edx;
+
+	unsigned int maxLeaf = __get_cpuid_max(0, 0);
+	if(maxLeaf < 1) return f;
+
+	__cpuid(1, eax, ebx, ecx, edx);
+	f.ssse3 = (ecx & (1u << 9)) != 0;
+	f.sse41 = (ecx & (1u << 19)) != 0;
+
+	// AVX2 also needs the OS to save the YMM registers on context switch
+	bool ymmEnabled = false;
+	if((ecx & (1u << 27)) && (ecx & (1u << 28)))
+	{
+		unsigned int xcr0Lo, xcr0Hi;
+		__asm__ __volatile__("xgetbv" : "=a"(xcr0Lo), "=d"(xcr0Hi) : "c"(0));
+		ymmEnabled = (xcr0Lo & 6) == 6;
+	}
+
+	if(maxLeaf >= 7)
+	{
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		f.avx2 = ymmEnabled && (ebx & (1u << 5)) != 0;
+		f.sha = (ebx & (1u << 29)) != 0;
+	}
+	return f;
+}
+
+const SHA1_CPU_FEATURES& CPU()
+{
+	static const SHA1_CPU_FEATURES features = DetectCPU();
+	return features;
+}
+
+}
+
+bool SHA1_CPU_HasSSSE3()
+{
+	return CPU().ssse3;
+}
+
+bool SHA1_CPU_HasAVX2()
+{
+	return CPU().avx2 && CPU().ssse3;
+}
+
+bool SHA1_CPU_HasSHANI()
+{
+	return CPU().sha && CPU().sse41 && CPU().ssse3;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Scalar rounds over a precomputed W[i]+K schedule
+
+#define SHA1X_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define SHA1X_F0(w,x,y) (((w) & ((x) ^ (y))) ^ (y))
+#define SHA1X_F1(w,x,y) ((w) ^ (x) ^ (y))
+#define SHA1X_F2(w,x,y) ((((w) | (x)) & (y)) | ((w) & (x)))
+
+#define SHA1X_R(f,v,w,x,y,z,i) { z += f(w,x,y) + wk[i] + SHA1X_ROL(v,5); w = SHA1X_ROL(w,30); }
+#define SHA1X_R5(f,i) \
+	SHA1X_R(f,a,b,c,d,e,(i)+0); SHA1X_R(f,e,a,b,c,d,(i)+1); SHA1X_R(f,d,e,a,b,c,(i)+2); \
+	SHA1X_R(f,c,d,e,a,b,(i)+3); SHA1X_R(f,b,c,d,e,a,(i)+4)
+
+static inline __attribute__((always_inline)) void RoundsWK(UINT_32 *state, const UINT_32 *wk)
+{
+	UINT_32 a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+	SHA1X_R5(SHA1X_F0, 0); SHA1X_R5(SHA1X_F0, 5); SHA1X_R5(SHA1X_F0,10); SHA1X_R5(SHA1X_F0,15);
+	SHA1X_R5(SHA1X_F1,20); SHA1X_R5(SHA1X_F1,25); SHA1X_R5(SHA1X_F1,30); SHA1X_R5(SHA1X_F1,35);
+	SHA1X_R5(SHA1X_F2,40); SHA1X_R5(SHA1X_F2,45); SHA1X_R5(SHA1X_F2,50); SHA1X_R5(SHA1X_F2,55);
+	SHA1X_R5(SHA1X_F1,60); SHA1X_R5(SHA1X_F1,65); SHA1X_R5(SHA1X_F1,70); SHA1X_R5(SHA1X_F1,75);
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+static const UINT_32 SHA1X_K[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+
+/////////////////////////////////////////////////////////////////////////////
+// SSSE3 message schedule
+
+__attribute__((target("ssse3")))
+static inline __m128i Rol128(__m128i x, int n)
+{
+	return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n));
+}
+
+__attribute__((target("ssse3")))
+static void Schedule128(const UINT_8 *data, UINT_32 *wk)
+{
+	const __m128i bswap = _mm_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+	__m128i w[20];
+	int k;
+
+	for(k = 0; k < 4; k++)
+		w[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * k)), bswap);
+
+	for(k = 4; k < 8; k++)
+	{
+		// Lane 3 is missing W[i] here, it is folded in below
+		__m128i t = _mm_xor_si128(_mm_srli_si128(w[k-1], 4), w[k-2]);
+		t = _mm_xor_si128(t, _mm_alignr_epi8(w[k-3], w[k-4], 8));
+		t = _mm_xor_si128(t, w[k-4]);
+		t = Rol128(t, 1);
+		w[k] = _mm_xor_si128(t, Rol128(_mm_slli_si128(t, 12), 1));
+	}
+
+	for(k = 8; k < 20; k++)
+	{
+		__m128i t = _mm_xor_si128(_mm_alignr_epi8(w[k-1], w[k-2], 8), w[k-4]);
+		t = _mm_xor_si128(t, _mm_xor_si128(w[k-7], w[k-8]));
+		w[k] = Rol128(t, 2);
+	}
+
+	for(k = 0; k < 20; k++)
+	{
+		__m128i kv = _mm_set1_epi32((int)SHA1X_K[k / 5]);
+		_mm_storeu_si128((__m128i *)(wk + 4 * k), _mm_add_epi32(w[k], kv));
+	}
+}
+
+__attribute__((target("ssse3")))
+void SHA1_Transform_SSSE3(UINT_32 *state, const UINT_8 *data, size_t nBlocks)
+{
+	UINT_32 wk[80];
+
+	for(; nBlocks != 0; nBlocks--, data += 64)
+	{
+		Schedule128(data, wk);
+		RoundsWK(state, wk);
+	}
+
+#ifdef SHA1_WIPE_VARIABLES
+	memset(wk, 0, sizeof(wk));
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// AVX2 message schedule, two blocks per pass
+
+__attribute__((target("avx2")))
+static inline __m256i Rol256(__m256i x, int n)
+{
+	return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+// Byte shifts and alignr work within each 128-bit lane, so the schedule code
+// is the SSSE3 one with block A in the low lane and block B in the high lane.
+__attribute__((target("avx2")))
+static void Schedule256(const UINT_8 *data, UINT_32 *wkA, UINT_32 *wkB)
+{
+	const __m256i bswap = _mm256_set_epi8(
+		12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3,
+		12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+	__m256i w[20];
+	int k;
+
+	for(k = 0; k < 4; k++)
+	{
+		__m128i lo = _mm_loadu_si128((const __m128i *)(data + 16 * k));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(data + 64 + 16 * k));
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		w[k] = _mm256_shuffle_epi8(v, bswap);
+	}
+
+	for(k = 4; k < 8; k++)
+	{
+		__m256i t = _mm256_xor_si256(_mm256_srli_si256(w[k-1], 4), w[k-2]);
+		t = _mm256_xor_si256(t, _mm256_alignr_epi8(w[k-3], w[k-4], 8));
+		t = _mm256_xor_si256(t, w[k-4]);
+		t = Rol256(t, 1);
+		w[k] = _mm256_xor_si256(t, Rol256(_mm256_slli_si256(t, 12), 1));
+	}
+
+	for(k = 8; k < 20; k++)
+	{
+		__m256i t = _mm256_xor_si256(_mm256_alignr_epi8(w[k-1], w[k-2], 8), w[k-4]);
+		t = _mm256_xor_si256(t, _mm256_xor_si256(w[k-7], w[k-8]));
+		w[k] = Rol256(t, 2);
+	}
+
+	for(k = 0; k < 20; k++)
+	{
+		__m256i v = _mm256_add_epi32(w[k], _mm256_set1_epi32((int)SHA1X_K[k / 5]));
+		_mm_storeu_si128((__m128i *)(wkA + 4 * k), _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i *)(wkB + 4 * k), _mm256_extracti128_si256(v, 1));
+	}
+}
+
+__attribute__((target("avx2")))
+void SHA1_Transform_AVX2(UINT_32 *state, const UINT_8 *data, size_t nBlocks)
+{
+	UINT_32 wkA[80], wkB[80];
+
+	for(; nBlocks >= 2; nBlocks -= 2, data += 128)
+	{
+		Schedule256(data, wkA, wkB);
+		RoundsWK(state, wkA);
+		RoundsWK(state, wkB);
+	}
+
+	if(nBlocks != 0)
+	{
+		Schedule128(data, wkA);
+		RoundsWK(state, wkA);
+	}
+
+#ifdef SHA1_WIPE_VARIABLES
+	memset(wkA, 0, sizeof(wkA));
+	memset(wkB, 0, sizeof(wkB));
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// SHA extensions
+
+// Four rounds. Ea receives the next E from Cur, Eb saves ABCD for the
+// following group; the message words for later groups are advanced with
+// sha1msg1/sha1msg2/xor as soon as Cur is available.
+#define SHA1X_NI_ROUNDS(f, Ea, Eb, Cur) \
+	Ea = _mm_sha1nexte_epu32(Ea, Cur); \
+	Eb = abcd; \
+	abcd = _mm_sha1rnds4_epu32(abcd, Ea, f)
+
+#define SHA1X_NI_MSG1(M, Cur) M = _mm_sha1msg1_epu32(M, Cur)
+#define SHA1X_NI_MSG2(M, Cur) M = _mm_sha1msg2_epu32(M, Cur)
+#define SHA1X_NI_XOR(M, Cur)  M = _mm_xor_si128(M, Cur)
+
+__attribute__((target("sha,sse4.1")))
+void SHA1_Transform_SHANI(UINT_32 *state, const UINT_8 *data, size_t nBlocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcdSave, e0, e0Save, e1;
+	__m128i m0, m1, m2, m3;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	for(; nBlocks != 0; nBlocks--, data += 64)
+	{
+		abcdSave = abcd;
+		e0Save = e0;
+
+		// Rounds 0-15, loading the message
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), bswap);
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), bswap);
+		SHA1X_NI_ROUNDS(0, e1, e0, m1);
+		SHA1X_NI_MSG1(m0, m1);
+
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), bswap);
+		SHA1X_NI_ROUNDS(0, e0, e1, m2);
+		SHA1X_NI_MSG1(m1, m2);
+		SHA1X_NI_XOR(m0, m2);
+
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), bswap);
+		SHA1X_NI_MSG2(m0, m3);
+		SHA1X_NI_ROUNDS(0, e1, e0, m3);
+		SHA1X_NI_MSG1(m2, m3);
+		SHA1X_NI_XOR(m1, m3);
+
+		// Rounds 16-63, steady state
+#define SHA1X_NI_STEADY(f, Ea, Eb, Cur, Next, Next2, Prev) \
+		SHA1X_NI_MSG2(Next, Cur); \
+		SHA1X_NI_ROUNDS(f, Ea, Eb, Cur); \
+		SHA1X_NI_MSG1(Prev, Cur); \
+		SHA1X_NI_XOR(Next2, Cur)
+
+		SHA1X_NI_STEADY(0, e0, e1, m0, m1, m2, m3); // 16-19
+		SHA1X_NI_STEADY(1, e1, e0, m1, m2, m3, m0); // 20-23
+		SHA1X_NI_STEADY(1, e0, e1, m2, m3, m0, m1); // 24-27
+		SHA1X_NI_STEADY(1, e1, e0, m3, m0, m1, m2); // 28-31
+		SHA1X_NI_STEADY(1, e0, e1, m0, m1, m2, m3); // 32-35
+		SHA1X_NI_STEADY(1, e1, e0, m1, m2, m3, m0); // 36-39
+		SHA1X_NI_STEADY(2, e0, e1, m2, m3, m0, m1); // 40-43
+		SHA1X_NI_STEADY(2, e1, e0, m3, m0, m1, m2); // 44-47
+		SHA1X_NI_STEADY(2, e0, e1, m0, m1, m2, m3); // 48-51
+		SHA1X_NI_STEADY(2, e1, e0, m1, m2, m3, m0); // 52-55
+		SHA1X_NI_STEADY(2, e0, e1, m2, m3, m0, m1); // 56-59
+		SHA1X_NI_STEADY(3, e1, e0, m3, m0, m1, m2); // 60-63
+#undef SHA1X_NI_STEADY
+
+		// Rounds 64-79, draining the schedule
+		SHA1X_NI_MSG2(m1, m0);
+		SHA1X_NI_ROUNDS(3, e0, e1, m0);              // 64-67
+		SHA1X_NI_MSG1(m3, m0);
+		SHA1X_NI_XOR(m2, m0);
+
+		SHA1X_NI_MSG2(m2, m1);
+		SHA1X_NI_ROUNDS(3, e1, e0, m1);              // 68-71
+		SHA1X_NI_XOR(m3, m1);
+
+		SHA1X_NI_MSG2(m3, m2);
+		SHA1X_NI_ROUNDS(3, e0, e1, m2);              // 72-75
+
+		SHA1X_NI_ROUNDS(3, e1, e0, m3);              // 76-79
+
+		e0 = _mm_sha1nexte_epu32(e0, e0Save);
+		abcd = _mm_add_epi32(abcd, abcdSave);
+	}
+
+	abcd = _mm_shuffle_epi32(abcd, 0x1B);
+	_mm_storeu_si128((__m128i *)state, abcd);
+	state[4] = (UINT_32)_mm_extract_epi32(e0, 3);
+}
+
+#endif // SHA1_X86_SIMD
@@ -0,0 +1,33 @@
+/*
+	x86 SIMD block transforms for CSHA1, selected at runtime by
+	CSHA1::SetTransform based on what the CPU supports.
+*/
+
+#ifndef ___SHA1_X86_HDR___
+#define ___SHA1_X86_HDR___
+
+#include "SHA1.h"
+
+// The SIMD paths rely on per-function target attributes, so they are only
+// built for GCC-compatible compilers targeting x86.
+#if !defined(SHA1_NO_X86_SIMD) && (defined(__GNUC__) || defined(__clang__)) && \
+	(defined(__x86_64__) || defined(__i386__))
+#define SHA1_X86_SIMD
+#endif
+
+#ifdef SHA1_X86_SIMD
+
+bool SHA1_CPU_HasSSSE3();
+bool SHA1_CPU_HasAVX2();
+bool SHA1_CPU_HasSHANI();
+
+// Vectorized message schedule, scalar rounds
+void SHA1_Transform_SSSE3(UINT_32 *state, const UINT_8 *data, size_t nBlocks);
+// Same, computing the schedules of two blocks at once in 256-bit registers
+void SHA1_Transform_AVX2(UINT_32 *state, const UINT_8 *data, size_t nBlocks);
+// SHA extensions (sha1rnds4, sha1nexte, sha1msg1, sha1msg2)
+void SHA1_Transform_SHANI(UINT_32 *state, const UINT_8 *data, size_t nBlocks);
+
+#endif
+
+#endif
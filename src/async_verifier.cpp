@@ -0,0 +1,436 @@
+#include <liboauthcpp/liboauthcpp.h>
+#include "signing_key.h"
+#include "nonce.h"
+#include "mutex.h"
+#include <vector>
+#include <deque>
+#include <map>
+#include <cassert>
+
+#ifndef _WIN32
+#include <time.h>
+#include <errno.h>
+#endif
+
+namespace OAuth {
+
+namespace {
+
+// A consumer and token pair in a batch, and what the resolver found
+struct BatchItem {
+    enum Status { UnknownConsumer, Found, UnknownToken };
+
+    std::string consumerKey;
+    std::string token;
+    Status status;
+    std::string consumerSecret;
+    std::string tokenSecret;
+    CHMAC_SHA1::KEY_STATE key;
+};
+
+// A request waiting for its batch, and the scratch space it was checked in
+struct AsyncRequest {
+    VerificationBuffer buffer;
+    VerificationCallback* callback;
+    std::size_t item;
+};
+
+void SleepSeconds(double seconds) {
+    if (seconds <= 0)
+        return;
+#ifdef _WIN32
+    Sleep((DWORD)(seconds * 1000));
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+#endif
+}
+
+}
+
+// Items are kept when a batch is reused, so their strings keep their
+// memory; only the first size are in use
+struct SecretBatch::State {
+    AsyncVerifier* owner;
+    std::vector<BatchItem> items;
+    std::size_t size;
+    std::vector<AsyncRequest*> requests;
+    std::string signingKey;
+
+    State() : owner(NULL), size(0) {}
+};
+
+SecretBatch::SecretBatch()
+ : mState(new State)
+{
+}
+
+SecretBatch::~SecretBatch()
+{
+    delete mState;
+}
+
+std::size_t SecretBatch::size() const
+{
+    return mState->size;
+}
+
+const std::string& SecretBatch::consumerKey(std::size_t i) const
+{
+    assert(i < mState->size);
+    return mState->items[i].consumerKey;
+}
+
+const std::string& SecretBatch::token(std::size_t i) const
+{
+    assert(i < mState->size);
+    return mState->items[i].token;
+}
+
+void SecretBatch::setSecrets(std::size_t i, const std::string& consumerSecret,
+                             const std::string& tokenSecret)
+{
+    assert(i < mState->size);
+    BatchItem& item = mState->items[i];
+    item.status = BatchItem::Found;
+    item.consumerSecret = consumerSecret;
+    if (item.token.length())
+        item.tokenSecret = tokenSecret;
+    else
+        item.tokenSecret.clear();
+}
+
+void SecretBatch::setUnknownToken(std::size_t i)
+{
+    assert(i < mState->size);
+    mState->items[i].status = BatchItem::UnknownToken;
+}
+
+void SecretBatch::complete()
+{
+    mState->owner->complete(*this);
+}
+
+struct AsyncVerifier::State {
+    const Verifier* verifier;
+    BatchSecretResolver* resolver;
+    std::size_t maxBatch;
+
+    Mutex mutex;
+    // Signalled as requests complete, for drain()
+    Condition completed;
+    // The batch requests are added to, or NULL before the first
+    SecretBatch* open;
+    std::vector<SecretBatch*> freeBatches;
+    std::vector<AsyncRequest*> freeRequests;
+    std::size_t outstanding;
+    std::size_t batches;
+
+    State() : verifier(NULL), resolver(NULL), maxBatch(0), open(NULL), outstanding(0), batches(0) {}
+};
+
+AsyncVerifier::AsyncVerifier(const Verifier* verifier, BatchSecretResolver* resolver,
+                             std::size_t maxBatch)
+ : mState(new State)
+{
+    assert(maxBatch > 0);
+    mState->verifier = verifier;
+    mState->resolver = resolver;
+    mState->maxBatch = maxBatch;
+}
+
+AsyncVerifier::~AsyncVerifier()
+{
+    drain();
+    for (std::size_t i = 0; i < mState->freeBatches.size(); i++)
+        delete mState->freeBatches[i];
+    for (std::size_t i = 0; i < mState->freeRequests.size(); i++)
+        delete mState->freeRequests[i];
+    delete mState;
+}
+
+void AsyncVerifier::submit(const Http::RequestType eType,
+                           const std::string& rawUrl,
+                           const std::string& authorizationHeader,
+                           const std::string& rawData,
+                           VerificationCallback* callback)
+{
+    State& state = *mState;
+    AsyncRequest* request = NULL;
+    {
+        ScopedLock lock(state.mutex);
+        if (state.freeRequests.empty()) {
+            request = new AsyncRequest;
+        }
+        else {
+            request = state.freeRequests.back();
+            state.freeRequests.pop_back();
+        }
+        state.outstanding++;
+    }
+    request->callback = callback;
+
+    Verification::Result result = state.verifier->prepareVerify(request->buffer, eType, rawUrl, authorizationHeader, rawData);
+    if (result != Verification::Valid) {
+        callback->verified(result, request->buffer);
+        ScopedLock lock(state.mutex);
+        state.freeRequests.push_back(request);
+        state.outstanding--;
+        state.completed.broadcast();
+        return;
+    }
+
+    const std::string& consumerKey = request->buffer.consumerKey();
+    const std::string& token = request->buffer.token();
+    SecretBatch* full = NULL;
+    {
+        ScopedLock lock(state.mutex);
+        if (!state.open) {
+            if (state.freeBatches.empty()) {
+                state.open = new SecretBatch;
+            }
+            else {
+                state.open = state.freeBatches.back();
+                state.freeBatches.pop_back();
+            }
+            state.open->mState->owner = this;
+        }
+        SecretBatch::State& batch = *state.open->mState;
+
+        // Requests with the same secrets share an item
+        std::size_t i = 0;
+        while (i < batch.size && (batch.items[i].consumerKey != consumerKey || batch.items[i].token != token))
+            i++;
+        if (i == batch.size) {
+            if (batch.items.size() == batch.size)
+                batch.items.push_back(BatchItem());
+            BatchItem& item = batch.items[batch.size++];
+            item.consumerKey = consumerKey;
+            item.token = token;
+            item.status = BatchItem::UnknownConsumer;
+        }
+        request->item = i;
+        batch.requests.push_back(request);
+
+        if (batch.requests.size() >= state.maxBatch) {
+            full = state.open;
+            state.open = NULL;
+            state.batches++;
+        }
+    }
+    // Sent without the lock, as the resolver may complete it right away
+    if (full)
+        state.resolver->resolve(*full);
+}
+
+void AsyncVerifier::flush()
+{
+    State& state = *mState;
+    SecretBatch* batch = NULL;
+    {
+        ScopedLock lock(state.mutex);
+        if (state.open && state.open->mState->requests.size()) {
+            batch = state.open;
+            state.open = NULL;
+            state.batches++;
+        }
+    }
+    if (batch)
+        state.resolver->resolve(*batch);
+}
+
+void AsyncVerifier::drain()
+{
+    flush();
+    State& state = *mState;
+    ScopedLock lock(state.mutex);
+    while (state.outstanding)
+        state.completed.wait(state.mutex);
+}
+
+std::size_t AsyncVerifier::outstanding() const
+{
+    ScopedLock lock(mState->mutex);
+    return mState->outstanding;
+}
+
+std::size_t AsyncVerifier::batches() const
+{
+    ScopedLock lock(mState->mutex);
+    return mState->batches;
+}
+
+void AsyncVerifier::complete(SecretBatch& secretBatch)
+{
+    State& state = *mState;
+    SecretBatch::State& batch = *secretBatch.mState;
+
+    // Each pair's key is built once, for all of its requests
+    for (std::size_t i = 0; i < batch.size; i++) {
+        BatchItem& item = batch.items[i];
+        if (item.status == BatchItem::Found)
+            PrepareSigningKey(item.consumerSecret, item.tokenSecret, batch.signingKey, &item.key);
+    }
+
+    for (std::size_t r = 0; r < batch.requests.size(); r++) {
+        AsyncRequest& request = *batch.requests[r];
+        const BatchItem& item = batch.items[request.item];
+        Verification::Result result = Verification::UnknownConsumer;
+        if (item.status == BatchItem::Found) {
+            CredentialCache::SigningKey key;
+            key.state = item.key;
+            result = state.verifier->finishVerify(request.buffer, key);
+        }
+        else if (item.status == BatchItem::UnknownToken) {
+            result = Verification::UnknownToken;
+        }
+        request.callback->verified(result, request.buffer);
+    }
+
+    ScopedLock lock(state.mutex);
+    state.freeRequests.insert(state.freeRequests.end(), batch.requests.begin(), batch.requests.end());
+    state.outstanding -= batch.requests.size();
+    batch.requests.clear();
+    batch.size = 0;
+    state.freeBatches.push_back(&secretBatch);
+    state.completed.broadcast();
+}
+
+// Batches wait in a queue for the thread completing them, in order
+struct MemorySecretResolver::State {
+    double latency;
+    double perKeyLatency;
+
+    Mutex mutex;
+    Condition changed;
+    std::map<std::string, std::string> consumers;
+    std::map<std::pair<std::string, std::string>, std::string> tokens;
+    std::deque<std::pair<double, SecretBatch*> > queue;
+    bool stopping;
+    std::size_t batches;
+    std::size_t lookups;
+#ifndef _WIN32
+    bool threadStarted;
+    pthread_t thread;
+#endif
+
+    State(double l, double k)
+     : latency(l), perKeyLatency(k), stopping(false), batches(0), lookups(0)
+#ifndef _WIN32
+       , threadStarted(false)
+#endif
+    {}
+
+    void fill(SecretBatch& batch) {
+        ScopedLock lock(mutex);
+        for (std::size_t i = 0; i < batch.size(); i++) {
+            std::map<std::string, std::string>::const_iterator consumer = consumers.find(batch.consumerKey(i));
+            if (consumer == consumers.end())
+                continue;
+            if (batch.token(i).empty()) {
+                batch.setSecrets(i, consumer->second);
+                continue;
+            }
+            std::map<std::pair<std::string, std::string>, std::string>::const_iterator token =
+                tokens.find(std::make_pair(batch.consumerKey(i), batch.token(i)));
+            if (token == tokens.end())
+                batch.setUnknownToken(i);
+            else
+                batch.setSecrets(i, consumer->second, token->second);
+        }
+        batches++;
+        lookups += batch.size();
+    }
+
+#ifndef _WIN32
+    static void* run(void* arg) {
+        State& state = *(State*)arg;
+        for (;;) {
+            std::pair<double, SecretBatch*> next;
+            {
+                ScopedLock lock(state.mutex);
+                while (state.queue.empty() && !state.stopping)
+                    state.changed.wait(state.mutex);
+                if (state.queue.empty())
+                    return NULL;
+                next = state.queue.front();
+                state.queue.pop_front();
+            }
+            SleepSeconds(next.first - monotonic_now());
+            state.fill(*next.second);
+            next.second->complete();
+        }
+    }
+#endif
+};
+
+MemorySecretResolver::MemorySecretResolver(double latency, double perKeyLatency)
+ : mState(new State(latency, perKeyLatency))
+{
+}
+
+MemorySecretResolver::~MemorySecretResolver()
+{
+#ifndef _WIN32
+    {
+        ScopedLock lock(mState->mutex);
+        mState->stopping = true;
+        mState->changed.broadcast();
+    }
+    if (mState->threadStarted)
+        pthread_join(mState->thread, NULL);
+#endif
+    delete mState;
+}
+
+void MemorySecretResolver::addConsumer(const std::string& consumerKey, const std::string& secret)
+{
+    ScopedLock lock(mState->mutex);
+    mState->consumers[consumerKey] = secret;
+}
+
+void MemorySecretResolver::addToken(const std::string& consumerKey, const std::string& token,
+                                    const std::string& secret)
+{
+    ScopedLock lock(mState->mutex);
+    mState->tokens[std::make_pair(consumerKey, token)] = secret;
+}
+
+void MemorySecretResolver::resolve(SecretBatch& batch)
+{
+    State& state = *mState;
+    double delay = state.latency + state.perKeyLatency * batch.size();
+#ifndef _WIN32
+    if (delay > 0) {
+        ScopedLock lock(state.mutex);
+        if (!state.threadStarted) {
+            pthread_create(&state.thread, NULL, State::run, &state);
+            state.threadStarted = true;
+        }
+        state.queue.push_back(std::make_pair(monotonic_now() + delay, &batch));
+        state.changed.broadcast();
+        return;
+    }
+#else
+    // Without a thread of its own, it waits out the delay here
+    SleepSeconds(delay);
+#endif
+    state.fill(batch);
+    batch.complete();
+}
+
+std::size_t MemorySecretResolver::batches() const
+{
+    ScopedLock lock(mState->mutex);
+    return mState->batches;
+}
+
+std::size_t MemorySecretResolver::lookups() const
+{
+    ScopedLock lock(mState->mutex);
+    return mState->lookups;
+}
+
+} // namespace OAuth
@@ -0,0 +1,76 @@
+#ifndef __LIBOAUTHCPP_ATOMIC_H__
+#define __LIBOAUTHCPP_ATOMIC_H__
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// Atomic operations for the parts of the library that share memory between
+// threads, or processes, without a lock: the Interlocked functions on
+// Windows and the GCC builtins elsewhere. On Windows, values are at most 32
+// bits wide, or pointers for loads and stores.
+
+namespace OAuth {
+
+// Loads with acquire ordering: reads after it see everything written before
+// the release store of the value read
+template<typename T>
+inline T AtomicLoad(T volatile* p) {
+#if defined(_WIN32)
+    T value = *p;
+    MemoryBarrier();
+    return value;
+#elif defined(__ATOMIC_ACQUIRE)
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+    T value = *p;
+    __sync_synchronize();
+    return value;
+#endif
+}
+
+// Stores with release ordering
+template<typename T>
+inline void AtomicStore(T volatile* p, T value) {
+#if defined(_WIN32)
+    MemoryBarrier();
+    *p = value;
+#elif defined(__ATOMIC_RELEASE)
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+#else
+    __sync_synchronize();
+    *p = value;
+#endif
+}
+
+// Adds delta, returning the value before. A full barrier.
+template<typename T>
+inline T AtomicFetchAdd(T volatile* p, T delta) {
+#ifdef _WIN32
+    typedef char LongSized[sizeof(T) == sizeof(LONG) ? 1 : -1];
+    (void)sizeof(LongSized);
+    return (T)InterlockedExchangeAdd((volatile LONG*)p, (LONG)delta);
+#else
+    return __sync_fetch_and_add(p, delta);
+#endif
+}
+
+// Sets *p to desired if it is expected, returning whether it was. A full
+// barrier.
+template<typename T>
+inline bool AtomicCompareAndSwap(T volatile* p, T expected, T desired) {
+#ifdef _WIN32
+    typedef char LongSized[sizeof(T) == sizeof(LONG) ? 1 : -1];
+    (void)sizeof(LongSized);
+    return InterlockedCompareExchange((volatile LONG*)p, (LONG)desired, (LONG)expected) == (LONG)expected;
+#else
+    return __sync_bool_compare_and_swap(p, expected, desired);
+#endif
+}
+
+} // namespace OAuth
+
+#endif /* __LIBOAUTHCPP_ATOMIC_H__ */
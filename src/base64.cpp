@@ -23,101 +23,260 @@
 
    Ren Nyffenegger rene.nyffenegger@adp-gmbh.ch
 
+   Modified for liboauthcpp: table-driven encoding and decoding into
+   exactly sized output, AVX2 kernels for long inputs, and helpers for
+   SHA-1 digests.
+
 */
 
 #include "base64.h"
-#include <iostream>
+#include "SHA1_x86.h"
+
+#ifdef SHA1_X86_SIMD
+#include <immintrin.h>
+#endif
 
-static const std::string base64_chars = 
+static const char base64_chars[] =
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
              "abcdefghijklmnopqrstuvwxyz"
              "0123456789+/";
 
+// Value of each base64 character, XX for everything else (including '=')
+#define XX 0xFF
+static const unsigned char base64_values[256] = {
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  62,  XX,  XX,  XX,  63,
+   52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+   15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  XX,  XX,  XX,  XX,  XX,
+   XX,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+   41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+   XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+};
+#undef XX
 
-static inline bool is_base64(unsigned char c) {
-  return (isalnum(c) || (c == '+') || (c == '/'));
+static inline void encode_triple(unsigned char const* in, char* out) {
+  out[0] = base64_chars[in[0] >> 2];
+  out[1] = base64_chars[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+  out[2] = base64_chars[((in[1] & 0x0f) << 2) | (in[2] >> 6)];
+  out[3] = base64_chars[in[2] & 0x3f];
 }
 
-std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
-  std::string ret;
-  int i = 0;
-  int j = 0;
-  unsigned char char_array_3[3];
-  unsigned char char_array_4[4];
-
-  while (in_len--) {
-    char_array_3[i++] = *(bytes_to_encode++);
-    if (i == 3) {
-      char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-      char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-      char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-      char_array_4[3] = char_array_3[2] & 0x3f;
-
-      for(i = 0; (i <4) ; i++)
-        ret += base64_chars[char_array_4[i]];
-      i = 0;
-    }
+// Decodes four characters to three bytes. Returns false, without writing
+// anything, if any of them is outside the alphabet.
+static inline bool decode_quad(unsigned char const* in, unsigned char* out) {
+  unsigned int a = base64_values[in[0]], b = base64_values[in[1]];
+  unsigned int c = base64_values[in[2]], d = base64_values[in[3]];
+  if ((a | b | c | d) & 0x80)
+    return false;
+  out[0] = (unsigned char)((a << 2) | (b >> 4));
+  out[1] = (unsigned char)((b << 4) | (c >> 2));
+  out[2] = (unsigned char)((c << 6) | d);
+  return true;
+}
+
+#ifdef SHA1_X86_SIMD
+/* AVX2 kernels, after Wojciech Mula's SIMD base64 algorithms: 24 bytes are
+ * encoded to 32 characters, or 32 characters decoded to 24 bytes, per step.
+ */
+#define BASE64_AVX2 __attribute__((target("avx2")))
+
+BASE64_AVX2
+static size_t base64_encode_avx2(unsigned char const* in, size_t in_len, char* out) {
+  // Spread each 3 input bytes over a 32-bit word as bytes 1,0,2,1, so the
+  // four 6-bit fields can be moved into place with 16-bit multiplies
+  const __m256i shuf = _mm256_set_epi8(
+    10, 11,  9, 10,  7,  8,  6,  7,  4,  5,  3,  4,  1,  2,  0,  1,
+    14, 15, 13, 14, 11, 12, 10, 11,  8,  9,  7,  8,  5,  6,  4,  5);
+  // Offsets from 6-bit values to ASCII for the ranges A-Z, a-z, 0-9, +, /
+  const __m256i offsets = _mm256_setr_epi8(
+    65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+    65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+
+  size_t i = 0;
+  // Each step reads 28 bytes: the low lane takes bytes 0-11 (shifted up by
+  // four), the high lane bytes 12-23
+  for (; i + 28 <= in_len; i += 24) {
+    __m128i lo = _mm_slli_si128(_mm_loadu_si128((const __m128i*)(in + i)), 4);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(in + i + 12));
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+    v = _mm256_shuffle_epi8(v, shuf);
+    __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)),
+                                    _mm256_set1_epi32(0x04000040));
+    __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)),
+                                    _mm256_set1_epi32(0x01000010));
+    v = _mm256_or_si256(t0, t1);
+
+    // Table index: 0 for A-Z, 1 for a-z, 2-11 for digits, 12 and 13 for + /
+    __m256i idx = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+    idx = _mm256_sub_epi8(idx, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(25)));
+    v = _mm256_add_epi8(v, _mm256_shuffle_epi8(offsets, idx));
+
+    _mm256_storeu_si256((__m256i*)(out + i / 3 * 4), v);
   }
+  return i;
+}
 
-  if (i)
-  {
-    for(j = i; j < 3; j++)
-      char_array_3[j] = '\0';
+// Decodes 32 characters at a time while they are all in the alphabet, and
+// while the output has room for the 32 byte stores. Returns the number of
+// characters consumed.
+BASE64_AVX2
+static size_t base64_decode_avx2(unsigned char const* in, size_t in_len, unsigned char* out) {
+  // Nibble lookups whose AND is non-zero for any byte outside the alphabet
+  const __m256i lut_lo = _mm256_setr_epi8(
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lut_hi = _mm256_setr_epi8(
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  // ASCII to 6-bit value offsets, by high nibble ('/' gets its own)
+  const __m256i lut_roll = _mm256_setr_epi8(
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+  const __m256i pack = _mm256_setr_epi8(
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+  size_t i = 0;
+  // 44 characters left guarantees at least 33 bytes of output left
+  for (; i + 44 <= in_len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+    __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_2f);
+    __m256i lo_nibbles = _mm256_and_si256(v, mask_2f);
+    if (!_mm256_testz_si256(_mm256_shuffle_epi8(lut_lo, lo_nibbles),
+                            _mm256_shuffle_epi8(lut_hi, hi_nibbles)))
+      break;
 
-    char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-    char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-    char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-    char_array_4[3] = char_array_3[2] & 0x3f;
+    __m256i eq_2f = _mm256_cmpeq_epi8(v, mask_2f);
+    v = _mm256_add_epi8(v, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles)));
 
-    for (j = 0; (j < i + 1); j++)
-      ret += base64_chars[char_array_4[j]];
+    // Merge the 6-bit fields of each word into 24 bits, then pack
+    v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+    v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+    v = _mm256_shuffle_epi8(v, pack);
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+    _mm256_storeu_si256((__m256i*)(out + i / 4 * 3), v);
+  }
+  return i;
+}
 
-    while((i++ < 3))
-      ret += '=';
+static bool base64_use_avx2() {
+  static const bool hasAVX2 = SHA1_CPU_HasAVX2();
+  return hasAVX2;
+}
+#endif
 
+std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
+  std::string ret(4 * ((in_len + 2) / 3), '\0');
+  if (ret.empty())
+    return ret;
+
+  char* out = &ret[0];
+  size_t i = 0;
+#ifdef SHA1_X86_SIMD
+  if (in_len >= BASE64_SIMD_THRESHOLD && base64_use_avx2())
+    i = base64_encode_avx2(bytes_to_encode, in_len, out);
+#endif
+  for (; i + 3 <= in_len; i += 3)
+    encode_triple(bytes_to_encode + i, out + i / 3 * 4);
+
+  if (i < in_len)
+  {
+    unsigned char last[3] = { 0, 0, 0 };
+    size_t rest = in_len - i;
+    for (size_t j = 0; j < rest; j++)
+      last[j] = bytes_to_encode[i + j];
+
+    char* tail = out + i / 3 * 4;
+    encode_triple(last, tail);
+    tail[3] = '=';
+    if (rest == 1)
+      tail[2] = '=';
   }
 
   return ret;
-
 }
 
 std::string base64_decode(std::string const& encoded_string) {
-  int in_len = encoded_string.size();
-  int i = 0;
-  int j = 0;
-  int in_ = 0;
-  unsigned char char_array_4[4], char_array_3[3];
-  std::string ret;
-
-  while (in_len-- && ( encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-    char_array_4[i++] = encoded_string[in_]; in_++;
-    if (i ==4) {
-      for (i = 0; i <4; i++)
-        char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-      char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-      char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-      char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-      for (i = 0; (i < 3); i++)
-        ret += char_array_3[i];
-      i = 0;
-    }
-  }
+  const unsigned char* in = (const unsigned char*)encoded_string.data();
+  size_t in_len = encoded_string.size();
 
-  if (i) {
-    for (j = i; j <4; j++)
-      char_array_4[j] = 0;
+  // Size the output for well formed input. Decoding stops at the first '='
+  // or character outside the alphabet, in which case it's trimmed after.
+  size_t n = in_len;
+  while (n && in[n - 1] == '=')
+    n--;
+  size_t out_len = n / 4 * 3 + ((n % 4) ? (n % 4) - 1 : 0);
 
-    for (j = 0; j <4; j++)
-      char_array_4[j] = base64_chars.find(char_array_4[j]);
+  std::string ret(out_len, '\0');
+  if (ret.empty())
+    return ret;
 
-    char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-    char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-    char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+  unsigned char* out = (unsigned char*)&ret[0];
+  size_t i = 0;
+#ifdef SHA1_X86_SIMD
+  if (n >= BASE64_SIMD_THRESHOLD && base64_use_avx2())
+    i = base64_decode_avx2(in, n, out);
+#endif
+  size_t o = i / 4 * 3;
+  for (; i + 4 <= n; i += 4, o += 3) {
+    if (!decode_quad(in + i, out + o))
+      break;
+  }
 
-    for (j = 0; (j < i - 1); j++) ret += char_array_3[j];
+  // Partial group, either at the end or before the first character outside
+  // the alphabet
+  unsigned int quad[4];
+  size_t k = 0;
+  for (; i < n && k < 4; i++, k++) {
+    quad[k] = base64_values[in[i]];
+    if (quad[k] & 0x80)
+      break;
   }
+  if (k >= 2)
+    out[o++] = (unsigned char)((quad[0] << 2) | (quad[1] >> 4));
+  if (k >= 3)
+    out[o++] = (unsigned char)((quad[1] << 4) | (quad[2] >> 2));
 
+  ret.resize(o);
   return ret;
-}
\ No newline at end of file
+}
+
+void base64_encode_sha1_digest(unsigned char const* digest, char* out) {
+  for (int i = 0; i < 6; i++)
+    encode_triple(digest + 3 * i, out + 4 * i);
+
+  // The last two bytes make three characters and one pad
+  out[24] = base64_chars[digest[18] >> 2];
+  out[25] = base64_chars[((digest[18] & 0x03) << 4) | (digest[19] >> 4)];
+  out[26] = base64_chars[(digest[19] & 0x0f) << 2];
+  out[27] = '=';
+}
+
+bool base64_decode_sha1_digest(char const* encoded, size_t len, unsigned char* digest) {
+  const unsigned char* in = (const unsigned char*)encoded;
+  if (len != BASE64_SHA1_DIGEST_LENGTH || in[27] != '=')
+    return false;
+
+  for (int i = 0; i < 6; i++) {
+    if (!decode_quad(in + 4 * i, digest + 3 * i))
+      return false;
+  }
+
+  unsigned int a = base64_values[in[24]], b = base64_values[in[25]], c = base64_values[in[26]];
+  if ((a | b | c) & 0x80)
+    return false;
+  digest[18] = (unsigned char)((a << 2) | (b >> 4));
+  digest[19] = (unsigned char)((b << 4) | (c >> 2));
+  return true;
+}
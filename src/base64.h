@@ -1,4 +1,16 @@
 #include <string>
+#include <cstddef>
 
 std::string base64_encode(unsigned char const* , unsigned int len);
-std::string base64_decode(std::string const& s);
\ No newline at end of file
+std::string base64_decode(std::string const& s);
+
+// Inputs at least this long use the AVX2 kernels, when the CPU has them
+const size_t BASE64_SIMD_THRESHOLD = 64;
+
+// A SHA-1 digest (20 bytes) is always 28 characters encoded, one of them
+// padding. These skip the general purpose code for that case: out must have
+// room for 28 characters (no terminator is written), and decoding fails
+// unless encoded is exactly such a string.
+const size_t BASE64_SHA1_DIGEST_LENGTH = 28;
+void base64_encode_sha1_digest(unsigned char const* digest, char* out);
+bool base64_decode_sha1_digest(char const* encoded, size_t len, unsigned char* digest);
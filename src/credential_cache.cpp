@@ -0,0 +1,354 @@
+#include <liboauthcpp/liboauthcpp.h>
+#include "signing_key.h"
+#include "nonce_hash.h"
+#include "mutex.h"
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace OAuth {
+
+namespace {
+
+const int NO_ENTRY = -1;
+
+struct CacheEntry {
+    std::string consumerKey;
+    std::string token;
+    // consumer_secret&token_secret, percent encoded
+    std::string signingKey;
+    CHMAC_SHA1::KEY_STATE state;
+    Hash hash;
+    // Next entry in the same bucket
+    int next;
+    bool used;
+    // Set by each hit, cleared as the CLOCK hand passes
+    bool referenced;
+
+    CacheEntry() : hash(0), next(NO_ENTRY), used(false), referenced(false) {}
+};
+
+// A lookup in the SecretStore that other threads missing on the same key
+// can wait for. It lives on the stack of the thread doing the lookup, which
+// waits for the others to take the result before it returns.
+struct PendingLookup {
+    Hash hash;
+    const std::string* consumerKey;
+    const std::string* token;
+    bool done;
+    // The SecretStore threw, so waiters have to look it up themselves
+    bool failed;
+    // Invalidated while in progress, so the result mustn't be cached
+    bool invalidated;
+    Verification::Result result;
+    CHMAC_SHA1::KEY_STATE state;
+    std::size_t waiters;
+
+    bool matches(Hash h, const std::string& ck, const std::string& t) const {
+        return hash == h && *consumerKey == ck && *token == t;
+    }
+};
+
+}
+
+// A fixed number of entries, chained from a power of 2 buckets by hash, and
+// the lookups in progress for keys in the shard. Padded so shards locked by
+// different threads don't share cache lines.
+struct CredentialCache::Shard {
+    Mutex mutex;
+    Condition lookupDone;
+    std::vector<CacheEntry> entries;
+    std::vector<int> buckets;
+    std::vector<int> freeEntries;
+    std::size_t hand;
+    std::vector<PendingLookup*> pending;
+    Stats stats;
+    char padding[64];
+
+    Shard(std::size_t capacity) : entries(capacity), hand(0) {
+        std::size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        buckets.assign(size, NO_ENTRY);
+        for (std::size_t i = capacity; i > 0; i--)
+            freeEntries.push_back((int)i - 1);
+    }
+
+    int find(Hash h, const std::string& consumerKey, const std::string& token) const {
+        for (int i = buckets[(std::size_t)h & (buckets.size() - 1)]; i != NO_ENTRY; i = entries[i].next) {
+            const CacheEntry& entry = entries[i];
+            if (entry.hash == h && entry.consumerKey == consumerKey && entry.token == token)
+                return i;
+        }
+        return NO_ENTRY;
+    }
+
+    void remove(int i) {
+        CacheEntry& entry = entries[i];
+        int* link = &buckets[(std::size_t)entry.hash & (buckets.size() - 1)];
+        while (*link != i)
+            link = &entries[*link].next;
+        *link = entry.next;
+        entry.used = false;
+        entry.referenced = false;
+        freeEntries.push_back(i);
+    }
+
+    // A free entry, evicting one that hasn't been used since the hand last
+    // went past it if there are none
+    int take() {
+        if (freeEntries.empty()) {
+            while (entries[hand].referenced) {
+                entries[hand].referenced = false;
+                hand = (hand + 1) % entries.size();
+            }
+            remove((int)hand);
+            hand = (hand + 1) % entries.size();
+            stats.evictions++;
+        }
+        int i = freeEntries.back();
+        freeEntries.pop_back();
+        return i;
+    }
+
+    void insert(Hash h, const std::string& consumerKey, const std::string& token,
+                const std::string& signingKey, const CHMAC_SHA1::KEY_STATE& state) {
+        int i = take();
+        CacheEntry& entry = entries[i];
+        entry.consumerKey = consumerKey;
+        entry.token = token;
+        entry.signingKey = signingKey;
+        entry.state = state;
+        entry.hash = h;
+        entry.used = true;
+        entry.referenced = true;
+        int& bucket = buckets[(std::size_t)h & (buckets.size() - 1)];
+        entry.next = bucket;
+        bucket = i;
+    }
+
+    // Caches the result of a lookup, and hands it to the threads waiting
+    // for it. Returns once they all have it.
+    void finish(PendingLookup& lookup, double elapsed, const std::string& signingKey) {
+        ScopedLock lock(mutex);
+        stats.lookups++;
+        stats.lookupSeconds += elapsed;
+        stats.maxLookupSeconds = std::max(stats.maxLookupSeconds, elapsed);
+        if (lookup.result == Verification::Valid && !lookup.failed && !lookup.invalidated)
+            insert(lookup.hash, *lookup.consumerKey, *lookup.token, signingKey, lookup.state);
+
+        pending.erase(std::find(pending.begin(), pending.end(), &lookup));
+        lookup.done = true;
+        lookupDone.broadcast();
+        while (lookup.waiters)
+            lookupDone.wait(mutex);
+    }
+};
+
+CredentialCache::Stats::Stats()
+ : hits(0),
+   misses(0),
+   coalesced(0),
+   lookups(0),
+   evictions(0),
+   invalidations(0),
+   lookupSeconds(0),
+   maxLookupSeconds(0)
+{
+}
+
+double CredentialCache::Stats::hitRate() const
+{
+    return (hits + misses) ? (double)hits / (hits + misses) : 0;
+}
+
+double CredentialCache::Stats::averageLookupSeconds() const
+{
+    return lookups ? lookupSeconds / lookups : 0;
+}
+
+CredentialCache::CredentialCache(const SecretStore* secrets,
+                                 std::size_t capacity,
+                                 unsigned int shards)
+ : mShards(NULL),
+   mShardBits(0),
+   mSecrets(secrets),
+   mSeed(RandomSeed())
+{
+    assert(capacity > 0);
+    while ((1u << mShardBits) < shards && (std::size_t)(2u << mShardBits) <= capacity && mShardBits < 16)
+        mShardBits++;
+
+    mShards = new Shard*[1u << mShardBits];
+    for (unsigned int i = 0; i < (1u << mShardBits); i++)
+        mShards[i] = new Shard(std::max((std::size_t)1, capacity >> mShardBits));
+}
+
+CredentialCache::~CredentialCache()
+{
+    for (unsigned int i = 0; i < (1u << mShardBits); i++)
+        delete mShards[i];
+    delete[] mShards;
+}
+
+Verification::Result CredentialCache::signingKey(const std::string& consumerKey,
+                                                 const std::string& token,
+                                                 SigningKey& key)
+{
+    Hash h = Finalize(HashBytes(HashBytes(mSeed, consumerKey), token));
+    Shard& shard = *mShards[mShardBits ? (unsigned int)(h >> (64 - mShardBits)) : 0];
+
+    PendingLookup lookup;
+    lookup.hash = h;
+    lookup.consumerKey = &consumerKey;
+    lookup.token = &token;
+    lookup.done = false;
+    lookup.failed = false;
+    lookup.invalidated = false;
+    lookup.result = Verification::Valid;
+    lookup.waiters = 0;
+
+    {
+        ScopedLock lock(shard.mutex);
+        bool missed = false;
+        for (;;) {
+            int i = shard.find(h, consumerKey, token);
+            if (i != NO_ENTRY) {
+                CacheEntry& entry = shard.entries[i];
+                entry.referenced = true;
+                key.state = entry.state;
+                if (!missed)
+                    shard.stats.hits++;
+                return Verification::Valid;
+            }
+            if (!missed)
+                shard.stats.misses++;
+            missed = true;
+
+            PendingLookup* other = NULL;
+            for (std::size_t p = 0; p < shard.pending.size() && !other; p++) {
+                if (shard.pending[p]->matches(h, consumerKey, token))
+                    other = shard.pending[p];
+            }
+            if (!other)
+                break;
+
+            shard.stats.coalesced++;
+            other->waiters++;
+            while (!other->done)
+                shard.lookupDone.wait(shard.mutex);
+            bool failed = other->failed;
+            Verification::Result result = other->result;
+            key.state = other->state;
+            if (--other->waiters == 0)
+                shard.lookupDone.broadcast();
+            if (!failed)
+                return result;
+            // Try again, with the thread that threw gone
+        }
+        shard.pending.push_back(&lookup);
+    }
+
+    // The SecretStore may be slow, so it is asked without holding the shard
+    std::string consumerSecret, tokenSecret, signingKey;
+    double start = monotonic_now();
+    try {
+        if (!mSecrets->consumerSecret(consumerKey, consumerSecret))
+            lookup.result = Verification::UnknownConsumer;
+        else if (token.length() && !mSecrets->tokenSecret(consumerKey, token, tokenSecret))
+            lookup.result = Verification::UnknownToken;
+    }
+    catch (...) {
+        lookup.failed = true;
+        shard.finish(lookup, monotonic_now() - start, signingKey);
+        throw;
+    }
+    double elapsed = monotonic_now() - start;
+    if (lookup.result == Verification::Valid)
+        PrepareSigningKey(consumerSecret, tokenSecret, signingKey, &lookup.state);
+    shard.finish(lookup, elapsed, signingKey);
+
+    key.state = lookup.state;
+    return lookup.result;
+}
+
+void CredentialCache::invalidate(const std::string& consumerKey, const std::string& token)
+{
+    Hash h = Finalize(HashBytes(HashBytes(mSeed, consumerKey), token));
+    Shard& shard = *mShards[mShardBits ? (unsigned int)(h >> (64 - mShardBits)) : 0];
+    ScopedLock lock(shard.mutex);
+    int i = shard.find(h, consumerKey, token);
+    if (i != NO_ENTRY) {
+        shard.remove(i);
+        shard.stats.invalidations++;
+    }
+    for (std::size_t p = 0; p < shard.pending.size(); p++) {
+        if (shard.pending[p]->matches(h, consumerKey, token))
+            shard.pending[p]->invalidated = true;
+    }
+}
+
+void CredentialCache::invalidateConsumer(const std::string& consumerKey)
+{
+    for (unsigned int s = 0; s < (1u << mShardBits); s++) {
+        Shard& shard = *mShards[s];
+        ScopedLock lock(shard.mutex);
+        for (std::size_t i = 0; i < shard.entries.size(); i++) {
+            if (shard.entries[i].used && shard.entries[i].consumerKey == consumerKey) {
+                shard.remove((int)i);
+                shard.stats.invalidations++;
+            }
+        }
+        for (std::size_t p = 0; p < shard.pending.size(); p++) {
+            if (*shard.pending[p]->consumerKey == consumerKey)
+                shard.pending[p]->invalidated = true;
+        }
+    }
+}
+
+void CredentialCache::clear()
+{
+    for (unsigned int s = 0; s < (1u << mShardBits); s++) {
+        Shard& shard = *mShards[s];
+        ScopedLock lock(shard.mutex);
+        for (std::size_t i = 0; i < shard.entries.size(); i++) {
+            if (shard.entries[i].used) {
+                shard.remove((int)i);
+                shard.stats.invalidations++;
+            }
+        }
+        for (std::size_t p = 0; p < shard.pending.size(); p++)
+            shard.pending[p]->invalidated = true;
+    }
+}
+
+std::size_t CredentialCache::size() const
+{
+    std::size_t count = 0;
+    for (unsigned int s = 0; s < (1u << mShardBits); s++) {
+        Shard& shard = *mShards[s];
+        ScopedLock lock(shard.mutex);
+        count += shard.entries.size() - shard.freeEntries.size();
+    }
+    return count;
+}
+
+CredentialCache::Stats CredentialCache::stats() const
+{
+    Stats total;
+    for (unsigned int s = 0; s < (1u << mShardBits); s++) {
+        Shard& shard = *mShards[s];
+        ScopedLock lock(shard.mutex);
+        total.hits += shard.stats.hits;
+        total.misses += shard.stats.misses;
+        total.coalesced += shard.stats.coalesced;
+        total.lookups += shard.stats.lookups;
+        total.evictions += shard.stats.evictions;
+        total.invalidations += shard.stats.invalidations;
+        total.lookupSeconds += shard.stats.lookupSeconds;
+        total.maxLookupSeconds = std::max(total.maxLookupSeconds, shard.stats.maxLookupSeconds);
+    }
+    return total;
+}
+
+} // namespace OAuth
@@ -1,10 +1,16 @@
 #include <liboauthcpp/liboauthcpp.h>
 #include "HMAC_SHA1.h"
+#include "HMAC_SHA1_mb.h"
 #include "base64.h"
 #include "urlencode.h"
+#include "parameters.h"
+#include "nonce.h"
+#include "signing_key.h"
+#include "shared_credentials.h"
 #include <cstdlib>
 #include <vector>
 #include <cassert>
+#include <cctype>
 
 namespace OAuth {
 
@@ -23,14 +29,13 @@ namespace Defaults
     const std::string TOKEN_KEY = "oauth_token";
     const std::string TOKENSECRET_KEY = "oauth_token_secret";
     const std::string VERIFIER_KEY = "oauth_verifier";
+    const std::string BODYHASH_KEY = "oauth_body_hash";
 
     const std::string AUTHHEADER_FIELD = "Authorization: ";
     const std::string AUTHHEADER_PREFIX = "OAuth ";
+    const std::string AUTHHEADER_FIELD_PREFIX = AUTHHEADER_FIELD + AUTHHEADER_PREFIX;
 };
 
-/** std::string -> std::string conversion function */
-typedef std::string(*StringConvertFunction)(const std::string&);
-
 LogLevel gLogLevel = LogLevelNone;
 
 void SetLogLevel(LogLevel lvl) {
@@ -61,11 +66,21 @@ std::string HttpEncodeQueryValue(const std::string& decoded) {
     return urlencode(decoded, URLEncode_QueryValue);
 }
 
-namespace {
-std::string PassThrough(const std::string& decoded) {
+std::string PercentDecode(const std::string& encoded, DecodeMode mode) {
+    std::string decoded(encoded);
+    if (!decoded.empty())
+        decoded.resize(PercentDecodeInPlace(&decoded[0], decoded.length(), mode));
+    return decoded;
+}
+
+size_t PercentDecodeInPlace(char* data, size_t length, DecodeMode mode) {
+    size_t decoded = 0;
+    if (!urldecode_to(data, length, data, mode == DecodeStrict, &decoded))
+        throw ParseError("Malformed percent encoding.");
     return decoded;
 }
 
+namespace {
 std::string RequestTypeString(const Http::RequestType rt) {
     switch(rt) {
       case Http::Invalid: return "Invalid Request Type"; break;
@@ -80,53 +95,17 @@ std::string RequestTypeString(const Http::RequestType rt) {
 }
 }
 
-// Parse a single key-value pair
-static std::pair<std::string, std::string> ParseKeyValuePair(const std::string& encoded) {
-    std::size_t eq_pos = encoded.find("=");
-    if (eq_pos == std::string::npos)
-        throw ParseError("Failed to find '=' in key-value pair.");
-    return std::pair<std::string, std::string>(
-        encoded.substr(0, eq_pos),
-        encoded.substr(eq_pos+1)
-    );
-}
-
 KeyValuePairs ParseKeyValuePairs(const std::string& encoded) {
     KeyValuePairs result;
-
-    if (encoded.length() == 0) return result;
-
-    // Split by &
-    std::size_t last_amp = 0;
-    // We can bail when the last one "found" was the end of the string
-    while(true) {
-        std::size_t next_amp = encoded.find('&', last_amp+1);
-        std::string keyval =
-            (next_amp == std::string::npos) ?
-            encoded.substr(last_amp) :
-            encoded.substr(last_amp, next_amp-last_amp);
-        result.insert(ParseKeyValuePair(keyval));
-        // Track spot after the & so the first iteration works without dealing
-        // with -1 index
-        last_amp = next_amp+1;
-
-        // Exit condition
-        if (next_amp == std::string::npos) break;
+    ParameterReader reader(encoded);
+    while (reader.next()) {
+        result.insert(KeyValuePairs::value_type(
+            std::string(reader.key(), reader.keyLength()),
+            std::string(reader.value(), reader.valueLength())));
     }
     return result;
 }
 
-// Helper for parameters in key-value pair lists that should only appear
-// once. Either replaces an existing entry or adds a new entry.
-static void ReplaceOrInsertKeyValuePair(KeyValuePairs& kvp, const std::string& key, const std::string& value) {
-    assert(kvp.count(key) <= 1);
-    KeyValuePairs::iterator it = kvp.find(key);
-    if (it != kvp.end())
-        it->second = value;
-    else
-        kvp.insert(KeyValuePairs::value_type(key, value));
-}
-
 Consumer::Consumer(const std::string& key, const std::string& secret)
  : mKey(key), mSecret(secret)
 {
@@ -145,7 +124,29 @@ Token::Token(const std::string& key, const std::string& secret, const std::strin
 }
 
 Token Token::extract(const std::string& response) {
-    return Token::extract(ParseKeyValuePairs(response));
+    // The first of each key, as KeyValuePairs::find would give. The rest is
+    // still read, so a malformed response throws as it always has.
+    const char* token_key = NULL;
+    const char* token_secret = NULL;
+    size_t token_key_length = 0, token_secret_length = 0;
+    ParameterReader reader(response);
+    while (reader.next()) {
+        if (!token_key && reader.keyIs(Defaults::TOKEN_KEY)) {
+            token_key = reader.value();
+            token_key_length = reader.valueLength();
+        }
+        else if (!token_secret && reader.keyIs(Defaults::TOKENSECRET_KEY)) {
+            token_secret = reader.value();
+            token_secret_length = reader.valueLength();
+        }
+    }
+
+    if (!token_key)
+        throw MissingKeyError("Couldn't find oauth_token in response");
+    if (!token_secret)
+        throw MissingKeyError("Couldn't find oauth_token_secret in response");
+    return Token(std::string(token_key, token_key_length),
+                 std::string(token_secret, token_secret_length));
 }
 
 Token Token::extract(const KeyValuePairs& response) {
@@ -165,13 +166,301 @@ Token Token::extract(const KeyValuePairs& response) {
 }
 
 
+struct BodyHash::State {
+    CSHA1 sha;
+    bool finished;
+    std::string value;
+};
+
+BodyHash::BodyHash()
+ : mState(new State)
+{
+    mState->finished = false;
+}
+
+BodyHash::~BodyHash()
+{
+    delete mState;
+}
+
+void BodyHash::update(const void* data, size_t len)
+{
+    assert(!mState->finished && "BodyHash updated after value()");
+    mState->sha.UpdateLarge((const UINT_8*)data, len);
+}
+
+bool BodyHash::updateFromFile(const std::string& path)
+{
+    assert(!mState->finished && "BodyHash updated after value()");
+    return mState->sha.HashFile(path.c_str());
+}
+
+bool BodyHash::updateFromFileDescriptor(int fd)
+{
+    assert(!mState->finished && "BodyHash updated after value()");
+#ifndef _WIN32
+    return mState->sha.HashFileDescriptor(fd);
+#else
+    return false;
+#endif
+}
+
+std::string BodyHash::value() const
+{
+    if( !mState->finished )
+    {
+        UINT_8 digest[20];
+        char base64Digest[BASE64_SHA1_DIGEST_LENGTH];
+        mState->sha.Final();
+        mState->sha.GetHash(digest);
+        base64_encode_sha1_digest(digest, base64Digest);
+        mState->value.assign(base64Digest, BASE64_SHA1_DIGEST_LENGTH);
+        mState->finished = true;
+    }
+    return mState->value;
+}
+
+struct PreparedRequest::State {
+    Http::RequestType eType;
+    bool includeOAuthVerifierPin;
+    /* Percent encoded url without the query string */
+    std::string encodedUrl;
+    /* Sorted static parameters, with placeholders for nonce and timestamp */
+    ParameterList parameters;
+};
+
+PreparedRequest::PreparedRequest()
+ : mState(new State)
+{
+}
+
+PreparedRequest::PreparedRequest(const PreparedRequest& other)
+ : mState(new State(*other.mState))
+{
+}
+
+PreparedRequest& PreparedRequest::operator=(const PreparedRequest& other)
+{
+    if (this != &other)
+        *mState = *other.mState;
+    return *this;
+}
+
+PreparedRequest::~PreparedRequest()
+{
+    delete mState;
+}
+
+struct SigningBuffer::State {
+    ParameterList parameters;
+    std::string pureUrl;
+    std::string nonce;
+    std::string timeStamp;
+    std::string signature;
+    std::string output;
+};
+
+SigningBuffer::SigningBuffer()
+ : mState(new State)
+{
+}
+
+SigningBuffer::~SigningBuffer()
+{
+    delete mState;
+}
+
+const char* SigningBuffer::data() const
+{
+    return mState->output.data();
+}
+
+size_t SigningBuffer::length() const
+{
+    return mState->output.length();
+}
+
+size_t SigningBuffer::copy(char* out, size_t outSize) const
+{
+    size_t length = mState->output.length();
+    if( out && length < outSize )
+    {
+        memcpy( out, mState->output.data(), length );
+        out[length] = '\0';
+    }
+    return length;
+}
+
+void FixedNonceSource::append(std::string& nonce) const
+{
+    char text[16];
+    nonce.append( text, nonce_format_hex( mValue, text ) );
+}
+
+DistributedNonceSource::DistributedNonceSource(unsigned long long nodeId)
+ : mNodeId(nodeId)
+{
+}
+
+void DistributedNonceSource::append(std::string& nonce) const
+{
+    // node-prefix-counter, in hex
+    char text[16 * 3 + 2];
+    size_t length = nonce_format_hex( mNodeId, text );
+    text[length++] = '-';
+    length += nonce_format_hex( nonce_process_prefix(), text + length );
+    text[length++] = '-';
+    length += nonce_format_hex( nonce_process_counter_next(), text + length );
+    nonce.append( text, length );
+}
+
+struct Client::SigningKey {
+    CHMAC_SHA1::KEY_STATE state;
+};
+
+// The credentials one request is signed with. Shared credentials are held
+// until it is destroyed, so they stay valid while the request is signed
+// even if others are published meanwhile.
+struct Client::Credentials {
+    explicit Credentials(const Client& client)
+     : reader(client.mSharedCredentials)
+    {
+        if( !client.mSharedCredentials )
+        {
+            consumer = client.mConsumer;
+            token = client.mToken;
+            key = &client.mSigningKey->state;
+            return;
+        }
+        const CredentialEntry* entry = reader.snapshot()->find( client.mConsumerKey, client.mTokenKey );
+        if( !entry )
+        {
+            std::string message = "Couldn't find consumer " + client.mConsumerKey;
+            if( client.mTokenKey.length() )
+                message += " with token " + client.mTokenKey;
+            throw MissingKeyError( message + " in SharedCredentials" );
+        }
+        consumer = entry->consumer;
+        token = entry->token;
+        key = &entry->state;
+    }
+
+    CredentialsReader reader;
+    const Consumer* consumer;
+    const Token* token;
+    const CHMAC_SHA1::KEY_STATE* key;
+};
+
+// Signing key is composed of consumer_secret&token_secret. The key is built
+// in secretSigningKey, which is only scratch space.
+void PrepareSigningKey(const std::string& consumerSecret, const std::string& tokenSecret,
+                       std::string& secretSigningKey, CHMAC_SHA1::KEY_STATE* ks) {
+    secretSigningKey.clear();
+    urlencode_append keyOutput( secretSigningKey );
+    urlencode_to( consumerSecret.data(), consumerSecret.length(), keyOutput );
+    secretSigningKey.append( "&" );
+    urlencode_to( tokenSecret.data(), tokenSecret.length(), keyOutput );
+
+    CHMAC_SHA1 objHMACSHA1;
+    objHMACSHA1.PrepareKey( (unsigned char*)secretSigningKey.c_str(),
+                            secretSigningKey.length(),
+                            ks );
+}
+
+namespace {
+void BuildSigningKey(const Consumer* consumer, const Token* token, CHMAC_SHA1::KEY_STATE* ks) {
+    std::string secretSigningKey;
+    PrepareSigningKey( consumer->secret(), token ? token->secret() : std::string(),
+                       secretSigningKey, ks );
+}
+
+// Start of the signature base string for a request type, or NULL if the type
+// can't be signed.
+const char* SignatureBasePrefix(const Http::RequestType eType) {
+    switch( eType )
+    {
+      case Http::Head: return "HEAD&";
+      case Http::Get: return "GET&";
+      case Http::Post: return "POST&";
+      case Http::Delete: return "DELETE&";
+      case Http::Put: return "PUT&";
+      default: return NULL;
+    }
+}
+
+// Feeds the signature base string to an HMAC as it is produced. Output is
+// gathered one SHA1 block at a time, so the (percent encoded) base string
+// never has to exist in memory as a whole.
+class SignatureBaseHasher {
+public:
+    SignatureBaseHasher(CHMAC_SHA1& hmac) : mHMAC(hmac), mLength(0) {}
+
+    void put(char c) {
+        mBlock[mLength++] = (UINT_8)c;
+        if (mLength == sizeof(mBlock))
+            flush();
+    }
+
+    void append(const char* s) {
+        for( ; *s; s++ )
+            put(*s);
+    }
+
+    void appendPercentEncoded(const char* s, size_t length) {
+        urlencode_to(s, length, *this);
+    }
+
+    void flush() {
+        if (mLength)
+            mHMAC.Update(mBlock, mLength);
+        mLength = 0;
+    }
+
+private:
+    CHMAC_SHA1& mHMAC;
+    UINT_8 mBlock[CHMAC_SHA1::SHA1_BLOCK_SIZE];
+    UINT_32 mLength;
+};
+
+// Percent encodes the signature base string straight into HMAC_SHA1, keyed
+// with a precomputed signing key:
+// METHOD&encode(url)&encode(k1=v1&k2=v2...)
+// The url is percent encoded already if urlEncoded is set.
+void DigestSignatureBase(const CHMAC_SHA1::KEY_STATE& key, const char* prefix,
+                         const std::string& url, bool urlEncoded,
+                         const ParameterList& params, unsigned char* digest) {
+    CHMAC_SHA1 objHMACSHA1;
+    objHMACSHA1.Begin( key );
+    SignatureBaseHasher sigBase( objHMACSHA1 );
+    sigBase.append( prefix );
+    if( urlEncoded )
+        sigBase.append( url.c_str() );
+    else
+        sigBase.appendPercentEncoded( url.data(), url.length() );
+    sigBase.put( '&' );
+    for( size_t i = 0; i < params.size(); i++ )
+    {
+        if( i )
+        {
+            sigBase.append( "%26" );
+        }
+        sigBase.appendPercentEncoded( params.key( i ), params.keyLength( i ) );
+        sigBase.append( "%3D" );
+        sigBase.appendPercentEncoded( params.value( i ), params.valueLength( i ) );
+    }
+    sigBase.flush();
+    objHMACSHA1.Finish( key, digest );
+}
+}
+
 bool Client::initialized = false;
 int Client::testingNonce = 0;
 time_t Client::testingTimestamp = 0;
 
 void Client::initialize() {
+    // Nonces need no setup any more; this only keeps a later testing
+    // initialize() from taking effect, as it always has.
     if(!initialized) {
-        srand( time( NULL ) );
         initialized = true;
     }
 }
@@ -192,19 +481,88 @@ void Client::__resetInitialize() {
 
 Client::Client(const Consumer* consumer)
  : mConsumer(consumer),
-   mToken(NULL)
+   mToken(NULL),
+   mSigningKey(new SigningKey),
+   mSharedCredentials(NULL),
+   mSigningBuffer(NULL),
+   mClock(NULL),
+   mNonceSource(NULL)
 {
+    BuildSigningKey(mConsumer, mToken, &mSigningKey->state);
 }
 
 Client::Client(const Consumer* consumer, const Token* token)
  : mConsumer(consumer),
-   mToken(token)
+   mToken(token),
+   mSigningKey(new SigningKey),
+   mSharedCredentials(NULL),
+   mSigningBuffer(NULL),
+   mClock(NULL),
+   mNonceSource(NULL)
+{
+    BuildSigningKey(mConsumer, mToken, &mSigningKey->state);
+}
+
+Client::Client(const SharedCredentials* credentials, const std::string& consumerKey,
+               const std::string& token)
+ : mConsumer(NULL),
+   mToken(NULL),
+   mSigningKey(new SigningKey()),
+   mSharedCredentials(credentials),
+   mConsumerKey(consumerKey),
+   mTokenKey(token),
+   mSigningBuffer(NULL),
+   mClock(NULL),
+   mNonceSource(NULL)
+{
+}
+
+Client::Client(const Client& other)
+ : mConsumer(other.mConsumer),
+   mToken(other.mToken),
+   mSigningKey(new SigningKey(*other.mSigningKey)),
+   mSharedCredentials(other.mSharedCredentials),
+   mConsumerKey(other.mConsumerKey),
+   mTokenKey(other.mTokenKey),
+   mSigningBuffer(NULL),
+   mClock(other.mClock),
+   mNonceSource(other.mNonceSource)
 {
 }
 
+Client& Client::operator=(const Client& other)
+{
+    if (this != &other) {
+        mConsumer = other.mConsumer;
+        mToken = other.mToken;
+        *mSigningKey = *other.mSigningKey;
+        mSharedCredentials = other.mSharedCredentials;
+        mConsumerKey = other.mConsumerKey;
+        mTokenKey = other.mTokenKey;
+        mClock = other.mClock;
+        mNonceSource = other.mNonceSource;
+    }
+    return *this;
+}
 
 Client::~Client()
 {
+    delete mSigningKey;
+}
+
+void Client::setSigningBuffer(SigningBuffer* buffer)
+{
+    mSigningBuffer = buffer;
+}
+
+void Client::setClock(const Clock* clock)
+{
+    mClock = clock;
+}
+
+void Client::setNonceSource(const NonceSource* source)
+{
+    mNonceSource = source;
 }
 
 
@@ -224,132 +582,130 @@ Client::~Client()
 *--*/
 void Client::generateNonceTimeStamp(std::string& nonce, std::string& timeStamp) const
 {
-    // Make sure the random seed has been initialized
-    Client::initialize();
-
-    char szTime[Defaults::BUFFSIZE];
-    char szRand[Defaults::BUFFSIZE];
-    memset( szTime, 0, Defaults::BUFFSIZE );
-    memset( szRand, 0, Defaults::BUFFSIZE );
-
     // Any non-zero timestamp triggers testing mode with fixed values. Fixing
     // both values makes life easier because generating a signature is
     // idempotent -- otherwise using macros can cause double evaluation and
-    // incorrect results because of repeated calls to rand().
-    sprintf( szRand, "%x", ((testingTimestamp != 0) ? testingNonce : rand()) );
-    sprintf( szTime, "%ld", ((testingTimestamp != 0) ? testingTimestamp : time( NULL )) );
+    // incorrect results because of repeated calls to the random source.
+    // Testing mode stands in for a FixedClock and FixedNonceSource, so a
+    // Client's own clock and nonce source take precedence. The defaults are
+    // called directly rather than through the interfaces.
+    time_t now;
+    if( mClock )
+        now = mClock->now();
+    else if( testingTimestamp != 0 )
+        now = testingTimestamp;
+    else
+        now = timestamp_now();
 
-    nonce.assign( szTime );
-    nonce.append( szRand );
+    const char* szTime;
+    size_t timeLength = timestamp_format( now, &szTime );
+    nonce.assign( szTime, timeLength );
+    timeStamp.assign( szTime, timeLength );
 
-    timeStamp.assign( szTime );
+    if( mNonceSource )
+    {
+        mNonceSource->append( nonce );
+    }
+    else if( testingTimestamp != 0 )
+    {
+        FixedNonceSource( testingNonce ).append( nonce );
+    }
+    else
+    {
+        char szRand[NONCE_RANDOM_HEX_LENGTH];
+        nonce_random_hex( szRand );
+        nonce.append( szRand, NONCE_RANDOM_HEX_LENGTH );
+    }
 }
 
 /*++
 * @method: Client::buildOAuthTokenKeyValuePairs
 *
-* @description: this method prepares key-value pairs required for OAuth header
-*               and signature generation.
+* @description: this method adds the key-value pairs required for OAuth
+*               signature generation. Values are percent encoded, the form
+*               they're signed and sent in query strings in.
 *
-* @input: includeOAuthVerifierPin - flag to indicate whether oauth_verifer key-value
+* @input: credentials - consumer and token to sign with
+*         includeOAuthVerifierPin - flag to indicate whether oauth_verifer key-value
 *                                   pair needs to be included. oauth_verifer is only
 *                                   used during exchanging request token with access token.
 *         rawData - url encoded data. this is used during signature generation.
-*         oauthSignature - base64 and url encoded OAuth signature.
 *         nonce - OAuth nonce to use
 *         timeStamp - timestamp when nonce was generated
 *
-* @input: urlEncodeValues - if true, URLEncode the values inserted into the
-*         output keyValueMap
-* @output: keyValueMap - map in which key-value pairs are populated
+* @output: keyValueMap - parameter list in which key-value pairs are populated
 *
 * @remarks: internal method
 *
 *--*/
-bool Client::buildOAuthTokenKeyValuePairs( const bool includeOAuthVerifierPin,
+bool Client::buildOAuthTokenKeyValuePairs( const Credentials& credentials,
+                                          const bool includeOAuthVerifierPin,
                                           const std::string& rawData,
-                                          const std::string& oauthSignature,
-                                          KeyValuePairs& keyValueMap,
-                                          const bool urlEncodeValues,
+                                          ParameterList& keyValueMap,
                                           const std::string& nonce,
                                           const std::string& timeStamp) const
 {
-    // Encodes value part of key-value pairs depending on type of output (query
-    // string vs. HTTP headers.
-    StringConvertFunction value_encoder = (urlEncodeValues ? HttpEncodeQueryValue : PassThrough);
-
     /* Consumer key and its value */
-    ReplaceOrInsertKeyValuePair(keyValueMap, Defaults::CONSUMERKEY_KEY, value_encoder(mConsumer->key()));
+    keyValueMap.setPercentEncoded(Defaults::CONSUMERKEY_KEY, credentials.consumer->key());
 
     /* Nonce key and its value */
-    ReplaceOrInsertKeyValuePair(keyValueMap, Defaults::NONCE_KEY, value_encoder(nonce));
-
-    /* Signature if supplied */
-    if( oauthSignature.length() )
-    {
-        // Signature is exempt from encoding. The procedure for
-        // computing it already percent-encodes it as required by the
-        // spec for both query string and Auth header
-        // methods. Therefore, it's pass-through in both cases.
-        ReplaceOrInsertKeyValuePair(keyValueMap, Defaults::SIGNATURE_KEY, oauthSignature);
-    }
+    keyValueMap.setPercentEncoded(Defaults::NONCE_KEY, nonce);
 
     /* Signature method, only HMAC-SHA1 as of now */
-    ReplaceOrInsertKeyValuePair(keyValueMap, Defaults::SIGNATUREMETHOD_KEY, std::string( "HMAC-SHA1" ));
+    keyValueMap.set(Defaults::SIGNATUREMETHOD_KEY, std::string( "HMAC-SHA1" ));
 
     /* Timestamp */
-    ReplaceOrInsertKeyValuePair(keyValueMap, Defaults::TIMESTAMP_KEY, value_encoder(timeStamp));
+    keyValueMap.setPercentEncoded(Defaults::TIMESTAMP_KEY, timeStamp);
 
     /* Token */
-    if( mToken && mToken->key().length() )
+    if( credentials.token && credentials.token->key().length() )
     {
-        ReplaceOrInsertKeyValuePair(keyValueMap, Defaults::TOKEN_KEY, value_encoder(mToken->key()));
+        keyValueMap.setPercentEncoded(Defaults::TOKEN_KEY, credentials.token->key());
     }
 
     /* Verifier */
-    if( includeOAuthVerifierPin && mToken && mToken->pin().length() )
+    if( includeOAuthVerifierPin && credentials.token && credentials.token->pin().length() )
     {
-        ReplaceOrInsertKeyValuePair(keyValueMap, Defaults::VERIFIER_KEY, value_encoder(mToken->pin()));
+        keyValueMap.setPercentEncoded(Defaults::VERIFIER_KEY, credentials.token->pin());
     }
 
     /* Version */
-    ReplaceOrInsertKeyValuePair(keyValueMap, Defaults::VERSION_KEY, std::string( "1.0" ));
+    keyValueMap.set(Defaults::VERSION_KEY, std::string( "1.0" ));
 
     /* Data if it's present */
     if( rawData.length() )
     {
-        KeyValuePairs encodedPairs = ParseKeyValuePairs(rawData);
-        keyValueMap.insert(encodedPairs.begin(), encodedPairs.end());
+        keyValueMap.parse(rawData);
     }
 
     return ( keyValueMap.size() ) ? true : false;
 }
 
 /*++
-* @method: Client::getSignature
+* @method: Client::getSignatureBaseString
 *
-* @description: this method calculates HMAC-SHA1 signature of OAuth header
+* @description: this method builds the signature base string of a request
 *
 * @input: eType - HTTP request type
 *         rawUrl - raw url of the HTTP request
-*         rawKeyValuePairs - key-value pairs containing OAuth headers and HTTP data
+*         rawKeyValuePairs - sorted key-value pairs containing OAuth headers and HTTP data
+*         rawUrlEncoded - whether rawUrl is already percent encoded
 *
-* @output: oAuthSignature - base64 and url encoded signature
+* @output: sigBase - the signature base string
 *
 * @remarks: internal method
 *
 *--*/
-bool Client::getSignature( const Http::RequestType eType,
-                          const std::string& rawUrl,
-                          const KeyValuePairs& rawKeyValuePairs,
-                          std::string& oAuthSignature ) const
+bool Client::getSignatureBaseString( const Http::RequestType eType,
+                                    const std::string& rawUrl,
+                                    const ParameterList& rawKeyValuePairs,
+                                    std::string& sigBase,
+                                    const bool rawUrlEncoded ) const
 {
     std::string rawParams;
     std::string paramsSeperator;
-    std::string sigBase;
 
-    /* Initially empty signature */
-    oAuthSignature.assign( "" );
+    sigBase.assign( "" );
 
     /* Build a string using key-value pairs */
     paramsSeperator = "&";
@@ -357,79 +713,109 @@ bool Client::getSignature( const Http::RequestType eType,
     LOG(LogLevelDebug, "Normalized parameters: " << rawParams);
 
     /* Start constructing base signature string. Refer http://dev.twitter.com/auth#intro */
-    switch( eType )
+    const char* prefix = SignatureBasePrefix( eType );
+    if( !prefix )
     {
-      case Http::Head:
-        {
-            sigBase.assign( "HEAD&" );
-        }
-        break;
+        return false;
+    }
+    sigBase.assign( prefix );
+    sigBase.append( rawUrlEncoded ? rawUrl : PercentEncode( rawUrl ) );
+    sigBase.append( "&" );
+    sigBase.append( PercentEncode( rawParams ) );
+    LOG(LogLevelDebug, "Signature base string: " << sigBase);
 
-      case Http::Get:
-        {
-            sigBase.assign( "GET&" );
-        }
-        break;
+    return true;
+}
 
-      case Http::Post:
-        {
-            sigBase.assign( "POST&" );
-        }
-        break;
+/*++
+* @method: Client::getSignatureFromDigest
+*
+* @description: this method encodes an HMAC-SHA1 digest as an OAuth signature
+*
+* @input: digest - 20 byte HMAC-SHA1 digest of the signature base string
+*
+* @output: oAuthSignature - base64 and url encoded signature
+*
+* @remarks: internal method
+*
+*--*/
+bool Client::getSignatureFromDigest( const unsigned char* digest,
+                                    std::string& oAuthSignature ) const
+{
+    /* Do a base64 encode of signature */
+    char base64Digest[BASE64_SHA1_DIGEST_LENGTH];
+    base64_encode_sha1_digest( digest, base64Digest );
+    LOG(LogLevelDebug, "Signature: " << std::string( base64Digest, BASE64_SHA1_DIGEST_LENGTH ));
 
-      case Http::Delete:
-        {
-            sigBase.assign( "DELETE&" );
-        }
-        break;
+    /* Do an url encode */
+    oAuthSignature.clear();
+    urlencode_append signatureOutput( oAuthSignature );
+    urlencode_to( base64Digest, BASE64_SHA1_DIGEST_LENGTH, signatureOutput );
+    LOG(LogLevelDebug, "Percent-encoded Signature: " << oAuthSignature);
 
-      case Http::Put:
-        {
-            sigBase.assign( "PUT&" );
-        }
-        break;
+    return ( oAuthSignature.length() ) ? true : false;
+}
 
-    default:
-        {
-            return false;
-        }
-        break;
-    }
-    sigBase.append( PercentEncode( rawUrl ) );
-    sigBase.append( "&" );
-    sigBase.append( PercentEncode( rawParams ) );
-    LOG(LogLevelDebug, "Signature base string: " << sigBase);
+/*++
+* @method: Client::getSignature
+*
+* @description: this method calculates HMAC-SHA1 signature of OAuth header
+*
+* @input: credentials - signing key to use
+*         eType - HTTP request type
+*         rawUrl - raw url of the HTTP request
+*         rawKeyValuePairs - sorted key-value pairs containing OAuth headers and HTTP data
+*         rawUrlEncoded - whether rawUrl is already percent encoded
+*
+* @output: oAuthSignature - base64 and url encoded signature
+*
+* @remarks: internal method
+*
+*--*/
+bool Client::getSignature( const Credentials& credentials,
+                          const Http::RequestType eType,
+                          const std::string& rawUrl,
+                          const ParameterList& rawKeyValuePairs,
+                          std::string& oAuthSignature,
+                          const bool rawUrlEncoded ) const
+{
+    /* Initially empty signature */
+    oAuthSignature.assign( "" );
 
-    /* Now, hash the signature base string using HMAC_SHA1 class */
-    CHMAC_SHA1 objHMACSHA1;
-    std::string secretSigningKey;
-    unsigned char strDigest[Defaults::BUFFSIZE_LARGE];
+    const char* prefix = SignatureBasePrefix( eType );
+    if( !prefix )
+        return false;
 
-    memset( strDigest, 0, Defaults::BUFFSIZE_LARGE );
+    CHMAC_SHA1 objHMACSHA1;
+    unsigned char strDigest[CHMAC_SHA1::SHA1_DIGEST_LENGTH];
 
-    /* Signing key is composed of consumer_secret&token_secret */
-    secretSigningKey.assign( PercentEncode(mConsumer->secret()) );
-    secretSigningKey.append( "&" );
-    if( mToken && mToken->secret().length() )
+    if( LogLevelDebug <= gLogLevel )
     {
-        secretSigningKey.append( PercentEncode(mToken->secret()) );
+        /* Build the base string in full so it can be logged */
+        std::string sigBase;
+        getSignatureBaseString( eType, rawUrl, rawKeyValuePairs, sigBase, rawUrlEncoded );
+        objHMACSHA1.HMAC_SHA1( (unsigned char*)sigBase.c_str(),
+                               sigBase.length(),
+                               *credentials.key,
+                               strDigest );
+        return getSignatureFromDigest( strDigest, oAuthSignature );
     }
 
-    objHMACSHA1.HMAC_SHA1( (unsigned char*)sigBase.c_str(),
-                           sigBase.length(),
-                           (unsigned char*)secretSigningKey.c_str(),
-                           secretSigningKey.length(),
-                           strDigest );
+    /* Otherwise hash the base string as it is produced */
+    DigestSignatureBase( *credentials.key, prefix, rawUrl, rawUrlEncoded, rawKeyValuePairs, strDigest );
 
-    /* Do a base64 encode of signature */
-    std::string base64Str = base64_encode( strDigest, 20 /* SHA 1 digest is 160 bits */ );
-    LOG(LogLevelDebug, "Signature: " << base64Str);
-
-    /* Do an url encode */
-    oAuthSignature = PercentEncode( base64Str );
-    LOG(LogLevelDebug, "Percent-encoded Signature: " << oAuthSignature);
+    return getSignatureFromDigest( strDigest, oAuthSignature );
+}
 
-    return ( oAuthSignature.length() ) ? true : false;
+Request::Request(const Http::RequestType eType_,
+                 const std::string& rawUrl_,
+                 const std::string& rawData_,
+                 const bool includeOAuthVerifierPin_)
+ : eType(eType_),
+   rawUrl(rawUrl_),
+   rawData(rawData_),
+   includeOAuthVerifierPin(includeOAuthVerifierPin_)
+{
 }
 
 std::string Client::getHttpHeader(const Http::RequestType eType,
@@ -437,7 +823,7 @@ std::string Client::getHttpHeader(const Http::RequestType eType,
     const std::string& rawData,
     const bool includeOAuthVerifierPin) const
 {
-    return Defaults::AUTHHEADER_PREFIX + buildOAuthParameterString(AuthorizationHeaderString, eType, rawUrl, rawData, includeOAuthVerifierPin);
+    return buildOAuthParameterString(AuthorizationHeaderString, Defaults::AUTHHEADER_PREFIX, eType, rawUrl, rawData, includeOAuthVerifierPin);
 }
 
 std::string Client::getFormattedHttpHeader(const Http::RequestType eType,
@@ -445,7 +831,23 @@ std::string Client::getFormattedHttpHeader(const Http::RequestType eType,
     const std::string& rawData,
     const bool includeOAuthVerifierPin) const
 {
-    return Defaults::AUTHHEADER_FIELD + Defaults::AUTHHEADER_PREFIX + buildOAuthParameterString(AuthorizationHeaderString, eType, rawUrl, rawData, includeOAuthVerifierPin);
+    return buildOAuthParameterString(AuthorizationHeaderString, Defaults::AUTHHEADER_FIELD_PREFIX, eType, rawUrl, rawData, includeOAuthVerifierPin);
+}
+
+std::string Client::getHttpHeader(const Http::RequestType eType,
+    const std::string& rawUrl,
+    const BodyHash& body,
+    const bool includeOAuthVerifierPin) const
+{
+    return buildOAuthParameterString(AuthorizationHeaderString, Defaults::AUTHHEADER_PREFIX, eType, rawUrl, "", includeOAuthVerifierPin, body.value());
+}
+
+std::string Client::getFormattedHttpHeader(const Http::RequestType eType,
+    const std::string& rawUrl,
+    const BodyHash& body,
+    const bool includeOAuthVerifierPin) const
+{
+    return buildOAuthParameterString(AuthorizationHeaderString, Defaults::AUTHHEADER_FIELD_PREFIX, eType, rawUrl, "", includeOAuthVerifierPin, body.value());
 }
 
 std::string Client::getURLQueryString(const Http::RequestType eType,
@@ -453,162 +855,808 @@ std::string Client::getURLQueryString(const Http::RequestType eType,
     const std::string& rawData,
     const bool includeOAuthVerifierPin) const
 {
-    return buildOAuthParameterString(QueryStringString, eType, rawUrl, rawData, includeOAuthVerifierPin);
+    return buildOAuthParameterString(QueryStringString, std::string(), eType, rawUrl, rawData, includeOAuthVerifierPin);
+}
+
+std::string Client::getHttpHeader(const PreparedRequest& request,
+    const std::string& dynamicData) const
+{
+    return buildOAuthParameterString(AuthorizationHeaderString, Defaults::AUTHHEADER_PREFIX, request, dynamicData);
+}
+
+std::string Client::getFormattedHttpHeader(const PreparedRequest& request,
+    const std::string& dynamicData) const
+{
+    return buildOAuthParameterString(AuthorizationHeaderString, Defaults::AUTHHEADER_FIELD_PREFIX, request, dynamicData);
+}
+
+std::string Client::getURLQueryString(const PreparedRequest& request,
+    const std::string& dynamicData) const
+{
+    return buildOAuthParameterString(QueryStringString, std::string(), request, dynamicData);
+}
+
+size_t Client::getHttpHeader(SigningBuffer& buffer,
+    char* out, size_t outSize,
+    const Http::RequestType eType,
+    const std::string& rawUrl,
+    const std::string& rawData,
+    const bool includeOAuthVerifierPin) const
+{
+    buffer.mState->output.assign(Defaults::AUTHHEADER_PREFIX);
+    buildOAuthParameterString(AuthorizationHeaderString, eType, rawUrl, rawData, includeOAuthVerifierPin, "", *buffer.mState);
+    return buffer.copy(out, outSize);
+}
+
+size_t Client::getFormattedHttpHeader(SigningBuffer& buffer,
+    char* out, size_t outSize,
+    const Http::RequestType eType,
+    const std::string& rawUrl,
+    const std::string& rawData,
+    const bool includeOAuthVerifierPin) const
+{
+    buffer.mState->output.assign(Defaults::AUTHHEADER_FIELD_PREFIX);
+    buildOAuthParameterString(AuthorizationHeaderString, eType, rawUrl, rawData, includeOAuthVerifierPin, "", *buffer.mState);
+    return buffer.copy(out, outSize);
+}
+
+size_t Client::getURLQueryString(SigningBuffer& buffer,
+    char* out, size_t outSize,
+    const Http::RequestType eType,
+    const std::string& rawUrl,
+    const std::string& rawData,
+    const bool includeOAuthVerifierPin) const
+{
+    buffer.mState->output.clear();
+    buildOAuthParameterString(QueryStringString, eType, rawUrl, rawData, includeOAuthVerifierPin, "", *buffer.mState);
+    return buffer.copy(out, outSize);
+}
+
+std::vector<std::string> Client::getHttpHeaders(const RequestList& requests) const
+{
+    std::vector<std::string> result;
+    buildOAuthParameterStrings(AuthorizationHeaderString, requests, result);
+    for(size_t i = 0; i < result.size(); i++)
+        result[i].insert(0, Defaults::AUTHHEADER_PREFIX);
+    return result;
+}
+
+std::vector<std::string> Client::getURLQueryStrings(const RequestList& requests) const
+{
+    std::vector<std::string> result;
+    buildOAuthParameterStrings(QueryStringString, requests, result);
+    return result;
 }
 
 std::string Client::buildOAuthParameterString(
+    ParameterStringType string_type,
+    const std::string& prefix,
+    const Http::RequestType eType,
+    const std::string& rawUrl,
+    const std::string& rawData,
+    const bool includeOAuthVerifierPin,
+    const std::string& oauthBodyHash) const
+{
+    SigningBuffer::State localScratch;
+    SigningBuffer::State& scratch = mSigningBuffer ? *mSigningBuffer->mState : localScratch;
+    if( !mSigningBuffer )
+    {
+        /* Allocate once rather than growing piecemeal */
+        scratch.parameters.reserve( 16, rawUrl.length() + rawData.length() + 256 );
+        scratch.output.reserve( prefix.length() + rawUrl.length() + rawData.length() + 512 );
+    }
+
+    scratch.output.assign( prefix );
+    buildOAuthParameterString( string_type, eType, rawUrl, rawData, includeOAuthVerifierPin, oauthBodyHash, scratch );
+    return scratch.output;
+}
+
+void Client::buildOAuthParameterString(
     ParameterStringType string_type,
     const Http::RequestType eType,
+    const std::string& rawUrl,
+    const std::string& rawData,
+    const bool includeOAuthVerifierPin,
+    const std::string& oauthBodyHash,
+    SigningBuffer::State& scratch) const
+{
+    Credentials credentials( *this );
+    ParameterList& rawKeyValuePairs = scratch.parameters;
+
+    prepareOAuthParameters( credentials, eType, rawUrl, rawData, includeOAuthVerifierPin, rawKeyValuePairs, scratch.pureUrl, scratch.nonce, scratch.timeStamp );
+    if( oauthBodyHash.length() )
+    {
+        rawKeyValuePairs.setPercentEncoded( Defaults::BODYHASH_KEY, oauthBodyHash );
+    }
+    rawKeyValuePairs.sort();
+
+    /* Get url encoded base64 signature using request type, url and parameters */
+    getSignature( credentials, eType, scratch.pureUrl, rawKeyValuePairs, scratch.signature );
+
+    finishOAuthParameterString( credentials, string_type, includeOAuthVerifierPin, scratch.signature, scratch.nonce, scratch.timeStamp, rawKeyValuePairs, scratch.output );
+}
+
+PreparedRequest Client::prepare(const Http::RequestType eType,
     const std::string& rawUrl,
     const std::string& rawData,
     const bool includeOAuthVerifierPin) const
 {
-    KeyValuePairs rawKeyValuePairs;
-    std::string rawParams;
-    std::string oauthSignature;
-    std::string paramsSeperator;
-    std::string pureUrl( rawUrl );
+    PreparedRequest request;
+    PreparedRequest::State& prepared = *request.mState;
+    prepared.eType = eType;
+    prepared.includeOAuthVerifierPin = includeOAuthVerifierPin;
 
-    LOG(LogLevelDebug, "Signing request " << RequestTypeString(eType) << " " << rawUrl << " " << rawData);
+    std::string pureUrl = rawUrl;
+    size_t nPos = rawUrl.find_first_of( "?" );
+    if( std::string::npos != nPos )
+    {
+        pureUrl = rawUrl.substr( 0, nPos );
+        prepared.parameters.parse( rawUrl, nPos + 1 );
+    }
+    prepared.encodedUrl = PercentEncode( pureUrl );
+
+    /* Nonce and timestamp are left empty, to be set for each signature.
+     * Their keys are unique, so setting them never reorders the list. */
+    Credentials credentials( *this );
+    buildOAuthTokenKeyValuePairs( credentials, includeOAuthVerifierPin, rawData, prepared.parameters, "", "" );
+    prepared.parameters.sort();
+
+    return request;
+}
+
+std::string Client::buildOAuthParameterString(
+    ParameterStringType string_type,
+    const std::string& prefix,
+    const PreparedRequest& request,
+    const std::string& dynamicData) const
+{
+    const PreparedRequest::State& prepared = *request.mState;
+    LOG(LogLevelDebug, "Signing prepared request " << RequestTypeString(prepared.eType) << " " << prepared.encodedUrl << " " << dynamicData);
 
-    std::string separator;
-    bool do_urlencode;
-    if (string_type == AuthorizationHeaderString) {
-        separator = ",";
-        do_urlencode = false;
+    SigningBuffer::State localScratch;
+    SigningBuffer::State& scratch = mSigningBuffer ? *mSigningBuffer->mState : localScratch;
+    if( !mSigningBuffer )
+    {
+        scratch.output.reserve( prefix.length() + prepared.encodedUrl.length() + dynamicData.length() + 512 );
     }
-    else { // QueryStringString
-        separator = "&";
-        do_urlencode = true;
+    Credentials credentials( *this );
+    ParameterList& rawKeyValuePairs = scratch.parameters;
+    rawKeyValuePairs = prepared.parameters;
+
+    generateNonceTimeStamp( scratch.nonce, scratch.timeStamp );
+    rawKeyValuePairs.setPercentEncoded( Defaults::NONCE_KEY, scratch.nonce );
+    rawKeyValuePairs.setPercentEncoded( Defaults::TIMESTAMP_KEY, scratch.timeStamp );
+
+    if( dynamicData.length() )
+    {
+        rawKeyValuePairs.parseSorted( dynamicData );
     }
 
+    getSignature( credentials, prepared.eType, prepared.encodedUrl, rawKeyValuePairs, scratch.signature, true );
+
+    scratch.output.assign( prefix );
+    finishOAuthParameterString( credentials, string_type, prepared.includeOAuthVerifierPin, scratch.signature, scratch.nonce, scratch.timeStamp, rawKeyValuePairs, scratch.output );
+    return scratch.output;
+}
+
+void Client::buildOAuthParameterStrings(
+    ParameterStringType string_type,
+    const RequestList& requests,
+    std::vector<std::string>& results) const
+{
+    size_t count = requests.size();
+    std::vector<ParameterList> rawKeyValuePairs(count);
+    std::vector<std::string> nonces(count);
+    std::vector<std::string> timeStamps(count);
+    std::vector<std::string> sigBases(count);
+    std::vector<bool> valid(count);
+
+    Credentials credentials( *this );
+    std::vector<const CHMAC_SHA1::KEY_STATE*> keys(count, credentials.key);
+    std::vector<const BYTE*> texts(count);
+    std::vector<size_t> textLengths(count);
+    std::vector<BYTE> digests(count * CHMAC_SHA1::SHA1_DIGEST_LENGTH);
+
+    /* Collect every signature base string first so they can all be hashed
+     * together, one per SIMD lane */
+    for(size_t i = 0; i < count; i++)
+    {
+        const Request& req = requests[i];
+        std::string pureUrl;
+        prepareOAuthParameters( credentials, req.eType, req.rawUrl, req.rawData, req.includeOAuthVerifierPin, rawKeyValuePairs[i], pureUrl, nonces[i], timeStamps[i] );
+        rawKeyValuePairs[i].sort();
+        valid[i] = getSignatureBaseString( req.eType, pureUrl, rawKeyValuePairs[i], sigBases[i] );
+        texts[i] = (const BYTE*)sigBases[i].data();
+        textLengths[i] = sigBases[i].length();
+    }
+
+    if( count )
+        HMAC_SHA1_MB( count, &keys[0], &texts[0], &textLengths[0], &digests[0] );
+
+    results.resize(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        std::string oauthSignature;
+        if( valid[i] )
+            getSignatureFromDigest( &digests[i * CHMAC_SHA1::SHA1_DIGEST_LENGTH], oauthSignature );
+        finishOAuthParameterString( credentials, string_type, requests[i].includeOAuthVerifierPin, oauthSignature, nonces[i], timeStamps[i], rawKeyValuePairs[i], results[i] );
+    }
+}
+
+/*++
+* @method: Client::prepareOAuthParameters
+*
+* @description: this method collects the url encoded parameters a request
+*               is signed over: query string parameters from the url, OAuth
+*               parameters and request data.
+*
+* @input: credentials - consumer and token to sign with
+*         eType - HTTP request type
+*         rawUrl - raw url of the HTTP request, including query parameters
+*         rawData - url encoded request data
+*         includeOAuthVerifierPin - whether to include oauth_verifier
+*
+* @output: rawKeyValuePairs - parameters to sign, without the signature. Not
+*                            sorted yet.
+*          pureUrl - rawUrl without the query string
+*          nonce - OAuth nonce to use
+*          timeStamp - timestamp when nonce was generated
+*
+* @remarks: internal method
+*
+*--*/
+void Client::prepareOAuthParameters( const Credentials& credentials,
+                                    const Http::RequestType eType,
+                                    const std::string& rawUrl,
+                                    const std::string& rawData,
+                                    const bool includeOAuthVerifierPin,
+                                    ParameterList& rawKeyValuePairs,
+                                    std::string& pureUrl,
+                                    std::string& nonce,
+                                    std::string& timeStamp ) const
+{
+    LOG(LogLevelDebug, "Signing request " << RequestTypeString(eType) << " " << rawUrl << " " << rawData);
+
     /* Clear header string initially */
     rawKeyValuePairs.clear();
+    pureUrl = rawUrl;
 
     /* If URL itself contains ?key=value, then extract and put them in map */
     size_t nPos = rawUrl.find_first_of( "?" );
     if( std::string::npos != nPos )
     {
         /* Get only URL */
-        pureUrl = rawUrl.substr( 0, nPos );
+        pureUrl.assign( rawUrl, 0, nPos );
 
         /* Get only key=value data part */
-        std::string dataPart = rawUrl.substr( nPos + 1 );
-        rawKeyValuePairs = ParseKeyValuePairs(dataPart);
+        rawKeyValuePairs.parse( rawUrl, nPos + 1 );
     }
 
-    // NOTE: We always request URL encoding on the first pass so that the
-    // signature generation works properly. This *relies* on
-    // buildOAuthTokenKeyValuePairs overwriting values when we do the second
-    // pass to get the values in the form we actually want. The signature and
-    // rawdata are the only things that change, but the signature is only used
-    // in the second pass and the rawdata is already encoded, regardless of
-    // request type.
-    std::string nonce;
-    std::string timeStamp;
-    
+    // The parameters are built once, percent encoded, which is the form they
+    // are signed in. finishOAuthParameterString derives both output formats
+    // from them.
     generateNonceTimeStamp(nonce, timeStamp);
 
     /* Build key-value pairs needed for OAuth request token, without signature */
-    buildOAuthTokenKeyValuePairs( includeOAuthVerifierPin, rawData, std::string( "" ), rawKeyValuePairs, true, nonce, timeStamp );
+    buildOAuthTokenKeyValuePairs( credentials, includeOAuthVerifierPin, rawData, rawKeyValuePairs, nonce, timeStamp );
+}
 
-    /* Get url encoded base64 signature using request type, url and parameters */
-    getSignature( eType, pureUrl, rawKeyValuePairs, oauthSignature );
-
-    /* Now, again build key-value pairs with signature this time */
-    buildOAuthTokenKeyValuePairs( includeOAuthVerifierPin, std::string( "" ), oauthSignature, rawKeyValuePairs, do_urlencode, nonce, timeStamp );
-
-    /* Get OAuth header in string format. If we're getting the Authorization
-     * header, we need to filter out other parameters.
-     */
-    if (string_type == AuthorizationHeaderString) {
-        KeyValuePairs oauthKeyValuePairs;
-        std::vector<std::string> oauth_keys;
-        oauth_keys.push_back(Defaults::CONSUMERKEY_KEY);
-        oauth_keys.push_back(Defaults::NONCE_KEY);
-        oauth_keys.push_back(Defaults::SIGNATURE_KEY);
-        oauth_keys.push_back(Defaults::SIGNATUREMETHOD_KEY);
-        oauth_keys.push_back(Defaults::TIMESTAMP_KEY);
-        oauth_keys.push_back(Defaults::TOKEN_KEY);
-        oauth_keys.push_back(Defaults::VERIFIER_KEY);
-        oauth_keys.push_back(Defaults::VERSION_KEY);
-
-        for(size_t i = 0; i < oauth_keys.size(); i++) {
-            assert(rawKeyValuePairs.count(oauth_keys[i]) <= 1);
-            KeyValuePairs::iterator oauth_key_it = rawKeyValuePairs.find(oauth_keys[i]);
-            if (oauth_key_it != rawKeyValuePairs.end())
-                ReplaceOrInsertKeyValuePair(oauthKeyValuePairs, oauth_keys[i], oauth_key_it->second);
-        }
-        getStringFromOAuthKeyValuePairs( oauthKeyValuePairs, rawParams, separator );
+/*++
+* @method: Client::finishOAuthParameterString
+*
+* @description: this method adds the signature to the parameters collected by
+*               prepareOAuthParameters and formats them as a query string or
+*               Authorization header value.
+*
+* @input: credentials - consumer and token the request is signed with
+*         string_type - query string or Authorization header
+*         includeOAuthVerifierPin - whether to include oauth_verifier
+*         oauthSignature - base64 and url encoded OAuth signature
+*         nonce - OAuth nonce used for the signature
+*         timeStamp - timestamp used for the signature
+*         rawKeyValuePairs - sorted parameters from prepareOAuthParameters.
+*                            The signature is added in place.
+*
+* @output: rawParams - the query string or header value, appended to
+*
+* @remarks: internal method
+*
+*--*/
+void Client::finishOAuthParameterString( const Credentials& credentials,
+                                        ParameterStringType string_type,
+                                        const bool includeOAuthVerifierPin,
+                                        const std::string& oauthSignature,
+                                        const std::string& nonce,
+                                        const std::string& timeStamp,
+                                        ParameterList& rawKeyValuePairs,
+                                        std::string& rawParams ) const
+{
+
+    /* Signature if supplied. Signature is exempt from encoding: the procedure
+     * for computing it already percent-encodes it as required by the spec for
+     * both query string and Auth header methods. */
+    if( oauthSignature.length() )
+    {
+        rawKeyValuePairs.setSorted( Defaults::SIGNATURE_KEY, oauthSignature );
     }
-    else if (string_type == QueryStringString) {
-        getStringFromOAuthKeyValuePairs( rawKeyValuePairs, rawParams, separator );
+
+    if (string_type == QueryStringString) {
+        getStringFromOAuthKeyValuePairs( rawKeyValuePairs, rawParams, "&" );
+        return;
     }
 
-    /* Build authorization header */
-    return rawParams;
+    /* Authorization header: only the OAuth parameters, quoted. The ones this
+     * client supplied itself are sent unencoded; the rest (signature, body
+     * hash, anything passed in the url) as they were signed. */
+    const Token* token = credentials.token;
+    const std::string* tokenKey = ( token && token->key().length() ) ? &token->key() : NULL;
+    const std::string* verifier = ( includeOAuthVerifierPin && token && token->pin().length() ) ? &token->pin() : NULL;
+    const struct {
+        const std::string* key;
+        const std::string* plainValue;
+    } oauth_keys[] = {
+        { &Defaults::CONSUMERKEY_KEY, &credentials.consumer->key() },
+        { &Defaults::NONCE_KEY, &nonce },
+        { &Defaults::SIGNATURE_KEY, NULL },
+        { &Defaults::SIGNATUREMETHOD_KEY, NULL },
+        { &Defaults::TIMESTAMP_KEY, &timeStamp },
+        { &Defaults::TOKEN_KEY, tokenKey },
+        { &Defaults::VERIFIER_KEY, verifier },
+        { &Defaults::VERSION_KEY, NULL },
+        { &Defaults::BODYHASH_KEY, NULL }
+    };
+
+    bool first = true;
+    for( size_t i = 0; i < rawKeyValuePairs.size(); i++ )
+    {
+        const char* key = rawKeyValuePairs.key( i );
+        size_t keyLength = rawKeyValuePairs.keyLength( i );
+        if( keyLength < 6 || memcmp( key, "oauth_", 6 ) != 0 )
+            continue;
+
+        for( size_t k = 0; k < sizeof(oauth_keys)/sizeof(oauth_keys[0]); k++ )
+        {
+            const std::string& oauthKey = *oauth_keys[k].key;
+            if( oauthKey.length() != keyLength || memcmp( key, oauthKey.data(), keyLength ) != 0 )
+                continue;
+
+            if( !first )
+                rawParams.append( "," );
+            first = false;
+            rawParams.append( key, keyLength );
+            rawParams.append( "=\"" );
+            if( oauth_keys[k].plainValue )
+                rawParams.append( *oauth_keys[k].plainValue );
+            else
+                rawParams.append( rawKeyValuePairs.value( i ), rawKeyValuePairs.valueLength( i ) );
+            rawParams.append( "\"" );
+            break;
+        }
+    }
 }
 
 /*++
 * @method: Client::getStringFromOAuthKeyValuePairs
 *
-* @description: this method builds a sorted string from key-value pairs
+* @description: this method builds a string from sorted key-value pairs
 *
-* @input: rawParamMap - key-value pairs map
+* @input: rawParamMap - sorted key-value pairs
 *         paramsSeperator - sepearator, either & or ,
 *
-* @output: rawParams - sorted string of OAuth parameters
+* @output: rawParams - string of OAuth parameters, appended to
 *
 * @remarks: internal method
 *
 *--*/
-bool Client::getStringFromOAuthKeyValuePairs( const KeyValuePairs& rawParamMap,
+bool Client::getStringFromOAuthKeyValuePairs( const ParameterList& rawParamMap,
                                              std::string& rawParams,
                                              const std::string& paramsSeperator ) const
 {
-    rawParams.assign( "" );
-    if( rawParamMap.size() )
+    /* Values are quoted in headers */
+    bool quoteValues = ( paramsSeperator == "," );
+
+    size_t length = 0;
+    for( size_t i = 0; i < rawParamMap.size(); i++ )
     {
-        KeyValueList keyValueList;
-        std::string dummyStr;
+        length += rawParamMap.keyLength( i ) + 1 + rawParamMap.valueLength( i );
+        length += quoteValues ? 2 : 0;
+        length += i ? paramsSeperator.length() : 0;
+    }
 
-        /* Push key-value pairs to a list of strings */
-        keyValueList.clear();
-        KeyValuePairs::const_iterator itMap = rawParamMap.begin();
-        for( ; itMap != rawParamMap.end(); itMap++ )
+    length += rawParams.length();
+    if( rawParams.capacity() < length )
+    {
+        rawParams.reserve( length );
+    }
+    for( size_t i = 0; i < rawParamMap.size(); i++ )
+    {
+        if( i )
+        {
+            rawParams.append( paramsSeperator );
+        }
+        rawParams.append( rawParamMap.key( i ), rawParamMap.keyLength( i ) );
+        rawParams.append( "=" );
+        if( quoteValues )
         {
-            dummyStr.assign( itMap->first );
-            dummyStr.append( "=" );
-            if( paramsSeperator == "," )
-            {
-                dummyStr.append( "\"" );
-            }
-            dummyStr.append( itMap->second );
-            if( paramsSeperator == "," )
-            {
-                dummyStr.append( "\"" );
-            }
-            keyValueList.push_back( dummyStr );
+            rawParams.append( "\"" );
         }
+        rawParams.append( rawParamMap.value( i ), rawParamMap.valueLength( i ) );
+        if( quoteValues )
+        {
+            rawParams.append( "\"" );
+        }
+    }
+    return ( rawParams.length() ) ? true : false;
+}
+
+
+struct VerificationBuffer::State {
+    ParameterList parameters;
+    std::string pureUrl;
+    /* Decoded parameters of the last request */
+    std::string consumerKey;
+    std::string token;
+    std::string nonce;
+    time_t timestamp;
+    /* Header parameters, while they're normalized */
+    std::string decoded;
+    std::string normalized;
+    std::string consumerSecret;
+    std::string tokenSecret;
+    std::string signingKey;
+    /* Between the checks before and after the secrets are looked up: the
+     * start of the base string, and the signature the request came with */
+    const char* prefix;
+    unsigned char expected[CHMAC_SHA1::SHA1_DIGEST_LENGTH];
+
+    State() : timestamp(0), prefix(NULL) {}
+};
+
+VerificationBuffer::VerificationBuffer()
+ : mState(new State)
+{
+}
+
+VerificationBuffer::~VerificationBuffer()
+{
+    delete mState;
+}
+
+const std::string& VerificationBuffer::consumerKey() const
+{
+    return mState->consumerKey;
+}
+
+const std::string& VerificationBuffer::token() const
+{
+    return mState->token;
+}
+
+const std::string& VerificationBuffer::nonce() const
+{
+    return mState->nonce;
+}
+
+time_t VerificationBuffer::timestamp() const
+{
+    return mState->timestamp;
+}
+
+namespace {
+// Clients are meant to percent encode Authorization header values, but
+// needn't do it the way they are signed (Client itself sends its own values
+// unencoded). Decoding and encoding them again gives the signed form.
+bool AppendNormalized(const char* s, size_t length, std::string& decoded, std::string& out) {
+    decoded.clear();
+    if( !urldecode_append( s, length, decoded ) )
+        return false;
+    urlencode_append output( out );
+    urlencode_to( decoded.data(), decoded.length(), output );
+    return true;
+}
+
+// Whether decoding and encoding s again would give s back: it is all
+// unreserved characters
+bool IsNormalized(const char* s, size_t length) {
+    for( size_t i = 0; i < length; i++ )
+    {
+        if( urlencode_length_everything[(unsigned char)s[i]] != 1 )
+            return false;
+    }
+    return true;
+}
 
-        /* Sort key-value pairs based on key name */
-        keyValueList.sort();
+// Adds the parameters of an Authorization header to params, leaving out
+// the realm: [Authorization:] OAuth key="value", key="value"...
+// Throws ParseError if it isn't an OAuth header or can't be parsed, and
+// returns false if a key or value doesn't decode.
+bool ParseAuthorizationHeader(const std::string& header, ParameterList& params,
+                              std::string& decoded, std::string& normalized) {
+    ParameterReader reader( header, ParameterReader::AuthorizationHeader );
+    while( reader.next() )
+    {
+        if( reader.keyLength() == 5 && memcmp( reader.key(), "realm", 5 ) == 0 )
+            continue;
 
-        /* Now, form a string */
-        dummyStr.assign( "" );
-        KeyValueList::iterator itKeyValue = keyValueList.begin();
-        for( ; itKeyValue != keyValueList.end(); itKeyValue++ )
+        // Most values are already in their signed form, and are used as
+        // they are
+        if( IsNormalized( reader.key(), reader.keyLength() ) &&
+            IsNormalized( reader.value(), reader.valueLength() ) )
         {
-            if( dummyStr.length() )
-            {
-                dummyStr.append( paramsSeperator );
-            }
-            dummyStr.append( itKeyValue->c_str() );
+            params.add( reader.key(), reader.keyLength(), reader.value(), reader.valueLength() );
+            continue;
         }
-        rawParams.assign( dummyStr );
+        normalized.clear();
+        if( !AppendNormalized( reader.key(), reader.keyLength(), decoded, normalized ) )
+            return false;
+        size_t normalizedKeyLength = normalized.length();
+        if( !AppendNormalized( reader.value(), reader.valueLength(), decoded, normalized ) )
+            return false;
+        params.add( normalized.data(), normalizedKeyLength,
+                    normalized.data() + normalizedKeyLength, normalized.length() - normalizedKeyLength );
     }
-    return ( rawParams.length() ) ? true : false;
+    return true;
 }
 
+// Compares the whole digest whatever the first difference, so the time taken
+// doesn't tell an attacker how much of a forged signature was right
+bool DigestsEqual(const unsigned char* a, const unsigned char* b) {
+    unsigned char difference = 0;
+    for( size_t i = 0; i < CHMAC_SHA1::SHA1_DIGEST_LENGTH; i++ )
+        difference |= a[i] ^ b[i];
+    return difference == 0;
+}
+
+bool ParseTimestamp(const char* s, size_t length, time_t* timestamp) {
+    // 18 digits can't overflow, and are plenty
+    if( length == 0 || length > 18 )
+        return false;
+    long long t = 0;
+    for( size_t i = 0; i < length; i++ )
+    {
+        if( s[i] < '0' || s[i] > '9' )
+            return false;
+        t = t * 10 + ( s[i] - '0' );
+    }
+    *timestamp = (time_t)t;
+    return true;
+}
+}
+
+Verifier::Verifier(const SecretStore* secrets)
+ : mSecrets(secrets),
+   mClock(NULL),
+   mMaxClockSkew(300),
+   mNonceStore(NULL),
+   mCredentials(NULL),
+   mSharedCredentials(NULL)
+{
+}
+
+void Verifier::setClock(const Clock* clock)
+{
+    mClock = clock;
+}
+
+void Verifier::setMaxClockSkew(time_t seconds)
+{
+    mMaxClockSkew = seconds;
+}
+
+void Verifier::setNonceStore(NonceStore* store)
+{
+    mNonceStore = store;
+}
+
+void Verifier::setCredentialCache(CredentialCache* cache)
+{
+    mCredentials = cache;
+}
+
+void Verifier::setSharedCredentials(const SharedCredentials* credentials)
+{
+    mSharedCredentials = credentials;
+}
+
+Verification::Result Verifier::verify(const Http::RequestType eType,
+                                      const std::string& rawUrl,
+                                      const std::string& authorizationHeader,
+                                      const std::string& rawData) const
+{
+    VerificationBuffer buffer;
+    return verify( buffer, eType, rawUrl, authorizationHeader, rawData );
+}
+
+/*++
+* @method: Verifier::verify
+*
+* @description: this method checks the signature of a request. The parameters
+*               are collected and normalized as Client collects them, so the
+*               signature base string comes out the same.
+*
+* @input: eType - HTTP request type
+*         rawUrl - url of the request, including query parameters
+*         authorizationHeader - Authorization header, can be empty
+*         rawData - url encoded request data
+*
+* @output: buffer - decoded consumer key, token, nonce and timestamp
+*
+*--*/
+Verification::Result Verifier::verify(VerificationBuffer& buffer,
+                                      const Http::RequestType eType,
+                                      const std::string& rawUrl,
+                                      const std::string& authorizationHeader,
+                                      const std::string& rawData) const
+{
+    Verification::Result result = prepareVerify( buffer, eType, rawUrl, authorizationHeader, rawData );
+    if( result != Verification::Valid )
+        return result;
+
+    VerificationBuffer::State& scratch = *buffer.mState;
+    CredentialCache::SigningKey key;
+    if( mSharedCredentials )
+    {
+        CredentialsReader reader( mSharedCredentials );
+        const CredentialEntry* entry = NULL;
+        result = reader.snapshot()->lookup( scratch.consumerKey, scratch.token, &entry );
+        if( result != Verification::Valid )
+            return result;
+        key.state = entry->state;
+    }
+    else if( mCredentials )
+    {
+        result = mCredentials->signingKey( scratch.consumerKey, scratch.token, key );
+        if( result != Verification::Valid )
+            return result;
+    }
+    else
+    {
+        if( !mSecrets->consumerSecret( scratch.consumerKey, scratch.consumerSecret ) )
+            return Verification::UnknownConsumer;
+        scratch.tokenSecret.clear();
+        if( scratch.token.length() && !mSecrets->tokenSecret( scratch.consumerKey, scratch.token, scratch.tokenSecret ) )
+            return Verification::UnknownToken;
+        PrepareSigningKey( scratch.consumerSecret, scratch.tokenSecret, scratch.signingKey, &key.state );
+    }
+    return finishVerify( buffer, key );
+}
+
+/*++
+* @method: Verifier::prepareVerify
+*
+* @description: this method makes the checks that don't need the secrets,
+*               and leaves the request in the buffer for finishVerify
+*
+*--*/
+Verification::Result Verifier::prepareVerify(VerificationBuffer& buffer,
+                                             const Http::RequestType eType,
+                                             const std::string& rawUrl,
+                                             const std::string& authorizationHeader,
+                                             const std::string& rawData) const
+{
+    VerificationBuffer::State& scratch = *buffer.mState;
+    ParameterList& params = scratch.parameters;
+    params.clear();
+    scratch.consumerKey.clear();
+    scratch.token.clear();
+    scratch.nonce.clear();
+    scratch.timestamp = 0;
+
+    scratch.prefix = SignatureBasePrefix( eType );
+    if( !scratch.prefix )
+        return Verification::Unsupported;
+
+    size_t nPos = rawUrl.find( '?' );
+    scratch.pureUrl.assign( rawUrl, 0, nPos );
+    try
+    {
+        if( std::string::npos != nPos )
+            params.parse( rawUrl, nPos + 1 );
+        params.parse( rawData );
+        if( authorizationHeader.length() &&
+            !ParseAuthorizationHeader( authorizationHeader, params, scratch.decoded, scratch.normalized ) )
+            return Verification::Malformed;
+    }
+    catch( const ParseError& )
+    {
+        return Verification::Malformed;
+    }
+
+    /* Find the protocol parameters, each of which may only appear once */
+    enum { CONSUMERKEY, TOKEN, SIGNATUREMETHOD, SIGNATURE, TIMESTAMP, NONCE, VERSION, PROTOCOL_PARAMETERS };
+    const std::string* protocolKeys[PROTOCOL_PARAMETERS] = {
+        &Defaults::CONSUMERKEY_KEY, &Defaults::TOKEN_KEY, &Defaults::SIGNATUREMETHOD_KEY,
+        &Defaults::SIGNATURE_KEY, &Defaults::TIMESTAMP_KEY, &Defaults::NONCE_KEY, &Defaults::VERSION_KEY
+    };
+    size_t found[PROTOCOL_PARAMETERS];
+    for( size_t k = 0; k < PROTOCOL_PARAMETERS; k++ )
+        found[k] = ParameterList::npos;
+
+    for( size_t i = 0; i < params.size(); i++ )
+    {
+        const char* key = params.key( i );
+        size_t keyLength = params.keyLength( i );
+        if( keyLength < 6 || memcmp( key, "oauth_", 6 ) != 0 )
+            continue;
+        for( size_t k = 0; k < PROTOCOL_PARAMETERS; k++ )
+        {
+            if( protocolKeys[k]->length() != keyLength || memcmp( key, protocolKeys[k]->data(), keyLength ) != 0 )
+                continue;
+            if( found[k] != ParameterList::npos )
+                return Verification::Malformed;
+            found[k] = i;
+            break;
+        }
+    }
+
+    if( found[CONSUMERKEY] == ParameterList::npos || found[SIGNATUREMETHOD] == ParameterList::npos ||
+        found[SIGNATURE] == ParameterList::npos || found[TIMESTAMP] == ParameterList::npos ||
+        found[NONCE] == ParameterList::npos )
+        return Verification::MissingParameter;
+
+    size_t i = found[SIGNATUREMETHOD];
+    if( params.valueLength( i ) != 9 || memcmp( params.value( i ), "HMAC-SHA1", 9 ) != 0 )
+        return Verification::Unsupported;
+    i = found[VERSION];
+    if( i != ParameterList::npos && ( params.valueLength( i ) != 3 || memcmp( params.value( i ), "1.0", 3 ) != 0 ) )
+        return Verification::Unsupported;
+
+    i = found[CONSUMERKEY];
+    if( !urldecode_append( params.value( i ), params.valueLength( i ), scratch.consumerKey ) )
+        return Verification::Malformed;
+    i = found[TOKEN];
+    if( i != ParameterList::npos && !urldecode_append( params.value( i ), params.valueLength( i ), scratch.token ) )
+        return Verification::Malformed;
+    i = found[NONCE];
+    if( !urldecode_append( params.value( i ), params.valueLength( i ), scratch.nonce ) )
+        return Verification::Malformed;
+    i = found[TIMESTAMP];
+    if( !ParseTimestamp( params.value( i ), params.valueLength( i ), &scratch.timestamp ) )
+        return Verification::Malformed;
+
+    /* Cheap checks first: the clock, then the signature's form */
+    if( mMaxClockSkew > 0 )
+    {
+        time_t now = mClock ? mClock->now() : timestamp_now();
+        if( scratch.timestamp > now + mMaxClockSkew || scratch.timestamp < now - mMaxClockSkew )
+            return Verification::StaleTimestamp;
+    }
+
+    i = found[SIGNATURE];
+    scratch.decoded.clear();
+    if( !urldecode_append( params.value( i ), params.valueLength( i ), scratch.decoded ) ||
+        !base64_decode_sha1_digest( scratch.decoded.data(), scratch.decoded.length(), scratch.expected ) )
+        return Verification::InvalidSignature;
+    /* The signature isn't signed over */
+    params.erase( i );
+    return Verification::Valid;
+}
+
+/*++
+* @method: Verifier::finishVerify
+*
+* @description: this method checks the signature of a request passed by
+*               prepareVerify, with its signing key, and records its nonce
+*
+*--*/
+Verification::Result Verifier::finishVerify(VerificationBuffer& buffer,
+                                            const CredentialCache::SigningKey& key) const
+{
+    VerificationBuffer::State& scratch = *buffer.mState;
+    ParameterList& params = scratch.parameters;
+    params.sort();
+    unsigned char digest[CHMAC_SHA1::SHA1_DIGEST_LENGTH];
+    DigestSignatureBase( key.state, scratch.prefix, scratch.pureUrl, false, params, digest );
+    if( !DigestsEqual( digest, scratch.expected ) )
+    {
+        LOG(LogLevelDebug, "Signature mismatch for " << scratch.prefix << scratch.pureUrl);
+        return Verification::InvalidSignature;
+    }
+
+    /* Only now is the nonce known to be the client's */
+    if( mNonceStore && !mNonceStore->insert( scratch.consumerKey, scratch.token, scratch.nonce, scratch.timestamp ) )
+        return Verification::Replayed;
+    return Verification::Valid;
+}
 
 } // namespace OAuth
@@ -0,0 +1,69 @@
+#ifndef __LIBOAUTHCPP_MUTEX_H__
+#define __LIBOAUTHCPP_MUTEX_H__
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Locking for the parts of the library that share state between threads.
+
+namespace OAuth {
+
+class Mutex {
+public:
+#ifdef _WIN32
+    Mutex() { InitializeCriticalSection(&mMutex); }
+    ~Mutex() { DeleteCriticalSection(&mMutex); }
+    void lock() { EnterCriticalSection(&mMutex); }
+    void unlock() { LeaveCriticalSection(&mMutex); }
+private:
+    CRITICAL_SECTION mMutex;
+#else
+    Mutex() { pthread_mutex_init(&mMutex, NULL); }
+    ~Mutex() { pthread_mutex_destroy(&mMutex); }
+    void lock() { pthread_mutex_lock(&mMutex); }
+    void unlock() { pthread_mutex_unlock(&mMutex); }
+private:
+    pthread_mutex_t mMutex;
+#endif
+    friend class Condition;
+    Mutex(const Mutex&);
+    Mutex& operator=(const Mutex&);
+};
+
+class ScopedLock {
+public:
+    ScopedLock(Mutex& mutex) : mMutex(mutex) { mMutex.lock(); }
+    ~ScopedLock() { mMutex.unlock(); }
+private:
+    Mutex& mMutex;
+};
+
+// Waits for a change to state guarded by a Mutex. As with any condition
+// variable, wait() can return spuriously, so check the state in a loop.
+class Condition {
+public:
+#ifdef _WIN32
+    Condition() { InitializeConditionVariable(&mCondition); }
+    ~Condition() {}
+    void wait(Mutex& mutex) { SleepConditionVariableCS(&mCondition, &mutex.mMutex, INFINITE); }
+    void broadcast() { WakeAllConditionVariable(&mCondition); }
+private:
+    CONDITION_VARIABLE mCondition;
+#else
+    Condition() { pthread_cond_init(&mCondition, NULL); }
+    ~Condition() { pthread_cond_destroy(&mCondition); }
+    void wait(Mutex& mutex) { pthread_cond_wait(&mCondition, &mutex.mMutex); }
+    void broadcast() { pthread_cond_broadcast(&mCondition); }
+private:
+    pthread_cond_t mCondition;
+#endif
+    Condition(const Condition&);
+    Condition& operator=(const Condition&);
+};
+
+} // namespace OAuth
+
+#endif /* __LIBOAUTHCPP_MUTEX_H__ */
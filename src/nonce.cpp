@@ -0,0 +1,260 @@
+#ifdef _WIN32
+// For rand_s, must come before the first stdlib.h
+#define _CRT_RAND_S
+#endif
+#include "nonce.h"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#include <windows.h>
+#define NONCE_THREAD_LOCAL __declspec(thread)
+#else
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <time.h>
+#define NONCE_THREAD_LOCAL __thread
+#endif
+
+namespace {
+
+// Entropy is read this many bytes at a time, enough for 32 nonces
+const size_t NONCE_POOL_SIZE = 256;
+
+struct NoncePool {
+    unsigned char bytes[NONCE_POOL_SIZE];
+    size_t available;
+    unsigned long long fallbackCounter;
+};
+
+// Zero initialized, i.e. empty, in every new thread
+NONCE_THREAD_LOCAL NoncePool gPool;
+
+struct TimestampCache {
+    time_t time;
+    size_t length; // 0 until the first time is formatted
+    char text[24];
+};
+
+NONCE_THREAD_LOCAL TimestampCache gTimestamp;
+
+// Per process state for distributed nonces
+struct ProcessNonceState {
+    unsigned long long prefix;
+    volatile unsigned long long counter;
+};
+
+ProcessNonceState gProcess;
+
+void DrawProcessPrefix();
+
+#ifndef _WIN32
+pthread_once_t gProcessOnce = PTHREAD_ONCE_INIT;
+
+// A forked child starts with a copy of the parent's state and would repeat
+// its nonces: it starts over with an empty pool, and a new process prefix
+// if the parent had one.
+void AfterForkInChild() {
+    gPool.available = 0;
+    if (gProcess.prefix != 0)
+        DrawProcessPrefix();
+}
+
+pthread_once_t gAtForkOnce = PTHREAD_ONCE_INIT;
+
+void RegisterAtFork() {
+    pthread_atfork(NULL, NULL, AfterForkInChild);
+}
+#else
+volatile LONG gProcessOnce = 0; // 0 not started, 1 drawing, 2 done
+#endif
+
+bool ReadEntropy(unsigned char* buf, size_t len) {
+#if defined(_WIN32)
+    for(size_t i = 0; i < len; i += sizeof(unsigned int)) {
+        unsigned int r;
+        if (rand_s(&r) != 0) return false;
+        memcpy(buf + i, &r, (len - i < sizeof(r)) ? len - i : sizeof(r));
+    }
+    return true;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    arc4random_buf(buf, len);
+    return true;
+#else
+#ifdef SYS_getrandom
+    size_t got = 0;
+    while(got < len) {
+        long n = syscall(SYS_getrandom, buf + got, len - got, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        got += (size_t)n;
+    }
+    if (got == len) return true;
+#endif
+    // Older kernels
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0) return false;
+    size_t total = 0;
+    while(total < len) {
+        ssize_t n = read(fd, buf + total, len - total);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        total += (size_t)n;
+    }
+    close(fd);
+    return total == len;
+#endif
+}
+
+// Last resort when the OS has no entropy to give: splitmix64 over the time,
+// this thread's pool address and a per-thread counter. Not unpredictable,
+// but still distinct between threads.
+void FillFallback(NoncePool& pool) {
+    unsigned long long x = (unsigned long long)time(NULL) ^ ((unsigned long long)(size_t)&pool << 16);
+#ifndef _WIN32
+    x ^= (unsigned long long)getpid() << 40;
+#else
+    x ^= (unsigned long long)GetCurrentProcessId() << 40;
+#endif
+    for(size_t i = 0; i < NONCE_POOL_SIZE; i += 8) {
+        unsigned long long z = (x += 0x9E3779B97F4A7C15ULL + pool.fallbackCounter++);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        memcpy(pool.bytes + i, &z, 8);
+    }
+}
+
+void Refill(NoncePool& pool) {
+#ifndef _WIN32
+    pthread_once(&gAtForkOnce, RegisterAtFork);
+#endif
+    if (!ReadEntropy(pool.bytes, NONCE_POOL_SIZE))
+        FillFallback(pool);
+    pool.available = NONCE_POOL_SIZE;
+}
+
+void DrawProcessPrefix() {
+#ifndef _WIN32
+    pthread_once(&gAtForkOnce, RegisterAtFork);
+#endif
+    unsigned long long prefix = 0;
+    while(prefix == 0) {
+        // Not from the thread's pool: a child would get the same bytes
+        // as the parent if it hadn't been reset yet
+        NoncePool pool;
+        pool.fallbackCounter = 0;
+        if (!ReadEntropy(pool.bytes, sizeof(prefix)))
+            FillFallback(pool);
+        memcpy(&prefix, pool.bytes, sizeof(prefix));
+    }
+    gProcess.prefix = prefix;
+    gProcess.counter = 0;
+}
+
+void InitProcessPrefix() {
+#ifndef _WIN32
+    pthread_once(&gProcessOnce, DrawProcessPrefix);
+#else
+    if (InterlockedCompareExchange(&gProcessOnce, 1, 0) == 0) {
+        DrawProcessPrefix();
+        InterlockedExchange(&gProcessOnce, 2);
+    }
+    while(gProcessOnce != 2)
+        Sleep(0);
+#endif
+}
+
+} // namespace
+
+void nonce_random_hex(char* out) {
+    static const char hex_digits[] = "0123456789abcdef";
+
+    NoncePool& pool = gPool;
+    if (pool.available < NONCE_RANDOM_HEX_LENGTH / 2)
+        Refill(pool);
+
+    const unsigned char* r = pool.bytes + NONCE_POOL_SIZE - pool.available;
+    for(size_t i = 0; i < NONCE_RANDOM_HEX_LENGTH / 2; i++) {
+        out[2*i] = hex_digits[r[i] >> 4];
+        out[2*i+1] = hex_digits[r[i] & 0x0F];
+    }
+    pool.available -= NONCE_RANDOM_HEX_LENGTH / 2;
+}
+
+unsigned long long nonce_process_prefix() {
+    InitProcessPrefix();
+    return gProcess.prefix;
+}
+
+unsigned long long nonce_process_counter_next() {
+    InitProcessPrefix();
+#if defined(_WIN32)
+    return (unsigned long long)InterlockedIncrement64((volatile LONGLONG*)&gProcess.counter) - 1;
+#else
+    return __sync_fetch_and_add(&gProcess.counter, 1ULL);
+#endif
+}
+
+size_t nonce_format_hex(unsigned long long v, char* out) {
+    static const char hex_digits[] = "0123456789abcdef";
+    char digits[16];
+    size_t n = 0;
+    do {
+        digits[n++] = hex_digits[v & 0x0F];
+        v >>= 4;
+    } while(v);
+    for(size_t i = 0; i < n; i++)
+        out[i] = digits[n - 1 - i];
+    return n;
+}
+
+time_t timestamp_now() {
+#ifdef CLOCK_REALTIME_COARSE
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0)
+        return ts.tv_sec;
+#endif
+    return time(NULL);
+}
+
+double monotonic_now() {
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+size_t timestamp_format(time_t t, const char** text) {
+    TimestampCache& cache = gTimestamp;
+    if (cache.length == 0 || cache.time != t) {
+        // Digits are produced backwards, from the end of a scratch buffer
+        char digits[sizeof(cache.text)];
+        char* p = digits + sizeof(digits);
+        unsigned long long v = (t < 0) ? 0ULL - (unsigned long long)t : (unsigned long long)t;
+        do {
+            *--p = (char)('0' + v % 10);
+            v /= 10;
+        } while(v);
+        if (t < 0)
+            *--p = '-';
+
+        cache.length = digits + sizeof(digits) - p;
+        memcpy(cache.text, p, cache.length);
+        cache.time = t;
+    }
+    *text = cache.text;
+    return cache.length;
+}
@@ -0,0 +1,40 @@
+#ifndef __LIBOAUTHCPP_NONCE_H__
+#define __LIBOAUTHCPP_NONCE_H__
+
+#include <cstddef>
+#include <ctime>
+
+// Random part of a nonce: 64 bits, as 16 lowercase hex digits
+const size_t NONCE_RANDOM_HEX_LENGTH = 16;
+
+// Writes NONCE_RANDOM_HEX_LENGTH hex digits of fresh randomness to out (no
+// terminator). Each thread draws from its own buffer of operating system
+// entropy, so this takes no locks, and only makes a system call to refill
+// it. Safe to use from any number of threads, and across fork().
+void nonce_random_hex(char* out);
+
+// For nonces that are unique without coordination: a random value drawn once
+// per process, and again in a forked child (never 0), and the next value of
+// a process wide counter that restarts with it. Lock free.
+unsigned long long nonce_process_prefix();
+unsigned long long nonce_process_counter_next();
+
+// Writes v as lowercase hex without leading zeros (at most 16 digits, no
+// terminator) and returns the number of digits.
+size_t nonce_format_hex(unsigned long long v, char* out);
+
+// The current time in seconds, from the cheapest clock available: the
+// coarse realtime clock where there is one, which is read without a system
+// call.
+time_t timestamp_now();
+
+// Seconds from a monotonic clock, for measuring intervals.
+double monotonic_now();
+
+// Decimal text for the time t, for oauth_timestamp. Each thread caches the
+// text of the last time it formatted, so within a second this is only a
+// comparison. Returns the length; *text is valid until the thread's next
+// call.
+size_t timestamp_format(time_t t, const char** text);
+
+#endif /* __LIBOAUTHCPP_NONCE_H__ */
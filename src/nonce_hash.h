@@ -0,0 +1,76 @@
+#ifndef __LIBOAUTHCPP_NONCE_HASH_H__
+#define __LIBOAUTHCPP_NONCE_HASH_H__
+
+#include "nonce.h"
+#include <string>
+#include <cstring>
+
+// Keyed 64-bit hashing of the requests recorded by the nonce stores.
+
+namespace OAuth {
+
+typedef unsigned long long Hash;
+
+inline Hash RotateLeft(Hash x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline Hash Finalize(Hash h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// One MurmurHash3 style lane, eight bytes at a time. The length goes in
+// too, so the fields of a request can't run into each other.
+inline Hash HashBytes(Hash h, const std::string& s) {
+    const char* p = s.data();
+    std::size_t length = s.length();
+    for( ; length >= 8; p += 8, length -= 8 ) {
+        Hash k;
+        memcpy(&k, p, 8);
+        k *= 0x87c37b91114253d5ULL;
+        k = RotateLeft(k, 31);
+        k *= 0x4cf5ad432745937fULL;
+        h ^= k;
+        h = RotateLeft(h, 27) * 5 + 0x52dce729;
+    }
+    Hash k = s.length();
+    for(std::size_t i = 0; i < length; i++)
+        k ^= (Hash)(unsigned char)p[i] << (8 * (i + 1));
+    k *= 0x87c37b91114253d5ULL;
+    k = RotateLeft(k, 31);
+    k *= 0x4cf5ad432745937fULL;
+    h ^= k;
+    return RotateLeft(h, 27) * 5 + 0x52dce729;
+}
+
+// Hash of a request's consumer key, token and nonce, keyed with seed
+inline Hash HashRequest(Hash seed, const std::string& consumerKey,
+                        const std::string& token, const std::string& nonce) {
+    return HashBytes(HashBytes(HashBytes(seed, consumerKey), token), nonce);
+}
+
+// Mixes a timestamp into a request hash, for stores that keep several
+// timestamps together
+inline Hash HashTimestamp(Hash h, time_t timestamp) {
+    return Finalize(h ^ ((Hash)timestamp * 0x9e3779b97f4a7c15ULL));
+}
+
+// A random key for a store's hashes, so that requests can't be chosen to
+// collide
+inline Hash RandomSeed() {
+    char hex[NONCE_RANDOM_HEX_LENGTH];
+    nonce_random_hex(hex);
+    Hash seed = 0;
+    for(std::size_t i = 0; i < NONCE_RANDOM_HEX_LENGTH; i++)
+        seed = (seed << 4) | (Hash)(hex[i] <= '9' ? hex[i] - '0' : hex[i] - 'a' + 10);
+    return seed;
+}
+
+} // namespace OAuth
+
+#endif /* __LIBOAUTHCPP_NONCE_HASH_H__ */
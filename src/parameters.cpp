@@ -0,0 +1,292 @@
+#include "parameters.h"
+#include "urlencode.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace OAuth {
+
+void ParameterList::clear() {
+    mBuffer.clear();
+    mEntries.clear();
+}
+
+void ParameterList::reserve(std::size_t count, std::size_t bytes) {
+    mEntries.reserve(count);
+    // std::string::reserve may shrink
+    if (mBuffer.capacity() < bytes)
+        mBuffer.reserve(bytes);
+}
+
+void ParameterList::add(const char* key, std::size_t keyLength, const char* value, std::size_t valueLength) {
+    Entry e;
+    e.keyOffset = mBuffer.length();
+    e.keyLength = keyLength;
+    mBuffer.append(key, keyLength);
+    e.valueOffset = mBuffer.length();
+    e.valueLength = valueLength;
+    mBuffer.append(value, valueLength);
+    mEntries.push_back(e);
+}
+
+void ParameterList::erase(std::size_t i) {
+    // Its key and value are left behind in the buffer
+    mEntries.erase(mEntries.begin() + i);
+}
+
+std::size_t ParameterList::find(const std::string& key) const {
+    for(std::size_t i = 0; i < mEntries.size(); i++) {
+        if (mEntries[i].keyLength == key.length() &&
+            memcmp(mBuffer.data() + mEntries[i].keyOffset, key.data(), key.length()) == 0)
+            return i;
+    }
+    return npos;
+}
+
+void ParameterList::set(const std::string& key, const std::string& value) {
+    std::size_t i = find(key);
+    if (i == npos) {
+        add(key, value);
+        return;
+    }
+    // The old value is left behind in the buffer; it's only ever a few bytes
+    Entry& e = mEntries[i];
+    if (value.length() <= e.valueLength) {
+        mBuffer.replace(e.valueOffset, value.length(), value);
+    }
+    else {
+        e.valueOffset = mBuffer.length();
+        mBuffer.append(value);
+    }
+    e.valueLength = value.length();
+}
+
+void ParameterList::setPercentEncoded(const std::string& key, const std::string& value) {
+    std::size_t i = find(key);
+    if (i == npos) {
+        add(key.data(), key.length(), "", 0);
+        i = mEntries.size() - 1;
+    }
+    // Encode onto the end of the buffer, as set() does with long values
+    Entry& e = mEntries[i];
+    e.valueOffset = mBuffer.length();
+    urlencode_append out(mBuffer);
+    urlencode_to(value.data(), value.length(), out);
+    e.valueLength = mBuffer.length() - e.valueOffset;
+}
+
+/* Orders entries as the strings key=value would be, without building them.
+ * Keys never contain '=' (parsing splits on the first one), so unless one
+ * key is equal to the other the order is settled within the keys.
+ */
+class ParameterList::JoinedLess {
+public:
+    JoinedLess(const char* base) : mBase(base) {}
+
+    bool operator()(const Entry& a, const Entry& b) const {
+        const char* ka = mBase + a.keyOffset;
+        const char* kb = mBase + b.keyOffset;
+        std::size_t n = std::min(a.keyLength, b.keyLength);
+        int c = memcmp(ka, kb, n);
+        if (c != 0)
+            return c < 0;
+
+        if (a.keyLength == b.keyLength) {
+            const char* va = mBase + a.valueOffset;
+            const char* vb = mBase + b.valueOffset;
+            c = memcmp(va, vb, std::min(a.valueLength, b.valueLength));
+            if (c != 0)
+                return c < 0;
+            return a.valueLength < b.valueLength;
+        }
+
+        // One key is a prefix of the other: compare the '=' after the
+        // shorter one with the next character of the longer one
+        unsigned char next = (unsigned char)(a.keyLength < b.keyLength ? kb[n] : ka[n]);
+        if (next != '=')
+            return (a.keyLength < b.keyLength) ? ('=' < next) : (next < '=');
+        return joined(a) < joined(b);
+    }
+
+private:
+    std::string joined(const Entry& e) const {
+        std::string s(mBase + e.keyOffset, e.keyLength);
+        s += '=';
+        s.append(mBase + e.valueOffset, e.valueLength);
+        return s;
+    }
+
+    const char* mBase;
+};
+
+void ParameterList::sort() {
+    std::sort(mEntries.begin(), mEntries.end(), JoinedLess(mBuffer.data()));
+}
+
+void ParameterList::setSorted(const std::string& key, const std::string& value) {
+    // Distinct keys are ordered by the keys alone, so replacing a value
+    // never moves an entry
+    if (find(key) != npos) {
+        set(key, value);
+        return;
+    }
+    add(key, value);
+    insertSorted(mEntries.size() - 1);
+}
+
+void ParameterList::insertSorted(std::size_t i) {
+    std::vector<Entry>::iterator last = mEntries.begin() + i;
+    std::vector<Entry>::iterator pos =
+        std::upper_bound(mEntries.begin(), last, *last, JoinedLess(mBuffer.data()));
+    std::rotate(pos, last, last + 1);
+}
+
+void ParameterList::parse(const std::string& encoded, std::size_t begin) {
+    if (encoded.length() <= begin) return;
+
+    ParameterReader reader(encoded.data() + begin, encoded.length() - begin);
+    while (reader.next())
+        add(reader.key(), reader.keyLength(), reader.value(), reader.valueLength());
+}
+
+void ParameterList::parseSorted(const std::string& encoded) {
+    std::size_t sorted = mEntries.size();
+    parse(encoded);
+    for(; sorted < mEntries.size(); sorted++)
+        insertSorted(sorted);
+}
+
+namespace {
+
+bool IsHeaderSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Whether [p, end) starts with word, ignoring case. word is lower case.
+bool StartsWithNoCase(const char* p, const char* end, const char* word) {
+    for( ; *word; word++, p++) {
+        if (p == end || tolower((unsigned char)*p) != *word)
+            return false;
+    }
+    return true;
+}
+
+}
+
+ParameterReader::ParameterReader(const char* data, std::size_t length, Format format)
+{
+    init(data, length, format);
+}
+
+ParameterReader::ParameterReader(const char* data, Format format)
+{
+    init(data, strlen(data), format);
+}
+
+ParameterReader::ParameterReader(const std::string& data, Format format)
+{
+    init(data.data(), data.length(), format);
+}
+
+void ParameterReader::init(const char* data, std::size_t length, Format format) {
+    mPos = data;
+    mEnd = data + length;
+    mFormat = format;
+    mDone = length == 0;
+    mKey = mValue = NULL;
+    mKeyLength = mValueLength = 0;
+    if (mFormat == AuthorizationHeader)
+        skipHeaderPrefix();
+}
+
+bool ParameterReader::next() {
+    if (mDone)
+        return false;
+    return (mFormat == UrlEncoded) ? nextUrlEncoded() : nextHeaderParameter();
+}
+
+bool ParameterReader::keyIs(const std::string& key) const {
+    return mKey && key.length() == mKeyLength && memcmp(key.data(), mKey, mKeyLength) == 0;
+}
+
+bool ParameterReader::decodeKey(std::string& out) const {
+    return urldecode_append(mKey, mKeyLength, out);
+}
+
+bool ParameterReader::decodeValue(std::string& out) const {
+    return urldecode_append(mValue, mValueLength, out);
+}
+
+// Pairs are split by &. The search for the next one starts a character in,
+// so a leading & is part of the first key, as it always has been.
+bool ParameterReader::nextUrlEncoded() {
+    const char* start = mPos;
+    const char* search = (start == mEnd) ? start : start + 1;
+    const char* amp = (const char*)memchr(search, '&', mEnd - search);
+    const char* end = amp ? amp : mEnd;
+
+    const char* eq = (const char*)memchr(start, '=', end - start);
+    if (!eq)
+        throw ParseError("Failed to find '=' in key-value pair.");
+    mKey = start;
+    mKeyLength = eq - start;
+    mValue = eq + 1;
+    mValueLength = end - eq - 1;
+
+    if (amp)
+        mPos = amp + 1;
+    else
+        mDone = true;
+    return true;
+}
+
+void ParameterReader::skipHeaderPrefix() {
+    const char* p = mPos;
+    while (p != mEnd && IsHeaderSpace(*p)) p++;
+    if (StartsWithNoCase(p, mEnd, "authorization:")) {
+        p += 14;
+        while (p != mEnd && IsHeaderSpace(*p)) p++;
+    }
+    if (!StartsWithNoCase(p, mEnd, "oauth"))
+        throw ParseError("Not an OAuth Authorization header.");
+    p += 5;
+    if (p != mEnd && !IsHeaderSpace(*p))
+        throw ParseError("Not an OAuth Authorization header.");
+    mPos = p;
+    mDone = false;
+}
+
+bool ParameterReader::nextHeaderParameter() {
+    const char* p = mPos;
+    while (p != mEnd && (IsHeaderSpace(*p) || *p == ',')) p++;
+    if (p == mEnd) {
+        mDone = true;
+        return false;
+    }
+
+    const char* key = p;
+    while (p != mEnd && *p != '=' && *p != ',' && !IsHeaderSpace(*p)) p++;
+    if (p == mEnd || *p != '=' || p == key)
+        throw ParseError("Failed to find '=' in Authorization header parameter.");
+    mKey = key;
+    mKeyLength = p - key;
+    p++;
+
+    if (p != mEnd && *p == '"') {
+        mValue = ++p;
+        p = (const char*)memchr(p, '"', mEnd - p);
+        if (!p)
+            throw ParseError("Unterminated quoted value in Authorization header.");
+        mValueLength = p - mValue;
+        p++;
+    }
+    else {
+        mValue = p;
+        while (p != mEnd && *p != ',' && !IsHeaderSpace(*p)) p++;
+        mValueLength = p - mValue;
+    }
+    mPos = p;
+    return true;
+}
+
+} // namespace OAuth
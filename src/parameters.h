@@ -0,0 +1,82 @@
+#ifndef __LIBOAUTHCPP_PARAMETERS_H__
+#define __LIBOAUTHCPP_PARAMETERS_H__
+
+#include <liboauthcpp/liboauthcpp.h>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace OAuth {
+
+/** Request parameters, stored flat: all keys and values are appended to one
+ *  buffer and each entry only records where its key and value are. This is
+ *  what requests are signed from; KeyValuePairs is only used at the API
+ *  boundary.
+ *
+ *  Keys and values are kept exactly as given, i.e. percent encoded.
+ */
+class ParameterList {
+public:
+    static const std::size_t npos = (std::size_t)-1;
+
+    void clear();
+    void reserve(std::size_t count, std::size_t bytes);
+
+    std::size_t size() const { return mEntries.size(); }
+    bool empty() const { return mEntries.empty(); }
+
+    const char* key(std::size_t i) const { return mBuffer.data() + mEntries[i].keyOffset; }
+    std::size_t keyLength(std::size_t i) const { return mEntries[i].keyLength; }
+    const char* value(std::size_t i) const { return mBuffer.data() + mEntries[i].valueOffset; }
+    std::size_t valueLength(std::size_t i) const { return mEntries[i].valueLength; }
+
+    void add(const char* key, std::size_t keyLength, const char* value, std::size_t valueLength);
+    void add(const std::string& key, const std::string& value) {
+        add(key.data(), key.length(), value.data(), value.length());
+    }
+
+    /** Removes entry i, keeping the order of the rest. */
+    void erase(std::size_t i);
+
+    /** Index of the first entry with the key, or npos. */
+    std::size_t find(const std::string& key) const;
+    /** For parameters that should only appear once: replaces the value of
+     *  the entry with the key, or adds one.
+     */
+    void set(const std::string& key, const std::string& value);
+    /** set() with the value percent encoded, without a temporary string. */
+    void setPercentEncoded(const std::string& key, const std::string& value);
+    /** set() for a sorted list, keeping it sorted. */
+    void setSorted(const std::string& key, const std::string& value);
+
+    /** Sort into the order OAuth normalizes parameters to: as if each entry
+     *  were the string key=value.
+     */
+    void sort();
+
+    /** Add the pairs in url encoded data (key=value&key=value...).
+     *  \throws ParseError if a pair has no '='
+     */
+    void parse(const std::string& encoded, std::size_t begin = 0);
+    /** parse() for a sorted list, keeping it sorted. */
+    void parseSorted(const std::string& encoded);
+
+private:
+    struct Entry {
+        std::size_t keyOffset;
+        std::size_t keyLength;
+        std::size_t valueOffset;
+        std::size_t valueLength;
+    };
+    class JoinedLess;
+
+    // Moves entry i into place among the sorted entries before it
+    void insertSorted(std::size_t i);
+
+    std::string mBuffer;
+    std::vector<Entry> mEntries;
+};
+
+} // namespace OAuth
+
+#endif
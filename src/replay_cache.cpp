@@ -0,0 +1,393 @@
+#include <liboauthcpp/liboauthcpp.h>
+#include "nonce_hash.h"
+#include "mutex.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+
+namespace OAuth {
+
+namespace {
+
+// Marks an empty place in a table; a hash that comes out as 0 is stored as 1
+const Hash EMPTY_HASH = 0;
+// Tables start this big, and are never shrunk below it
+const std::size_t MIN_TABLE_SIZE = 16;
+
+// The nonces of requests with one timestamp: an open addressing hash set,
+// at most three quarters full.
+struct Second {
+    time_t timestamp;
+    bool used;
+    std::size_t count;
+    std::vector<Hash> table;
+
+    Second() : timestamp(0), used(false), count(0) {}
+
+    // Empties the set for another timestamp. The table is kept for it,
+    // unless it was much bigger than the last timestamp needed (e.g. after
+    // a burst)
+    void reuse(time_t t) {
+        if (table.size() > MIN_TABLE_SIZE && count * 8 < table.size()) {
+            std::size_t size = MIN_TABLE_SIZE;
+            while (size * 3 < count * 4) size *= 2;
+            std::vector<Hash>(size, EMPTY_HASH).swap(table);
+        }
+        else {
+            std::fill(table.begin(), table.end(), EMPTY_HASH);
+        }
+        timestamp = t;
+        used = true;
+        count = 0;
+    }
+
+    // Returns false if h is already in the set
+    bool insert(Hash h) {
+        if ((count + 1) * 4 > table.size() * 3)
+            grow();
+        std::size_t mask = table.size() - 1;
+        for(std::size_t i = (std::size_t)h & mask; ; i = (i + 1) & mask) {
+            if (table[i] == h)
+                return false;
+            if (table[i] == EMPTY_HASH) {
+                table[i] = h;
+                count++;
+                return true;
+            }
+        }
+    }
+
+    void grow() {
+        std::vector<Hash> old(table.empty() ? MIN_TABLE_SIZE : table.size() * 2, EMPTY_HASH);
+        old.swap(table);
+        std::size_t mask = table.size() - 1;
+        for(std::size_t j = 0; j < old.size(); j++) {
+            if (old[j] == EMPTY_HASH)
+                continue;
+            std::size_t i = (std::size_t)old[j] & mask;
+            while (table[i] != EMPTY_HASH)
+                i = (i + 1) & mask;
+            table[i] = old[j];
+        }
+    }
+};
+
+// Filters are split into blocks of one cache line, and all the bits of an
+// entry are in one block, so checking one takes a single cache miss
+const unsigned int FILTER_BLOCK_BITS = 512;
+const std::size_t FILTER_BLOCK_WORDS = FILTER_BLOCK_BITS / 64;
+// Bits picked from each 64-bit hash, 9 bits apiece
+const unsigned int FILTER_BITS_PER_HASH = 7;
+// At most this many bits are set per entry
+const unsigned int MAX_FILTER_BITS = 16;
+
+// Rate of false positives of a blocked Bloom filter that sets k bits per
+// entry, with bitsPerEntry bits of filter per entry. The number of entries
+// in a block is Poisson distributed.
+double BlockedFilterFalsePositiveRate(double bitsPerEntry, unsigned int k) {
+    double lambda = FILTER_BLOCK_BITS / bitsPerEntry;
+    double probability = exp(-lambda);
+    double rate = 0;
+    for (unsigned int x = 0; x < lambda + 20 * sqrt(lambda) + 20; x++) {
+        double bitSet = 1 - pow(1 - 1.0 / FILTER_BLOCK_BITS, (double)(k * x));
+        rate += probability * pow(bitSet, (double)k);
+        probability *= lambda / (x + 1);
+    }
+    return rate;
+}
+
+// The smallest filter, in bits per entry, that meets falsePositiveRate, and
+// the number of bits to set per entry for it
+void ChooseFilterShape(double falsePositiveRate, double* bitsPerEntry, unsigned int* k) {
+    for (double bits = 1; bits < 64; bits += 0.25) {
+        for (unsigned int bitsSet = 1; bitsSet <= MAX_FILTER_BITS; bitsSet++) {
+            if (BlockedFilterFalsePositiveRate(bits, bitsSet) <= falsePositiveRate) {
+                *bitsPerEntry = bits;
+                *k = bitsSet;
+                return;
+            }
+        }
+    }
+    *bitsPerEntry = 64;
+    *k = MAX_FILTER_BITS;
+}
+
+inline unsigned int PopCount(Hash x) {
+#ifdef __GNUC__
+    return __builtin_popcountll(x);
+#else
+    unsigned int count = 0;
+    for ( ; x; x &= x - 1) count++;
+    return count;
+#endif
+}
+
+// The requests of bucketSeconds consecutive timestamps, starting at
+// epoch * bucketSeconds
+struct FilterBucket {
+    long long epoch;
+    bool used;
+    std::vector<Hash> words;
+
+    FilterBucket() : epoch(0), used(false) {}
+};
+
+}
+
+// A timing wheel of one Second per possible timestamp in the window, plus
+// padding so shards locked by different threads don't share cache lines
+struct ReplayCache::Shard {
+    Mutex mutex;
+    std::vector<Second> wheel;
+    char padding[64];
+
+    Shard(std::size_t seconds) : wheel(seconds) {}
+};
+
+ReplayCache::ReplayCache(time_t window, unsigned int shards)
+ : mShards(NULL),
+   mShardBits(0),
+   mWindow(window),
+   mSeed(RandomSeed())
+{
+    assert(window > 0);
+    while ((1u << mShardBits) < shards && mShardBits < 16)
+        mShardBits++;
+
+    // A request can be accepted up to window seconds either side of the
+    // verifier's clock, so its nonce must be kept until the clock is window
+    // seconds past its timestamp. With 2*window+2 seconds in the wheel, a
+    // timestamp's place is only reused by one at least that much newer,
+    // whose acceptance means the clock has moved on far enough.
+    std::size_t seconds = (std::size_t)(2 * window + 2);
+    mShards = new Shard*[1u << mShardBits];
+    for (unsigned int i = 0; i < (1u << mShardBits); i++)
+        mShards[i] = new Shard(seconds);
+}
+
+ReplayCache::~ReplayCache()
+{
+    for (unsigned int i = 0; i < (1u << mShardBits); i++)
+        delete mShards[i];
+    delete[] mShards;
+}
+
+bool ReplayCache::insert(const std::string& consumerKey,
+                         const std::string& token,
+                         const std::string& nonce,
+                         time_t timestamp)
+{
+    Hash h = Finalize(HashRequest(mSeed, consumerKey, token, nonce));
+    if (h == EMPTY_HASH)
+        h = 1;
+
+    // The top bits pick the shard, the bottom ones the place in its tables
+    Shard& shard = *mShards[mShardBits ? (unsigned int)(h >> (64 - mShardBits)) : 0];
+    ScopedLock lock(shard.mutex);
+
+    unsigned long long place = (unsigned long long)timestamp % shard.wheel.size();
+    Second& second = shard.wheel[(std::size_t)place];
+    if (!second.used || second.timestamp < timestamp)
+        second.reuse(timestamp);
+    else if (second.timestamp > timestamp)
+        return false;
+    return second.insert(h);
+}
+
+std::size_t ReplayCache::size() const
+{
+    std::size_t count = 0;
+    for (unsigned int i = 0; i < (1u << mShardBits); i++) {
+        Shard& shard = *mShards[i];
+        ScopedLock lock(shard.mutex);
+        for (std::size_t j = 0; j < shard.wheel.size(); j++)
+            count += shard.wheel[j].count;
+    }
+    return count;
+}
+
+std::size_t ReplayCache::memoryUsage() const
+{
+    std::size_t bytes = 0;
+    for (unsigned int i = 0; i < (1u << mShardBits); i++) {
+        Shard& shard = *mShards[i];
+        ScopedLock lock(shard.mutex);
+        bytes += sizeof(Shard) + shard.wheel.size() * sizeof(Second);
+        for (std::size_t j = 0; j < shard.wheel.size(); j++)
+            bytes += shard.wheel[j].table.capacity() * sizeof(Hash);
+    }
+    return bytes;
+}
+
+struct ReplayFilter::Shard {
+    Mutex mutex;
+    std::vector<FilterBucket> buckets;
+    std::size_t wordsPerBucket;
+    std::size_t suspected;
+    std::size_t falsePositives;
+    char padding[64];
+
+    Shard(std::size_t count, std::size_t words)
+     : buckets(count), wordsPerBucket(words), suspected(0), falsePositives(0) {}
+};
+
+ReplayFilter::ReplayFilter(time_t window, std::size_t requestsPerSecond,
+                           double falsePositiveRate,
+                           const NonceHistory* history,
+                           unsigned int shards)
+ : mShards(NULL),
+   mShardBits(0),
+   mBitsPerRequest(0),
+   mBucketSeconds(1),
+   mHistory(history),
+   mSeed(RandomSeed())
+{
+    assert(window > 0);
+    while ((1u << mShardBits) < shards && mShardBits < 16)
+        mShardBits++;
+
+    double bitsPerEntry;
+    falsePositiveRate = std::max(1e-9, std::min(falsePositiveRate, 0.5));
+    ChooseFilterShape(falsePositiveRate, &bitsPerEntry, &mBitsPerRequest);
+
+    // As in ReplayCache, a filter may only be reused once none of its
+    // timestamps can pass the clock check: the buckets have to span more
+    // than 2*window seconds before coming round again. Around 32 buckets
+    // keep the span over that small.
+    mBucketSeconds = std::max((time_t)1, (2 * window + 1) / 30);
+    std::size_t buckets = (std::size_t)((2 * window + 1 + mBucketSeconds - 1) / mBucketSeconds) + 1;
+    double bits = (double)requestsPerSecond * mBucketSeconds * bitsPerEntry / (1u << mShardBits);
+    std::size_t words = FILTER_BLOCK_WORDS * std::max((std::size_t)1, (std::size_t)ceil(bits / FILTER_BLOCK_BITS));
+
+    mShards = new Shard*[1u << mShardBits];
+    for (unsigned int i = 0; i < (1u << mShardBits); i++)
+        mShards[i] = new Shard(buckets, words);
+}
+
+ReplayFilter::~ReplayFilter()
+{
+    for (unsigned int i = 0; i < (1u << mShardBits); i++)
+        delete mShards[i];
+    delete[] mShards;
+}
+
+bool ReplayFilter::insert(const std::string& consumerKey,
+                          const std::string& token,
+                          const std::string& nonce,
+                          time_t timestamp)
+{
+    // A filter holds several timestamps, so unlike ReplayCache the
+    // timestamp is hashed too
+    Hash h = HashTimestamp(HashRequest(mSeed, consumerKey, token, nonce), timestamp);
+    unsigned int positions[MAX_FILTER_BITS];
+    Hash bits = h;
+    for (unsigned int i = 0; i < mBitsPerRequest; i++) {
+        if (i % FILTER_BITS_PER_HASH == 0)
+            bits = Finalize(bits + 0x9e3779b97f4a7c15ULL);
+        positions[i] = (unsigned int)(bits >> (9 * (i % FILTER_BITS_PER_HASH))) & (FILTER_BLOCK_BITS - 1);
+    }
+
+    long long epoch = (timestamp >= 0) ? (long long)(timestamp / mBucketSeconds)
+                                       : -(long long)((-timestamp + mBucketSeconds - 1) / mBucketSeconds);
+
+    // The top bits pick the shard, the bottom ones the block
+    Shard& shard = *mShards[mShardBits ? (unsigned int)(h >> (64 - mShardBits)) : 0];
+    {
+        ScopedLock lock(shard.mutex);
+        FilterBucket& bucket = shard.buckets[(std::size_t)((unsigned long long)epoch % shard.buckets.size())];
+        if (!bucket.used || bucket.epoch < epoch) {
+            bucket.words.assign(shard.wordsPerBucket, 0);
+            bucket.epoch = epoch;
+            bucket.used = true;
+        }
+        else if (bucket.epoch > epoch) {
+            return false;
+        }
+
+        std::size_t blocks = shard.wordsPerBucket / FILTER_BLOCK_WORDS;
+        Hash* block = &bucket.words[FILTER_BLOCK_WORDS * (std::size_t)(((h & 0xffffffffULL) * blocks) >> 32)];
+        bool allSet = true;
+        for (unsigned int i = 0; i < mBitsPerRequest; i++)
+            allSet = allSet && (block[positions[i] / 64] >> (positions[i] % 64) & 1);
+        if (!allSet) {
+            for (unsigned int i = 0; i < mBitsPerRequest; i++)
+                block[positions[i] / 64] |= (Hash)1 << (positions[i] % 64);
+            return true;
+        }
+        shard.suspected++;
+        if (!mHistory)
+            return false;
+    }
+
+    // The history may be slow, so it is asked without holding the shard
+    if (mHistory->seen(consumerKey, token, nonce, timestamp))
+        return false;
+    ScopedLock lock(shard.mutex);
+    shard.falsePositives++;
+    return true;
+}
+
+double ReplayFilter::falsePositiveRate() const
+{
+    double total = 0;
+    std::size_t filters = 0;
+    for (unsigned int i = 0; i < (1u << mShardBits); i++) {
+        Shard& shard = *mShards[i];
+        ScopedLock lock(shard.mutex);
+        for (std::size_t j = 0; j < shard.buckets.size(); j++) {
+            const FilterBucket& bucket = shard.buckets[j];
+            if (!bucket.used)
+                continue;
+            // A new request's bits are each set with about the chance that
+            // any one bit of its block is
+            double rate = 0;
+            std::size_t blocks = bucket.words.size() / FILTER_BLOCK_WORDS;
+            for (std::size_t b = 0; b < blocks; b++) {
+                unsigned int set = 0;
+                for (std::size_t w = 0; w < FILTER_BLOCK_WORDS; w++)
+                    set += PopCount(bucket.words[b * FILTER_BLOCK_WORDS + w]);
+                rate += pow((double)set / FILTER_BLOCK_BITS, (double)mBitsPerRequest);
+            }
+            total += rate / blocks;
+            filters++;
+        }
+    }
+    return filters ? total / filters : 0;
+}
+
+std::size_t ReplayFilter::suspectedReplays() const
+{
+    std::size_t count = 0;
+    for (unsigned int i = 0; i < (1u << mShardBits); i++) {
+        ScopedLock lock(mShards[i]->mutex);
+        count += mShards[i]->suspected;
+    }
+    return count;
+}
+
+std::size_t ReplayFilter::falsePositives() const
+{
+    std::size_t count = 0;
+    for (unsigned int i = 0; i < (1u << mShardBits); i++) {
+        ScopedLock lock(mShards[i]->mutex);
+        count += mShards[i]->falsePositives;
+    }
+    return count;
+}
+
+std::size_t ReplayFilter::memoryUsage() const
+{
+    std::size_t bytes = 0;
+    for (unsigned int i = 0; i < (1u << mShardBits); i++) {
+        Shard& shard = *mShards[i];
+        ScopedLock lock(shard.mutex);
+        bytes += sizeof(Shard) + shard.buckets.size() * sizeof(FilterBucket);
+        for (std::size_t j = 0; j < shard.buckets.size(); j++)
+            bytes += shard.buckets[j].words.capacity() * sizeof(Hash);
+    }
+    return bytes;
+}
+
+} // namespace OAuth
@@ -0,0 +1,328 @@
+#include <liboauthcpp/liboauthcpp.h>
+#include "shared_credentials.h"
+#include "signing_key.h"
+#include "mutex.h"
+#include "atomic.h"
+#include <map>
+
+#ifdef _WIN32
+#include <windows.h>
+#define CREDENTIALS_THREAD_LOCAL __declspec(thread)
+#else
+#include <sched.h>
+#define CREDENTIALS_THREAD_LOCAL __thread
+#endif
+
+namespace OAuth {
+
+namespace {
+
+// Readers are spread over this many counters, so that threads reading at
+// once rarely increment the same one
+const unsigned int READER_STRIPES = 64;
+
+// The readers counted in each of the last two epochs, alone in a cache line
+struct ReaderStripe {
+    volatile long count[2];
+    char padding[64 - 2 * sizeof(long)];
+};
+
+// Each thread's stripe plus one, 0 until its first read
+CREDENTIALS_THREAD_LOCAL unsigned int tStripe;
+unsigned int gNextStripe = 0;
+
+// Threads are given stripes in turn, so the first READER_STRIPES threads
+// all have their own
+unsigned int ThreadStripe() {
+    if (!tStripe)
+        tStripe = AtomicFetchAdd(&gNextStripe, 1u) % READER_STRIPES + 1;
+    return tStripe - 1;
+}
+
+void YieldThread() {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+}
+
+CredentialSnapshot::~CredentialSnapshot()
+{
+    for (std::size_t i = 0; i < consumers.size(); i++)
+        delete consumers[i];
+    for (std::size_t i = 0; i < tokens.size(); i++)
+        delete tokens[i];
+}
+
+void CredentialSnapshot::add(const Consumer* consumer, const Token* token, std::string& scratch)
+{
+    const std::string none;
+    CredentialEntry entry;
+    entry.consumer = consumer;
+    entry.token = token;
+    PrepareSigningKey(consumer->secret(), token ? token->secret() : none, scratch, &entry.state);
+    entry.hash = Finalize(HashBytes(HashBytes(seed, consumer->key()), token ? token->key() : none));
+    entry.next = NO_CREDENTIAL;
+    entries.push_back(entry);
+}
+
+void CredentialSnapshot::index()
+{
+    std::size_t size = 1;
+    while (size < entries.size())
+        size *= 2;
+    buckets.assign(size, NO_CREDENTIAL);
+    for (std::size_t i = 0; i < entries.size(); i++) {
+        int& bucket = buckets[(std::size_t)entries[i].hash & (size - 1)];
+        entries[i].next = bucket;
+        bucket = (int)i;
+    }
+}
+
+const CredentialEntry* CredentialSnapshot::find(const std::string& consumerKey,
+                                                const std::string& token) const
+{
+    Hash h = Finalize(HashBytes(HashBytes(seed, consumerKey), token));
+    for (int i = buckets[(std::size_t)h & (buckets.size() - 1)]; i != NO_CREDENTIAL; i = entries[i].next) {
+        const CredentialEntry& entry = entries[i];
+        if (entry.hash != h || entry.consumer->key() != consumerKey)
+            continue;
+        if (token.empty() ? !entry.token : (entry.token && entry.token->key() == token))
+            return &entry;
+    }
+    return NULL;
+}
+
+Verification::Result CredentialSnapshot::lookup(const std::string& consumerKey,
+                                                const std::string& token,
+                                                const CredentialEntry** entry) const
+{
+    *entry = find(consumerKey, token);
+    if (*entry)
+        return Verification::Valid;
+    if (token.empty() || !find(consumerKey, std::string()))
+        return Verification::UnknownConsumer;
+    return Verification::UnknownToken;
+}
+
+struct CredentialSet::State {
+    std::map<std::string, std::string> consumers;
+    // The secret and pin of each token, by consumer key and token
+    typedef std::map<std::pair<std::string, std::string>, std::pair<std::string, std::string> > TokenMap;
+    TokenMap tokens;
+
+    // Both maps are sorted by consumer key, so each consumer's tokens
+    // follow it
+    CredentialSnapshot* build(Hash seed) const {
+        CredentialSnapshot* snapshot = new CredentialSnapshot(seed);
+        try {
+            std::string scratch;
+            snapshot->entries.reserve(consumers.size() + tokens.size());
+            TokenMap::const_iterator token = tokens.begin();
+            for (std::map<std::string, std::string>::const_iterator consumer = consumers.begin();
+                 consumer != consumers.end(); ++consumer) {
+                // Room is made first, so a failed push_back can't leak
+                snapshot->consumers.push_back(NULL);
+                snapshot->consumers.back() = new Consumer(consumer->first, consumer->second);
+                const Consumer* owner = snapshot->consumers.back();
+                snapshot->add(owner, NULL, scratch);
+
+                while (token != tokens.end() && token->first.first < consumer->first)
+                    ++token;
+                for ( ; token != tokens.end() && token->first.first == consumer->first; ++token) {
+                    // An empty key is how a request without a token looks
+                    if (token->first.second.empty())
+                        continue;
+                    snapshot->tokens.push_back(NULL);
+                    snapshot->tokens.back() = new Token(token->first.second, token->second.first, token->second.second);
+                    snapshot->add(owner, snapshot->tokens.back(), scratch);
+                }
+            }
+            snapshot->index();
+        }
+        catch (...) {
+            delete snapshot;
+            throw;
+        }
+        return snapshot;
+    }
+};
+
+CredentialSet::CredentialSet()
+ : mState(new State)
+{
+}
+
+CredentialSet::CredentialSet(const CredentialSet& other)
+ : mState(new State(*other.mState))
+{
+}
+
+CredentialSet& CredentialSet::operator=(const CredentialSet& other)
+{
+    if (this != &other)
+        *mState = *other.mState;
+    return *this;
+}
+
+CredentialSet::~CredentialSet()
+{
+    delete mState;
+}
+
+void CredentialSet::addConsumer(const Consumer& consumer)
+{
+    mState->consumers[consumer.key()] = consumer.secret();
+}
+
+void CredentialSet::addToken(const std::string& consumerKey, const Token& token)
+{
+    mState->tokens[std::make_pair(consumerKey, token.key())] = std::make_pair(token.secret(), token.pin());
+}
+
+void CredentialSet::removeConsumer(const std::string& consumerKey)
+{
+    mState->consumers.erase(consumerKey);
+    State::TokenMap::iterator first = mState->tokens.lower_bound(std::make_pair(consumerKey, std::string()));
+    State::TokenMap::iterator last = first;
+    while (last != mState->tokens.end() && last->first.first == consumerKey)
+        ++last;
+    mState->tokens.erase(first, last);
+}
+
+void CredentialSet::removeToken(const std::string& consumerKey, const std::string& token)
+{
+    mState->tokens.erase(std::make_pair(consumerKey, token));
+}
+
+std::size_t CredentialSet::size() const
+{
+    return mState->consumers.size() + mState->tokens.size();
+}
+
+// The current snapshot, and the readers of it and the one before. Readers
+// count themselves in the stripe for the epoch they start in; publish moves
+// on to the next epoch after the swap, so only readers counted in the
+// previous epoch can still hold the old snapshot, and it waits for them.
+struct SharedCredentials::State {
+    CredentialSnapshot* volatile current;
+    volatile unsigned long epoch;
+    ReaderStripe stripes[READER_STRIPES];
+    Hash seed;
+
+    // Held by publish, so only one epoch is being left at a time
+    Mutex publishMutex;
+    std::size_t version;
+
+    State() : current(NULL), epoch(0), seed(RandomSeed()), version(1) {
+        for (unsigned int i = 0; i < READER_STRIPES; i++)
+            stripes[i].count[0] = stripes[i].count[1] = 0;
+    }
+
+    void waitForReaders(unsigned long epoch) {
+        for (unsigned int i = 0; i < READER_STRIPES; i++) {
+            volatile long* count = &stripes[i].count[epoch & 1];
+            for (int spins = 0; AtomicLoad(count) != 0; spins++) {
+                if (spins >= 100)
+                    YieldThread();
+            }
+        }
+    }
+};
+
+CredentialsReader::CredentialsReader(const SharedCredentials* credentials)
+ : mSnapshot(NULL),
+   mCount(NULL)
+{
+    if (!credentials)
+        return;
+    SharedCredentials::State& state = *credentials->mState;
+    ReaderStripe& stripe = state.stripes[ThreadStripe()];
+    for (;;) {
+        unsigned long epoch = AtomicLoad(&state.epoch);
+        volatile long* count = &stripe.count[epoch & 1];
+        AtomicFetchAdd(count, 1L);
+        // If publish moved on before seeing the count, it may not wait for
+        // it, so count again in the new epoch
+        if (AtomicLoad(&state.epoch) == epoch) {
+            mCount = count;
+            mSnapshot = AtomicLoad(&state.current);
+            return;
+        }
+        AtomicFetchAdd(count, -1L);
+    }
+}
+
+CredentialsReader::~CredentialsReader()
+{
+    if (mCount)
+        AtomicFetchAdd(mCount, -1L);
+}
+
+SharedCredentials::SharedCredentials()
+ : mState(new State)
+{
+    mState->current = CredentialSet().mState->build(mState->seed);
+}
+
+SharedCredentials::SharedCredentials(const CredentialSet& credentials)
+ : mState(new State)
+{
+    mState->current = credentials.mState->build(mState->seed);
+}
+
+SharedCredentials::~SharedCredentials()
+{
+    delete mState->current;
+    delete mState;
+}
+
+void SharedCredentials::publish(const CredentialSet& credentials)
+{
+    State& state = *mState;
+    // Built before the lock, so one slow publish doesn't hold up another's
+    CredentialSnapshot* next = credentials.mState->build(state.seed);
+    CredentialSnapshot* previous = NULL;
+    {
+        ScopedLock lock(state.publishMutex);
+        previous = state.current;
+        AtomicStore(&state.current, next);
+        // Readers counted from here on see the new snapshot
+        unsigned long epoch = AtomicFetchAdd(&state.epoch, 1UL);
+        state.waitForReaders(epoch);
+        state.version++;
+    }
+    delete previous;
+}
+
+std::size_t SharedCredentials::version() const
+{
+    ScopedLock lock(mState->publishMutex);
+    return mState->version;
+}
+
+bool SharedCredentials::consumerSecret(const std::string& consumerKey, std::string& secret) const
+{
+    CredentialsReader reader(this);
+    const CredentialEntry* entry = reader.snapshot()->find(consumerKey, std::string());
+    if (!entry)
+        return false;
+    secret = entry->consumer->secret();
+    return true;
+}
+
+bool SharedCredentials::tokenSecret(const std::string& consumerKey, const std::string& token,
+                                    std::string& secret) const
+{
+    CredentialsReader reader(this);
+    const CredentialEntry* entry = reader.snapshot()->find(consumerKey, token);
+    if (!entry || !entry->token)
+        return false;
+    secret = entry->token->secret();
+    return true;
+}
+
+} // namespace OAuth
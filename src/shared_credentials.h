@@ -0,0 +1,69 @@
+#ifndef __LIBOAUTHCPP_SHARED_CREDENTIALS_H__
+#define __LIBOAUTHCPP_SHARED_CREDENTIALS_H__
+
+#include <liboauthcpp/liboauthcpp.h>
+#include "HMAC_SHA1.h"
+#include "nonce_hash.h"
+#include <vector>
+
+namespace OAuth {
+
+const int NO_CREDENTIAL = -1;
+
+// A consumer, or a token issued to it, with its signing key. token is NULL
+// for the consumer's own key, used for requests without a token.
+struct CredentialEntry {
+    const Consumer* consumer;
+    const Token* token;
+    CHMAC_SHA1::KEY_STATE state;
+    Hash hash;
+    // Next entry in the same bucket
+    int next;
+};
+
+// A published CredentialSet. Nothing in it changes once it is built, so it
+// is read without locking while a CredentialsReader holds it.
+struct CredentialSnapshot {
+    explicit CredentialSnapshot(Hash seed_) : seed(seed_) {}
+    ~CredentialSnapshot();
+
+    // Adds the entry for a consumer and token, computing its signing key
+    void add(const Consumer* consumer, const Token* token, std::string& scratch);
+    // Chains the entries from a power of 2 buckets, once they are all added
+    void index();
+
+    const CredentialEntry* find(const std::string& consumerKey, const std::string& token) const;
+    // As find, but tells an unknown consumer from an unknown token. Returns
+    // Valid, UnknownConsumer or UnknownToken.
+    Verification::Result lookup(const std::string& consumerKey, const std::string& token,
+                                const CredentialEntry** entry) const;
+
+    Hash seed;
+    // Owned, and pointed to by the entries
+    std::vector<Consumer*> consumers;
+    std::vector<Token*> tokens;
+    std::vector<CredentialEntry> entries;
+    std::vector<int> buckets;
+};
+
+// Holds the snapshot most recently published in a SharedCredentials for as
+// long as it lives, so it is only used for the span of one request. Takes
+// no lock. With NULL credentials it holds nothing.
+class CredentialsReader {
+public:
+    explicit CredentialsReader(const SharedCredentials* credentials);
+    ~CredentialsReader();
+
+    const CredentialSnapshot* snapshot() const { return mSnapshot; }
+private:
+    CredentialsReader(const CredentialsReader&);
+    CredentialsReader& operator=(const CredentialsReader&);
+
+    const CredentialSnapshot* mSnapshot;
+    // The reader counter it was counted in
+    volatile long* mCount;
+};
+
+} // namespace OAuth
+
+#endif /* __LIBOAUTHCPP_SHARED_CREDENTIALS_H__ */
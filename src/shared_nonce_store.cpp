@@ -0,0 +1,272 @@
+#ifndef _WIN32
+
+#include <liboauthcpp/liboauthcpp.h>
+#include "nonce_hash.h"
+#include "atomic.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace OAuth {
+
+namespace {
+
+// "oauthNS" and a layout version, set once a segment is ready to use
+const unsigned long long SEGMENT_MAGIC = 0x6f617574684e5301ULL;
+// Or this and the pid of the process setting it up
+const unsigned long long SETUP_CLAIM = 1ULL << 63;
+// How long to wait for another process to finish setting up a segment
+const int ATTACH_TIMEOUT_MS = 5000;
+
+// An entry is a 40-bit hash above the low 24 bits of its table's epoch. 0
+// is never an entry, as the hash part is never 0.
+const unsigned int EPOCH_BITS = 24;
+const unsigned long long EPOCH_MASK = (1ULL << EPOCH_BITS) - 1;
+
+// Smallest table, in entries
+const std::size_t MIN_TABLE_SLOTS = 64;
+
+// The epoch a table is on, alone in its cache line. Stored plus one, so
+// that 0 is a table never used.
+struct TableEpoch {
+    volatile long long epoch;
+    char padding[64 - sizeof(long long)];
+};
+
+// Whether epoch a comes before b, comparing their low EPOCH_BITS
+inline bool EpochBefore(unsigned long long a, unsigned long long b) {
+    unsigned long long distance = (b - a) & EPOCH_MASK;
+    return distance != 0 && distance < (1ULL << (EPOCH_BITS - 1));
+}
+
+std::string SystemError(const std::string& what, const std::string& name) {
+    return what + " " + name + ": " + strerror(errno);
+}
+
+}
+
+// The start of a segment. It is followed by a TableEpoch for each table,
+// then the tables.
+struct SharedNonceStore::Segment {
+    // Written last by the process setting up the segment
+    volatile unsigned long long magic;
+    unsigned long long size;
+    unsigned long long seed;
+    long long bucketSeconds;
+    unsigned long long tables;
+    unsigned long long tableSlots;
+    char padding[64 - 6 * sizeof(unsigned long long)];
+
+    TableEpoch* epochs() {
+        return (TableEpoch*)(this + 1);
+    }
+    volatile unsigned long long* table(std::size_t i) {
+        return (volatile unsigned long long*)(epochs() + tables) + i * tableSlots;
+    }
+};
+
+SharedNonceStore::SharedNonceStore(const std::string& name, time_t window,
+                                   std::size_t requestsPerSecond)
+ : mSegment(NULL),
+   mSegmentSize(0)
+{
+    assert(window > 0);
+
+    // Spans and tables as in ReplayFilter: a table may only be reused once
+    // none of its timestamps can pass the clock check
+    long long bucketSeconds = std::max((long long)1, (long long)(2 * window + 1) / 30);
+    std::size_t tables = (std::size_t)((2 * window + 1 + bucketSeconds - 1) / bucketSeconds) + 1;
+    std::size_t slots = MIN_TABLE_SLOTS;
+    while (slots < 2 * requestsPerSecond * (std::size_t)bucketSeconds)
+        slots *= 2;
+    std::size_t size = sizeof(Segment) + tables * (sizeof(TableEpoch) + slots * sizeof(unsigned long long));
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    bool created = fd >= 0;
+    if (!created) {
+        if (errno != EEXIST)
+            throw SharedMemoryError(SystemError("Couldn't create shared memory", name));
+        fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            throw SharedMemoryError(SystemError("Couldn't open shared memory", name));
+    }
+
+    // Another process created it, and may still be setting it up. If it
+    // died first, the segment stays without its magic, so after waiting
+    // this process sets it up instead.
+    unsigned long long seen = 0;
+    for (int waited = 0; ; waited++) {
+        if (created || waited == ATTACH_TIMEOUT_MS) {
+            if (seen != 0 && !(seen & SETUP_CLAIM)) {
+                close(fd);
+                throw SharedMemoryError("Shared memory " + name + " was set up by another version; remove it and retry");
+            }
+            // Grow it to this layout if it's smaller, then claim it from
+            // whoever was setting it up. New memory is zeroed, and nothing
+            // is recorded before the magic is set, so every table is
+            // unused and empty and only the description needs filling in.
+            struct stat st;
+            if (fstat(fd, &st) != 0 || ((std::size_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0)) {
+                std::string error = SystemError("Couldn't size shared memory", name);
+                close(fd);
+                if (created)
+                    shm_unlink(name.c_str());
+                throw SharedMemoryError(error);
+            }
+            void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (memory == MAP_FAILED) {
+                std::string error = SystemError("Couldn't map shared memory", name);
+                close(fd);
+                if (created)
+                    shm_unlink(name.c_str());
+                throw SharedMemoryError(error);
+            }
+            Segment* segment = (Segment*)memory;
+            if (AtomicCompareAndSwap(&segment->magic, seen, SETUP_CLAIM | (unsigned long long)getpid())) {
+                close(fd);
+                mSegment = segment;
+                mSegmentSize = size;
+                segment->size = size;
+                segment->seed = RandomSeed();
+                segment->bucketSeconds = bucketSeconds;
+                segment->tables = tables;
+                segment->tableSlots = slots;
+                AtomicStore(&segment->magic, SEGMENT_MAGIC);
+                return;
+            }
+            munmap(memory, size);
+            // Another process claimed it first
+            created = false;
+            waited = 0;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            std::string error = SystemError("Couldn't open shared memory", name);
+            close(fd);
+            throw SharedMemoryError(error);
+        }
+        if ((std::size_t)st.st_size >= sizeof(Segment)) {
+            void* memory = mmap(NULL, (std::size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (memory == MAP_FAILED) {
+                std::string error = SystemError("Couldn't map shared memory", name);
+                close(fd);
+                throw SharedMemoryError(error);
+            }
+            Segment* segment = (Segment*)memory;
+            unsigned long long magic = AtomicLoad(&segment->magic);
+            if (magic == SEGMENT_MAGIC && segment->size <= (unsigned long long)st.st_size) {
+                close(fd);
+                mSegment = segment;
+                mSegmentSize = (std::size_t)st.st_size;
+                return;
+            }
+            munmap(memory, (std::size_t)st.st_size);
+            // Only wait out a setup that isn't moving on
+            if (magic != seen) {
+                seen = magic;
+                waited = 0;
+            }
+        }
+        usleep(1000);
+    }
+}
+
+SharedNonceStore::~SharedNonceStore()
+{
+    munmap(mSegment, mSegmentSize);
+}
+
+void SharedNonceStore::remove(const std::string& name)
+{
+    shm_unlink(name.c_str());
+}
+
+bool SharedNonceStore::insert(const std::string& consumerKey,
+                              const std::string& token,
+                              const std::string& nonce,
+                              time_t timestamp)
+{
+    Segment& segment = *mSegment;
+    Hash h = HashTimestamp(HashRequest(segment.seed, consumerKey, token, nonce), timestamp);
+    long long bucketSeconds = segment.bucketSeconds;
+    long long epoch = (timestamp >= 0) ? (long long)(timestamp / bucketSeconds)
+                                       : -(long long)((-timestamp + bucketSeconds - 1) / bucketSeconds);
+    std::size_t index = (std::size_t)((unsigned long long)epoch % segment.tables);
+
+    // Move the table on to this span, unless it is already on a later one
+    volatile long long* tableEpoch = &segment.epochs()[index].epoch;
+    for (;;) {
+        long long current = AtomicLoad(tableEpoch);
+        if (current == epoch + 1)
+            break;
+        if (current > epoch + 1)
+            return false;
+        if (AtomicCompareAndSwap(tableEpoch, current, epoch + 1))
+            break;
+    }
+
+    Hash tag = h >> EPOCH_BITS;
+    if (tag == 0)
+        tag = 1;
+    unsigned long long entry = (tag << EPOCH_BITS) | ((unsigned long long)epoch & EPOCH_MASK);
+
+    // Entries of earlier spans are free places. One of a later span means
+    // the table moved on while this request was on its way, so it's too
+    // old now, and entries of the new span mustn't be overwritten.
+    volatile unsigned long long* table = segment.table(index);
+    std::size_t mask = (std::size_t)segment.tableSlots - 1;
+    std::size_t i = (std::size_t)h & mask;
+    for (std::size_t probes = 0; probes <= mask; ) {
+        unsigned long long current = AtomicLoad(&table[i]);
+        if (current == entry)
+            return false;
+        unsigned long long currentEpoch = current & EPOCH_MASK;
+        if (current == 0 || EpochBefore(currentEpoch, (unsigned long long)epoch)) {
+            // Claim it. If another process got there first, look again:
+            // it may have been recording the same request.
+            if (AtomicCompareAndSwap(&table[i], current, entry))
+                return true;
+            continue;
+        }
+        if (currentEpoch != ((unsigned long long)epoch & EPOCH_MASK))
+            return false;
+        i = (i + 1) & mask;
+        probes++;
+    }
+    // Full
+    return false;
+}
+
+std::size_t SharedNonceStore::size() const
+{
+    Segment& segment = *mSegment;
+    std::size_t count = 0;
+    for (std::size_t t = 0; t < segment.tables; t++) {
+        long long epoch = AtomicLoad(&segment.epochs()[t].epoch);
+        if (epoch == 0)
+            continue;
+        unsigned long long current = (unsigned long long)(epoch - 1) & EPOCH_MASK;
+        volatile unsigned long long* table = segment.table(t);
+        for (std::size_t i = 0; i < segment.tableSlots; i++) {
+            unsigned long long entry = AtomicLoad(&table[i]);
+            if (entry != 0 && (entry & EPOCH_MASK) == current)
+                count++;
+        }
+    }
+    return count;
+}
+
+std::size_t SharedNonceStore::memoryUsage() const
+{
+    return mSegmentSize;
+}
+
+} // namespace OAuth
+
+#endif
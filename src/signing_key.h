@@ -0,0 +1,21 @@
+#ifndef __LIBOAUTHCPP_SIGNING_KEY_H__
+#define __LIBOAUTHCPP_SIGNING_KEY_H__
+
+#include <liboauthcpp/liboauthcpp.h>
+#include "HMAC_SHA1.h"
+#include <string>
+
+namespace OAuth {
+
+// Builds the consumer_secret&token_secret signing key, percent encoded, in
+// secretSigningKey and computes its HMAC-SHA1 pad states into ks.
+void PrepareSigningKey(const std::string& consumerSecret, const std::string& tokenSecret,
+                       std::string& secretSigningKey, CHMAC_SHA1::KEY_STATE* ks);
+
+struct CredentialCache::SigningKey {
+    CHMAC_SHA1::KEY_STATE state;
+};
+
+} // namespace OAuth
+
+#endif /* __LIBOAUTHCPP_SIGNING_KEY_H__ */
@@ -1,103 +1,382 @@
 #include "urlencode.h"
+#include "SHA1_x86.h"
 #include <cassert>
-#include <sstream>
-#include <iomanip>
 
-inline bool isUnreserved(char c)
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef SHA1_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Length of each byte once encoded: 1 if it is copied as is, 3 if it is
+ * percent encoded. There is one table per URLEncodeType.
+ *
+ * Everything: only the unreserved characters (ALPHA / DIGIT / "-" / "." /
+ * "_" / "~") are left alone.
+ */
+const unsigned char urlencode_length_everything[256] = {
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 00 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 10 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 1, 1, 3, /* 20 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, /* 30 */
+    3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 40 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 1, /* 50 */
+    3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 60 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 1, 3, /* 70 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 80 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 90 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* A0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* B0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* C0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* D0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* E0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* F0 */
+};
+
+/* Path: unreserved characters and the sub-delims ("!" / "$" / "&" / "'" /
+ * "(" / ")" / "*" / "+" / "," / ";" / "=") are left alone.
+ */
+static const unsigned char urlencode_length_path[256] = {
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 00 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 10 */
+    3, 1, 3, 3, 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, /* 20 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 1, 3, 1, 3, 3, /* 30 */
+    3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 40 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 1, /* 50 */
+    3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 60 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 1, 3, /* 70 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 80 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 90 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* A0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* B0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* C0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* D0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* E0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* F0 */
+};
+
+const char urlencode_hex_digits[] = "0123456789ABCDEF";
+
+static const unsigned char* lengthTable( URLEncodeType enctype )
 {
-    switch (c)
+    switch (enctype)
     {
-        case '0': case '1': case '2': case '3': case '4':
-        case '5': case '6': case '7': case '8': case '9':
-
-        case 'A': case 'B': case 'C': case 'D': case 'E':
-        case 'F': case 'G': case 'H': case 'I': case 'J':
-        case 'K': case 'L': case 'M': case 'N': case 'O':
-        case 'P': case 'Q': case 'R': case 'S': case 'T':
-        case 'U': case 'V': case 'W': case 'X': case 'Y':
-        case 'Z':
-
-        case 'a': case 'b': case 'c': case 'd': case 'e':
-        case 'f': case 'g': case 'h': case 'i': case 'j':
-        case 'k': case 'l': case 'm': case 'n': case 'o':
-        case 'p': case 'q': case 'r': case 's': case 't':
-        case 'u': case 'v': case 'w': case 'x': case 'y':
-        case 'z':
-
-        case '-': case '.': case '_': case '~':
-            return true;
+        case URLEncode_Path:
+            return urlencode_length_path;
+
+        case URLEncode_Everything:
+            return urlencode_length_everything;
 
         default:
-            return false;
+            assert(false && "Unknown urlencode type");
+            return urlencode_length_everything;
     }
 }
 
-inline bool isSubDelim(char c)
+/* Vector classification of bytes which are copied as is: a bit per byte,
+ * set if the byte is unreserved (or, for paths, a sub-delim). Bytes are
+ * range checked as unsigned: c is in [lo, hi] iff min(c - lo, hi - lo) ==
+ * c - lo.
+ */
+#ifdef __SSE2__
+static inline __m128i inRange16( __m128i x, char lo, char hi )
 {
-    switch (c)
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8((char)(hi - lo))), t);
+}
+
+static inline unsigned safeMask16( __m128i x, bool path )
+{
+    __m128i safe = _mm_or_si128(
+        _mm_or_si128(inRange16(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z'),
+                     inRange16(x, '0', '9')),
+        _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('_')),
+                     _mm_cmpeq_epi8(x, _mm_set1_epi8('~'))));
+    if (path)
+    {
+        // '&' to '.' covers the sub-delims &'()*+, along with -.
+        safe = _mm_or_si128(safe, _mm_or_si128(
+            _mm_or_si128(inRange16(x, '&', '.'), _mm_cmpeq_epi8(x, _mm_set1_epi8('!'))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('$')),
+                                      _mm_cmpeq_epi8(x, _mm_set1_epi8(';'))),
+                         _mm_cmpeq_epi8(x, _mm_set1_epi8('=')))));
+    }
+    else
     {
-        case '!': case '$': case '&': case '\'': case '(':
-        case ')': case '*': case '+': case ',':  case ';':
-        case '=':
-            return true;
+        safe = _mm_or_si128(safe, inRange16(x, '-', '.'));
+    }
+    return (unsigned)_mm_movemask_epi8(safe);
+}
+#endif
 
-        default:
-            return false;
+#ifdef SHA1_X86_SIMD
+#define URLENCODE_AVX2 __attribute__((target("avx2")))
+
+URLENCODE_AVX2
+static inline __attribute__((always_inline)) __m256i inRange32( __m256i x, char lo, char hi )
+{
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8((char)(hi - lo))), t);
+}
+
+URLENCODE_AVX2
+static inline __attribute__((always_inline)) unsigned safeMask32( __m256i x, bool path )
+{
+    __m256i safe = _mm256_or_si256(
+        _mm256_or_si256(inRange32(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z'),
+                        inRange32(x, '0', '9')),
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')),
+                        _mm256_cmpeq_epi8(x, _mm256_set1_epi8('~'))));
+    if (path)
+    {
+        safe = _mm256_or_si256(safe, _mm256_or_si256(
+            _mm256_or_si256(inRange32(x, '&', '.'), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('!'))),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('$')),
+                                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8(';'))),
+                            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('=')))));
+    }
+    else
+    {
+        safe = _mm256_or_si256(safe, inRange32(x, '-', '.'));
     }
+    return (unsigned)_mm256_movemask_epi8(safe);
 }
 
-std::string char2hex( char dec )
+// Copies whole 32 byte chunks of safe bytes, returning how many leading
+// bytes of s were safe. The chunk containing the first byte to escape is
+// stored too; the caller overwrites the tail of it.
+URLENCODE_AVX2
+static size_t copySafeAVX2( const unsigned char *s, size_t len, char *out, bool path )
 {
-	char dig1 = (dec&0xF0)>>4;
-	char dig2 = (dec&0x0F);
-	if ( 0<= dig1 && dig1<= 9) dig1+=48;    //0,48 in ascii
-	if (10<= dig1 && dig1<=15) dig1+=65-10; //A,65 in ascii
-	if ( 0<= dig2 && dig2<= 9) dig2+=48;
-	if (10<= dig2 && dig2<=15) dig2+=65-10;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(s + i));
+        _mm256_storeu_si256((__m256i*)(out + i), x);
+        unsigned mask = safeMask32(x, path);
+        if (mask != 0xFFFFFFFFu)
+            return i + __builtin_ctz(~mask);
+    }
+    return i;
+}
 
-    std::string r;
-	r.append( &dig1, 1);
-	r.append( &dig2, 1);
-	return r;
+URLENCODE_AVX2
+static size_t countEscapedAVX2( const unsigned char *s, size_t len, bool path, size_t *pDone )
+{
+    size_t escaped = 0, i = 0;
+    for (; i + 32 <= len; i += 32)
+        escaped += __builtin_popcount(~safeMask32(_mm256_loadu_si256((const __m256i*)(s + i)), path));
+    *pDone = i;
+    return escaped;
+}
+
+static bool useAVX2()
+{
+    static const bool hasAVX2 = SHA1_CPU_HasAVX2();
+    return hasAVX2;
+}
+#endif
+
+/* Counts the bytes of s that need escaping, a SIMD chunk at a time where
+ * possible. */
+static size_t countEscaped( const unsigned char *s, size_t len, URLEncodeType enctype,
+                            const unsigned char *table )
+{
+    bool path = (enctype == URLEncode_Path);
+    size_t escaped = 0, i = 0;
+#ifdef SHA1_X86_SIMD
+    if (useAVX2())
+        escaped = countEscapedAVX2(s, len, path, &i);
+#endif
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16)
+        escaped += __builtin_popcount(~safeMask16(_mm_loadu_si128((const __m128i*)(s + i)), path) & 0xFFFF);
+#endif
+    for (; i < len; i++)
+        escaped += (table[s[i]] != 1);
+    return escaped;
+}
+
+/* Copies the run of safe bytes at the start of s to out, returning its
+ * length. out must have room for len bytes. */
+static size_t copySafe( const unsigned char *s, size_t len, char *out, URLEncodeType enctype,
+                        const unsigned char *table )
+{
+    bool path = (enctype == URLEncode_Path);
+    size_t i = 0;
+#ifdef SHA1_X86_SIMD
+    if (useAVX2())
+    {
+        i = copySafeAVX2(s, len, out, path);
+        if (i < len && table[s[i]] != 1)
+            return i;
+    }
+#endif
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(s + i));
+        _mm_storeu_si128((__m128i*)(out + i), x);
+        unsigned mask = safeMask16(x, path);
+        if (mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+#endif
+    for (; i < len && table[s[i]] == 1; i++)
+        out[i] = (char)s[i];
+    return i;
+}
+
+std::string char2hex( char dec )
+{
+    char r[2];
+    r[0] = urlencode_hex_digits[((unsigned char)dec) >> 4];
+    r[1] = urlencode_hex_digits[((unsigned char)dec) & 0x0F];
+    return std::string(r, 2);
 }
 
 std::string urlencode( const std::string &s, URLEncodeType enctype)
 {
-    std::stringstream escaped;
+    const unsigned char *table = lengthTable(enctype);
+    const unsigned char *in = (const unsigned char*)s.data();
+    size_t len = s.length();
+
+    // Work out the exact output size first, so the result is written
+    // straight into a buffer of the right size
+    size_t escaped = countEscaped(in, len, enctype, table);
+    if (escaped == 0)
+        return s;
 
-    std::string::const_iterator itStr = s.begin();
-    for (; itStr != s.end(); ++itStr)
+    std::string result(len + 2 * escaped, '\0');
+    char *out = &result[0];
+    size_t i = 0;
+    while (i < len)
     {
-        char c = *itStr;
+        size_t run = copySafe(in + i, len - i, out, enctype, table);
+        i += run;
+        out += run;
+        if (i == len)
+            break;
 
-        // Unreserved chars - never percent-encoded
-        if (isUnreserved(c))
-        {
-            escaped << c;
-            continue;
-        }
+        // Unreserved chars were copied above; this one needs encoding
+        unsigned char c = in[i++];
+        out[0] = '%';
+        out[1] = urlencode_hex_digits[c >> 4];
+        out[2] = urlencode_hex_digits[c & 0x0F];
+        out += 3;
+    }
 
-        // Further on, the encoding depends on the context (where in the
-        // URI we are, what type of URI, and which character).
-        switch (enctype)
-        {
-            case URLEncode_Path:
-                if (isSubDelim(c))
-                {
-                    escaped << c;
-                    continue;
-                }
-                /* fall-through */
-
-            case URLEncode_Everything:
-                escaped << '%' << char2hex(c);
-                break;
+    return result;
+}
+
+/* Value of each byte as a hex digit, or 0xFF if it isn't one. */
+static const unsigned char urldecode_hex_value[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 00 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 10 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 20 */
+       0,    1,    2,    3,    4,    5,    6,    7,    8,    9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 30 */
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 40 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 50 */
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 60 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 70 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 80 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* 90 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* A0 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* B0 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* C0 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* D0 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* E0 */
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, /* F0 */
+};
 
-            default:
-                assert(false && "Unknown urlencode type");
+#ifdef SHA1_X86_SIMD
+// Copies whole 32 byte chunks up to the first one with a '%', returning how
+// many bytes were copied. The chunk with the '%' is left to the caller:
+// when decoding in place out is behind s, and storing all of it would
+// overwrite input that hasn't been read yet.
+URLENCODE_AVX2
+static size_t copyUntilPercentAVX2( const char *s, size_t len, char *out )
+{
+    const __m256i percent = _mm256_set1_epi8('%');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(s + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, percent));
+        if (mask)
+            break;
+        _mm256_storeu_si256((__m256i*)(out + i), x);
+    }
+    return i;
+}
+#endif
+
+/* Copies the run of bytes at the start of s up to the first '%' to out,
+ * returning its length. out may be s, or anywhere before it. */
+static size_t copyUntilPercent( const char *s, size_t len, char *out )
+{
+    size_t i = 0;
+#ifdef SHA1_X86_SIMD
+    if (useAVX2())
+        i = copyUntilPercentAVX2(s, len, out);
+#endif
+#ifdef __SSE2__
+    const __m128i percent = _mm_set1_epi8('%');
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(s + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, percent)))
+            break;
+        _mm_storeu_si128((__m128i*)(out + i), x);
+    }
+#endif
+    // The rest of the run is copied a byte at a time, which is safe in place
+    for (; i < len && s[i] != '%'; i++)
+        out[i] = s[i];
+    return i;
+}
+
+bool urldecode_to( const char *s, size_t len, char *out, bool strict, size_t *pLength )
+{
+    size_t i = 0, o = 0;
+    bool valid = true;
+    while (i < len)
+    {
+        size_t run = copyUntilPercent(s + i, len - i, out + o);
+        i += run;
+        o += run;
+        if (i == len)
+            break;
+
+        unsigned char hi = (i + 2 < len) ? urldecode_hex_value[(unsigned char)s[i + 1]] : 0xFF;
+        unsigned char lo = (i + 2 < len) ? urldecode_hex_value[(unsigned char)s[i + 2]] : 0xFF;
+        if ((hi | lo) == 0xFF)
+        {
+            if (strict)
+            {
+                valid = false;
                 break;
+            }
+            // Lenient: the '%' stands for itself
+            out[o++] = '%';
+            i++;
+            continue;
         }
+        out[o++] = (char)((hi << 4) | lo);
+        i += 3;
     }
+    *pLength = o;
+    return valid;
+}
 
-    return escaped.str();
+bool urldecode_append( const char *s, size_t len, std::string &out )
+{
+    size_t start = out.length(), decoded = 0;
+    if (len == 0)
+        return true;
+    out.resize(start + len);
+    bool valid = urldecode_to(s, len, &out[start], true, &decoded);
+    out.resize(start + decoded);
+    return valid;
 }
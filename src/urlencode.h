@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string>
+#include <cstddef>
 
 std::string char2hex( char dec );
 enum URLEncodeType {
@@ -13,4 +14,55 @@ enum URLEncodeType {
 };
 std::string urlencode( const std::string &s, URLEncodeType enctype );
 
+/* Encoded length of each byte for URLEncode_Everything: 1 if it is copied
+ * as is, 3 if it is percent encoded. */
+extern const unsigned char urlencode_length_everything[256];
+extern const char urlencode_hex_digits[];
+
+/* Percent encodes [s, s+len) with the URLEncode_Everything rules, passing each
+ * output character to out.put(char). Lets callers consume the encoded form
+ * (e.g. hash it) without building it as a string first.
+ */
+template<typename Output>
+void urlencode_to( const char *s, size_t len, Output &out )
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)s[i];
+        if (urlencode_length_everything[c] == 1)
+        {
+            out.put((char)c);
+        }
+        else
+        {
+            out.put('%');
+            out.put(urlencode_hex_digits[c >> 4]);
+            out.put(urlencode_hex_digits[c & 0x0F]);
+        }
+    }
+}
+
+/* Decodes the %XX escapes in [s, s+len) into out, which must have room for
+ * len bytes. out may be s, to decode in place. A '%' that isn't followed by
+ * two hex digits makes it return false if strict, and is copied as is
+ * otherwise. '+' is left alone. *pLength is set to the number of bytes
+ * written, up to the malformed escape if it failed.
+ */
+bool urldecode_to( const char *s, size_t len, char *out, bool strict, size_t *pLength );
+
+/* Decodes the %XX escapes in [s, s+len), appending the result to out.
+ * Returns false if a '%' isn't followed by two hex digits; out then holds
+ * what was decoded up to it. '+' is left alone.
+ */
+bool urldecode_append( const char *s, size_t len, std::string &out );
+
+/* Output for urlencode_to that appends to a string. */
+class urlencode_append {
+public:
+    urlencode_append( std::string &out ) : mOut(out) {}
+    void put( char c ) { mOut += c; }
+private:
+    std::string &mOut;
+};
+
 #endif // __URLENCODE_H__
@@ -0,0 +1,189 @@
+#ifndef __LIBOAUTHCPP_ASYNC_VERIFIER_TEST_H__
+#define __LIBOAUTHCPP_ASYNC_VERIFIER_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <vector>
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests verifying requests with batched secret lookups: results match
+ *  Verifier::verify, requests sharing secrets share a lookup, and batches
+ *  are sent when full or flushed.
+ **/
+class AsyncVerifierTest {
+public:
+    /** Keeps each result, and the token it was for. */
+    class ResultList : public VerificationCallback {
+    public:
+        virtual void verified(Verification::Result result, const VerificationBuffer& buffer) {
+            results.push_back(result);
+            tokens.push_back(buffer.token());
+        }
+        std::vector<Verification::Result> results;
+        std::vector<std::string> tokens;
+    };
+
+    static void run() {
+        batch_test();
+        max_batch_test();
+        replay_test();
+        latency_test();
+    }
+
+    static std::string header(const OAuth::Consumer& consumer, const OAuth::Token* token, int nonce) {
+        static FixedClock clock(1390268986);
+        FixedNonceSource nonceSource(nonce);
+        OAuth::Client oauth(&consumer, token);
+        oauth.setClock(&clock);
+        oauth.setNonceSource(&nonceSource);
+        return oauth.getHttpHeader(Http::Get, url());
+    }
+
+    static std::string url() {
+        return "http://api.example.com/1/statuses/home_timeline.json";
+    }
+
+    static void batch_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        OAuth::Token oddToken("a/b+c d", "s&cr%t");
+        OAuth::Token unknownToken("unknown", "secret");
+        OAuth::Consumer unknownConsumer("unknown", "secret");
+        MemorySecretResolver resolver;
+        resolver.addConsumer(consumer.key(), consumer.secret());
+        resolver.addToken(consumer.key(), token.key(), token.secret());
+        resolver.addToken(consumer.key(), oddToken.key(), oddToken.secret());
+
+        FixedClock clock(1390268986);
+        Verifier verifier(NULL);
+        verifier.setClock(&clock);
+        AsyncVerifier async(&verifier, &resolver);
+
+        std::string forged = header(consumer, &token, 1);
+        forged.replace(forged.find("oauth_timestamp=\"") + 17, 10, "1390268987");
+        std::vector<std::string> headers;
+        std::vector<Verification::Result> expected;
+        for(int i = 0; i < 5; i++) {
+            headers.push_back(header(consumer, &token, i));
+            expected.push_back(Verification::Valid);
+        }
+        headers.push_back(header(consumer, NULL, 0));
+        expected.push_back(Verification::Valid);
+        headers.push_back(header(consumer, &oddToken, 0));
+        expected.push_back(Verification::Valid);
+        headers.push_back(header(consumer, &unknownToken, 0));
+        expected.push_back(Verification::UnknownToken);
+        headers.push_back(header(unknownConsumer, NULL, 0));
+        expected.push_back(Verification::UnknownConsumer);
+        headers.push_back(forged);
+        expected.push_back(Verification::InvalidSignature);
+        headers.push_back("OAuth oauth_consumer_key=\"x\"");
+        expected.push_back(Verification::MissingParameter);
+
+        ResultList list;
+        for(std::size_t i = 0; i < headers.size(); i++)
+            async.submit(Http::Get, url(), headers[i], "", &list);
+        std::size_t early = list.results.size();
+        std::size_t outstanding = async.outstanding();
+        ASSERT_EQUAL(early, 1, "Request failing the first checks should complete right away");
+        ASSERT_EQUAL(outstanding, headers.size() - 1, "Other requests should wait for their batch");
+        async.drain();
+
+        ASSERT_EQUAL(list.results.size(), headers.size(), "Every request should complete");
+        // The malformed request came first, and batches keep their order
+        ASSERT_EQUAL(list.results[0], Verification::MissingParameter, "Malformed request should fail");
+        for(std::size_t i = 1; i < list.results.size(); i++)
+            ASSERT_EQUAL(list.results[i], expected[i - 1], "Batched result should match Verifier::verify");
+        ASSERT_EQUAL(list.tokens[7], oddToken.key(), "Callback should get the request's buffer");
+
+        std::size_t batches = resolver.batches();
+        std::size_t lookups = resolver.lookups();
+        ASSERT_EQUAL(batches, 1, "Requests should be sent in one batch");
+        ASSERT_EQUAL(lookups, 5, "Requests with the same secrets should share a lookup");
+    }
+
+    static void max_batch_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        MemorySecretResolver resolver;
+        resolver.addConsumer(consumer.key(), consumer.secret());
+        FixedClock clock(1390268986);
+        Verifier verifier(NULL);
+        verifier.setClock(&clock);
+        AsyncVerifier async(&verifier, &resolver, 4);
+
+        ResultList list;
+        std::string withoutToken = header(consumer, NULL, 0);
+        for(int i = 0; i < 10; i++)
+            async.submit(Http::Get, url(), withoutToken, "", &list);
+        std::size_t sent = async.batches();
+        std::size_t outstanding = async.outstanding();
+        ASSERT_EQUAL(sent, 2, "Full batches should be sent");
+        ASSERT_EQUAL(outstanding, 2, "Requests in the open batch should wait");
+        async.flush();
+        sent = async.batches();
+        ASSERT_EQUAL(sent, 3, "Flush should send the open batch");
+        async.flush();
+        sent = async.batches();
+        ASSERT_EQUAL(sent, 3, "Flush shouldn't send an empty batch");
+        ASSERT_EQUAL(list.results.size(), 10, "Every request should complete");
+    }
+
+    static void replay_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        MemorySecretResolver resolver;
+        resolver.addConsumer(consumer.key(), consumer.secret());
+        FixedClock clock(1390268986);
+        ReplayCache cache;
+        Verifier verifier(NULL);
+        verifier.setClock(&clock);
+        verifier.setNonceStore(&cache);
+        AsyncVerifier async(&verifier, &resolver);
+
+        ResultList list;
+        std::string withoutToken = header(consumer, NULL, 0);
+        async.submit(Http::Get, url(), withoutToken, "", &list);
+        async.submit(Http::Get, url(), withoutToken, "", &list);
+        async.drain();
+        ASSERT_EQUAL(list.results.size(), 2, "Both requests should complete");
+        ASSERT_EQUAL(list.results[0], Verification::Valid, "First request should verify");
+        ASSERT_EQUAL(list.results[1], Verification::Replayed, "Repeated request in a batch should be a replay");
+    }
+
+    /** With a delay, batches are completed by the resolver's thread. */
+    static void latency_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        MemorySecretResolver resolver(0.01);
+        FixedClock clock(1390268986);
+        Verifier verifier(NULL);
+        verifier.setClock(&clock);
+        std::vector<std::string> headers;
+        for(int i = 0; i < 100; i++) {
+            std::stringstream key;
+            key << "consumer" << i;
+            OAuth::Consumer other(key.str(), "secret");
+            resolver.addConsumer(other.key(), other.secret());
+            headers.push_back(header(other, NULL, i));
+        }
+
+        ResultList list;
+        {
+            AsyncVerifier async(&verifier, &resolver, 16);
+            for(std::size_t i = 0; i < headers.size(); i++)
+                async.submit(Http::Get, url(), headers[i], "", &list);
+            // Destroying it waits for the outstanding requests
+        }
+        int valid = 0;
+        for(std::size_t i = 0; i < list.results.size(); i++)
+            valid += list.results[i] == Verification::Valid;
+        ASSERT_EQUAL(valid, 100, "Every request should verify after the delay");
+        std::size_t batches = resolver.batches();
+        ASSERT_EQUAL(batches, 7, "Requests should be sent in full batches");
+    }
+};
+
+}
+
+#endif
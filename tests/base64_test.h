@@ -0,0 +1,102 @@
+#ifndef __LIBOAUTHCPP_BASE64_TEST_H__
+#define __LIBOAUTHCPP_BASE64_TEST_H__
+
+#include "testutil.h"
+#include "../src/base64.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace OAuthTest {
+
+/** Tests base64 encoding and decoding against the RFC 4648 test vectors,
+ *  round trips long enough to use the vectorized code, and the SHA-1 digest
+ *  helpers.
+ **/
+class Base64Test {
+public:
+    static void run() {
+        rfc4648_test();
+        decode_stops_test();
+        round_trip_test();
+        sha1_digest_test();
+    }
+
+    static std::string encode(const std::string& s) {
+        return base64_encode((const unsigned char*)s.data(), s.size());
+    }
+
+    static void rfc4648_test() {
+        const char* vectors[][2] = {
+            { "", "" },
+            { "f", "Zg==" },
+            { "fo", "Zm8=" },
+            { "foo", "Zm9v" },
+            { "foob", "Zm9vYg==" },
+            { "fooba", "Zm9vYmE=" },
+            { "foobar", "Zm9vYmFy" }
+        };
+        for(std::size_t i = 0; i < sizeof(vectors)/sizeof(vectors[0]); i++) {
+            ASSERT_EQUAL(encode(vectors[i][0]), vectors[i][1], std::string("Encode \"") + vectors[i][0] + "\"");
+            ASSERT_EQUAL(base64_decode(vectors[i][1]), vectors[i][0], std::string("Decode \"") + vectors[i][1] + "\"");
+        }
+    }
+
+    // Decoding ends at padding or at the first character outside the alphabet
+    static void decode_stops_test() {
+        ASSERT_EQUAL(base64_decode("Zm9v"), "foo", "Decode without padding");
+        ASSERT_EQUAL(base64_decode("Zm9vYg"), "foob", "Decode unpadded partial group");
+        ASSERT_EQUAL(base64_decode("Zg==Zm9v"), "f", "Decode stops at padding");
+        ASSERT_EQUAL(base64_decode("Zm9v YmFy"), "foo", "Decode stops at a space");
+        ASSERT_EQUAL(base64_decode("Zm9vY"), "foo", "Single trailing character gives no byte");
+
+        std::string long_value(300, 'x');
+        std::string encoded = encode(long_value);
+        encoded[200] = '*';
+        ASSERT_EQUAL(base64_decode(encoded), long_value.substr(0, 150), "Long decode stops at an invalid character");
+    }
+
+    static void round_trip_test() {
+        srand(4648);
+        for(std::size_t len = 0; len < 300; len++) {
+            std::string data;
+            for(std::size_t i = 0; i < len; i++)
+                data.push_back((char)(rand() & 0xFF));
+
+            std::string encoded = encode(data);
+            std::stringstream msg;
+            msg << "Round trip of " << len << " bytes";
+            ASSERT_EQUAL(encoded.size(), (len + 2) / 3 * 4, msg.str() + " has the right encoded length");
+            ASSERT_EQUAL(base64_decode(encoded), data, msg.str());
+        }
+
+        // Every character of the alphabet in every position of a vector
+        std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string all = alphabet + alphabet.substr(1) + alphabet.substr(2) + alphabet.substr(3);
+        all = all.substr(0, all.size() / 4 * 4);
+        ASSERT_EQUAL(encode(base64_decode(all)), all, "Round trip of the whole alphabet");
+    }
+
+    static void sha1_digest_test() {
+        srand(20);
+        for(int n = 0; n < 50; n++) {
+            unsigned char digest[20], decoded[20];
+            for(int i = 0; i < 20; i++)
+                digest[i] = (unsigned char)(rand() & 0xFF);
+
+            char encoded[BASE64_SHA1_DIGEST_LENGTH];
+            base64_encode_sha1_digest(digest, encoded);
+            ASSERT_EQUAL(std::string(encoded, BASE64_SHA1_DIGEST_LENGTH), base64_encode(digest, 20), "Digest encoding should match base64_encode");
+            ASSERT_TRUE(base64_decode_sha1_digest(encoded, BASE64_SHA1_DIGEST_LENGTH, decoded), "Digest should decode");
+            ASSERT_TRUE(memcmp(digest, decoded, 20) == 0, "Digest should round trip");
+        }
+
+        unsigned char decoded[20];
+        ASSERT_TRUE(!base64_decode_sha1_digest("Wo8bolvRL6CC2MyJEP7zkjtMvvs", 27, decoded), "Digest without padding is rejected");
+        ASSERT_TRUE(!base64_decode_sha1_digest("Wo8bolvRL6CC2MyJEP7zkjtM*vs=", 28, decoded), "Digest with an invalid character is rejected");
+        ASSERT_TRUE(base64_decode_sha1_digest("Wo8bolvRL6CC2MyJEP7zkjtMvvs=", 28, decoded), "Valid digest is accepted");
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef __LIBOAUTHCPP_BODY_HASH_TEST_H__
+#define __LIBOAUTHCPP_BODY_HASH_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <cstdio>
+#include <algorithm>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests oauth_body_hash computation from each kind of input, and signing
+ *  requests with a body hash.
+ **/
+class BodyHashTest {
+public:
+    static void run() {
+        std::string body = "{\"status\": \"Hello Ladies + Gentlemen, a signed OAuth request!\"}";
+        std::string expected = "wileyJ24qUvWPjF1rcJ2SOQk0ic=";
+
+        {
+            BodyHash empty;
+            ASSERT_EQUAL(empty.value(), "2jmj7l5rSw0yVb/vlWAYkK/YBwk=", "Empty body hash should be SHA1 of nothing");
+        }
+        {
+            BodyHash whole;
+            whole.update(body.data(), body.size());
+            ASSERT_EQUAL(whole.value(), expected, "Body hash of whole body");
+            ASSERT_EQUAL(whole.value(), expected, "Body hash value should be stable");
+        }
+        {
+            BodyHash chunked;
+            for(std::size_t i = 0; i < body.size(); i += 7)
+                chunked.update(body.data() + i, std::min<std::size_t>(7, body.size() - i));
+            ASSERT_EQUAL(chunked.value(), expected, "Body hash fed in chunks");
+        }
+        {
+            BodyHash missing;
+            ASSERT_TRUE(!missing.updateFromFile("/nonexistent/liboauthcpp/body"), "Missing file should fail");
+        }
+
+#ifndef _WIN32
+        char path[] = "/tmp/liboauthcpp_body_XXXXXX";
+        int fd = mkstemp(path);
+        ASSERT_TRUE(fd >= 0, "Create temporary body file");
+        if (fd >= 0) {
+            ASSERT_TRUE(write(fd, body.data(), body.size()) == (ssize_t)body.size(), "Write temporary body file");
+            {
+                BodyHash fromFile;
+                ASSERT_TRUE(fromFile.updateFromFile(path), "Hash body file");
+                ASSERT_EQUAL(fromFile.value(), expected, "Body hash from mapped file");
+            }
+            {
+                // Hashing starts at the current position
+                BodyHash fromFd;
+                fromFd.update(body.data(), 10);
+                lseek(fd, 10, SEEK_SET);
+                ASSERT_TRUE(fromFd.updateFromFileDescriptor(fd), "Hash body file descriptor");
+                ASSERT_EQUAL(fromFd.value(), expected, "Body hash from file descriptor");
+            }
+            close(fd);
+            unlink(path);
+        }
+
+        int fds[2];
+        if (pipe(fds) == 0) {
+            ASSERT_TRUE(write(fds[1], body.data(), body.size()) == (ssize_t)body.size(), "Write body to pipe");
+            close(fds[1]);
+            BodyHash fromPipe;
+            ASSERT_TRUE(fromPipe.updateFromFileDescriptor(fds[0]), "Hash body pipe");
+            ASSERT_EQUAL(fromPipe.value(), expected, "Body hash from pipe");
+            close(fds[0]);
+        }
+#endif
+
+#ifdef __linux__
+        // procfs files are regular files that report a size of 0
+        std::string cmdline;
+        FILE* file = fopen("/proc/self/cmdline", "rb");
+        if (file) {
+            char buffer[256];
+            std::size_t n;
+            while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+                cmdline.append(buffer, n);
+            fclose(file);
+            ASSERT_TRUE(!cmdline.empty(), "Read /proc/self/cmdline");
+
+            BodyHash fromMemory;
+            fromMemory.update(cmdline.data(), cmdline.size());
+            BodyHash fromProc;
+            ASSERT_TRUE(fromProc.updateFromFile("/proc/self/cmdline"), "Hash procfs file");
+            ASSERT_EQUAL(fromProc.value(), fromMemory.value(), "Body hash of a file reporting size 0 should cover its contents");
+        }
+#endif
+
+        signing_test(body);
+    }
+
+    static void signing_test(const std::string& body) {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+
+        Client::__resetInitialize();
+        Client::initialize(100, 1390268986);
+        OAuth::Client oauth(&consumer, &token);
+
+        BodyHash hash;
+        hash.update(body.data(), body.size());
+        ASSERT_EQUAL(
+            oauth.getHttpHeader(OAuth::Http::Post, "http://api.example.com/1/upload.json", hash),
+            "OAuth oauth_body_hash=\"wileyJ24qUvWPjF1rcJ2SOQk0ic%3D\",oauth_consumer_key=\"wwwwxxxxyyyyzzzz\",oauth_nonce=\"139026898664\",oauth_signature=\"eSMuyhnWkaHCE5c3G2qpU%2FZqMLA%3D\",oauth_signature_method=\"HMAC-SHA1\",oauth_timestamp=\"1390268986\",oauth_token=\"aaaabbbbccccdddd\",oauth_version=\"1.0\"",
+            "Validate POST request signed with a body hash"
+        );
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef __LIBOAUTHCPP_CLOCK_TEST_H__
+#define __LIBOAUTHCPP_CLOCK_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <ctime>
+#include <cstdlib>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests where oauth_timestamp and oauth_nonce come from: the defaults,
+ *  and clocks and nonce sources set on a Client.
+ **/
+class ClockTest {
+public:
+    static void run() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+
+        Client::__resetInitialize();
+        OAuth::Client oauth(&consumer, &token);
+        default_clock_test(oauth);
+        client_clock_test(oauth);
+        fixed_nonce_test(consumer, token);
+#ifndef _WIN32
+        threaded_fixed_test(consumer, token);
+#endif
+    }
+
+    static std::string param(const OAuth::Client& oauth, const std::string& key) {
+        OAuth::KeyValuePairs kv = OAuth::ParseKeyValuePairs(oauth.getURLQueryString(Http::Get, "http://api.example.com/1/resource?arg=foo"));
+        OAuth::KeyValuePairs::const_iterator it = kv.find(key);
+        return (it == kv.end()) ? "" : it->second;
+    }
+
+    static void default_clock_test(const OAuth::Client& oauth) {
+        time_t before = time(NULL);
+        long timestamp = atol(param(oauth, "oauth_timestamp").c_str());
+        time_t after = time(NULL);
+        // The coarse clock may lag the precise one by a tick
+        ASSERT_TRUE(timestamp >= (long)before - 1 && timestamp <= (long)after, "Default clock should give the current time");
+    }
+
+    static void client_clock_test(OAuth::Client& oauth) {
+        FixedClock clock(1390268986);
+        oauth.setClock(&clock);
+        ASSERT_EQUAL(param(oauth, "oauth_timestamp"), "1390268986", "Timestamp should come from the Client's clock");
+        ASSERT_EQUAL(param(oauth, "oauth_nonce").substr(0, 10), "1390268986", "Nonce should start with the timestamp");
+
+        clock.set(1390268987);
+        ASSERT_EQUAL(param(oauth, "oauth_timestamp"), "1390268987", "Timestamp should follow the clock");
+        clock.set(7);
+        ASSERT_EQUAL(param(oauth, "oauth_timestamp"), "7", "Short timestamp");
+        clock.set(-12);
+        ASSERT_EQUAL(param(oauth, "oauth_timestamp"), "-12", "Negative timestamp");
+
+        OAuth::Client copy(oauth);
+        ASSERT_EQUAL(param(copy, "oauth_timestamp"), "-12", "Clock should be copied with the Client");
+
+        oauth.setClock(NULL);
+        default_clock_test(oauth);
+    }
+
+    /** A FixedClock and FixedNonceSource should sign exactly like the
+     *  process wide testing mode.
+     */
+    static void fixed_nonce_test(const OAuth::Consumer& consumer, const OAuth::Token& token) {
+        Client::__resetInitialize();
+        OAuth::Client oauth(&consumer, &token);
+        FixedClock clock(1390268986);
+        FixedNonceSource nonce(100);
+        oauth.setClock(&clock);
+        oauth.setNonceSource(&nonce);
+        ASSERT_EQUAL(
+            oauth.getURLQueryString(OAuth::Http::Head, "resource"),
+            "oauth_consumer_key=wwwwxxxxyyyyzzzz&oauth_nonce=139026898664&oauth_signature=4J4T69RentaaJJ6R5nzlnidLzSY%3D&oauth_signature_method=HMAC-SHA1&oauth_timestamp=1390268986&oauth_token=aaaabbbbccccdddd&oauth_version=1.0",
+            "Fixed clock and nonce should match the testing mode"
+        );
+
+        nonce.set(0xbeef);
+        ASSERT_EQUAL(param(oauth, "oauth_nonce"), "1390268986beef", "Nonce should follow the source");
+
+        // The Client's own values win over the process wide ones
+        Client::initialize(1, 2);
+        ASSERT_EQUAL(param(oauth, "oauth_nonce"), "1390268986beef", "Client's nonce source should take precedence");
+        Client::__resetInitialize();
+    }
+
+#ifndef _WIN32
+    struct FixedSigner {
+        OAuth::Client* oauth;
+        std::string expected;
+        bool matched;
+    };
+
+    static void* sign_fixed(void* arg) {
+        FixedSigner* signer = (FixedSigner*)arg;
+        signer->matched = true;
+        for(int i = 0; i < 200; i++) {
+            if (signer->oauth->getHttpHeader(Http::Get, "http://api.example.com/1/resource?page=2") != signer->expected)
+                signer->matched = false;
+        }
+        return NULL;
+    }
+
+    /** Clients with different fixed values, signing on several threads at
+     *  once, should each get their own exact results.
+     */
+    static void threaded_fixed_test(const OAuth::Consumer& consumer, const OAuth::Token& token) {
+        const int nthreads = 4;
+        FixedClock* clocks[nthreads];
+        FixedNonceSource* nonces[nthreads];
+        OAuth::Client* clients[nthreads];
+        FixedSigner signers[nthreads];
+        pthread_t ids[nthreads];
+
+        for(int t = 0; t < nthreads; t++) {
+            clocks[t] = new FixedClock(1390268986 + t);
+            nonces[t] = new FixedNonceSource(100 + t);
+            clients[t] = new OAuth::Client(&consumer, &token);
+            clients[t]->setClock(clocks[t]);
+            clients[t]->setNonceSource(nonces[t]);
+            signers[t].oauth = clients[t];
+            signers[t].expected = clients[t]->getHttpHeader(Http::Get, "http://api.example.com/1/resource?page=2");
+        }
+        ASSERT_NOTEQUAL(signers[0].expected, signers[1].expected, "Clients with different fixed values should sign differently");
+
+        for(int t = 0; t < nthreads; t++) {
+            int err = pthread_create(&ids[t], NULL, sign_fixed, &signers[t]);
+            ASSERT_EQUAL(err, 0, "Start signing thread");
+        }
+        for(int t = 0; t < nthreads; t++) {
+            pthread_join(ids[t], NULL);
+            ASSERT_TRUE(signers[t].matched, "Each thread should reproduce its Client's signature");
+            delete clients[t];
+            delete nonces[t];
+            delete clocks[t];
+        }
+    }
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef __LIBOAUTHCPP_CREDENTIAL_CACHE_TEST_H__
+#define __LIBOAUTHCPP_CREDENTIAL_CACHE_TEST_H__
+
+#include "testutil.h"
+#include "verifier_test.h"
+#include <liboauthcpp/liboauthcpp.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests looking signing keys up through a CredentialCache: requests verify
+ *  as they do without one, the SecretStore is only asked on misses, and
+ *  invalidated keys are looked up again.
+ **/
+class CredentialCacheTest {
+public:
+    /** Counts lookups, and can be made slow or to fail. */
+    class CountingSecretStore : public SecretStore {
+    public:
+        CountingSecretStore() : delayMicroseconds(0), fail(false), mLookups(0) {}
+
+        VerifierTest::MapSecretStore secrets;
+        int delayMicroseconds;
+        bool fail;
+
+        int lookups() const { return __sync_fetch_and_add(&mLookups, 0); }
+
+        virtual bool consumerSecret(const std::string& consumerKey, std::string& secret) const {
+            __sync_fetch_and_add(&mLookups, 1);
+#ifndef _WIN32
+            if (delayMicroseconds)
+                usleep(delayMicroseconds);
+#endif
+            if (fail)
+                throw std::runtime_error("Secret store unavailable");
+            return secrets.consumerSecret(consumerKey, secret);
+        }
+        virtual bool tokenSecret(const std::string& consumerKey, const std::string& token, std::string& secret) const {
+            return secrets.tokenSecret(consumerKey, token, secret);
+        }
+    private:
+        mutable int mLookups;
+    };
+
+    static void run() {
+        cache_test();
+        invalidate_test();
+        eviction_test();
+        failure_test();
+#ifndef _WIN32
+        coalesce_test();
+#endif
+    }
+
+    static std::string header(const OAuth::Consumer& consumer, const OAuth::Token* token, const std::string& url) {
+        static FixedClock clock(1390268986);
+        static FixedNonceSource nonce(100);
+        OAuth::Client oauth(&consumer, token);
+        oauth.setClock(&clock);
+        oauth.setNonceSource(&nonce);
+        return oauth.getHttpHeader(Http::Get, url);
+    }
+
+    static Verification::Result verify(const Verifier& verifier, const std::string& header) {
+        return verifier.verify(Http::Get, "http://api.example.com/1/statuses/home_timeline.json", header);
+    }
+
+    // Keeps the result first, as each verify changes the cache's counts
+    static void expect(const Verifier& verifier, const std::string& header, Verification::Result expected,
+                       const std::string& message) {
+        Verification::Result result = verify(verifier, header);
+        ASSERT_EQUAL(result, expected, message);
+    }
+
+    static void cache_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        OAuth::Token oddToken("a/b+c d", "s&cr%t");
+        OAuth::Token unknownToken("unknown", "secret");
+        OAuth::Consumer unknownConsumer("unknown", "secret");
+        CountingSecretStore store;
+        store.secrets.addConsumer(consumer.key(), consumer.secret());
+        store.secrets.addToken(consumer.key(), token.key(), token.secret());
+        store.secrets.addToken(consumer.key(), oddToken.key(), oddToken.secret());
+
+        FixedClock clock(1390268986);
+        CredentialCache cache(&store);
+        Verifier verifier(&store);
+        verifier.setClock(&clock);
+        verifier.setCredentialCache(&cache);
+
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json";
+        std::string withToken = header(consumer, &token, url);
+        for(int i = 0; i < 10; i++)
+            expect(verifier, withToken, Verification::Valid, "Request should verify with a cache");
+        ASSERT_EQUAL(store.lookups(), 1, "Secrets should be looked up once");
+        expect(verifier, header(consumer, NULL, url), Verification::Valid, "Request without token should verify with a cache");
+        expect(verifier, header(consumer, &oddToken, url), Verification::Valid, "Encoded secrets should match Client's");
+        ASSERT_EQUAL(store.lookups(), 3, "Each token should be looked up");
+
+        std::string forged = withToken;
+        forged.replace(forged.find("oauth_timestamp=\"") + 17, 10, "1390268987");
+        expect(verifier, forged, Verification::InvalidSignature, "Changed request should not verify with a cache");
+
+        for(int i = 0; i < 2; i++) {
+            expect(verifier, header(consumer, &unknownToken, url), Verification::UnknownToken, "Unknown token should be reported");
+            expect(verifier, header(unknownConsumer, NULL, url), Verification::UnknownConsumer, "Unknown consumer should be reported");
+        }
+        ASSERT_EQUAL(store.lookups(), 7, "Unknown keys shouldn't be cached");
+
+        CredentialCache::Stats stats = cache.stats();
+        ASSERT_EQUAL(stats.hits, 10, "Hits should be counted");
+        ASSERT_EQUAL(stats.misses, 7, "Misses should be counted");
+        ASSERT_EQUAL(stats.lookups, 7, "Lookups should be counted");
+        ASSERT_TRUE(stats.hitRate() > 0.58 && stats.hitRate() < 0.59, "Hit rate should be hits over requests");
+        ASSERT_TRUE(stats.maxLookupSeconds >= stats.averageLookupSeconds(), "Lookup time should be measured");
+        std::size_t size = cache.size();
+        ASSERT_EQUAL(size, 3, "Cache should hold the known keys");
+    }
+
+    static void invalidate_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        CountingSecretStore store;
+        store.secrets.addConsumer(consumer.key(), consumer.secret());
+        store.secrets.addToken(consumer.key(), token.key(), token.secret());
+
+        FixedClock clock(1390268986);
+        CredentialCache cache(&store);
+        Verifier verifier(&store);
+        verifier.setClock(&clock);
+        verifier.setCredentialCache(&cache);
+
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json";
+        std::string withToken = header(consumer, &token, url);
+        std::string withoutToken = header(consumer, NULL, url);
+        expect(verifier, withToken, Verification::Valid, "Request should verify");
+        expect(verifier, withoutToken, Verification::Valid, "Request without token should verify");
+
+        // Revoke the token by giving it another secret
+        store.secrets.addToken(consumer.key(), token.key(), "revoked");
+        expect(verifier, withToken, Verification::Valid, "Cached key should still be used");
+        cache.invalidate(consumer.key(), token.key());
+        expect(verifier, withToken, Verification::InvalidSignature, "Invalidated key should be looked up again");
+        expect(verifier, withoutToken, Verification::Valid, "Other keys should stay cached");
+        ASSERT_EQUAL(store.lookups(), 3, "Only the invalidated key should be looked up again");
+
+        cache.invalidateConsumer(consumer.key());
+        std::size_t size = cache.size();
+        ASSERT_EQUAL(size, 0, "Consumer's keys should be invalidated");
+        CredentialCache::Stats stats = cache.stats();
+        ASSERT_EQUAL(stats.invalidations, 3, "Invalidations should be counted");
+    }
+
+    static void eviction_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        CountingSecretStore store;
+        store.secrets.addConsumer(consumer.key(), consumer.secret());
+        std::vector<std::string> headers;
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json";
+        for(int i = 0; i < 5; i++) {
+            std::stringstream key;
+            key << "token" << i;
+            OAuth::Token token(key.str(), "secret");
+            store.secrets.addToken(consumer.key(), token.key(), token.secret());
+            headers.push_back(header(consumer, &token, url));
+        }
+
+        FixedClock clock(1390268986);
+        CredentialCache cache(&store, 4, 1);
+        Verifier verifier(&store);
+        verifier.setClock(&clock);
+        verifier.setCredentialCache(&cache);
+
+        for(int i = 0; i < 4; i++)
+            verify(verifier, headers[i]);
+        // The hand clears every reference and comes back to the first
+        verify(verifier, headers[4]);
+        std::size_t size = cache.size();
+        ASSERT_EQUAL(size, 4, "Cache should stay within its capacity");
+        // Tokens 1 to 3 are now unreferenced, and token 4 is
+        verify(verifier, headers[4]);
+        verify(verifier, headers[0]);
+        int lookups = store.lookups();
+        verify(verifier, headers[4]);
+        ASSERT_EQUAL(store.lookups(), lookups, "Recently used key should be kept");
+        CredentialCache::Stats stats = cache.stats();
+        ASSERT_EQUAL(stats.evictions, 2, "Evictions should be counted");
+    }
+
+    static void failure_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        CountingSecretStore store;
+        store.secrets.addConsumer(consumer.key(), consumer.secret());
+        FixedClock clock(1390268986);
+        CredentialCache cache(&store);
+        Verifier verifier(&store);
+        verifier.setClock(&clock);
+        verifier.setCredentialCache(&cache);
+
+        std::string withoutToken = header(consumer, NULL, "http://api.example.com/1/statuses/home_timeline.json");
+        store.fail = true;
+        bool threw = false;
+        try {
+            verify(verifier, withoutToken);
+        }
+        catch(const std::runtime_error&) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw, "SecretStore errors should be passed on");
+        store.fail = false;
+        expect(verifier, withoutToken, Verification::Valid, "Key should be looked up after an error");
+    }
+
+#ifndef _WIN32
+    struct Request {
+        const Verifier* verifier;
+        const std::string* header;
+        Verification::Result result;
+    };
+
+    static void* verify_thread(void* arg) {
+        Request* request = (Request*)arg;
+        request->result = verify(*request->verifier, *request->header);
+        return NULL;
+    }
+
+    /** Threads missing on one key at once should share a single lookup. */
+    static void coalesce_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        CountingSecretStore store;
+        store.secrets.addConsumer(consumer.key(), consumer.secret());
+        store.delayMicroseconds = 200000;
+        FixedClock clock(1390268986);
+        CredentialCache cache(&store);
+        Verifier verifier(&store);
+        verifier.setClock(&clock);
+        verifier.setCredentialCache(&cache);
+        std::string withoutToken = header(consumer, NULL, "http://api.example.com/1/statuses/home_timeline.json");
+
+        const int nthreads = 8;
+        Request requests[nthreads];
+        pthread_t ids[nthreads];
+        for(int t = 0; t < nthreads; t++) {
+            requests[t].verifier = &verifier;
+            requests[t].header = &withoutToken;
+            int err = pthread_create(&ids[t], NULL, verify_thread, &requests[t]);
+            ASSERT_EQUAL(err, 0, "Start verifying thread");
+        }
+        int valid = 0;
+        for(int t = 0; t < nthreads; t++) {
+            pthread_join(ids[t], NULL);
+            valid += requests[t].result == Verification::Valid;
+        }
+        ASSERT_EQUAL(valid, nthreads, "Every thread's request should verify");
+        ASSERT_EQUAL(store.lookups(), 1, "Concurrent misses should share one lookup");
+        CredentialCache::Stats stats = cache.stats();
+        ASSERT_EQUAL(stats.misses, nthreads, "Each thread should have missed");
+        ASSERT_EQUAL(stats.coalesced, nthreads - 1, "Waiting threads should be counted");
+        ASSERT_TRUE(stats.maxLookupSeconds >= 0.1, "Slow lookup should be timed");
+    }
+#endif
+};
+
+}
+
+#endif
@@ -3,6 +3,12 @@
 
 #include "testutil.h"
 #include <liboauthcpp/liboauthcpp.h>
+#include <map>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 using namespace OAuth;
 
@@ -14,6 +20,36 @@ class FastRequestTest {
 public:
     static void run() {
         repeated_nonce_test();
+        distributed_nonce_test();
+#ifndef _WIN32
+        threaded_nonce_test(NULL);
+        OAuth::DistributedNonceSource source(42);
+        threaded_nonce_test(&source);
+        forked_nonce_test(NULL);
+        forked_nonce_test(&source);
+#endif
+    }
+
+    static std::string nonce(const OAuth::Client& oauth) {
+        OAuth::KeyValuePairs kv = OAuth::ParseKeyValuePairs(oauth.getURLQueryString(OAuth::Http::Head, "resource?arg=foo"));
+        return kv.find("oauth_nonce")->second;
+    }
+
+    static void distributed_nonce_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::FixedClock clock(1390268986);
+        OAuth::DistributedNonceSource source(0x2a);
+        OAuth::Client oauth(&consumer);
+        oauth.setClock(&clock);
+        oauth.setNonceSource(&source);
+
+        std::string first = nonce(oauth);
+        std::string second = nonce(oauth);
+        ASSERT_EQUAL(first.substr(0, 13), "13902689862a-", "Distributed nonce should start with the timestamp and node id");
+        std::size_t dash = first.rfind('-');
+        ASSERT_TRUE(dash > 13, "Distributed nonce should have a process prefix and counter");
+        ASSERT_EQUAL(first.substr(0, dash), second.substr(0, second.rfind('-')), "Process prefix should be the same for every nonce");
+        ASSERT_NOTEQUAL(first, second, "Distributed nonces should differ by counter");
     }
 
     /** Tries to check that nonces will not be reused. This tries to make sure
@@ -62,6 +98,101 @@ public:
             ASSERT_EQUAL(1, it->second, "Found repeated nonce");
         }
     }
+
+#ifndef _WIN32
+    struct SignerThread {
+        const OAuth::Client* oauth;
+        std::vector<std::string> queries;
+    };
+
+    static void* sign_repeatedly(void* arg) {
+        SignerThread* thread = (SignerThread*)arg;
+        for(int i = 0; i < 1000; i++)
+            thread->queries.push_back(thread->oauth->getURLQueryString(OAuth::Http::Head, "resource?arg=foo"));
+        return NULL;
+    }
+
+    /** The same, but with several threads signing at once from a shared
+     *  Client. Nonces must be unique across threads too.
+     */
+    static void threaded_nonce_test(const OAuth::NonceSource* source) {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+
+        Client::__resetInitialize();
+        OAuth::Client oauth(&consumer, &token);
+        oauth.setNonceSource(source);
+
+        const int nthreads = 8;
+        SignerThread threads[nthreads];
+        pthread_t ids[nthreads];
+        for(int t = 0; t < nthreads; t++) {
+            threads[t].oauth = &oauth;
+            int err = pthread_create(&ids[t], NULL, sign_repeatedly, &threads[t]);
+            ASSERT_EQUAL(err, 0, "Start signing thread");
+        }
+        for(int t = 0; t < nthreads; t++)
+            pthread_join(ids[t], NULL);
+
+        std::map<std::string, int> nonces;
+        std::size_t total = 0;
+        for(int t = 0; t < nthreads; t++) {
+            for(std::size_t i = 0; i < threads[t].queries.size(); i++) {
+                OAuth::KeyValuePairs kv = OAuth::ParseKeyValuePairs(threads[t].queries[i]);
+                ASSERT_EQUAL(kv.count("oauth_nonce"), 1, "oauth_nonce should appear exactly once in a generated query string");
+                nonces[kv.find("oauth_nonce")->second]++;
+                total++;
+            }
+        }
+        ASSERT_EQUAL(total, (std::size_t)(nthreads * 1000), "Every thread should sign all its requests");
+        ASSERT_EQUAL(nonces.size(), total, "Nonces should be unique across threads");
+    }
+
+    /** A forked child must not repeat its parent's nonces. */
+    static void forked_nonce_test(const OAuth::NonceSource* source) {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::FixedClock clock(1390268986);
+        OAuth::Client oauth(&consumer);
+        oauth.setClock(&clock);
+        oauth.setNonceSource(source);
+
+        // Get the parent's nonce state going before forking
+        std::map<std::string, int> nonces;
+        nonces[nonce(oauth)]++;
+
+        int fds[2];
+        if (pipe(fds) != 0) return;
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            for(int i = 0; i < 100; i++) {
+                std::string n = nonce(oauth) + "\n";
+                if (write(fds[1], n.data(), n.size()) != (ssize_t)n.size()) break;
+            }
+            close(fds[1]);
+            _exit(0);
+        }
+        close(fds[1]);
+        for(int i = 0; i < 100; i++)
+            nonces[nonce(oauth)]++;
+
+        std::string child;
+        char buf[4096];
+        ssize_t n;
+        while((n = read(fds[0], buf, sizeof(buf))) > 0)
+            child.append(buf, n);
+        close(fds[0]);
+        waitpid(pid, NULL, 0);
+
+        std::size_t count = 0;
+        for(std::size_t start = 0, end; (end = child.find('\n', start)) != std::string::npos; start = end + 1) {
+            nonces[child.substr(start, end - start)]++;
+            count++;
+        }
+        ASSERT_EQUAL(count, 100, "Child should generate its nonces");
+        ASSERT_EQUAL(nonces.size(), 201, "Nonces should be unique across fork");
+    }
+#endif
 };
 
 }
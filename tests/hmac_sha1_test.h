@@ -0,0 +1,102 @@
+#ifndef __LIBOAUTHCPP_HMAC_SHA1_TEST_H__
+#define __LIBOAUTHCPP_HMAC_SHA1_TEST_H__
+
+#include "testutil.h"
+#include "../src/HMAC_SHA1.h"
+#include "../src/HMAC_SHA1_mb.h"
+#include <cstdlib>
+
+namespace OAuthTest {
+
+/** Tests HMAC-SHA1 against the RFC 2202 test vectors, and the multi-buffer
+ *  implementations against the single message one.
+ **/
+class HMACSHA1Test {
+public:
+    static void run() {
+        rfc2202_test();
+
+        int impls[] = {
+            HMAC_SHA1_MB_SCALAR,
+            HMAC_SHA1_MB_SSSE3_X4,
+            HMAC_SHA1_MB_AVX2_X8
+        };
+        for(std::size_t i = 0; i < sizeof(impls)/sizeof(impls[0]); i++) {
+            if (!HMAC_SHA1_MB_IsSupported(impls[i])) continue;
+            multi_buffer_test(impls[i]);
+        }
+    }
+
+    static std::string hex(const BYTE* digest) {
+        std::stringstream ss;
+        const char* digits = "0123456789abcdef";
+        for(int i = 0; i < 20; i++)
+            ss << digits[digest[i] >> 4] << digits[digest[i] & 0xF];
+        return ss.str();
+    }
+
+    static std::string hmac(const std::string& key, const std::string& text) {
+        CHMAC_SHA1 h;
+        BYTE digest[20];
+        h.HMAC_SHA1((BYTE*)text.data(), text.size(), (BYTE*)key.data(), key.size(), digest);
+        return hex(digest);
+    }
+
+    static void rfc2202_test() {
+        ASSERT_EQUAL(hmac(std::string(20, '\x0b'), "Hi There"),
+            "b617318655057264e28bc0b6fb378c8ef146be00",
+            "HMAC-SHA1 RFC 2202 test case 1");
+        ASSERT_EQUAL(hmac("Jefe", "what do ya want for nothing?"),
+            "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79",
+            "HMAC-SHA1 RFC 2202 test case 2");
+        ASSERT_EQUAL(hmac(std::string(80, '\xaa'), "Test Using Larger Than Block-Size Key - Hash Key First"),
+            "aa4ae5e15272d00e95705637ce8a3b55ed402112",
+            "HMAC-SHA1 RFC 2202 test case 6, key longer than a block");
+    }
+
+    /** Signs messages of every length across the padding boundaries, with a
+     *  mix of keys, so lanes finish at different times and get refilled.
+     */
+    static void multi_buffer_test(int impl) {
+        std::string data;
+        srand(4321);
+        for(int i = 0; i < 300; i++)
+            data.push_back((char)(rand() & 0xFF));
+
+        CHMAC_SHA1 h;
+        CHMAC_SHA1::KEY_STATE keyStates[3];
+        std::string keys[3] = { "key", std::string(64, 'k'), std::string(100, 'K') };
+        for(int k = 0; k < 3; k++)
+            h.PrepareKey((BYTE*)keys[k].data(), keys[k].size(), &keyStates[k]);
+
+        std::size_t count = data.size() + 1;
+        std::vector<const CHMAC_SHA1::KEY_STATE*> keyPtrs(count);
+        std::vector<const BYTE*> texts(count);
+        std::vector<std::size_t> lens(count);
+        std::vector<BYTE> digests(count * 20);
+        for(std::size_t i = 0; i < count; i++) {
+            // Interleave short and long messages
+            std::size_t len = (i % 2) ? i : data.size() - i;
+            keyPtrs[i] = &keyStates[i % 3];
+            texts[i] = (const BYTE*)data.data();
+            lens[i] = len;
+        }
+
+        HMAC_SHA1_MB(count, &keyPtrs[0], &texts[0], &lens[0], &digests[0], impl);
+
+        int mismatches = 0;
+        for(std::size_t i = 0; i < count; i++) {
+            BYTE expected[20];
+            h.HMAC_SHA1((BYTE*)data.data(), lens[i], keyStates[i % 3], expected);
+            if (memcmp(expected, &digests[i * 20], 20) != 0)
+                mismatches++;
+        }
+        std::stringstream msg;
+        msg << "Multi-buffer HMAC-SHA1 implementation " << impl << " should match CHMAC_SHA1";
+        ASSERT_EQUAL(mismatches, 0, msg.str());
+    }
+};
+
+}
+
+#endif
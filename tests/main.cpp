@@ -1,20 +1,58 @@
 #include <iostream>
 #include "testutil.h"
 #include "urlencode_test.h"
+#include "percent_decode_test.h"
 #include "parsekeyvaluepairs_test.h"
+#include "parameter_reader_test.h"
+#include "parameters_test.h"
 #include "request_test.h"
 #include "request_test.h"
 #include "long_request_test.h"
 #include "fast_request_test.h"
+#include "sha1_test.h"
+#include "hmac_sha1_test.h"
+#include "body_hash_test.h"
+#include "base64_test.h"
+#include "prepared_request_test.h"
+#include "signing_buffer_test.h"
+#include "clock_test.h"
+#include "verifier_test.h"
+#include "credential_cache_test.h"
+#include "async_verifier_test.h"
+#include "shared_credentials_test.h"
+#include "replay_cache_test.h"
+#include "replay_filter_test.h"
+#ifndef _WIN32
+#include "shared_nonce_store_test.h"
+#endif
 
 using namespace OAuthTest;
 
 int main(int argc, char** argv) {
     URLEncodeTest::run();
+    PercentDecodeTest::run();
     ParseKeyValuePairsTest::run();
+    ParameterReaderTest::run();
+    ParameterListTest::run();
     RequestTest::run();
     LongRequestTest::run();
     FastRequestTest::run();
+    SHA1Test::run();
+    HMACSHA1Test::run();
+    BodyHashTest::run();
+    Base64Test::run();
+    PreparedRequestTest::run();
+    SigningBufferTest::run();
+    ClockTest::run();
+    VerifierTest::run();
+    CredentialCacheTest::run();
+    AsyncVerifierTest::run();
+    SharedCredentialsTest::run();
+    ReplayCacheTest::run();
+    ReplayFilterTest::run();
+#ifndef _WIN32
+    SharedNonceStoreTest::run();
+#endif
 
     return TestUtil::summary();
 }
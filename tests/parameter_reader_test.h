@@ -0,0 +1,120 @@
+#ifndef __LIBOAUTHCPP_PARAMETER_READER_TEST_H__
+#define __LIBOAUTHCPP_PARAMETER_READER_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests reading key value pairs in place: keys and values point into the
+ *  data, url encoded data is split as ParseKeyValuePairs always has, and
+ *  Authorization header parameters may be quoted.
+ **/
+class ParameterReaderTest {
+public:
+    static void run() {
+        url_encoded_test();
+        header_test();
+        decode_test();
+        token_test();
+    }
+
+    static std::string key(const ParameterReader& reader) {
+        return std::string(reader.key(), reader.keyLength());
+    }
+
+    static std::string value(const ParameterReader& reader) {
+        return std::string(reader.value(), reader.valueLength());
+    }
+
+    static void url_encoded_test() {
+        std::string data = "foo=bar%20&baz=&foo=tar";
+        ParameterReader reader(data);
+        ASSERT_TRUE(reader.next(), "First pair should be read");
+        ASSERT_TRUE(reader.key() == data.data(), "Key should point into the data");
+        ASSERT_TRUE(reader.value() == data.data() + 4, "Value should point into the data");
+        ASSERT_EQUAL(value(reader), "bar%20", "Value should stay encoded");
+        ASSERT_TRUE(reader.keyIs("foo"), "keyIs should match the key");
+        ASSERT_FALSE(reader.keyIs("fo"), "keyIs should compare the whole key");
+        ASSERT_TRUE(reader.next(), "Second pair should be read");
+        ASSERT_EQUAL(key(reader), "baz", "Second key");
+        ASSERT_EQUAL(reader.valueLength(), 0, "Empty value");
+        ASSERT_TRUE(reader.next(), "Third pair should be read");
+        ASSERT_EQUAL(value(reader), "tar", "Last value should run to the end");
+        ASSERT_FALSE(reader.next(), "No pairs should follow the last");
+        ASSERT_FALSE(reader.next(), "Finished reader should stay finished");
+
+        ParameterReader empty("", 0);
+        ASSERT_FALSE(empty.next(), "Empty data has no pairs");
+        ParameterReader leading("&a=1");
+        ASSERT_TRUE(leading.next(), "Leading ampersand should be read");
+        ASSERT_EQUAL(key(leading), "&a", "Leading ampersand should be part of the first key");
+
+        ParameterReader trailing("foo=bar&");
+        trailing.next();
+        ASSERT_THROWS(trailing.next(), ParseError, "Ampersand followed by nothing should cause parse error");
+        ParameterReader missing("foo&bar=1");
+        ASSERT_THROWS(missing.next(), ParseError, "Pair without '=' should cause parse error");
+    }
+
+    static void header_test() {
+        std::string header = "Authorization: OAuth realm=\"Example\", oauth_consumer_key=\"a%20b\",oauth_nonce=123\t oauth_token=\"\"";
+        ParameterReader reader(header, ParameterReader::AuthorizationHeader);
+        ASSERT_TRUE(reader.next(), "Realm should be read");
+        ASSERT_EQUAL(key(reader), "realm", "Realm key");
+        ASSERT_EQUAL(value(reader), "Example", "Quotes should be left out of the value");
+        ASSERT_TRUE(reader.next(), "Quoted parameter should be read");
+        ASSERT_TRUE(reader.value() == header.data() + header.find("a%20b"), "Quoted value should point into the header");
+        ASSERT_EQUAL(value(reader), "a%20b", "Quoted value should stay encoded");
+        ASSERT_TRUE(reader.next(), "Parameter after a comma without space should be read");
+        ASSERT_EQUAL(value(reader), "123", "Unquoted value should end at whitespace");
+        ASSERT_TRUE(reader.next(), "Parameter after whitespace should be read");
+        ASSERT_EQUAL(key(reader), "oauth_token", "Last key");
+        ASSERT_EQUAL(reader.valueLength(), 0, "Empty quoted value");
+        ASSERT_FALSE(reader.next(), "No parameters should follow the last");
+
+        ParameterReader bare(" oauth ", ParameterReader::AuthorizationHeader);
+        ASSERT_FALSE(bare.next(), "Header without parameters has none");
+
+        ASSERT_THROWS(ParameterReader("Basic dXNlcg==", ParameterReader::AuthorizationHeader), ParseError,
+                      "Other schemes should cause parse error");
+        ASSERT_THROWS(ParameterReader("OAuthx a=\"1\"", ParameterReader::AuthorizationHeader), ParseError,
+                      "Scheme should be a whole word");
+        ParameterReader unterminated("OAuth a=\"1", ParameterReader::AuthorizationHeader);
+        ASSERT_THROWS(unterminated.next(), ParseError, "Unterminated quote should cause parse error");
+        ParameterReader missing("OAuth a, b=\"1\"", ParameterReader::AuthorizationHeader);
+        ASSERT_THROWS(missing.next(), ParseError, "Parameter without '=' should cause parse error");
+    }
+
+    static void decode_test() {
+        ParameterReader reader("a%2Bb=c%20d&bad=%2");
+        reader.next();
+        std::string decoded = "x";
+        ASSERT_TRUE(reader.decodeKey(decoded), "Key should decode");
+        ASSERT_EQUAL(decoded, "xa+b", "Decoded key should be appended");
+        decoded.clear();
+        ASSERT_TRUE(reader.decodeValue(decoded), "Value should decode");
+        ASSERT_EQUAL(decoded, "c d", "Decoded value");
+        reader.next();
+        ASSERT_FALSE(reader.decodeValue(decoded), "Truncated escape shouldn't decode");
+    }
+
+    static void token_test() {
+        Token token = Token::extract("oauth_token_secret=s%20t&oauth_token=key&oauth_token=other");
+        ASSERT_EQUAL(token.key(), "key", "First token should be used");
+        ASSERT_EQUAL(token.secret(), "s%20t", "Secret should stay encoded");
+        Token fromPairs = Token::extract(ParseKeyValuePairs("oauth_token_secret=s%20t&oauth_token=key"));
+        ASSERT_EQUAL(fromPairs.secret(), token.secret(), "Both extracts should agree");
+
+        ASSERT_THROWS(Token::extract("oauth_token=key"), MissingKeyError, "Missing secret should throw");
+        ASSERT_THROWS(Token::extract("oauth_token_secret=s"), MissingKeyError, "Missing token should throw");
+        ASSERT_THROWS(Token::extract("oauth_token=key&oauth_token_secret=s&x"), ParseError,
+                      "Malformed response should throw even after both keys");
+    }
+};
+
+}
+
+#endif
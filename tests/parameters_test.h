@@ -0,0 +1,137 @@
+#ifndef __LIBOAUTHCPP_PARAMETERS_TEST_H__
+#define __LIBOAUTHCPP_PARAMETERS_TEST_H__
+
+#include "testutil.h"
+#include "../src/parameters.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace OAuthTest {
+
+/** Tests the flat parameter list requests are signed from, mainly that it
+ *  sorts exactly like the key=value strings it replaces.
+ **/
+class ParameterListTest {
+public:
+    static void run() {
+        sort_order_test();
+        set_test();
+        set_sorted_test();
+        erase_test();
+        parse_test();
+    }
+
+    static std::vector<std::string> joined(const OAuth::ParameterList& params) {
+        std::vector<std::string> result;
+        for(std::size_t i = 0; i < params.size(); i++)
+            result.push_back(std::string(params.key(i), params.keyLength(i)) + "=" +
+                             std::string(params.value(i), params.valueLength(i)));
+        return result;
+    }
+
+    static void sort_order_test() {
+        // Keys that are prefixes of each other, duplicate keys, empty keys and
+        // values, and characters sorting either side of '='
+        const char* pairs[][2] = {
+            { "page", "2" }, { "page_size", "10" }, { "page", "10" }, { "pag", "e" },
+            { "a", "" }, { "", "x" }, { "a%20b", "1" }, { "a", "%3D" }, { "a-", "1" },
+            { "a~", "1" }, { "a", "b" }, { "oauth_token", "t" }, { "oauth_token_secret", "s" },
+            { "z", "\xff" }, { "z", "a" }, { "page", "10" }
+        };
+
+        OAuth::ParameterList params;
+        std::vector<std::string> expected;
+        for(std::size_t i = 0; i < sizeof(pairs)/sizeof(pairs[0]); i++) {
+            params.add(pairs[i][0], pairs[i][1]);
+            expected.push_back(std::string(pairs[i][0]) + "=" + pairs[i][1]);
+        }
+        std::sort(expected.begin(), expected.end());
+        params.sort();
+        ASSERT_TRUE(joined(params) == expected, "Parameters should sort like key=value strings");
+
+        // Random keys from a small alphabet so prefixes and duplicates are common
+        srand(8);
+        for(int round = 0; round < 50; round++) {
+            OAuth::ParameterList random;
+            expected.clear();
+            for(int i = 0; i < 40; i++) {
+                std::string key, value;
+                for(int n = rand() % 4; n > 0; n--) key += "ab_-"[rand() % 4];
+                for(int n = rand() % 3; n > 0; n--) value += "ab%="[rand() % 4];
+                random.add(key, value);
+                expected.push_back(key + "=" + value);
+            }
+            std::sort(expected.begin(), expected.end());
+            random.sort();
+            ASSERT_TRUE(joined(random) == expected, "Random parameters should sort like key=value strings");
+        }
+    }
+
+    static void set_test() {
+        OAuth::ParameterList params;
+        params.add("foo", "bar");
+        params.set("oauth_nonce", "12345");
+        params.set("oauth_nonce", "1");
+        ASSERT_EQUAL(params.size(), 2, "Setting a key twice should add one entry");
+        std::size_t idx = params.find("oauth_nonce");
+        ASSERT_TRUE(idx != OAuth::ParameterList::npos, "Set key should be found");
+        ASSERT_EQUAL(std::string(params.value(idx), params.valueLength(idx)), "1", "Shorter value should replace the old one");
+        params.set("oauth_nonce", "1234567");
+        ASSERT_EQUAL(std::string(params.value(idx), params.valueLength(idx)), "1234567", "Longer value should replace the old one");
+        ASSERT_EQUAL(std::string(params.value(0), params.valueLength(0)), "bar", "Other values should be untouched");
+        ASSERT_TRUE(params.find("missing") == OAuth::ParameterList::npos, "Missing key should not be found");
+    }
+
+    static void set_sorted_test() {
+        OAuth::ParameterList params;
+        params.add("a", "1");
+        params.add("oauth_nonce", "2");
+        params.add("oauth_timestamp", "3");
+        params.add("z", "4");
+        params.sort();
+        params.setSorted("oauth_signature", "sig");
+        params.setSorted("oauth_signature_method", "HMAC-SHA1");
+        params.setSorted("b", "5");
+        params.setSorted("oauth_nonce", "6");
+
+        OAuth::ParameterList expected;
+        expected.add("a", "1");
+        expected.add("b", "5");
+        expected.add("oauth_nonce", "6");
+        expected.add("oauth_signature", "sig");
+        expected.add("oauth_signature_method", "HMAC-SHA1");
+        expected.add("oauth_timestamp", "3");
+        expected.add("z", "4");
+        ASSERT_TRUE(joined(params) == joined(expected), "setSorted should keep parameters sorted");
+    }
+
+    static void erase_test() {
+        OAuth::ParameterList params;
+        params.add("a", "1");
+        params.add("oauth_signature", "sig");
+        params.add("z", "2");
+        params.erase(1);
+        params.setSorted("b", "3");
+
+        OAuth::ParameterList expected;
+        expected.add("a", "1");
+        expected.add("b", "3");
+        expected.add("z", "2");
+        ASSERT_TRUE(joined(params) == joined(expected), "erase should keep the other parameters in order");
+    }
+
+    static void parse_test() {
+        OAuth::ParameterList params;
+        std::string url = "http://example.com/path?a=1&b=2&a=";
+        params.parse(url, url.find('?') + 1);
+        std::vector<std::string> pairs = joined(params);
+        ASSERT_EQUAL(pairs.size(), 3, "Query string parameters should be parsed from an offset");
+        ASSERT_EQUAL(std::count(pairs.begin(), pairs.end(), "a=1") + std::count(pairs.begin(), pairs.end(), "a="), 2,
+                     "Repeated key should be kept twice");
+        ASSERT_THROWS(params.parse(std::string("x=1&y")), OAuth::ParseError, "Pair without '=' should cause parse error");
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef __LIBOAUTHCPP_PERCENT_DECODE_TEST_H__
+#define __LIBOAUTHCPP_PERCENT_DECODE_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests PercentDecode and PercentDecodeInPlace: escapes are decoded in
+ *  either case, malformed escapes fail or are kept depending on the mode,
+ *  and long strings through the vectorized paths match a simple decoder.
+ **/
+class PercentDecodeTest {
+public:
+    static void run() {
+        decode_test();
+        malformed_test();
+        in_place_test();
+        long_string_decode_test();
+    }
+
+    static void decode_test() {
+        ASSERT_EQUAL(PercentDecode(""), "", "Empty string should decode to itself");
+        ASSERT_EQUAL(PercentDecode("abc-._~"), "abc-._~", "Unescaped text should decode to itself");
+        ASSERT_EQUAL(PercentDecode("a%20b%2fc%2F"), "a b/c/", "Escapes should decode in either case");
+        ASSERT_EQUAL(PercentDecode("a+b"), "a+b", "'+' should be left alone");
+        ASSERT_EQUAL(PercentDecode("%00"), std::string(1, '\0'), "NUL should decode");
+        ASSERT_EQUAL(PercentDecode("%FF%2541"), "\xFF%41", "Decoded '%' shouldn't start another escape");
+        for(int c = 0; c < 256; c++) {
+            std::string s(1, (char)c);
+            ASSERT_EQUAL(PercentDecode(PercentEncode(s)), s, "Every byte should survive encoding and decoding");
+        }
+    }
+
+    static void malformed_test() {
+        ASSERT_THROWS(PercentDecode("%"), ParseError, "Lone '%' should be malformed");
+        ASSERT_THROWS(PercentDecode("a%2"), ParseError, "Truncated escape should be malformed");
+        ASSERT_THROWS(PercentDecode("%G0"), ParseError, "Non-hex digit should be malformed");
+        ASSERT_THROWS(PercentDecode("%0g"), ParseError, "Non-hex second digit should be malformed");
+        ASSERT_EQUAL(PercentDecode("%", DecodeLenient), "%", "Lenient should keep a lone '%'");
+        ASSERT_EQUAL(PercentDecode("a%2", DecodeLenient), "a%2", "Lenient should keep a truncated escape");
+        ASSERT_EQUAL(PercentDecode("%%41%G0", DecodeLenient), "%A%G0", "Lenient should decode the valid escapes");
+    }
+
+    static void in_place_test() {
+        char data[] = "x%3Dy%26z=%41";
+        std::size_t length = PercentDecodeInPlace(data, sizeof(data) - 1);
+        ASSERT_EQUAL(std::string(data, length), "x=y&z=A", "In place decode should write over the data");
+
+        char bad[] = "ok%2";
+        ASSERT_THROWS(PercentDecodeInPlace(bad, sizeof(bad) - 1), ParseError, "Strict in place decode should throw");
+        char lenient[] = "%zz%7E";
+        length = PercentDecodeInPlace(lenient, sizeof(lenient) - 1, DecodeLenient);
+        ASSERT_EQUAL(std::string(lenient, length), "%zz~", "Lenient in place decode should keep malformed escapes");
+    }
+
+    static std::string reference_decode(const std::string& s) {
+        std::string result;
+        for(std::size_t i = 0; i < s.size(); i++) {
+            if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2])) {
+                result += (char)strtol(s.substr(i + 1, 2).c_str(), NULL, 16);
+                i += 2;
+            }
+            else {
+                result += s[i];
+            }
+        }
+        return result;
+    }
+
+    // Strings long enough to go through the vectorized paths, with an
+    // escape, a malformed escape and a lone '%' at every offset of a 32 byte
+    // chunk and in the tail, decoded both copying and in place. The string
+    // ends in an escape, so the last chunk is never copied whole.
+    static void long_string_decode_test() {
+        std::string base = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-._~~._-9876543210";
+        const char* inserts[] = { "%41", "%4", "%", "%%2f" };
+        for(std::size_t n = 0; n < sizeof(inserts) / sizeof(inserts[0]); n++) {
+            for(std::size_t pos = 0; pos <= base.size(); pos++) {
+                std::string s = base + "%7e";
+                s.insert(pos, inserts[n]);
+                std::string expected = reference_decode(s);
+                std::stringstream msg;
+                msg << "'" << inserts[n] << "' at offset " << pos << " of a long string";
+
+                ASSERT_EQUAL(PercentDecode(s, DecodeLenient), expected, msg.str() + " should decode");
+                std::string inPlace = s;
+                std::size_t length = PercentDecodeInPlace(&inPlace[0], inPlace.size(), DecodeLenient);
+                ASSERT_EQUAL(inPlace.substr(0, length), expected, msg.str() + " should decode in place");
+                if (n == 0)
+                    ASSERT_EQUAL(PercentDecode(s), expected, msg.str() + " should decode strictly");
+            }
+        }
+    }
+};
+
+}
+
+#endif
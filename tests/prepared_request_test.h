@@ -0,0 +1,83 @@
+#ifndef __LIBOAUTHCPP_PREPARED_REQUEST_TEST_H__
+#define __LIBOAUTHCPP_PREPARED_REQUEST_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests that prepared requests sign exactly like the equivalent one-off
+ *  requests.
+ **/
+class PreparedRequestTest {
+public:
+    static void run() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa", "1234");
+
+        Client::__resetInitialize();
+        Client::initialize(100, 1390268986);
+        OAuth::Client oauth(&consumer, &token);
+        OAuth::Client consumerOnly(&consumer);
+
+        matches_test(oauth, Http::Get, "http://api.example.com/1/statuses/home_timeline.json", "", "", false);
+        matches_test(oauth, Http::Get, "http://api.example.com/1/statuses/home_timeline.json?count=200&trim_user=true", "", "cursor=1234", false);
+        matches_test(oauth, Http::Get, "http://api.example.com/1/search.json?q=a%20b&lang=en", "", "page=2&since_id=5", false);
+        matches_test(oauth, Http::Post, "http://api.example.com/1/statuses/update.json", "status=Hello%20Ladies%20%2b%20Gentlemen&trim_user=true", "in_reply_to=9", false);
+        // Dynamic parameters with the same key as static ones and each other
+        matches_test(oauth, Http::Get, "http://api.example.com/1/list.json?id=5&id=1", "", "id=3&id=0&a=z", false);
+        // Dynamic parameters sorting between the OAuth parameters
+        matches_test(oauth, Http::Get, "http://api.example.com/1/list.json", "", "oauth_n=1&oauth_z=2&oauth_=3", false);
+        matches_test(oauth, Http::Post, "http://api.example.com/oauth/access_token", "", "", true);
+        matches_test(consumerOnly, Http::Get, "http://api.example.com/1/users/show.json?screen_name=x", "", "include_entities=1", false);
+
+        repeated_test(oauth);
+    }
+
+    static void matches_test(const OAuth::Client& oauth, Http::RequestType eType, const std::string& url,
+                             const std::string& staticData, const std::string& dynamicData, bool pin) {
+        std::string data = staticData;
+        if (data.length() && dynamicData.length())
+            data += "&";
+        data += dynamicData;
+
+        PreparedRequest prepared = oauth.prepare(eType, url, staticData, pin);
+        ASSERT_EQUAL(
+            oauth.getHttpHeader(prepared, dynamicData),
+            oauth.getHttpHeader(eType, url, data, pin),
+            "Prepared request header should match for " + url + " " + dynamicData
+        );
+        ASSERT_EQUAL(
+            oauth.getFormattedHttpHeader(prepared, dynamicData),
+            oauth.getFormattedHttpHeader(eType, url, data, pin),
+            "Prepared request formatted header should match for " + url + " " + dynamicData
+        );
+        ASSERT_EQUAL(
+            oauth.getURLQueryString(prepared, dynamicData),
+            oauth.getURLQueryString(eType, url, data, pin),
+            "Prepared request query string should match for " + url + " " + dynamicData
+        );
+    }
+
+    /** Signing must not change the prepared request. */
+    static void repeated_test(const OAuth::Client& oauth) {
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json?count=200";
+        PreparedRequest prepared = oauth.prepare(Http::Get, url);
+        PreparedRequest copy(prepared);
+        for(int cursor = 0; cursor < 3; cursor++) {
+            std::stringstream dynamicData;
+            dynamicData << "cursor=" << cursor;
+            ASSERT_EQUAL(
+                oauth.getURLQueryString(copy, dynamicData.str()),
+                oauth.getURLQueryString(Http::Get, url + "&" + dynamicData.str()),
+                "Prepared request should sign the same each time"
+            );
+        }
+    }
+};
+
+}
+
+#endif
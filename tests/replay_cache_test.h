@@ -0,0 +1,164 @@
+#ifndef __LIBOAUTHCPP_REPLAY_CACHE_TEST_H__
+#define __LIBOAUTHCPP_REPLAY_CACHE_TEST_H__
+
+#include "testutil.h"
+#include "verifier_test.h"
+#include <liboauthcpp/liboauthcpp.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests recording nonces: replays are caught, other requests aren't
+ *  mistaken for them, and seconds are reused as the window moves on.
+ **/
+class ReplayCacheTest {
+public:
+    static void run() {
+        replay_test();
+        window_test();
+        bounded_test();
+        verifier_test();
+#ifndef _WIN32
+        threaded_test();
+#endif
+    }
+
+    static void replay_test() {
+        ReplayCache cache(300, 4);
+        ASSERT_TRUE(cache.insert("consumer", "token", "nonce", 1000), "First request should be recorded");
+        ASSERT_FALSE(cache.insert("consumer", "token", "nonce", 1000), "Same request should be a replay");
+        ASSERT_TRUE(cache.insert("consumer", "token", "nonce", 1001), "Same nonce at another time should be recorded");
+        ASSERT_TRUE(cache.insert("consumer", "", "nonce", 1000), "Same nonce without token should be recorded");
+        ASSERT_TRUE(cache.insert("other", "token", "nonce", 1000), "Same nonce for another consumer should be recorded");
+        ASSERT_TRUE(cache.insert("consumer", "token", "nonce2", 1000), "Another nonce should be recorded");
+        // Fields that only differ in where one ends and the next starts
+        ASSERT_TRUE(cache.insert("consumer", "tok", "ennonce", 1000), "Moved field boundary should be recorded");
+        ASSERT_FALSE(cache.insert("consumer", "tok", "ennonce", 1000), "Moved field boundary should be a replay");
+        std::size_t size = cache.size();
+        ASSERT_EQUAL(size, 6, "Cache should hold the recorded nonces");
+    }
+
+    static void window_test() {
+        // 2*2+2 = 6 seconds in the wheel
+        ReplayCache cache(2, 1);
+        ASSERT_TRUE(cache.insert("consumer", "token", "a", 100), "First request should be recorded");
+        ASSERT_TRUE(cache.insert("consumer", "token", "b", 105), "Request in the window should be recorded");
+        ASSERT_FALSE(cache.insert("consumer", "token", "a", 100), "Request in the window should be a replay");
+
+        ASSERT_TRUE(cache.insert("consumer", "token", "c", 106), "Request reusing a second should be recorded");
+        ASSERT_FALSE(cache.insert("consumer", "token", "c", 106), "Request in a reused second should be a replay");
+        ASSERT_FALSE(cache.insert("consumer", "token", "d", 100), "Request from a reused second should be refused");
+        ASSERT_TRUE(cache.insert("consumer", "token", "a", 107), "Nonce from an expired second should be recorded");
+        std::size_t size = cache.size();
+        ASSERT_EQUAL(size, 3, "Reused seconds should be emptied");
+    }
+
+    static void bounded_test() {
+        ReplayCache cache(5, 8);
+        // A burst fills one second, then a steady trickle for a long time
+        for(int i = 0; i < 20000; i++)
+            cache.insert("consumer", "token", nonce(i), 1000);
+        std::size_t burst = cache.memoryUsage();
+        bool recorded = true;
+        for(int t = 1001; t < 1200; t++) {
+            for(int i = 0; i < 50; i++)
+                recorded = recorded && cache.insert("consumer", "token", nonce(i), t);
+        }
+        ASSERT_TRUE(recorded, "Requests at new times should be recorded");
+        std::size_t size = cache.size();
+        ASSERT_EQUAL(size, 12 * 50, "Cache should only hold the window");
+        std::size_t memory = cache.memoryUsage();
+        ASSERT_TRUE(memory < burst, "Memory left by a burst should be returned");
+    }
+
+    static void verifier_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        VerifierTest::MapSecretStore secrets;
+        secrets.addConsumer(consumer.key(), consumer.secret());
+        secrets.addToken(consumer.key(), token.key(), token.secret());
+
+        FixedClock clock(1390268986);
+        FixedNonceSource nonce(100);
+        OAuth::Client oauth(&consumer, &token);
+        oauth.setClock(&clock);
+        oauth.setNonceSource(&nonce);
+
+        ReplayCache cache;
+        Verifier verifier(&secrets);
+        verifier.setClock(&clock);
+        verifier.setNonceStore(&cache);
+
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json";
+        std::string header = oauth.getHttpHeader(Http::Get, url);
+        // Results are kept first: each verify changes the store
+        Verification::Result forged = verifier.verify(Http::Get, url + "?x=1", header);
+        Verification::Result first = verifier.verify(Http::Get, url, header);
+        Verification::Result replayed = verifier.verify(Http::Get, url, header);
+        ASSERT_EQUAL(forged, Verification::InvalidSignature, "Changed request should not verify");
+        ASSERT_EQUAL(first, Verification::Valid, "Request should verify after a forgery with its nonce");
+        ASSERT_EQUAL(replayed, Verification::Replayed, "Repeated request should be a replay");
+
+        nonce.set(101);
+        Verification::Result fresh = verifier.verify(Http::Get, url, oauth.getHttpHeader(Http::Get, url));
+        ASSERT_EQUAL(fresh, Verification::Valid, "Request with a new nonce should verify");
+
+        verifier.setNonceStore(NULL);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, header), Verification::Valid, "Replays should verify without a store");
+    }
+
+#ifndef _WIN32
+    struct Inserter {
+        ReplayCache* cache;
+        int first;
+        int recorded;
+    };
+
+    static void* insert_thread(void* arg) {
+        Inserter* inserter = (Inserter*)arg;
+        inserter->recorded = 0;
+        // Each thread's range overlaps the next one's by half
+        for(int i = inserter->first; i < inserter->first + 2000; i++) {
+            if (inserter->cache->insert("consumer", "token", nonce(i), 1000 + i % 3))
+                inserter->recorded++;
+        }
+        return NULL;
+    }
+
+    /** Threads recording overlapping nonces at once should record each
+     *  exactly once between them.
+     */
+    static void threaded_test() {
+        const int nthreads = 4;
+        ReplayCache cache(300, 4);
+        Inserter inserters[nthreads];
+        pthread_t ids[nthreads];
+        for(int t = 0; t < nthreads; t++) {
+            inserters[t].cache = &cache;
+            inserters[t].first = t * 1000;
+            int err = pthread_create(&ids[t], NULL, insert_thread, &inserters[t]);
+            ASSERT_EQUAL(err, 0, "Start inserting thread");
+        }
+        int recorded = 0;
+        for(int t = 0; t < nthreads; t++) {
+            pthread_join(ids[t], NULL);
+            recorded += inserters[t].recorded;
+        }
+        ASSERT_EQUAL(recorded, (nthreads + 1) * 1000, "Each nonce should be recorded once");
+    }
+#endif
+
+    static std::string nonce(int i) {
+        std::stringstream s;
+        s << "nonce" << i;
+        return s.str();
+    }
+};
+
+}
+
+#endif
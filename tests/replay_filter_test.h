@@ -0,0 +1,138 @@
+#ifndef __LIBOAUTHCPP_REPLAY_FILTER_TEST_H__
+#define __LIBOAUTHCPP_REPLAY_FILTER_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <set>
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests the probabilistic nonce store: replays are never missed, false
+ *  positives stay near the configured rate and are resolved by the
+ *  history, and filters are rotated with the window.
+ **/
+class ReplayFilterTest {
+public:
+    class SetNonceHistory : public NonceHistory {
+    public:
+        void add(const std::string& nonce, time_t timestamp) {
+            mSeen.insert(key(nonce, timestamp));
+        }
+        virtual bool seen(const std::string& consumerKey, const std::string& token,
+                          const std::string& nonce, time_t timestamp) const {
+            return mSeen.count(key(nonce, timestamp)) != 0;
+        }
+    private:
+        static std::string key(const std::string& nonce, time_t timestamp) {
+            std::stringstream s;
+            s << nonce << "@" << timestamp;
+            return s.str();
+        }
+        std::set<std::string> mSeen;
+    };
+
+    static void run() {
+        replay_test();
+        false_positive_test();
+        history_test();
+        window_test();
+        memory_test();
+    }
+
+    static std::string nonce(int i) {
+        std::stringstream s;
+        s << "nonce" << i;
+        return s.str();
+    }
+
+    static void replay_test() {
+        ReplayFilter filter(300, 1000, 0.001, NULL, 4);
+        int recorded = 0, replayed = 0;
+        for(int i = 0; i < 1000; i++)
+            recorded += filter.insert("consumer", "token", nonce(i), 1000 + i % 7);
+        for(int i = 0; i < 1000; i++)
+            replayed += !filter.insert("consumer", "token", nonce(i), 1000 + i % 7);
+        ASSERT_TRUE(recorded > 990, "New requests should be recorded");
+        ASSERT_EQUAL(replayed, 1000, "Every replay should be caught");
+        ASSERT_TRUE(filter.insert("consumer", "token", nonce(0), 999), "Same nonce at another time should be recorded");
+    }
+
+    /** Filled at the expected rate, new requests should be refused at about
+     *  the configured rate, and about the rate the filter estimates.
+     */
+    static void false_positive_test() {
+        const int rate = 5000;
+        ReplayFilter filter(5, rate, 0.01, NULL, 4);
+        int refused = 0, total = 0;
+        for(int t = 1000; t < 1011; t++) {
+            for(int i = 0; i < rate; i++, total++)
+                refused += !filter.insert("consumer", "token", nonce(i), t);
+        }
+        // Probe the full filters with more new requests, spread over them
+        // so that each goes only a fifth over the expected rate. Fewer
+        // probes leave too few false positives to compare the estimate to.
+        int lastRefused = 0;
+        const int probes = 10000;
+        for(int i = 0; i < probes; i++)
+            lastRefused += !filter.insert("consumer", "token", nonce(i + rate), 1001 + i % 10);
+        double measured = (double)lastRefused / probes;
+        double estimated = filter.falsePositiveRate();
+        ASSERT_TRUE(measured < 0.025, "False positive rate should be near the configured one");
+        ASSERT_TRUE(estimated > measured / 3 && estimated < measured * 3 + 0.001, "Estimated false positive rate should be near the measured one");
+        std::size_t suspected = filter.suspectedReplays();
+        ASSERT_EQUAL(suspected, (std::size_t)(refused + lastRefused), "Suspected replays should be counted");
+    }
+
+    /** With a history, false positives are let in and replays still aren't. */
+    static void history_test() {
+        SetNonceHistory history;
+        // A tiny filter, so most new requests are suspected
+        ReplayFilter filter(5, 10, 0.2, &history, 1);
+        int recorded = 0, replayed = 0;
+        for(int i = 0; i < 2000; i++) {
+            bool inserted = filter.insert("consumer", "token", nonce(i), 1000);
+            recorded += inserted;
+            history.add(nonce(i), 1000);
+        }
+        for(int i = 0; i < 2000; i++)
+            replayed += !filter.insert("consumer", "token", nonce(i), 1000);
+        ASSERT_EQUAL(recorded, 2000, "New requests should be let in by the history");
+        ASSERT_EQUAL(replayed, 2000, "Replays should be caught with a history");
+        std::size_t suspected = filter.suspectedReplays();
+        std::size_t falsePositives = filter.falsePositives();
+        ASSERT_TRUE(falsePositives > 1000, "Filter should have suspected new requests");
+        ASSERT_EQUAL(suspected, falsePositives + 2000, "Suspected replays should be counted");
+    }
+
+    static void window_test() {
+        // One second per filter, and 2*2+1+1 = 6 filters
+        ReplayFilter filter(2, 100, 0.001, NULL, 1);
+        ASSERT_TRUE(filter.insert("consumer", "token", "a", 100), "First request should be recorded");
+        ASSERT_TRUE(filter.insert("consumer", "token", "b", 105), "Request in the window should be recorded");
+        ASSERT_FALSE(filter.insert("consumer", "token", "a", 100), "Request in the window should be a replay");
+        ASSERT_TRUE(filter.insert("consumer", "token", "c", 106), "Request rotating a filter should be recorded");
+        ASSERT_FALSE(filter.insert("consumer", "token", "d", 100), "Request from a rotated filter should be refused");
+        ASSERT_FALSE(filter.insert("consumer", "token", "c", 106), "Request in a rotated filter should be a replay");
+    }
+
+    static void memory_test() {
+        const int rate = 2000;
+        ReplayCache cache(30, 4);
+        ReplayFilter filter(30, rate, 0.01, NULL, 4);
+        for(int t = 1000; t < 1080; t++) {
+            for(int i = 0; i < rate; i++) {
+                cache.insert("consumer", "token", nonce(i), t);
+                filter.insert("consumer", "token", nonce(i), t);
+            }
+        }
+        std::size_t cacheBytes = cache.memoryUsage();
+        std::size_t filterBytes = filter.memoryUsage();
+        ASSERT_TRUE(filterBytes * 8 < cacheBytes, "Filter should take much less memory than the exact cache");
+    }
+};
+
+}
+
+#endif
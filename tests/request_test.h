@@ -86,6 +86,84 @@ public:
             "a=2&l=-74%2C40%2C-73%2C41&oauth_consumer_key=wwwwxxxxyyyyzzzz&oauth_nonce=139026898664&oauth_signature=QXyCmnX%2FL3OR6wQ9HpZGrTk7ZG0%3D&oauth_signature_method=HMAC-SHA1&oauth_timestamp=1390268986&oauth_token=aaaabbbbccccdddd&oauth_version=1.0&z=1",
             "Validate simple POST request with sub-delimiter character ','"
         );
+
+        signing_key_test();
+        batch_test();
+    }
+
+    /** Batch signing should match signing each request separately. */
+    static void batch_test() {
+        std::string consumer_key = "wwwwxxxxyyyyzzzz";
+        std::string consumer_secret = "zzzzyyyyxxxxwwww";
+        OAuth::Consumer consumer(consumer_key, consumer_secret);
+
+        std::string oauth_token = "aaaabbbbccccdddd";
+        std::string oauth_token_secret = "ddddccccbbbbaaaa";
+        OAuth::Token token(oauth_token, oauth_token_secret, "1234");
+
+        Client::__resetInitialize();
+        Client::initialize(100, 1390268986);
+        OAuth::Client oauth(&consumer, &token);
+
+        OAuth::RequestList requests;
+        requests.push_back(OAuth::Request(OAuth::Http::Get, "resource"));
+        requests.push_back(OAuth::Request(OAuth::Http::Post, "resource?z=1&a=2&d=baz", "x=%20y"));
+        requests.push_back(OAuth::Request(OAuth::Http::Put, "resource?arg=" + std::string(500, 'x')));
+        requests.push_back(OAuth::Request(OAuth::Http::Delete, "resource", "", true));
+        for(int i = 0; i < 20; i++)
+            requests.push_back(OAuth::Request(OAuth::Http::Head, "resource?arg=" + std::string(i * 7, 'y')));
+
+        std::vector<std::string> queries = oauth.getURLQueryStrings(requests);
+        std::vector<std::string> headers = oauth.getHttpHeaders(requests);
+        ASSERT_EQUAL(queries.size(), requests.size(), "Batch should return one query string per request");
+        ASSERT_EQUAL(headers.size(), requests.size(), "Batch should return one header per request");
+        for(std::size_t i = 0; i < requests.size() && i < queries.size() && i < headers.size(); i++) {
+            const OAuth::Request& r = requests[i];
+            ASSERT_EQUAL(queries[i], oauth.getURLQueryString(r.eType, r.rawUrl, r.rawData, r.includeOAuthVerifierPin),
+                "Batch query string should match single request query string");
+            ASSERT_EQUAL(headers[i], oauth.getHttpHeader(r.eType, r.rawUrl, r.rawData, r.includeOAuthVerifierPin),
+                "Batch header should match single request header");
+        }
+    }
+
+    /** Checks the precomputed signing key: secrets longer than a SHA1 block
+     *  are hashed down first, and copies of a Client sign identically.
+     */
+    static void signing_key_test() {
+        std::string consumer_key = "wwwwxxxxyyyyzzzz";
+        std::string consumer_secret(100, 'z');
+        OAuth::Consumer consumer(consumer_key, consumer_secret);
+
+        std::string oauth_token = "aaaabbbbccccdddd";
+        std::string oauth_token_secret = "ddddccccbbbbaaaa";
+        OAuth::Token token(oauth_token, oauth_token_secret);
+
+        Client::__resetInitialize();
+        Client::initialize(100, 1390268986);
+        OAuth::Client oauth(&consumer, &token);
+
+        std::string expected = "oauth_consumer_key=wwwwxxxxyyyyzzzz&oauth_nonce=139026898664&oauth_signature=qQd4j8qykfslR%2BAgMjdTkcKCWhM%3D&oauth_signature_method=HMAC-SHA1&oauth_timestamp=1390268986&oauth_token=aaaabbbbccccdddd&oauth_version=1.0";
+        ASSERT_EQUAL(
+            oauth.getURLQueryString(OAuth::Http::Get, "resource"),
+            expected,
+            "Validate GET request signature with a consumer secret longer than one SHA1 block"
+        );
+
+        OAuth::Client copied(oauth);
+        ASSERT_EQUAL(
+            copied.getURLQueryString(OAuth::Http::Get, "resource"),
+            expected,
+            "Copied client should sign with the same key"
+        );
+
+        OAuth::Consumer other_consumer(consumer_key, "zzzzyyyyxxxxwwww");
+        OAuth::Client assigned(&other_consumer, &token);
+        assigned = oauth;
+        ASSERT_EQUAL(
+            assigned.getURLQueryString(OAuth::Http::Get, "resource"),
+            expected,
+            "Assigned client should sign with the assigned key"
+        );
     }
 };
 
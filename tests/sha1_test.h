@@ -0,0 +1,155 @@
+#ifndef __LIBOAUTHCPP_SHA1_TEST_H__
+#define __LIBOAUTHCPP_SHA1_TEST_H__
+
+#include "testutil.h"
+#include "../src/SHA1.h"
+#include <cstdlib>
+#include <algorithm>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace OAuthTest {
+
+/** Tests each SHA1 block transform the CPU supports against the FIPS PUB 180-1
+ *  test vectors and against the scalar transform, and that the transform
+ *  can be switched while other threads hash.
+ **/
+class SHA1Test {
+public:
+    static void run() {
+        int impls[] = {
+            CSHA1::TRANSFORM_SCALAR,
+            CSHA1::TRANSFORM_SSSE3,
+            CSHA1::TRANSFORM_AVX2,
+            CSHA1::TRANSFORM_SHANI
+        };
+        int original = CSHA1::GetTransform();
+        for(std::size_t i = 0; i < sizeof(impls)/sizeof(impls[0]); i++) {
+            if (!CSHA1::SetTransform(impls[i])) continue;
+            fips_vectors_test(impls[i]);
+            matches_scalar_test(impls[i]);
+        }
+        CSHA1::SetTransform(original);
+#ifndef _WIN32
+        concurrent_select_test(impls, sizeof(impls)/sizeof(impls[0]));
+        CSHA1::SetTransform(original);
+#endif
+    }
+
+    static std::string hex_digest(CSHA1& sha) {
+        char report[128] = "";
+        sha.ReportHash(report, CSHA1::REPORT_HEX);
+        return report;
+    }
+
+    static std::string hash(const std::string& data) {
+        CSHA1 sha;
+        sha.Update((const UINT_8*)data.data(), data.size());
+        sha.Final();
+        return hex_digest(sha);
+    }
+
+    static void fips_vectors_test(int impl) {
+        std::stringstream impl_str;
+        impl_str << " (transform " << impl << ")";
+
+        ASSERT_EQUAL(
+            hash("abc"),
+            "A9 99 3E 36 47 06 81 6A BA 3E 25 71 78 50 C2 6C 9C D0 D8 9D",
+            "SHA1(\"abc\") should match FIPS 180-1" + impl_str.str()
+        );
+        ASSERT_EQUAL(
+            hash("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+            "84 98 3E 44 1C 3B D2 6E BA AE 4A A1 F9 51 29 E5 E5 46 70 F1",
+            "SHA1 of the two block message should match FIPS 180-1" + impl_str.str()
+        );
+
+        // Feed the million a's in uneven pieces so buffered, single block
+        // and multi-block updates are all exercised.
+        std::string as(1000, 'a');
+        CSHA1 sha;
+        std::size_t fed = 0, step = 1;
+        while(fed < 1000000) {
+            std::size_t n = std::min(step, std::min(as.size(), 1000000 - fed));
+            sha.Update((const UINT_8*)as.data(), n);
+            fed += n;
+            step = (step * 7 + 3) % 1000 + 1;
+        }
+        sha.Final();
+        ASSERT_EQUAL(
+            hex_digest(sha),
+            "34 AA 97 3C D4 C4 DA A4 F6 1E EB 2B DB AD 27 31 65 34 01 6F",
+            "SHA1 of a million a's should match FIPS 180-1" + impl_str.str()
+        );
+    }
+
+    static void matches_scalar_test(int impl) {
+        std::string data;
+        srand(1234);
+        for(int i = 0; i < 1100; i++)
+            data.push_back((char)(rand() & 0xFF));
+
+        for(std::size_t len = 0; len <= data.size(); len += 37) {
+            CSHA1::SetTransform(impl);
+            std::string simd = hash(data.substr(0, len));
+            CSHA1::SetTransform(CSHA1::TRANSFORM_SCALAR);
+            std::string scalar = hash(data.substr(0, len));
+
+            std::stringstream msg;
+            msg << "Transform " << impl << " should match the scalar transform for " << len << " bytes";
+            ASSERT_EQUAL(simd, scalar, msg.str());
+        }
+        CSHA1::SetTransform(impl);
+    }
+
+#ifndef _WIN32
+    struct Hasher {
+        std::string expected;
+        volatile int* stop;
+        int hashes;
+        int mismatches;
+    };
+
+    static void* hash_thread(void* arg) {
+        Hasher& hasher = *(Hasher*)arg;
+        std::string data(1000, 'x');
+        while (!__sync_fetch_and_add(hasher.stop, 0) || hasher.hashes < 100) {
+            if (hash(data) != hasher.expected)
+                hasher.mismatches++;
+            hasher.hashes++;
+        }
+        return NULL;
+    }
+
+    /** Threads hash while the main thread keeps selecting transforms. */
+    static void concurrent_select_test(const int* impls, std::size_t count) {
+        const int nthreads = 4;
+        volatile int stop = 0;
+        Hasher hashers[nthreads];
+        pthread_t ids[nthreads];
+        std::string expected = hash(std::string(1000, 'x'));
+        for(int t = 0; t < nthreads; t++) {
+            hashers[t].expected = expected;
+            hashers[t].stop = &stop;
+            hashers[t].hashes = hashers[t].mismatches = 0;
+            int err = pthread_create(&ids[t], NULL, hash_thread, &hashers[t]);
+            ASSERT_EQUAL(err, 0, "Start hashing thread");
+        }
+        for(int i = 0; i < 1000; i++)
+            CSHA1::SetTransform(i % 2 ? CSHA1::TRANSFORM_AUTO : impls[i / 2 % count]);
+        __sync_lock_test_and_set(&stop, 1);
+
+        int mismatches = 0;
+        for(int t = 0; t < nthreads; t++) {
+            pthread_join(ids[t], NULL);
+            mismatches += hashers[t].mismatches;
+        }
+        ASSERT_EQUAL(mismatches, 0, "Hashes should match while the transform is switched");
+    }
+#endif
+};
+
+}
+
+#endif
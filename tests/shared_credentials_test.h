@@ -0,0 +1,258 @@
+#ifndef __LIBOAUTHCPP_SHARED_CREDENTIALS_TEST_H__
+#define __LIBOAUTHCPP_SHARED_CREDENTIALS_TEST_H__
+
+#include "testutil.h"
+#include "verifier_test.h"
+#include <liboauthcpp/liboauthcpp.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests signing and verifying with SharedCredentials: results match the
+ *  ones with Consumer and Token objects, published sets replace the old
+ *  ones for later requests, and publishing while other threads sign and
+ *  verify leaves each request with one consistent set.
+ **/
+class SharedCredentialsTest {
+public:
+    static void run() {
+        sign_test();
+        publish_test();
+        secret_store_test();
+#ifndef _WIN32
+        concurrent_test();
+#endif
+    }
+
+    static std::string url() {
+        return "http://api.example.com/1/statuses/home_timeline.json";
+    }
+
+    static void setup(OAuth::Client& oauth) {
+        static FixedClock clock(1390268986);
+        static FixedNonceSource nonce(100);
+        oauth.setClock(&clock);
+        oauth.setNonceSource(&nonce);
+    }
+
+    static std::string header(const OAuth::Consumer& consumer, const OAuth::Token* token) {
+        OAuth::Client oauth(&consumer, token);
+        setup(oauth);
+        return oauth.getHttpHeader(Http::Get, url());
+    }
+
+    static std::string header(const SharedCredentials& credentials, const std::string& consumerKey,
+                              const std::string& token) {
+        OAuth::Client oauth(&credentials, consumerKey, token);
+        setup(oauth);
+        return oauth.getHttpHeader(Http::Get, url());
+    }
+
+    static void sign_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa", "1234");
+        OAuth::Token oddToken("a/b+c d", "s&cr%t");
+        CredentialSet set;
+        set.addConsumer(consumer);
+        set.addToken(consumer.key(), token);
+        set.addToken(consumer.key(), oddToken);
+        SharedCredentials credentials(set);
+
+        OAuth::Client direct(&consumer, &token);
+        OAuth::Client shared(&credentials, consumer.key(), token.key());
+        setup(direct);
+        setup(shared);
+        ASSERT_EQUAL(shared.getHttpHeader(Http::Get, url()), direct.getHttpHeader(Http::Get, url()),
+                     "Shared credentials should sign as Consumer and Token do");
+        ASSERT_EQUAL(shared.getURLQueryString(Http::Post, url(), "a=1", true), direct.getURLQueryString(Http::Post, url(), "a=1", true),
+                     "Shared token's pin should be included");
+        ASSERT_EQUAL(header(credentials, consumer.key(), oddToken.key()), header(consumer, &oddToken),
+                     "Encoded secrets should match");
+        ASSERT_EQUAL(header(credentials, consumer.key(), ""), header(consumer, NULL),
+                     "Consumer without token should sign the same");
+
+        OAuth::Client copy(shared);
+        ASSERT_EQUAL(copy.getHttpHeader(Http::Get, url()), direct.getHttpHeader(Http::Get, url()),
+                     "Copied Client should use the shared credentials");
+        PreparedRequest request = shared.prepare(Http::Get, url());
+        ASSERT_EQUAL(shared.getHttpHeader(request), direct.getHttpHeader(Http::Get, url()),
+                     "Prepared request should sign the same");
+        RequestList requests(3, Request(Http::Get, url()));
+        std::vector<std::string> headers = shared.getHttpHeaders(requests);
+        ASSERT_EQUAL(headers[2], direct.getHttpHeader(Http::Get, url()), "Batch should sign the same");
+
+        bool threw = false;
+        try {
+            header(credentials, consumer.key(), "unknown");
+        }
+        catch(const MissingKeyError&) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw, "Signing with an unknown token should throw");
+    }
+
+    static void publish_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        OAuth::Token rotated("aaaabbbbccccdddd", "rotated");
+        CredentialSet set;
+        set.addConsumer(consumer);
+        set.addToken(consumer.key(), token);
+        SharedCredentials credentials(set);
+        OAuth::Client oauth(&credentials, consumer.key(), token.key());
+        setup(oauth);
+
+        FixedClock clock(1390268986);
+        Verifier verifier(NULL);
+        verifier.setClock(&clock);
+        verifier.setSharedCredentials(&credentials);
+
+        std::string before = oauth.getHttpHeader(Http::Get, url());
+        ASSERT_EQUAL(verifier.verify(Http::Get, url(), before), Verification::Valid, "Request should verify with shared credentials");
+        std::size_t version = credentials.version();
+        ASSERT_EQUAL(version, 1, "Constructed set should be the first version");
+
+        set.addToken(consumer.key(), rotated);
+        credentials.publish(set);
+        std::string after = oauth.getHttpHeader(Http::Get, url());
+        ASSERT_EQUAL(after, header(consumer, &rotated), "Client should sign with the published secret");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url(), after), Verification::Valid, "Verifier should use the published secret");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url(), before), Verification::InvalidSignature, "Replaced secret shouldn't verify");
+
+        set.removeToken(consumer.key(), token.key());
+        credentials.publish(set);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url(), after), Verification::UnknownToken, "Removed token should be unknown");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url(), header(consumer, NULL)), Verification::Valid, "Consumer should stay");
+        set.removeConsumer(consumer.key());
+        ASSERT_EQUAL(set.size(), 0, "Removing the consumer should empty the set");
+        credentials.publish(set);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url(), header(consumer, NULL)), Verification::UnknownConsumer, "Removed consumer should be unknown");
+        version = credentials.version();
+        ASSERT_EQUAL(version, 4, "Each publish should be counted");
+
+        bool threw = false;
+        try {
+            oauth.getHttpHeader(Http::Get, url());
+        }
+        catch(const MissingKeyError&) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw, "Signing with removed credentials should throw");
+    }
+
+    static void secret_store_test() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        CredentialSet set;
+        set.addConsumer(consumer);
+        set.addToken(consumer.key(), token);
+        set.addToken("unknown", token);
+        SharedCredentials credentials;
+        std::string secret;
+        ASSERT_FALSE(credentials.consumerSecret(consumer.key(), secret), "Default set should be empty");
+        credentials.publish(set);
+        ASSERT_TRUE(credentials.consumerSecret(consumer.key(), secret), "Consumer should be found");
+        ASSERT_EQUAL(secret, consumer.secret(), "Consumer secret should match");
+        ASSERT_TRUE(credentials.tokenSecret(consumer.key(), token.key(), secret), "Token should be found");
+        ASSERT_EQUAL(secret, token.secret(), "Token secret should match");
+        ASSERT_FALSE(credentials.tokenSecret("unknown", token.key(), secret), "Token of an unknown consumer should be left out");
+        ASSERT_FALSE(credentials.tokenSecret(consumer.key(), "", secret), "Empty token shouldn't be found");
+
+        Verifier verifier(&credentials);
+        FixedClock clock(1390268986);
+        verifier.setClock(&clock);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url(), header(consumer, &token)), Verification::Valid,
+                     "Shared credentials should work as a SecretStore");
+    }
+
+#ifndef _WIN32
+    struct Worker {
+        const SharedCredentials* credentials;
+        // Verify with each of the two secrets the token is published with
+        const Verifier* verifiers[2];
+        const Verifier* shared;
+        volatile int* stop;
+        int signedRequests;
+        int consistent;
+        int verified;
+    };
+
+    static void* work(void* arg) {
+        Worker& worker = *(Worker*)arg;
+        OAuth::Client oauth(worker.credentials, "consumer", "token");
+        setup(oauth);
+        while (!__sync_fetch_and_add(worker.stop, 0) || worker.signedRequests < 100) {
+            std::string signedHeader = oauth.getHttpHeader(Http::Get, url());
+            worker.signedRequests++;
+            // Signed with one set or the other, never a mix or freed memory
+            if (worker.verifiers[0]->verify(Http::Get, url(), signedHeader) == Verification::Valid ||
+                worker.verifiers[1]->verify(Http::Get, url(), signedHeader) == Verification::Valid)
+                worker.consistent++;
+            Verification::Result result = worker.shared->verify(Http::Get, url(), signedHeader);
+            worker.verified += result == Verification::Valid || result == Verification::InvalidSignature;
+        }
+        return NULL;
+    }
+
+    /** Threads sign and verify while sets with alternating secrets are
+     *  published.
+     */
+    static void concurrent_test() {
+        CredentialSet sets[2];
+        VerifierTest::MapSecretStore stores[2];
+        for(int i = 0; i < 2; i++) {
+            std::string secret = i ? "second" : "first";
+            sets[i].addConsumer(OAuth::Consumer("consumer", secret));
+            sets[i].addToken("consumer", OAuth::Token("token", secret));
+            stores[i].addConsumer("consumer", secret);
+            stores[i].addToken("consumer", "token", secret);
+        }
+        SharedCredentials credentials(sets[0]);
+        FixedClock clock(1390268986);
+        Verifier first(&stores[0]), second(&stores[1]), shared(NULL);
+        first.setClock(&clock);
+        second.setClock(&clock);
+        shared.setClock(&clock);
+        shared.setSharedCredentials(&credentials);
+
+        const int nthreads = 8;
+        volatile int stop = 0;
+        Worker workers[nthreads];
+        pthread_t ids[nthreads];
+        for(int t = 0; t < nthreads; t++) {
+            workers[t].credentials = &credentials;
+            workers[t].verifiers[0] = &first;
+            workers[t].verifiers[1] = &second;
+            workers[t].shared = &shared;
+            workers[t].stop = &stop;
+            workers[t].signedRequests = workers[t].consistent = workers[t].verified = 0;
+            int err = pthread_create(&ids[t], NULL, work, &workers[t]);
+            ASSERT_EQUAL(err, 0, "Start signing thread");
+        }
+        const int publishes = 200;
+        for(int i = 1; i <= publishes; i++)
+            credentials.publish(sets[i % 2]);
+        __sync_lock_test_and_set(&stop, 1);
+
+        int signedRequests = 0, consistent = 0, verified = 0;
+        for(int t = 0; t < nthreads; t++) {
+            pthread_join(ids[t], NULL);
+            signedRequests += workers[t].signedRequests;
+            consistent += workers[t].consistent;
+            verified += workers[t].verified;
+        }
+        ASSERT_EQUAL(consistent, signedRequests, "Every request should be signed with one published set");
+        ASSERT_EQUAL(verified, signedRequests, "Every request should be verified with one published set");
+        std::size_t version = credentials.version();
+        ASSERT_EQUAL(version, publishes + 1, "Every publish should be counted");
+    }
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef __LIBOAUTHCPP_SHARED_NONCE_STORE_TEST_H__
+#define __LIBOAUTHCPP_SHARED_NONCE_STORE_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests the shared memory nonce store: replays are caught across objects
+ *  and processes, spans are reused as the window moves on, and a process
+ *  killed while creating or recording doesn't get in the others' way.
+ **/
+class SharedNonceStoreTest {
+public:
+    static void run() {
+        SharedNonceStore::remove(name());
+        replay_test();
+        window_test();
+        attach_test();
+        full_test();
+        fork_test();
+        killed_test();
+        killed_creator_test();
+        SharedNonceStore::remove(name());
+    }
+
+    static std::string name() {
+        std::stringstream s;
+        s << "/liboauthcpp-test-" << getpid();
+        return s.str();
+    }
+
+    static std::string nonce(int i) {
+        std::stringstream s;
+        s << "nonce" << i;
+        return s.str();
+    }
+
+    static void replay_test() {
+        SharedNonceStore store(name(), 300, 1000);
+        SharedNonceStore::remove(name());
+        ASSERT_TRUE(store.insert("consumer", "token", "nonce", 1000), "First request should be recorded");
+        ASSERT_FALSE(store.insert("consumer", "token", "nonce", 1000), "Same request should be a replay");
+        ASSERT_TRUE(store.insert("consumer", "token", "nonce", 1001), "Same nonce at another time should be recorded");
+        ASSERT_TRUE(store.insert("consumer", "", "nonce", 1000), "Same nonce without token should be recorded");
+        ASSERT_TRUE(store.insert("other", "token", "nonce", 1000), "Same nonce for another consumer should be recorded");
+        ASSERT_TRUE(store.insert("consumer", "tok", "ennonce", 1000), "Moved field boundary should be recorded");
+        ASSERT_FALSE(store.insert("consumer", "tok", "ennonce", 1000), "Moved field boundary should be a replay");
+        std::size_t size = store.size();
+        ASSERT_EQUAL(size, 5, "Store should hold the recorded nonces");
+    }
+
+    static void window_test() {
+        // One second per table, and 2*2+1+1 = 6 tables
+        SharedNonceStore store(name(), 2, 100);
+        SharedNonceStore::remove(name());
+        ASSERT_TRUE(store.insert("consumer", "token", "a", 100), "First request should be recorded");
+        ASSERT_TRUE(store.insert("consumer", "token", "b", 105), "Request in the window should be recorded");
+        ASSERT_FALSE(store.insert("consumer", "token", "a", 100), "Request in the window should be a replay");
+        ASSERT_TRUE(store.insert("consumer", "token", "c", 106), "Request reusing a table should be recorded");
+        ASSERT_FALSE(store.insert("consumer", "token", "d", 100), "Request from a reused table should be refused");
+        ASSERT_FALSE(store.insert("consumer", "token", "c", 106), "Request in a reused table should be a replay");
+        ASSERT_TRUE(store.insert("consumer", "token", "a", 107), "Nonce from an expired table should be recorded");
+        std::size_t size = store.size();
+        ASSERT_EQUAL(size, 3, "Reused tables should be emptied");
+    }
+
+    /** Objects attached to one segment share it, with its creator's sizes. */
+    static void attach_test() {
+        SharedNonceStore first(name(), 30, 1000);
+        SharedNonceStore second(name(), 300, 5);
+        SharedNonceStore::remove(name());
+        std::size_t firstBytes = first.memoryUsage();
+        std::size_t secondBytes = second.memoryUsage();
+        ASSERT_EQUAL(secondBytes, firstBytes, "Attached store should use the existing segment");
+        ASSERT_TRUE(first.insert("consumer", "token", "nonce", 1000), "First request should be recorded");
+        ASSERT_FALSE(second.insert("consumer", "token", "nonce", 1000), "Request recorded by another object should be a replay");
+        ASSERT_TRUE(second.insert("consumer", "token", "nonce2", 1000), "New request should be recorded");
+        ASSERT_FALSE(first.insert("consumer", "token", "nonce2", 1000), "Replays should be caught both ways");
+
+        // A removed segment is replaced by the next one of its name
+        SharedNonceStore third(name(), 30, 1000);
+        SharedNonceStore::remove(name());
+        ASSERT_TRUE(third.insert("consumer", "token", "nonce", 1000), "New segment should be empty");
+    }
+
+    static void full_test() {
+        // Tables of the smallest size, 64 entries
+        SharedNonceStore store(name(), 2, 1);
+        SharedNonceStore::remove(name());
+        int recorded = 0;
+        for(int i = 0; i < 100; i++)
+            recorded += store.insert("consumer", "token", nonce(i), 1000);
+        ASSERT_EQUAL(recorded, 64, "Requests should be refused once a table is full");
+        int replayed = 0;
+        for(int i = 0; i < 100; i++)
+            replayed += !store.insert("consumer", "token", nonce(i), 1000);
+        ASSERT_EQUAL(replayed, 100, "Full table should still catch replays");
+    }
+
+    // Records nonces first to first + count - 1 at a few timestamps in a
+    // child process, and returns its pid. The number recorded is written to
+    // fd.
+    static pid_t start_child(SharedNonceStore& store, int first, int count, int fd) {
+        pid_t pid = fork();
+        if (pid != 0)
+            return pid;
+        int recorded = 0;
+        for(int i = first; i < first + count; i++)
+            recorded += store.insert("consumer", "token", nonce(i), 1000 + i % 3);
+        ssize_t written = write(fd, &recorded, sizeof(recorded));
+        _exit(written == sizeof(recorded) ? 0 : 1);
+    }
+
+    /** Processes recording overlapping nonces at once should record each
+     *  exactly once between them.
+     */
+    static void fork_test() {
+        const int nprocesses = 4;
+        SharedNonceStore store(name(), 300, 10000);
+        SharedNonceStore::remove(name());
+        int fds[2];
+        ASSERT_EQUAL(pipe(fds), 0, "Create pipe");
+        pid_t pids[nprocesses];
+        // Each process's range overlaps the next one's by half
+        for(int p = 0; p < nprocesses; p++)
+            pids[p] = start_child(store, p * 1000, 2000, fds[1]);
+        int recorded = 0;
+        for(int p = 0; p < nprocesses; p++) {
+            int status = -1, count = 0;
+            waitpid(pids[p], &status, 0);
+            ASSERT_EQUAL(status, 0, "Recording process should exit cleanly");
+            if (read(fds[0], &count, sizeof(count)) == sizeof(count))
+                recorded += count;
+        }
+        close(fds[0]);
+        close(fds[1]);
+        ASSERT_EQUAL(recorded, (nprocesses + 1) * 1000, "Each nonce should be recorded once");
+        ASSERT_FALSE(store.insert("consumer", "token", nonce(0), 1000), "Nonce recorded by a child should be a replay");
+    }
+
+    /** A process killed part way through recording leaves what it recorded,
+     *  and nothing that stops others.
+     */
+    static void killed_test() {
+        SharedNonceStore store(name(), 300, 10000);
+        SharedNonceStore::remove(name());
+        int fds[2];
+        ASSERT_EQUAL(pipe(fds), 0, "Create pipe");
+        pid_t pid = fork();
+        if (pid == 0) {
+            int i = 0;
+            for( ; i < 1000; i++)
+                store.insert("consumer", "token", nonce(i), 1000);
+            ssize_t written = write(fds[1], &i, sizeof(i));
+            for( ; written == sizeof(i); i++)
+                store.insert("consumer", "token", nonce(i % 5000 + 1000), 1000);
+            _exit(1);
+        }
+        int recorded = 0;
+        ssize_t got = read(fds[0], &recorded, sizeof(recorded));
+        kill(pid, SIGKILL);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        close(fds[0]);
+        close(fds[1]);
+        ASSERT_EQUAL(got, (ssize_t)sizeof(recorded), "Child should have recorded nonces");
+        ASSERT_TRUE(WIFSIGNALED(status), "Child should have been killed");
+
+        int replayed = 0, fresh = 0;
+        for(int i = 0; i < 1000; i++)
+            replayed += !store.insert("consumer", "token", nonce(i), 1000);
+        for(int i = 0; i < 1000; i++)
+            fresh += store.insert("consumer", "token", nonce(i + 10000), 1000);
+        ASSERT_EQUAL(replayed, 1000, "Nonces recorded by a killed process should be replays");
+        ASSERT_EQUAL(fresh, 1000, "Other processes should carry on after one is killed");
+    }
+
+    /** A process killed after creating the segment, but before setting it
+     *  up, leaves it to be set up by the next one to attach.
+     */
+    static void killed_creator_test() {
+        // name() is of the parent's pid
+        std::string segment = name();
+        pid_t pid = fork();
+        if (pid == 0) {
+            int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd >= 0 && ftruncate(fd, 64) == 0)
+                kill(getpid(), SIGKILL);
+            _exit(1);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ASSERT_TRUE(WIFSIGNALED(status), "Creating process should have been killed");
+
+        SharedNonceStore store(name(), 300, 1000);
+        SharedNonceStore second(name(), 30, 5);
+        SharedNonceStore::remove(name());
+        std::size_t bytes = store.memoryUsage();
+        std::size_t secondBytes = second.memoryUsage();
+        ASSERT_EQUAL(secondBytes, bytes, "Store set up after a killed creator should be attached to");
+        ASSERT_TRUE(store.insert("consumer", "token", "nonce", 1000), "Store set up after a killed creator should record");
+        ASSERT_FALSE(second.insert("consumer", "token", "nonce", 1000), "Store set up after a killed creator should be shared");
+    }
+};
+
+}
+
+#endif
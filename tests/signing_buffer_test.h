@@ -0,0 +1,116 @@
+#ifndef __LIBOAUTHCPP_SIGNING_BUFFER_TEST_H__
+#define __LIBOAUTHCPP_SIGNING_BUFFER_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <cstring>
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests signing into caller supplied buffers: same results as the
+ *  std::string API, size queries, and no allocation once warmed up.
+ **/
+class SigningBufferTest {
+public:
+    static void run() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa", "1234");
+
+        Client::__resetInitialize();
+        Client::initialize(100, 1390268986);
+        OAuth::Client oauth(&consumer, &token);
+
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json?count=200&trim_user=true";
+        std::string data = "status=Hello%20Ladies%20%2b%20Gentlemen&trim_user=true";
+        matches_test(oauth, Http::Get, url, "", false);
+        matches_test(oauth, Http::Post, url, data, false);
+        matches_test(oauth, Http::Post, "http://api.example.com/oauth/access_token", "", true);
+
+        size_query_test(oauth, url);
+        allocation_test(oauth, url, data);
+        client_buffer_test(consumer, token, url, data);
+    }
+
+    static void matches_test(const OAuth::Client& oauth, Http::RequestType eType, const std::string& url,
+                             const std::string& data, bool pin) {
+        SigningBuffer buffer;
+        char out[1024];
+
+        std::size_t length = oauth.getHttpHeader(buffer, out, sizeof(out), eType, url, data, pin);
+        ASSERT_EQUAL(std::string(out), oauth.getHttpHeader(eType, url, data, pin), "Buffer header should match for " + url);
+        ASSERT_EQUAL(length, strlen(out), "Header length should be returned");
+
+        oauth.getFormattedHttpHeader(buffer, out, sizeof(out), eType, url, data, pin);
+        ASSERT_EQUAL(std::string(out), oauth.getFormattedHttpHeader(eType, url, data, pin), "Buffer formatted header should match for " + url);
+
+        oauth.getURLQueryString(buffer, out, sizeof(out), eType, url, data, pin);
+        ASSERT_EQUAL(std::string(out), oauth.getURLQueryString(eType, url, data, pin), "Buffer query string should match for " + url);
+        ASSERT_EQUAL(std::string(buffer.data(), buffer.length()), std::string(out), "Buffer should hold the last result");
+    }
+
+    static void size_query_test(const OAuth::Client& oauth, const std::string& url) {
+        SigningBuffer buffer;
+        std::size_t length = oauth.getHttpHeader(buffer, NULL, 0, Http::Get, url);
+        std::string expected = oauth.getHttpHeader(Http::Get, url);
+        ASSERT_EQUAL(length, expected.length(), "Size query should return the header length");
+
+        std::vector<char> out(length, 'x');
+        ASSERT_EQUAL(buffer.copy(&out[0], length), length, "Copy without room for the NUL should return the length");
+        ASSERT_EQUAL(out[0], 'x', "Copy without room for the NUL should write nothing");
+
+        out.resize(length + 1);
+        buffer.copy(&out[0], out.size());
+        ASSERT_EQUAL(std::string(&out[0]), expected, "Copy after size query should give the header");
+    }
+
+    static void allocation_test(const OAuth::Client& oauth, const std::string& url, const std::string& data) {
+        SigningBuffer buffer;
+        char out[1024];
+        // Warm up, so the buffer has grown to fit
+        oauth.getHttpHeader(buffer, out, sizeof(out), Http::Post, url, data);
+        oauth.getURLQueryString(buffer, out, sizeof(out), Http::Post, url, data);
+
+        std::size_t before = TestUtil::allocations;
+        for(int i = 0; i < 10; i++) {
+            oauth.getHttpHeader(buffer, out, sizeof(out), Http::Post, url, data);
+            oauth.getURLQueryString(buffer, out, sizeof(out), Http::Post, url, data);
+        }
+        std::size_t allocations = TestUtil::allocations - before;
+        ASSERT_EQUAL(allocations, 0, "Signing into a warm buffer should not allocate");
+    }
+
+    /** A Client with a signing buffer should give the same results, only
+     *  allocating the strings it returns.
+     */
+    static void client_buffer_test(const OAuth::Consumer& consumer, const OAuth::Token& token,
+                                   const std::string& url, const std::string& data) {
+        OAuth::Client plain(&consumer, &token);
+        OAuth::Client buffered(&consumer, &token);
+        SigningBuffer buffer;
+        buffered.setSigningBuffer(&buffer);
+
+        PreparedRequest prepared = buffered.prepare(Http::Get, url);
+        BodyHash body;
+        body.update(data.data(), data.size());
+        for(int i = 0; i < 2; i++) {
+            ASSERT_EQUAL(buffered.getHttpHeader(Http::Post, url, data), plain.getHttpHeader(Http::Post, url, data), "Buffered client header should match");
+            ASSERT_EQUAL(buffered.getFormattedHttpHeader(Http::Post, url, data), plain.getFormattedHttpHeader(Http::Post, url, data), "Buffered client formatted header should match");
+            ASSERT_EQUAL(buffered.getURLQueryString(Http::Post, url, data), plain.getURLQueryString(Http::Post, url, data), "Buffered client query string should match");
+            ASSERT_EQUAL(buffered.getHttpHeader(prepared, "cursor=1"), plain.getHttpHeader(prepared, "cursor=1"), "Buffered client prepared header should match");
+            ASSERT_EQUAL(buffered.getHttpHeader(Http::Post, url, body), plain.getHttpHeader(Http::Post, url, body), "Buffered client body hash header should match");
+        }
+
+        std::string header = buffered.getURLQueryString(Http::Post, url, data);
+        std::size_t before = TestUtil::allocations;
+        for(int i = 0; i < 10; i++)
+            header = buffered.getURLQueryString(Http::Post, url, data);
+        std::size_t allocations = TestUtil::allocations - before;
+        ASSERT_EQUAL(allocations, 10, "Buffered client should only allocate the returned string");
+    }
+};
+
+}
+
+#endif
@@ -1,9 +1,36 @@
 #include "testutil.h"
+#include <cstdlib>
+#include <new>
 
 namespace OAuthTest {
 
+std::size_t TestUtil::allocations = 0;
 int TestUtil::passed = 0;
 int TestUtil::failed = 0;
 std::vector<TestUtil::Details> TestUtil::failed_details;
 
 }
+
+// Count allocations. Everything else is left to the default operators,
+// which allocate through these.
+void* operator new(std::size_t size) {
+    // Some tests allocate from several threads
+#if defined(__GNUC__)
+    __sync_fetch_and_add(&OAuthTest::TestUtil::allocations, 1);
+#else
+    OAuthTest::TestUtil::allocations++;
+#endif
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    std::free(p);
+}
+
+// Compilers using sized deallocation call this one instead
+void operator delete(void* p, std::size_t) throw() {
+    std::free(p);
+}
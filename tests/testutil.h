@@ -53,6 +53,11 @@ public:
         return failed;
     }
 
+    /** Number of operator new calls so far, for checking that code doesn't
+     *  allocate.
+     */
+    static std::size_t allocations;
+
 private:
     static int passed;
     static int failed;
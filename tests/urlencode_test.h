@@ -3,6 +3,8 @@
 
 #include "testutil.h"
 #include <liboauthcpp/liboauthcpp.h>
+#include <cstdio>
+#include <cstring>
 
 using namespace OAuth;
 
@@ -21,6 +23,7 @@ public:
         http_path_encode_test();
         http_query_key_encode_test();
         http_query_value_encode_test();
+        long_string_encode_test();
     }
 
 
@@ -237,6 +240,40 @@ public:
         ASSERT_EQUAL(HttpEncodeQueryValue("|"), "%7C", "Non-unreserved character '|' should be percent encoded (http query string encoding)");
         ASSERT_EQUAL(HttpEncodeQueryValue("}"), "%7D", "Non-unreserved character '}' should be percent encoded (http query string encoding)");
     }
+
+    static std::string reference_encode(const std::string& s, bool path) {
+        static const char unreserved[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-._~";
+        static const char sub_delims[] = "!$&'()*+,;=";
+        std::string result;
+        for(std::size_t i = 0; i < s.size(); i++) {
+            char c = s[i];
+            if ((c && strchr(unreserved, c)) || (path && c && strchr(sub_delims, c))) {
+                result += c;
+            }
+            else {
+                char escaped[4];
+                snprintf(escaped, sizeof(escaped), "%%%02X", (unsigned char)c);
+                result += escaped;
+            }
+        }
+        return result;
+    }
+
+    // Strings long enough to go through the vectorized paths, with every
+    // byte value at every offset of a 32 byte chunk and in the tail.
+    static void long_string_encode_test() {
+        std::string base = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-._~~._-9876543210";
+        for(int c = 0; c < 256; c++) {
+            for(std::size_t pos = 0; pos < base.size(); pos++) {
+                std::string s = base;
+                s[pos] = (char)c;
+                std::stringstream msg;
+                msg << "Byte " << c << " at offset " << pos << " of a long string should be encoded";
+                ASSERT_EQUAL(PercentEncode(s), reference_encode(s, false), msg.str() + " (complete encoding)");
+                ASSERT_EQUAL(HttpEncodePath(s), reference_encode(s, true), msg.str() + " (http path encoding)");
+            }
+        }
+    }
 };
 
 }
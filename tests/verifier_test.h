@@ -0,0 +1,286 @@
+#ifndef __LIBOAUTHCPP_VERIFIER_TEST_H__
+#define __LIBOAUTHCPP_VERIFIER_TEST_H__
+
+#include "testutil.h"
+#include <liboauthcpp/liboauthcpp.h>
+#include <map>
+
+using namespace OAuth;
+
+namespace OAuthTest {
+
+/** Tests checking request signatures: everything Client signs verifies,
+ *  and changed, stale or malformed requests don't.
+ **/
+class VerifierTest {
+public:
+    class MapSecretStore : public SecretStore {
+    public:
+        void addConsumer(const std::string& key, const std::string& secret) {
+            mConsumers[key] = secret;
+        }
+        void addToken(const std::string& consumerKey, const std::string& token, const std::string& secret) {
+            mTokens[consumerKey + "&" + token] = secret;
+        }
+
+        virtual bool consumerSecret(const std::string& consumerKey, std::string& secret) const {
+            std::map<std::string, std::string>::const_iterator it = mConsumers.find(consumerKey);
+            if (it == mConsumers.end())
+                return false;
+            secret = it->second;
+            return true;
+        }
+        virtual bool tokenSecret(const std::string& consumerKey, const std::string& token, std::string& secret) const {
+            // Avoids building the joined key, so lookups don't allocate
+            for(std::map<std::string, std::string>::const_iterator it = mTokens.begin(); it != mTokens.end(); ++it) {
+                if (it->first.length() == consumerKey.length() + 1 + token.length() &&
+                    it->first.compare(0, consumerKey.length(), consumerKey) == 0 &&
+                    it->first.compare(consumerKey.length() + 1, std::string::npos, token) == 0) {
+                    secret = it->second;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        std::map<std::string, std::string> mConsumers;
+        std::map<std::string, std::string> mTokens;
+    };
+
+    static void run() {
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa", "1234");
+        OAuth::Token oddToken("a/b+c d", "s&cr%t", "");
+
+        MapSecretStore secrets;
+        secrets.addConsumer(consumer.key(), consumer.secret());
+        secrets.addToken(consumer.key(), token.key(), token.secret());
+        secrets.addToken(consumer.key(), oddToken.key(), oddToken.secret());
+
+        FixedClock clock(1390268986);
+        Verifier verifier(&secrets);
+        verifier.setClock(&clock);
+
+        valid_test(verifier, clock, consumer, token, oddToken);
+        rejected_test(verifier, clock, consumer, token);
+        clock_test(verifier, clock, consumer, token);
+        header_test(verifier);
+        rfc5849_test();
+        allocation_test(verifier, clock, consumer, token);
+    }
+
+    static void sign(OAuth::Client& oauth, const FixedClock& clock) {
+        static FixedNonceSource nonce(100);
+        oauth.setClock(&clock);
+        oauth.setNonceSource(&nonce);
+    }
+
+    static void valid_test(const Verifier& verifier, const FixedClock& clock, const OAuth::Consumer& consumer,
+                           const OAuth::Token& token, const OAuth::Token& oddToken) {
+        OAuth::Client oauth(&consumer, &token);
+        OAuth::Client consumerOnly(&consumer);
+        OAuth::Client odd(&consumer, &oddToken);
+        sign(oauth, clock);
+        sign(consumerOnly, clock);
+        sign(odd, clock);
+
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json?count=200&trim_user=true";
+        std::string data = "status=Hello%20Ladies%20%2b%20Gentlemen&trim_user=true";
+        std::string pureUrl = "http://api.example.com/1/statuses/home_timeline.json";
+
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, oauth.getHttpHeader(Http::Get, url)), Verification::Valid, "Header should verify");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, oauth.getFormattedHttpHeader(Http::Get, url)), Verification::Valid, "Formatted header should verify");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, oauth.getHttpHeader(Http::Post, url, data), data), Verification::Valid, "Header with form body should verify");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, oauth.getHttpHeader(Http::Post, url, data, true), data), Verification::Valid, "Header with verifier should verify");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, consumerOnly.getHttpHeader(Http::Get, url)), Verification::Valid, "Header without token should verify");
+        ASSERT_EQUAL(verifier.verify(Http::Get, pureUrl + "?" + oauth.getURLQueryString(Http::Get, url), ""), Verification::Valid, "Query string should verify");
+
+        // Client sends its own values unencoded, others percent encode them
+        std::string header = odd.getHttpHeader(Http::Get, url);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, header), Verification::Valid, "Unencoded header values should verify");
+        std::string encoded = header;
+        encoded.replace(encoded.find(oddToken.key()), oddToken.key().length(), PercentEncode(oddToken.key()));
+        ASSERT_NOTEQUAL(encoded, header, "Token should have been encoded");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, encoded), Verification::Valid, "Encoded header values should verify");
+
+        VerificationBuffer buffer;
+        Verification::Result result = verifier.verify(buffer, Http::Get, url, oauth.getHttpHeader(Http::Get, url));
+        ASSERT_EQUAL(result, Verification::Valid, "Header should verify with a buffer");
+        ASSERT_EQUAL(buffer.consumerKey(), consumer.key(), "Buffer should hold the consumer key");
+        ASSERT_EQUAL(buffer.token(), token.key(), "Buffer should hold the token");
+        ASSERT_EQUAL(buffer.nonce(), "139026898664", "Buffer should hold the nonce");
+        ASSERT_EQUAL(buffer.timestamp(), 1390268986, "Buffer should hold the timestamp");
+
+        verifier.verify(buffer, Http::Get, pureUrl + "?" + odd.getURLQueryString(Http::Get, url), "");
+        ASSERT_EQUAL(buffer.token(), oddToken.key(), "Buffer should hold the decoded token");
+    }
+
+    static void rejected_test(const Verifier& verifier, const FixedClock& clock, const OAuth::Consumer& consumer,
+                              const OAuth::Token& token) {
+        OAuth::Client oauth(&consumer, &token);
+        sign(oauth, clock);
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json?count=200";
+        std::string data = "status=Hello";
+        std::string header = oauth.getHttpHeader(Http::Post, url, data);
+
+        ASSERT_EQUAL(verifier.verify(Http::Post, url + "1", header, data), Verification::InvalidSignature, "Changed url should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, header, "status=Hellp"), Verification::InvalidSignature, "Changed body should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Put, url, header, data), Verification::InvalidSignature, "Changed method should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Invalid, url, header, data), Verification::Unsupported, "Invalid method should not verify");
+
+        OAuth::Consumer impostor("wwwwxxxxyyyyzzzz", "wrong");
+        OAuth::Client forged(&impostor, &token);
+        sign(forged, clock);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, forged.getHttpHeader(Http::Get, url)), Verification::InvalidSignature, "Wrong secret should not verify");
+
+        OAuth::Consumer unknownConsumer("unknown", "zzzzyyyyxxxxwwww");
+        OAuth::Client unknown(&unknownConsumer, &token);
+        sign(unknown, clock);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, unknown.getHttpHeader(Http::Get, url)), Verification::UnknownConsumer, "Unknown consumer should not verify");
+
+        OAuth::Token unknownToken("unknown", "ddddccccbbbbaaaa");
+        OAuth::Client revoked(&consumer, &unknownToken);
+        sign(revoked, clock);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, revoked.getHttpHeader(Http::Get, url)), Verification::UnknownToken, "Unknown token should not verify");
+
+        std::string signature = "oauth_signature=\"";
+        std::string tampered = header;
+        size_t pos = tampered.find(signature) + signature.length();
+        tampered[pos] = (tampered[pos] == 'A') ? 'B' : 'A';
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, tampered, data), Verification::InvalidSignature, "Changed signature should not verify");
+        tampered = header;
+        tampered.insert(pos, "AAAA");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, tampered, data), Verification::InvalidSignature, "Long signature should not verify");
+
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, ""), Verification::MissingParameter, "Unsigned request should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, without(header, "oauth_nonce"), data), Verification::MissingParameter, "Missing nonce should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, without(header, "oauth_signature"), data), Verification::MissingParameter, "Missing signature should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url + "&oauth_nonce=1", header, data), Verification::Malformed, "Repeated nonce should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, header, data + "&oauth_token=x"), Verification::Malformed, "Repeated token should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, header, "status"), Verification::Malformed, "Unparseable body should not verify");
+
+        std::string plaintext = header;
+        plaintext.replace(plaintext.find("HMAC-SHA1"), 9, "PLAINTEXT");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, plaintext, data), Verification::Unsupported, "Other signature methods should not verify");
+        std::string version = header;
+        version.replace(version.find("\"1.0\""), 5, "\"2.0\"");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, version, data), Verification::Unsupported, "Other versions should not verify");
+        std::string timestamp = header;
+        timestamp.replace(timestamp.find("oauth_timestamp=\"1390268986"), 27, "oauth_timestamp=\"139026898x");
+        ASSERT_EQUAL(verifier.verify(Http::Post, url, timestamp, data), Verification::Malformed, "Non-numeric timestamp should not verify");
+    }
+
+    static void clock_test(Verifier& verifier, FixedClock& clock, const OAuth::Consumer& consumer,
+                           const OAuth::Token& token) {
+        OAuth::Client oauth(&consumer, &token);
+        sign(oauth, clock);
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json";
+        std::string header = oauth.getHttpHeader(Http::Get, url);
+
+        clock.set(1390268986 + 300);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, header), Verification::Valid, "Timestamp within the skew should verify");
+        clock.set(1390268986 + 301);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, header), Verification::StaleTimestamp, "Old timestamp should not verify");
+        clock.set(1390268986 - 301);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, header), Verification::StaleTimestamp, "Future timestamp should not verify");
+
+        verifier.setMaxClockSkew(0);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, header), Verification::Valid, "Timestamp should not be checked with no skew");
+        verifier.setMaxClockSkew(300);
+        clock.set(1390268986);
+    }
+
+    /** Header syntax the Client doesn't produce itself. */
+    static void header_test(const Verifier& verifier) {
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json";
+        OAuth::Consumer consumer("wwwwxxxxyyyyzzzz", "zzzzyyyyxxxxwwww");
+        OAuth::Token token("aaaabbbbccccdddd", "ddddccccbbbbaaaa");
+        OAuth::Client oauth(&consumer, &token);
+        FixedClock clock(1390268986);
+        sign(oauth, clock);
+        std::string header = oauth.getHttpHeader(Http::Get, url);
+
+        std::string spaced = header;
+        for(size_t pos = spaced.find(','); pos != std::string::npos; pos = spaced.find(',', pos + 3))
+            spaced.replace(pos, 1, ",\t ");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, spaced), Verification::Valid, "Whitespace between parameters should verify");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, "  oauth realm=\"Example\"," + header.substr(6)), Verification::Valid, "Realm should be ignored");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, "authorization:" + header), Verification::Valid, "Field name should be skipped");
+
+        std::string unquoted = header;
+        size_t quote;
+        while((quote = unquoted.find('"')) != std::string::npos)
+            unquoted.erase(quote, 1);
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, unquoted), Verification::Valid, "Unquoted values should verify");
+
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, "Basic " + header.substr(6)), Verification::Malformed, "Other schemes should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, "OAuthx" + header.substr(5)), Verification::Malformed, "Other schemes should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, header + ",oauth_x=\"1"), Verification::Malformed, "Unterminated quote should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, header + ",oauth_x"), Verification::Malformed, "Parameter without value should not verify");
+        ASSERT_EQUAL(verifier.verify(Http::Get, url, header + ",oauth_x=\"%4\""), Verification::Malformed, "Bad escape should not verify");
+    }
+
+    /** The example request from RFC 5849, section 1.2, signed by another
+     *  implementation.
+     */
+    static void rfc5849_test() {
+        MapSecretStore secrets;
+        secrets.addConsumer("dpf43f3p2l4k3l03", "kd94hf93k423kf44");
+        secrets.addToken("dpf43f3p2l4k3l03", "nnch734d00sl2jdk", "pfkkdhi9sl3r4s00");
+        Verifier verifier(&secrets);
+        verifier.setMaxClockSkew(0);
+
+        std::string header =
+            "OAuth realm=\"Photos\", "
+            "oauth_consumer_key=\"dpf43f3p2l4k3l03\","
+            "oauth_token=\"nnch734d00sl2jdk\","
+            "oauth_signature_method=\"HMAC-SHA1\","
+            "oauth_timestamp=\"137131202\","
+            "oauth_nonce=\"chapoH\","
+            "oauth_signature=\"MdpQcU8iPSUjWoN%2FUDMsK2sui9I%3D\"";
+        ASSERT_EQUAL(
+            verifier.verify(Http::Get, "http://photos.example.net/photos?file=vacation.jpg&size=original", header),
+            Verification::Valid,
+            "RFC 5849 example should verify"
+        );
+    }
+
+    static void allocation_test(const Verifier& verifier, const FixedClock& clock, const OAuth::Consumer& consumer,
+                                const OAuth::Token& token) {
+        OAuth::Client oauth(&consumer, &token);
+        sign(oauth, clock);
+        std::string url = "http://api.example.com/1/statuses/home_timeline.json?count=200&trim_user=true";
+        std::string data = "status=Hello%20Ladies%20%2b%20Gentlemen&trim_user=true";
+        std::string header = oauth.getHttpHeader(Http::Post, url, data);
+        std::string query = "http://api.example.com/1/statuses/home_timeline.json?" + oauth.getURLQueryString(Http::Get, url);
+
+        VerificationBuffer buffer;
+        // Warm up, so the buffer has grown to fit
+        verifier.verify(buffer, Http::Post, url, header, data);
+        verifier.verify(buffer, Http::Get, query, "");
+
+        Verification::Result result = Verification::Valid;
+        std::size_t before = TestUtil::allocations;
+        for(int i = 0; i < 10; i++) {
+            result = (Verification::Result)(result | verifier.verify(buffer, Http::Post, url, header, data));
+            result = (Verification::Result)(result | verifier.verify(buffer, Http::Get, query, ""));
+        }
+        std::size_t allocations = TestUtil::allocations - before;
+        ASSERT_EQUAL(result, Verification::Valid, "Requests should verify with a warm buffer");
+        ASSERT_EQUAL(allocations, 0, "Verifying with a warm buffer should not allocate");
+    }
+
+    // header without the parameter key
+    static std::string without(const std::string& header, const std::string& key) {
+        std::string result = header;
+        size_t begin = result.find(key + "=");
+        size_t end = result.find(',', begin);
+        result.erase(begin, (end == std::string::npos) ? std::string::npos : end + 1 - begin);
+        return result;
+    }
+};
+
+}
+
+#endif